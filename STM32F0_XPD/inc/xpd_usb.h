@@ -176,9 +176,9 @@ void            USB_vEpSetStall         (USB_HandleType * pxUSB, uint8_t ucEpAdd
 void            USB_vEpClearStall       (USB_HandleType * pxUSB, uint8_t ucEpAddress);
 
 void            USB_vEpSend             (USB_HandleType * pxUSB, uint8_t ucEpAddress,
-                                         const uint8_t * pucData, uint16_t usLength);
+                                         const uint8_t * pucData, uint32_t ulLength);
 void            USB_vEpReceive          (USB_HandleType * pxUSB, uint8_t ucEpAddress,
-                                         uint8_t * pucData, uint16_t usLength);
+                                         uint8_t * pucData, uint32_t ulLength);
 
 void            USB_vSetRemoteWakeup    (USB_HandleType * pxUSB);
 void            USB_vClearRemoteWakeup  (USB_HandleType * pxUSB);
@@ -0,0 +1,152 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_cdc.h
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-20
+  * @brief   STM32 eXtensible Peripheral Drivers USB CDC-ACM Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __XPD_USB_CDC_H_
+#define __XPD_USB_CDC_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <xpd_common.h>
+#include <xpd_usb.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/** @ingroup USB
+ * @defgroup USB_CDC USB CDC-ACM
+ * @brief    Communications Device Class Abstract Control Model serial port over the USB endpoints
+ * @{ */
+
+/** @defgroup USB_CDC_Exported_Types USB CDC Exported Types
+ * @{ */
+
+#ifndef USB_CDC_MAX_PACKET_SIZE
+#if defined(USB_OTG_HS)
+#define USB_CDC_MAX_PACKET_SIZE     512 /*!< Largest supported bulk packet size */
+#else
+#define USB_CDC_MAX_PACKET_SIZE     64  /*!< Largest supported bulk packet size */
+#endif
+#endif
+#ifndef USB_CDC_NOTIFY_PACKET_SIZE
+#define USB_CDC_NOTIFY_PACKET_SIZE  8   /*!< Notification endpoint packet size */
+#endif
+
+#define USB_CDC_SET_LINE_CODING         0x20 /*!< Class request to set the serial port parameters */
+#define USB_CDC_GET_LINE_CODING         0x21 /*!< Class request to read the serial port parameters */
+#define USB_CDC_SET_CONTROL_LINE_STATE  0x22 /*!< Class request to set the DTR and RTS signals */
+#define USB_CDC_SEND_BREAK              0x23 /*!< Class request to generate a break condition */
+
+/** @brief CDC line coding structure, its first 7 bytes match the request data layout */
+typedef struct
+{
+    uint32_t DTERate;       /*!< Data terminal rate [bit/s] */
+    uint8_t  CharFormat;    /*!< Stop bits: 0 - 1, 1 - 1.5, 2 - 2 */
+    uint8_t  ParityType;    /*!< Parity: 0 - None, 1 - Odd, 2 - Even, 3 - Mark, 4 - Space */
+    uint8_t  DataBits;      /*!< Data bits: 5, 6, 7, 8 or 16 */
+}USB_CdcLineCodingType;
+
+/** @brief CDC data ring structure */
+typedef struct
+{
+    uint8_t *         Buffer;   /*!< Data storage of the ring */
+    uint16_t          Size;     /*!< Size of the storage, has to be a power of 2
+                                     and at least twice the MaxPacketSize */
+    volatile uint16_t Head;     /*!< [Internal] Write index, only advanced by the producer */
+    volatile uint16_t Tail;     /*!< [Internal] Read index, only advanced by the consumer */
+}USB_CdcRingType;
+
+/** @brief CDC-ACM function structure */
+typedef struct
+{
+    USB_HandleType *      pUSB;             /*!< USB handle of the device */
+    uint8_t               InEpAddress;      /*!< Bulk IN (device to host) endpoint address */
+    uint8_t               OutEpAddress;     /*!< Bulk OUT (host to device) endpoint address */
+    uint8_t               NotifyEpAddress;  /*!< Interrupt IN notification endpoint address, 0 if unused */
+    uint16_t              MaxPacketSize;    /*!< Bulk endpoint packet size [.. USB_CDC_MAX_PACKET_SIZE] */
+    USB_CdcRingType       TxRing;           /*!< Device to host data ring */
+    USB_CdcRingType       RxRing;           /*!< Host to device data ring */
+    struct {
+        XPD_HandleCallbackType Receive;     /*!< New data is available in the RxRing */
+        XPD_HandleCallbackType LineCoding;  /*!< The host has changed the LineCoding */
+        XPD_HandleCallbackType ControlLineState; /*!< The host has changed the ControlLineState */
+    } Callbacks;                            /*   Function Callbacks */
+    USB_CdcLineCodingType LineCoding;       /*!< Serial port parameters requested by the host */
+    uint16_t              ControlLineState; /*!< Host signals: DTR (bit 0), RTS (bit 1) */
+    volatile uint8_t      Configured;       /*!< [Internal] Set while the endpoints are open */
+    volatile uint8_t      TxBusy;           /*!< [Internal] Set while an IN transfer is ongoing */
+    volatile uint8_t      RxBusy;           /*!< [Internal] Set while an OUT transfer is ongoing */
+    uint8_t               RxStaged;         /*!< [Internal] Set when the OUT transfer uses the Packet buffer */
+    uint16_t              TxLength;         /*!< [Internal] Length of the ongoing IN transfer */
+    uint32_t              Packet[USB_CDC_MAX_PACKET_SIZE / sizeof(uint32_t)];
+                                            /*!< [Internal] Buffer of OUT packets crossing the RxRing end */
+}USB_CdcType;
+
+/** @} */
+
+/** @addtogroup USB_CDC_Exported_Functions
+ * @{ */
+XPD_ReturnType  USB_eCdcInit            (USB_CdcType * pxCdc);
+void            USB_vCdcOpen            (USB_CdcType * pxCdc);
+void            USB_vCdcClose           (USB_CdcType * pxCdc);
+
+uint32_t        USB_ulCdcWrite          (USB_CdcType * pxCdc, const uint8_t * pucData, uint32_t ulLength);
+uint32_t        USB_ulCdcRead           (USB_CdcType * pxCdc, uint8_t * pucData, uint32_t ulLength);
+
+XPD_ReturnType  USB_eCdcSetupRequest    (USB_CdcType * pxCdc, const uint8_t * pucSetup,
+                                         uint8_t ** ppucData, uint16_t * pusLength);
+void            USB_vCdcSetupData       (USB_CdcType * pxCdc, const uint8_t * pucSetup);
+
+void            USB_vCdcDataIn          (USB_CdcType * pxCdc);
+void            USB_vCdcDataOut         (USB_CdcType * pxCdc, USB_EndPointHandleType * pxEP);
+
+/**
+ * @brief Returns the number of received bytes waiting in the RxRing.
+ * @param pxCdc: pointer to the CDC function structure
+ * @return The number of readable bytes
+ */
+__STATIC_INLINE uint16_t USB_usCdcRxCount(USB_CdcType * pxCdc)
+{
+    return (uint16_t)(pxCdc->RxRing.Head - pxCdc->RxRing.Tail);
+}
+
+/**
+ * @brief Returns the free space of the TxRing.
+ * @param pxCdc: pointer to the CDC function structure
+ * @return The number of bytes that can be written
+ */
+__STATIC_INLINE uint16_t USB_usCdcTxSpace(USB_CdcType * pxCdc)
+{
+    return pxCdc->TxRing.Size - (uint16_t)(pxCdc->TxRing.Head - pxCdc->TxRing.Tail);
+}
+/** @} */
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XPD_USB_CDC_H_ */
@@ -0,0 +1,765 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_msc.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-28
+  * @brief   STM32 eXtensible Peripheral Drivers USB Mass Storage Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_usb_msc.h>
+#include <xpd_utils.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/* Setup packet fields */
+#define MSC_SETUP_REQUEST_TYPE(SETUP)   ((SETUP)[0])
+#define MSC_SETUP_REQUEST(SETUP)        ((SETUP)[1])
+
+#define MSC_REQUEST_TYPE_MASK           0x60
+#define MSC_REQUEST_TYPE_CLASS          0x20
+
+/* Byte order conversions of the wrappers (little endian) and command blocks (big endian) */
+#define MSC_LE32(P)     ((uint32_t)(P)[0] | ((uint32_t)(P)[1] << 8) | \
+                         ((uint32_t)(P)[2] << 16) | ((uint32_t)(P)[3] << 24))
+#define MSC_BE32(P)     ((uint32_t)(P)[3] | ((uint32_t)(P)[2] << 8) | \
+                         ((uint32_t)(P)[1] << 16) | ((uint32_t)(P)[0] << 24))
+#define MSC_BE16(P)     ((uint16_t)(P)[1] | ((uint16_t)(P)[0] << 8))
+
+/* Bulk-Only Transport wrappers */
+#define MSC_CBW_SIGNATURE               0x43425355
+#define MSC_CBW_LENGTH                  31
+#define MSC_CBW_DIR_IN                  0x80
+#define MSC_CSW_SIGNATURE               0x53425355
+#define MSC_CSW_LENGTH                  13
+
+#define MSC_STATUS_PASSED               0
+#define MSC_STATUS_FAILED               1
+#define MSC_STATUS_PHASE_ERROR          2
+
+/* Transport states */
+#define MSC_STATE_IDLE                  0 /* Endpoints closed */
+#define MSC_STATE_COMMAND               1 /* Waiting for command block wrapper */
+#define MSC_STATE_DATA_IN               2 /* Sending command response */
+#define MSC_STATE_READ                  3 /* Medium to host block pipeline */
+#define MSC_STATE_WRITE                 4 /* Host to medium block pipeline */
+#define MSC_STATE_STALLED               5 /* Status is sent when the host clears the stall */
+#define MSC_STATE_STATUS                6 /* Sending command status wrapper */
+#define MSC_STATE_ERROR                 7 /* Invalid command block, waiting for reset */
+
+/* SCSI operation codes */
+#define SCSI_TEST_UNIT_READY            0x00
+#define SCSI_REQUEST_SENSE              0x03
+#define SCSI_INQUIRY                    0x12
+#define SCSI_MODE_SENSE_6               0x1A
+#define SCSI_START_STOP_UNIT            0x1B
+#define SCSI_PREVENT_ALLOW_REMOVAL      0x1E
+#define SCSI_READ_FORMAT_CAPACITIES     0x23
+#define SCSI_READ_CAPACITY_10           0x25
+#define SCSI_READ_10                    0x28
+#define SCSI_WRITE_10                   0x2A
+#define SCSI_VERIFY_10                  0x2F
+#define SCSI_MODE_SENSE_10              0x5A
+
+/* SCSI sense keys */
+#define SCSI_KEY_NO_SENSE               0x00
+#define SCSI_KEY_NOT_READY              0x02
+#define SCSI_KEY_MEDIUM_ERROR           0x03
+#define SCSI_KEY_ILLEGAL_REQUEST        0x05
+#define SCSI_KEY_DATA_PROTECT           0x07
+
+/* SCSI additional sense codes */
+#define SCSI_ASC_NONE                   0x00
+#define SCSI_ASC_WRITE_FAULT            0x03
+#define SCSI_ASC_UNRECOVERED_READ       0x11
+#define SCSI_ASC_INVALID_COMMAND        0x20
+#define SCSI_ASC_LBA_OUT_OF_RANGE       0x21
+#define SCSI_ASC_WRITE_PROTECTED        0x27
+#define SCSI_ASC_MEDIUM_NOT_PRESENT     0x3A
+
+#define SCSI_REQUEST_SENSE_LENGTH       18
+#define SCSI_INQUIRY_LENGTH             36
+
+/* Only a single logical unit is supported */
+static const uint8_t ucMscMaxLun = 0;
+
+/** @defgroup USB_MSC_Private_Functions USB MSC Private Functions
+ * @{ */
+
+/**
+ * @brief Stores a value in big endian byte order.
+ * @param pucData: pointer to the destination
+ * @param ulValue: the value to store
+ */
+static void USB_prvMscPutBE32(uint8_t * pucData, uint32_t ulValue)
+{
+    pucData[0] = (uint8_t)(ulValue >> 24);
+    pucData[1] = (uint8_t)(ulValue >> 16);
+    pucData[2] = (uint8_t)(ulValue >> 8);
+    pucData[3] = (uint8_t)(ulValue);
+}
+
+/**
+ * @brief Copies an identification string, padding it with spaces.
+ * @param pucData: pointer to the destination
+ * @param pcId: the identification string, can be NULL
+ * @param ucLength: length of the field
+ */
+static void USB_prvMscPutId(uint8_t * pucData, const char * pcId, uint8_t ucLength)
+{
+    uint8_t i;
+
+    for (i = 0; i < ucLength; i++)
+    {
+        if ((pcId != NULL) && (*pcId != '\0'))
+        {
+            pucData[i] = (uint8_t)*pcId++;
+        }
+        else
+        {
+            pucData[i] = ' ';
+        }
+    }
+}
+
+/**
+ * @brief Marks the current command as failed.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param ucKey: the sense key
+ * @param ucCode: the additional sense code
+ */
+static void USB_prvMscFail(USB_MscType * pxMsc, uint8_t ucKey, uint8_t ucCode)
+{
+    pxMsc->Command.Status = MSC_STATUS_FAILED;
+    pxMsc->Sense.Key  = ucKey;
+    pxMsc->Sense.Code = ucCode;
+}
+
+/**
+ * @brief Starts the reception of the next command block wrapper.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscReceiveCommand(USB_MscType * pxMsc)
+{
+    pxMsc->State = MSC_STATE_COMMAND;
+
+    USB_vEpReceive(pxMsc->pUSB, pxMsc->OutEpAddress, pxMsc->Buffer[0], pxMsc->MaxPacketSize);
+}
+
+/**
+ * @brief Sends the command status wrapper of the current command.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscSendStatus(USB_MscType * pxMsc)
+{
+    uint8_t * pucStatus = (uint8_t*)pxMsc->Status;
+
+    pxMsc->Status[0] = MSC_CSW_SIGNATURE;
+    pxMsc->Status[1] = pxMsc->Command.Tag;
+    pxMsc->Status[2] = pxMsc->Command.Residue;
+    pucStatus[12]    = pxMsc->Command.Status;
+
+    pxMsc->State = MSC_STATE_STATUS;
+
+    USB_vEpSend(pxMsc->pUSB, pxMsc->InEpAddress, pucStatus, MSC_CSW_LENGTH);
+}
+
+/**
+ * @brief Concludes the current command: when the host expects more data,
+ *        the data stage is terminated by stalling, otherwise the status is sent.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscConclude(USB_MscType * pxMsc)
+{
+    if (pxMsc->Command.Residue > 0)
+    {
+        pxMsc->State = MSC_STATE_STALLED;
+
+        USB_vEpSetStall(pxMsc->pUSB, ((pxMsc->Command.Flags & MSC_CBW_DIR_IN) != 0) ?
+                pxMsc->InEpAddress : pxMsc->OutEpAddress);
+    }
+    else
+    {
+        USB_prvMscSendStatus(pxMsc);
+    }
+}
+
+static void USB_prvMscProduced(USB_MscType * pxMsc);
+static void USB_prvMscConsumed(USB_MscType * pxMsc);
+
+/**
+ * @brief Starts the idle stages of the block pipeline.
+ *        Reading fills the buffers from the medium and empties them to the IN endpoint,
+ *        writing fills them from the OUT endpoint and empties them to the medium.
+ *        With two buffers the medium operation of one block overlaps
+ *        with the USB transfer of the other.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscPump(USB_MscType * pxMsc)
+{
+    uint8_t ucWrite = pxMsc->State == MSC_STATE_WRITE;
+
+    if ((pxMsc->Pipe.ProducerBusy == 0) && (pxMsc->Pipe.ProduceLeft > 0) && (pxMsc->Pipe.Used < 2))
+    {
+        uint8_t * pucBuffer = pxMsc->Buffer[pxMsc->Pipe.Head];
+
+        pxMsc->Pipe.Used++;
+        pxMsc->Pipe.ProducerBusy = 1;
+
+        if (ucWrite != 0)
+        {
+            USB_vEpReceive(pxMsc->pUSB, pxMsc->OutEpAddress, pucBuffer, pxMsc->Medium.BlockSize);
+        }
+        /* After a medium error the rest of the data stage is only transported */
+        else if ((pxMsc->Pipe.Failed != 0) ||
+                 (pxMsc->Medium.Read(pxMsc, pucBuffer, pxMsc->Pipe.Block++) != XPD_OK))
+        {
+            pxMsc->Pipe.Failed = 1;
+            USB_prvMscProduced(pxMsc);
+        }
+    }
+
+    if ((pxMsc->Pipe.ConsumerBusy == 0) && (pxMsc->Pipe.Ready > 0))
+    {
+        uint8_t * pucBuffer = pxMsc->Buffer[pxMsc->Pipe.Tail];
+
+        pxMsc->Pipe.ConsumerBusy = 1;
+
+        if (ucWrite == 0)
+        {
+            USB_vEpSend(pxMsc->pUSB, pxMsc->InEpAddress, pucBuffer, pxMsc->Medium.BlockSize);
+        }
+        else if ((pxMsc->Pipe.Failed != 0) ||
+                 (pxMsc->Medium.Write(pxMsc, pucBuffer, pxMsc->Pipe.Block++) != XPD_OK))
+        {
+            pxMsc->Pipe.Failed = 1;
+            USB_prvMscConsumed(pxMsc);
+        }
+    }
+}
+
+/**
+ * @brief Handles a filled buffer of the block pipeline.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscProduced(USB_MscType * pxMsc)
+{
+    pxMsc->Pipe.ProducerBusy = 0;
+    pxMsc->Pipe.Head ^= 1;
+    pxMsc->Pipe.Ready++;
+    pxMsc->Pipe.ProduceLeft--;
+
+    if (pxMsc->State == MSC_STATE_WRITE)
+    {
+        pxMsc->Command.Residue -= pxMsc->Medium.BlockSize;
+    }
+
+    USB_prvMscPump(pxMsc);
+}
+
+/**
+ * @brief Handles an emptied buffer of the block pipeline.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscConsumed(USB_MscType * pxMsc)
+{
+    pxMsc->Pipe.ConsumerBusy = 0;
+    pxMsc->Pipe.Tail ^= 1;
+    pxMsc->Pipe.Ready--;
+    pxMsc->Pipe.Used--;
+    pxMsc->Pipe.ConsumeLeft--;
+
+    if (pxMsc->State == MSC_STATE_READ)
+    {
+        pxMsc->Command.Residue -= pxMsc->Medium.BlockSize;
+    }
+
+    if (pxMsc->Pipe.ConsumeLeft == 0)
+    {
+        if (pxMsc->Pipe.Failed != 0)
+        {
+            if (pxMsc->State == MSC_STATE_READ)
+            {
+                USB_prvMscFail(pxMsc, SCSI_KEY_MEDIUM_ERROR, SCSI_ASC_UNRECOVERED_READ);
+            }
+            else
+            {
+                USB_prvMscFail(pxMsc, SCSI_KEY_MEDIUM_ERROR, SCSI_ASC_WRITE_FAULT);
+            }
+        }
+        USB_prvMscSendStatus(pxMsc);
+    }
+    else
+    {
+        USB_prvMscPump(pxMsc);
+    }
+}
+
+/**
+ * @brief Validates a READ(10) or WRITE(10) command and starts its block pipeline.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param ucWrite: set for WRITE(10)
+ * @return true if the pipeline is started, false if the command is concluded
+ */
+static bool USB_prvMscStartBlocks(USB_MscType * pxMsc, uint8_t ucWrite)
+{
+    bool eStarted = false;
+    uint32_t ulBlock = MSC_BE32(&pxMsc->Command.Block[2]);
+    uint16_t usCount = MSC_BE16(&pxMsc->Command.Block[7]);
+    uint8_t ucDirIn = (pxMsc->Command.Flags & MSC_CBW_DIR_IN) != 0;
+
+    if (pxMsc->Medium.BlockCount == 0)
+    {
+        USB_prvMscFail(pxMsc, SCSI_KEY_NOT_READY, SCSI_ASC_MEDIUM_NOT_PRESENT);
+    }
+    else if ((ulBlock > pxMsc->Medium.BlockCount) ||
+             (usCount > (pxMsc->Medium.BlockCount - ulBlock)))
+    {
+        USB_prvMscFail(pxMsc, SCSI_KEY_ILLEGAL_REQUEST, SCSI_ASC_LBA_OUT_OF_RANGE);
+    }
+    else if ((ucWrite != 0) && (pxMsc->Medium.ReadOnly != 0))
+    {
+        USB_prvMscFail(pxMsc, SCSI_KEY_DATA_PROTECT, SCSI_ASC_WRITE_PROTECTED);
+    }
+    else if (((uint32_t)usCount * pxMsc->Medium.BlockSize) != pxMsc->Command.DataLength)
+    {
+        /* Only the exact data length of the command is transported */
+        pxMsc->Command.Status = MSC_STATUS_PHASE_ERROR;
+    }
+    else if ((usCount > 0) && (ucDirIn == ucWrite))
+    {
+        pxMsc->Command.Status = MSC_STATUS_PHASE_ERROR;
+    }
+    else if (usCount > 0)
+    {
+        pxMsc->Pipe.Block        = ulBlock;
+        pxMsc->Pipe.ProduceLeft  = usCount;
+        pxMsc->Pipe.ConsumeLeft  = usCount;
+        pxMsc->Pipe.Head         = 0;
+        pxMsc->Pipe.Tail         = 0;
+        pxMsc->Pipe.Used         = 0;
+        pxMsc->Pipe.Ready        = 0;
+        pxMsc->Pipe.ProducerBusy = 0;
+        pxMsc->Pipe.ConsumerBusy = 0;
+        pxMsc->Pipe.Failed       = 0;
+
+        pxMsc->State = (ucWrite != 0) ? MSC_STATE_WRITE : MSC_STATE_READ;
+        eStarted = true;
+
+        USB_prvMscPump(pxMsc);
+    }
+
+    return eStarted;
+}
+
+/**
+ * @brief Executes the received SCSI command.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+static void USB_prvMscExecute(USB_MscType * pxMsc)
+{
+    USB_MscCommandType * pxCmd = &pxMsc->Command;
+    uint8_t * pucData = pxMsc->Buffer[0];
+    uint32_t ulLength = 0;
+    uint8_t ucKey = pxMsc->Sense.Key, ucCode = pxMsc->Sense.Code;
+    bool eStarted = false;
+
+    pxCmd->Status  = MSC_STATUS_PASSED;
+    pxCmd->Residue = pxCmd->DataLength;
+    pxMsc->Sense.Key  = SCSI_KEY_NO_SENSE;
+    pxMsc->Sense.Code = SCSI_ASC_NONE;
+
+    switch (pxCmd->Block[0])
+    {
+        case SCSI_TEST_UNIT_READY:
+        case SCSI_READ_CAPACITY_10:
+        case SCSI_READ_FORMAT_CAPACITIES:
+            if (pxMsc->Medium.BlockCount == 0)
+            {
+                USB_prvMscFail(pxMsc, SCSI_KEY_NOT_READY, SCSI_ASC_MEDIUM_NOT_PRESENT);
+            }
+            else if (pxCmd->Block[0] == SCSI_READ_CAPACITY_10)
+            {
+                USB_prvMscPutBE32(&pucData[0], pxMsc->Medium.BlockCount - 1);
+                USB_prvMscPutBE32(&pucData[4], pxMsc->Medium.BlockSize);
+                ulLength = 8;
+            }
+            else if (pxCmd->Block[0] == SCSI_READ_FORMAT_CAPACITIES)
+            {
+                USB_prvMscPutBE32(&pucData[0], 8);
+                USB_prvMscPutBE32(&pucData[4], pxMsc->Medium.BlockCount);
+                /* Formatted media descriptor with the block length */
+                USB_prvMscPutBE32(&pucData[8], 0x02000000 | pxMsc->Medium.BlockSize);
+                ulLength = 12;
+            }
+            break;
+
+        case SCSI_REQUEST_SENSE:
+            /* Fixed format sense data of the previous command */
+            for (ulLength = 0; ulLength < SCSI_REQUEST_SENSE_LENGTH; ulLength++)
+            {
+                pucData[ulLength] = 0;
+            }
+            pucData[0]  = 0x70;
+            pucData[2]  = ucKey;
+            pucData[7]  = SCSI_REQUEST_SENSE_LENGTH - 8;
+            pucData[12] = ucCode;
+            break;
+
+        case SCSI_INQUIRY:
+            /* Removable direct access block device */
+            pucData[0] = 0x00;
+            pucData[1] = 0x80;
+            pucData[2] = 0x02;
+            pucData[3] = 0x02;
+            pucData[4] = SCSI_INQUIRY_LENGTH - 5;
+            pucData[5] = 0;
+            pucData[6] = 0;
+            pucData[7] = 0;
+            USB_prvMscPutId(&pucData[8],  pxMsc->VendorId,  8);
+            USB_prvMscPutId(&pucData[16], pxMsc->ProductId, 16);
+            USB_prvMscPutId(&pucData[32], pxMsc->Revision,  4);
+            ulLength = SCSI_INQUIRY_LENGTH;
+            break;
+
+        case SCSI_MODE_SENSE_6:
+            /* Mode parameter header only, with the write protect flag */
+            pucData[0] = 3;
+            pucData[1] = 0;
+            pucData[2] = (pxMsc->Medium.ReadOnly != 0) ? 0x80 : 0;
+            pucData[3] = 0;
+            ulLength = 4;
+            break;
+
+        case SCSI_MODE_SENSE_10:
+            pucData[0] = 0;
+            pucData[1] = 6;
+            pucData[2] = 0;
+            pucData[3] = (pxMsc->Medium.ReadOnly != 0) ? 0x80 : 0;
+            pucData[4] = 0;
+            pucData[5] = 0;
+            pucData[6] = 0;
+            pucData[7] = 0;
+            ulLength = 8;
+            break;
+
+        case SCSI_START_STOP_UNIT:
+        case SCSI_PREVENT_ALLOW_REMOVAL:
+        case SCSI_VERIFY_10:
+            break;
+
+        case SCSI_READ_10:
+            eStarted = USB_prvMscStartBlocks(pxMsc, 0);
+            break;
+
+        case SCSI_WRITE_10:
+            eStarted = USB_prvMscStartBlocks(pxMsc, 1);
+            break;
+
+        default:
+            USB_prvMscFail(pxMsc, SCSI_KEY_ILLEGAL_REQUEST, SCSI_ASC_INVALID_COMMAND);
+            break;
+    }
+
+    if (eStarted != false)
+    {
+        /* The block pipeline concludes the command */
+    }
+    else if ((ulLength > 0) && (pxCmd->Status == MSC_STATUS_PASSED))
+    {
+        if ((pxCmd->DataLength == 0) || ((pxCmd->Flags & MSC_CBW_DIR_IN) == 0))
+        {
+            /* The host doesn't expect the response */
+            pxCmd->Status = MSC_STATUS_PHASE_ERROR;
+            USB_prvMscConclude(pxMsc);
+        }
+        else
+        {
+            if (ulLength > pxCmd->DataLength)
+            {
+                ulLength = pxCmd->DataLength;
+            }
+            pxCmd->Residue -= ulLength;
+            pxMsc->State = MSC_STATE_DATA_IN;
+
+            USB_vEpSend(pxMsc->pUSB, pxMsc->InEpAddress, pucData, ulLength);
+        }
+    }
+    else
+    {
+        USB_prvMscConclude(pxMsc);
+    }
+}
+
+/** @} */
+
+/** @defgroup USB_MSC_Exported_Functions USB MSC Exported Functions
+ * @{ */
+
+/**
+ * @brief Initializes the MSC function and sets up its endpoints in the USB handle,
+ *        so that they are considered by the endpoint resource allocation.
+ * @param pxMsc: pointer to the MSC function structure
+ * @return ERROR if the block or packet sizes are invalid, OK otherwise
+ * @note  This function shall be called before the USB device is started.
+ *        The bulk endpoints of the packet memory core are set up with double buffering.
+ */
+XPD_ReturnType USB_eMscInit(USB_MscType * pxMsc)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if ((pxMsc->MaxPacketSize == 0) || (pxMsc->Medium.BlockSize < pxMsc->MaxPacketSize) ||
+        ((pxMsc->Medium.BlockSize % pxMsc->MaxPacketSize) != 0))
+    {
+    }
+    else if ((pxMsc->Buffer[0] == NULL) || (pxMsc->Buffer[1] == NULL))
+    {
+    }
+    else
+    {
+        USB_EndPointHandleType * pxIn  = &pxMsc->pUSB->EP.IN[pxMsc->InEpAddress & 0xF];
+        USB_EndPointHandleType * pxOut = &pxMsc->pUSB->EP.OUT[pxMsc->OutEpAddress & 0xF];
+
+        pxMsc->State      = MSC_STATE_IDLE;
+        pxMsc->Sense.Key  = SCSI_KEY_NO_SENSE;
+        pxMsc->Sense.Code = SCSI_ASC_NONE;
+
+        /* Endpoint properties for the resource allocation */
+        pxIn->MaxPacketSize = pxOut->MaxPacketSize = pxMsc->MaxPacketSize;
+        pxIn->Type          = pxOut->Type          = USB_EP_TYPE_BULK;
+#ifdef USB
+        pxIn->DoubleBuffer  = pxOut->DoubleBuffer  = 1;
+#endif
+
+        eResult = XPD_OK;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Opens the endpoints of the MSC function and waits for the first command.
+ * @param pxMsc: pointer to the MSC function structure
+ * @note  This function shall be called when the device configuration is set.
+ */
+void USB_vMscOpen(USB_MscType * pxMsc)
+{
+    USB_vEpOpen(pxMsc->pUSB, pxMsc->InEpAddress, USB_EP_TYPE_BULK,
+            pxMsc->MaxPacketSize);
+    USB_vEpOpen(pxMsc->pUSB, pxMsc->OutEpAddress, USB_EP_TYPE_BULK,
+            pxMsc->MaxPacketSize);
+
+    USB_prvMscReceiveCommand(pxMsc);
+}
+
+/**
+ * @brief Closes the endpoints of the MSC function.
+ * @param pxMsc: pointer to the MSC function structure
+ */
+void USB_vMscClose(USB_MscType * pxMsc)
+{
+    pxMsc->State = MSC_STATE_IDLE;
+
+    USB_vEpClose(pxMsc->pUSB, pxMsc->InEpAddress);
+    USB_vEpClose(pxMsc->pUSB, pxMsc->OutEpAddress);
+}
+
+/**
+ * @brief Processes the MSC class-specific control requests.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param pucSetup: pointer to the setup packet
+ * @param ppucData: set to the data stage buffer
+ * @param pusLength: set to the data stage length
+ * @return OK if the request is supported, ERROR if it shall be stalled
+ * @note  The Bulk-Only Mass Storage Reset doesn't cancel an ongoing medium operation,
+ *        its buffer shall not be accessed by the medium after it returns.
+ */
+XPD_ReturnType USB_eMscSetupRequest(
+        USB_MscType *       pxMsc,
+        const uint8_t *     pucSetup,
+        uint8_t **          ppucData,
+        uint16_t *          pusLength)
+{
+    XPD_ReturnType eResult = XPD_OK;
+
+    *ppucData  = NULL;
+    *pusLength = 0;
+
+    if ((MSC_SETUP_REQUEST_TYPE(pucSetup) & MSC_REQUEST_TYPE_MASK) != MSC_REQUEST_TYPE_CLASS)
+    {
+        eResult = XPD_ERROR;
+    }
+    else switch (MSC_SETUP_REQUEST(pucSetup))
+    {
+        case USB_MSC_BOT_RESET:
+            if (pxMsc->State != MSC_STATE_IDLE)
+            {
+                pxMsc->Pipe.ProducerBusy = 0;
+                pxMsc->Pipe.ConsumerBusy = 0;
+
+                USB_prvMscReceiveCommand(pxMsc);
+            }
+            break;
+
+        case USB_MSC_GET_MAX_LUN:
+            *ppucData  = (uint8_t*)&ucMscMaxLun;
+            *pusLength = sizeof(ucMscMaxLun);
+            break;
+
+        default:
+            eResult = XPD_ERROR;
+            break;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Continues the transport after the host has cleared an endpoint halt.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param ucEpAddress: the cleared endpoint address
+ * @note  This function shall be called by the device stack
+ *        when it processes a CLEAR_FEATURE(ENDPOINT_HALT) request.
+ */
+void USB_vMscClearFeature(USB_MscType * pxMsc, uint8_t ucEpAddress)
+{
+    if (pxMsc->State == MSC_STATE_STALLED)
+    {
+        USB_prvMscSendStatus(pxMsc);
+    }
+    else if (pxMsc->State == MSC_STATE_ERROR)
+    {
+        /* The endpoints stay halted until the Reset Recovery */
+        USB_vEpSetStall(pxMsc->pUSB, ucEpAddress);
+    }
+    else if ((pxMsc->State == MSC_STATE_COMMAND) && (ucEpAddress == pxMsc->OutEpAddress))
+    {
+        /* Clearing the halt of the Reset Recovery may cancel the armed reception */
+        USB_prvMscReceiveCommand(pxMsc);
+    }
+}
+
+/**
+ * @brief Handles the completion of the IN transfer.
+ * @param pxMsc: pointer to the MSC function structure
+ * @note  This function shall be called from @ref USB_vDataInCallback
+ *        for the MSC function's bulk IN endpoint.
+ */
+void USB_vMscDataIn(USB_MscType * pxMsc)
+{
+    switch (pxMsc->State)
+    {
+        case MSC_STATE_READ:
+            USB_prvMscConsumed(pxMsc);
+            break;
+
+        case MSC_STATE_DATA_IN:
+            /* A short response packet already terminates the data stage */
+            if (((pxMsc->Command.DataLength - pxMsc->Command.Residue)
+                    % pxMsc->MaxPacketSize) != 0)
+            {
+                USB_prvMscSendStatus(pxMsc);
+            }
+            else
+            {
+                USB_prvMscConclude(pxMsc);
+            }
+            break;
+
+        case MSC_STATE_STATUS:
+            USB_prvMscReceiveCommand(pxMsc);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Handles the completion of the OUT transfer.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param pxEP: pointer to the bulk OUT endpoint handle
+ * @note  This function shall be called from @ref USB_vDataOutCallback
+ *        for the MSC function's bulk OUT endpoint.
+ */
+void USB_vMscDataOut(USB_MscType * pxMsc, USB_EndPointHandleType * pxEP)
+{
+    if (pxMsc->State == MSC_STATE_WRITE)
+    {
+        USB_prvMscProduced(pxMsc);
+    }
+    else if (pxMsc->State == MSC_STATE_COMMAND)
+    {
+        const uint8_t * pucCbw = pxMsc->Buffer[0];
+
+        if ((pxEP->Transfer.Length == MSC_CBW_LENGTH) &&
+            (MSC_LE32(&pucCbw[0]) == MSC_CBW_SIGNATURE) &&
+            (pucCbw[13] == 0) && (pucCbw[14] > 0) && (pucCbw[14] <= sizeof(pxMsc->Command.Block)))
+        {
+            uint8_t i;
+
+            pxMsc->Command.Tag        = MSC_LE32(&pucCbw[4]);
+            pxMsc->Command.DataLength = MSC_LE32(&pucCbw[8]);
+            pxMsc->Command.Flags      = pucCbw[12];
+            pxMsc->Command.Length     = pucCbw[14];
+
+            for (i = 0; i < sizeof(pxMsc->Command.Block); i++)
+            {
+                pxMsc->Command.Block[i] = (i < pucCbw[14]) ? pucCbw[15 + i] : 0;
+            }
+
+            USB_prvMscExecute(pxMsc);
+        }
+        else
+        {
+            /* Invalid command block wrapper, halt until Reset Recovery */
+            pxMsc->State = MSC_STATE_ERROR;
+
+            USB_vEpSetStall(pxMsc->pUSB, pxMsc->InEpAddress);
+            USB_vEpSetStall(pxMsc->pUSB, pxMsc->OutEpAddress);
+        }
+    }
+}
+
+/**
+ * @brief Reports the completion of the medium operation started by
+ *        @ref USB_MscMediumType::Read or @ref USB_MscMediumType::Write,
+ *        and continues the block pipeline.
+ * @param pxMsc: pointer to the MSC function structure
+ * @param eResult: OK if the block was transferred successfully
+ * @note  This function can be called from within the medium operation.
+ *        It shall not preempt the USB endpoint completion callbacks, or vice versa.
+ */
+void USB_vMscMediumComplete(USB_MscType * pxMsc, XPD_ReturnType eResult)
+{
+    if (eResult != XPD_OK)
+    {
+        pxMsc->Pipe.Failed = 1;
+    }
+
+    if ((pxMsc->State == MSC_STATE_READ) && (pxMsc->Pipe.ProducerBusy != 0))
+    {
+        USB_prvMscProduced(pxMsc);
+    }
+    else if ((pxMsc->State == MSC_STATE_WRITE) && (pxMsc->Pipe.ConsumerBusy != 0))
+    {
+        USB_prvMscConsumed(pxMsc);
+    }
+}
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
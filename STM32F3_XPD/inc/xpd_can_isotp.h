@@ -0,0 +1,135 @@
+/**
+  ******************************************************************************
+  * @file    xpd_can_isotp.h
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-06-28
+  * @brief   STM32 eXtensible Peripheral Drivers CAN ISO-TP Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __XPD_CAN_ISOTP_H_
+#define __XPD_CAN_ISOTP_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <xpd_common.h>
+#include <xpd_can.h>
+#include <xpd_tim.h>
+
+#if defined(CAN) || defined(CAN1)
+
+/** @ingroup CAN
+ * @defgroup CAN_ISOTP CAN ISO-TP
+ * @brief    ISO 15765-2 transport protocol over the CAN peripheral
+ * @{ */
+
+/** @defgroup CAN_ISOTP_Exported_Types CAN ISO-TP Exported Types
+ * @{ */
+
+#ifndef CAN_ISOTP_TICK_us
+#define CAN_ISOTP_TICK_us       100  /*!< Update period of the ISO-TP timer [us] */
+#endif
+#ifndef CAN_ISOTP_TIMEOUT_ms
+#define CAN_ISOTP_TIMEOUT_ms    1000 /*!< N_Bs and N_Cr timeout [ms] */
+#endif
+#define CAN_ISOTP_MAX_LENGTH    4095 /*!< Maximal message length */
+
+/** @brief ISO-TP error types */
+typedef enum
+{
+    CAN_ISOTP_ERROR_NONE       = 0, /*!< No error */
+    CAN_ISOTP_ERROR_TIMEOUT_BS = 1, /*!< Flow control frame was not received in time */
+    CAN_ISOTP_ERROR_TIMEOUT_CR = 2, /*!< Consecutive frame was not received in time */
+    CAN_ISOTP_ERROR_WRONG_SN   = 3, /*!< Consecutive frame with unexpected sequence number received */
+    CAN_ISOTP_ERROR_OVERFLOW   = 4, /*!< Message does not fit in the receiver buffer */
+    CAN_ISOTP_ERROR_INVALID_FS = 5, /*!< Flow control frame with invalid flow status received */
+}CAN_IsoTpErrorType;
+
+/** @brief ISO-TP session structure */
+typedef struct
+{
+    CAN_IdentifierFieldType TxId;      /*!< Identifier of the transmitted frames */
+    CAN_IdentifierFieldType RxId;      /*!< Identifier of the received frames */
+    uint8_t BlockSize;                 /*!< Block size sent in flow control frames, 0 for unlimited */
+    uint8_t STmin;                     /*!< Separation time sent in flow control frames (ISO 15765-2 encoding) */
+    uint8_t Padding;                   /*!< Value of the unused data bytes of the transmitted frames */
+    struct {
+        XPD_HandleCallbackType Transmit; /*!< Message transmission complete callback */
+        XPD_HandleCallbackType Receive;  /*!< Message reception complete callback */
+        XPD_HandleCallbackType Error;    /*!< Message transfer failure callback */
+    } Callbacks;                       /*   Session Callbacks */
+    struct {
+        const uint8_t * Data;          /*   Message data */
+        uint16_t Length;               /*   Message length */
+        uint16_t Offset;               /*   Number of data bytes sent */
+        volatile uint16_t Timer;       /*   Remaining ticks until the next action */
+        uint16_t STmin;                /*   Separation time of consecutive frames in ticks */
+        uint8_t BlockCount;            /*   Remaining consecutive frames in the block */
+        uint8_t SN;                    /*   Next sequence number */
+        volatile uint8_t State;        /*   Transmit state */
+    } Tx;                              /*!< [Internal] Transmit context */
+    struct {
+        uint8_t * Data;                /*   Reception buffer */
+        uint16_t Size;                 /*   Reception buffer size */
+        uint16_t Length;               /*   Message length */
+        uint16_t Offset;               /*   Number of data bytes received */
+        volatile uint16_t Timer;       /*   Remaining ticks until timeout */
+        uint8_t BlockCount;            /*   Remaining consecutive frames in the block */
+        uint8_t SN;                    /*   Next expected sequence number */
+        uint8_t FlowStatus;            /*   Flow status of the flow control frame pending transmission */
+        volatile uint8_t State;        /*   Receive state */
+    } Rx;                              /*!< [Internal] Receive context */
+    CAN_IsoTpErrorType Error;          /*!< Last transfer error */
+}CAN_IsoTpSessionType;
+
+/** @brief ISO-TP layer structure */
+typedef struct
+{
+    CAN_HandleType * pCAN;             /*!< CAN handle, its transmit queue has to be set up */
+    TIM_HandleType * pTIM;             /*!< Timer handle with CAN_ISOTP_TICK_us update period */
+    CAN_IsoTpSessionType ** Sessions;  /*!< Array of the sessions of the layer */
+    uint8_t SessionCount;              /*!< Number of sessions in the array */
+    uint8_t Ticking;                   /*!< [Internal] Set while the timer is running */
+}CAN_IsoTpType;
+
+/** @} */
+
+/** @addtogroup CAN_ISOTP_Exported_Functions
+ * @{ */
+void            CAN_vIsoTpInit          (CAN_IsoTpType * pxTP);
+
+XPD_ReturnType  CAN_eIsoTpSend          (CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+                                         const uint8_t * pucData, uint16_t usLength);
+XPD_ReturnType  CAN_eIsoTpReceive       (CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+                                         uint8_t * pucBuffer, uint16_t usSize);
+void            CAN_vIsoTpAbort         (CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession);
+
+XPD_ReturnType  CAN_eIsoTpProcess       (CAN_IsoTpType * pxTP, const CAN_FrameType * pxFrame);
+void            CAN_vIsoTpTick          (CAN_IsoTpType * pxTP);
+/** @} */
+
+/** @} */
+
+#endif /* defined(CAN) || defined(CAN1) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XPD_CAN_ISOTP_H_ */
@@ -28,6 +28,7 @@
 
 typedef enum
 {
+    I2C_NOSTOP               = 0,
     I2C_AUTOSTOP             = I2C_CR2_AUTOEND,
     I2C_STOP                 = I2C_CR2_STOP,
     I2C_START_WRITE          = I2C_CR2_START,
@@ -50,6 +51,8 @@ typedef enum
 #define I2C_SLAVE_TX_ITS            (I2C_CR1_TXIE | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
 #define I2C_SLAVE_RX_DMA            (I2C_CR1_RXDMAEN | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
 #define I2C_SLAVE_TX_DMA            (I2C_CR1_TXDMAEN | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
+#define I2C_MASTER_BATCH_ITS        (I2C_CR1_TCIE | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
+#define I2C_MASTER_POLL_ITS         (I2C_CR1_TCIE | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
 #else
 #define I2C_ERR_ITS                 (0)
 #define I2C_MASTER_CMD_ITS          (I2C_CR1_TXIE | I2C_CR1_TCIE)
@@ -62,6 +65,8 @@ typedef enum
 #define I2C_SLAVE_TX_ITS            (I2C_CR1_TXIE | I2C_CR1_STOPIE)
 #define I2C_SLAVE_RX_DMA            (I2C_CR1_RXDMAEN | I2C_CR1_STOPIE)
 #define I2C_SLAVE_TX_DMA            (I2C_CR1_TXDMAEN | I2C_CR1_STOPIE)
+#define I2C_MASTER_BATCH_ITS        (I2C_CR1_TCIE | I2C_CR1_STOPIE)
+#define I2C_MASTER_POLL_ITS         (I2C_CR1_TCIE | I2C_CR1_STOPIE)
 #endif
 
 #define I2C_NBYTES_MASK             (I2C_CR2_NBYTES_Msk >> I2C_CR2_NBYTES_Pos)
@@ -81,57 +86,155 @@ __STATIC_INLINE void I2C_prvDisable(I2C_HandleType* pxI2C)
     I2C_REG_BIT(pxI2C, CR1, PE) = 0;
 }
 
-/* Configure the I2C bus timing based on the peripheral clock and the desired bus speed */
-static void I2C_prvSetTiming(I2C_HandleType * pxI2C, uint32_t ulBusFreq_Hz)
+/* I2C bus characteristics of a speed mode [ns] */
+typedef struct
 {
-    uint32_t ulClkFreq_Hz = I2C_ulClockFreq_Hz(pxI2C);
-    uint32_t ulScl, ulOvers, ulPresc = 0, ulTSetUp = 1, ulDiv, ulMulL;
+    uint32_t ulFreqMax_Hz;  /* Maximal SCL frequency */
+    uint16_t usHdDatMin;    /* Minimal data hold time */
+    uint16_t usVdDatMax;    /* Maximal data valid time */
+    uint16_t usSuDatMin;    /* Minimal data setup time */
+    uint16_t usLowMin;      /* Minimal SCL low period */
+    uint16_t usHighMin;     /* Minimal SCL high period */
+}I2C_BusSpecType;
+
+/* Timing requirements of the I2C specification (UM10204) */
+static const I2C_BusSpecType i2c_axBusSpecs[] = {
+    {  100000, 0, 3450, 250, 4700, 4000 }, /* Standard mode */
+    {  400000, 0,  900, 100, 1300,  600 }, /* Fast mode */
+    { 1000000, 0,  450,  50,  500,  260 }, /* Fast mode Plus */
+};
+
+/* Delay range of the analog noise filter [ns] */
+#define I2C_ANALOG_FILTER_MIN_NS    50
+#define I2C_ANALOG_FILTER_MAX_NS    260
+
+#define I2C_TIMINGR_PRESC_MAX       (I2C_TIMINGR_PRESC_Msk  >> I2C_TIMINGR_PRESC_Pos)
+#define I2C_TIMINGR_SCLDEL_MAX      (I2C_TIMINGR_SCLDEL_Msk >> I2C_TIMINGR_SCLDEL_Pos)
+#define I2C_TIMINGR_SDADEL_MAX      (I2C_TIMINGR_SDADEL_Msk >> I2C_TIMINGR_SDADEL_Pos)
+#define I2C_TIMINGR_SCL_MAX         ((I2C_TIMINGR_SCLL_Msk  >> I2C_TIMINGR_SCLL_Pos) + 1)
+
+/* Converts a frequency to period [ps], limited to the signed range of the calculations */
+__STATIC_INLINE uint32_t I2C_prvPeriod_ps(uint32_t ulFreq_Hz)
+{
+    uint64_t ullPeriod = (ulFreq_Hz > 0) ? (1000000000000ULL / ulFreq_Hz) : INT32_MAX;
+
+    return (ullPeriod < INT32_MAX) ? (uint32_t)ullPeriod : INT32_MAX;
+}
+
+/* Divides the signed dividend by the divisor, rounding up to the closest non-negative integer */
+__STATIC_INLINE uint32_t I2C_prvDivCeil(int32_t lDividend, uint32_t ulDivisor)
+{
+    return (lDividend > 0) ? ((uint32_t)lDividend + ulDivisor - 1) / ulDivisor : 0;
+}
 
-    /* Standard mode */
-    if (ulBusFreq_Hz <= 100000)
+/* Configure the I2C bus timing based on the peripheral clock, the desired bus speed,
+ * the bus signal slopes and the input filters, and return the achieved bus frequency */
+static uint32_t I2C_prvSetTiming(I2C_HandleType * pxI2C, const I2C_InitType * pxConfig)
+{
+    const I2C_BusSpecType * pxSpec = i2c_axBusSpecs;
+    uint32_t ulBusFreq_Hz = pxConfig->BusFreq_Hz;
+    uint32_t ulTimingR = I2C_TIMINGR_PRESC | I2C_TIMINGR_SCLDEL |
+                         I2C_TIMINGR_SCLH  | I2C_TIMINGR_SCLL;
+    uint32_t ulBestScl = 0, ulPresc;
+    uint32_t ulClk, ulTarget, ulRise, ulFall, ulDnf, ulAfMin = 0, ulAfMax = 0, ulSync;
+
+    /* Select the speed mode which covers the desired bus frequency */
+    while ((ulBusFreq_Hz > pxSpec->ulFreqMax_Hz) &&
+           (pxSpec < &i2c_axBusSpecs[(sizeof(i2c_axBusSpecs) / sizeof(i2c_axBusSpecs[0])) - 1]))
     {
-        /* SCL: \_/-\_/- */
-        ulDiv = 2;
-        ulMulL = 1;
+        pxSpec++;
     }
-    else /* Fast mode */
+    if (ulBusFreq_Hz > pxSpec->ulFreqMax_Hz)
     {
-        /* SCL: \__/-\__/- */
-        ulDiv = 3;
-        ulMulL = 2;
+        ulBusFreq_Hz = pxSpec->ulFreqMax_Hz;
     }
 
-    ulOvers = (ulClkFreq_Hz / ulBusFreq_Hz - 4) / ulDiv;
-    do
+    /* All calculations are carried out in picoseconds */
+    ulRise   = pxConfig->RiseTime_ns * 1000;
+    ulFall   = pxConfig->FallTime_ns * 1000;
+    ulClk    = I2C_prvPeriod_ps(I2C_ulClockFreq_Hz(pxI2C));
+    ulTarget = I2C_prvPeriod_ps(ulBusFreq_Hz);
+    ulDnf    = pxConfig->DigitalFilter * ulClk;
+    if (pxConfig->NoAnalogFilter == DISABLE)
     {
-        ulPresc++;
-        ulScl = ulOvers / ulPresc;
+        ulAfMin = I2C_ANALOG_FILTER_MIN_NS * 1000;
+        ulAfMax = I2C_ANALOG_FILTER_MAX_NS * 1000;
     }
-    while (ulScl > 0x100);
 
-    pxI2C->Inst->TIMINGR.b.PRESC  = ulPresc - 1;
-    pxI2C->Inst->TIMINGR.b.SCLL   = (ulScl * ulMulL) - 1;
+    /* SCL edges are detected with the input filter and synchronization delays */
+    ulSync = ulAfMin + ulDnf + 2 * ulClk;
 
-#if 0 /* TODO proper implementation */
+    for (ulPresc = 0; ulPresc <= I2C_TIMINGR_PRESC_MAX; ulPresc++)
     {
-        uint32_t ulOffset = 16, ulScaler = 8, ulLimit = 15;
+        uint32_t ulTPresc = (ulPresc + 1) * ulClk;
+        uint32_t ulSclDel, ulSdaDel, ulSclL, ulSclH, ulSclSum, ulScl;
+
+        /* Data setup time: tSCLDEL >= tr + tSU;DAT */
+        ulSclDel = I2C_prvDivCeil(ulRise + pxSpec->usSuDatMin * 1000, ulTPresc);
+        if (ulSclDel > 0)
+        {   ulSclDel--; }
+
+        /* Data hold time: tSDADEL >= tf + tHD;DAT - tAF(min) - (DNF + 3) * tI2CCLK */
+        ulSdaDel = I2C_prvDivCeil((int32_t)(ulFall + pxSpec->usHdDatMin * 1000)
+                - (int32_t)(ulAfMin + ulDnf + 3 * ulClk), ulTPresc);
+
+        /* Data valid time: tSDADEL <= tVD;DAT - tr - tAF(max) - (DNF + 4) * tI2CCLK */
+        if ((ulSclDel > I2C_TIMINGR_SCLDEL_MAX) || (ulSdaDel > I2C_TIMINGR_SDADEL_MAX) ||
+            ((int32_t)(ulSdaDel * ulTPresc + ulClk) > ((int32_t)(pxSpec->usVdDatMax * 1000)
+                - (int32_t)(ulRise + ulAfMax + ulDnf + 4 * ulClk))))
+        {
+            continue;
+        }
+
+        /* Minimal SCL phases, the data delays have to fit in the low phase */
+        ulSclL = I2C_prvDivCeil((int32_t)(pxSpec->usLowMin  * 1000 - ulSync), ulTPresc);
+        ulSclH = I2C_prvDivCeil((int32_t)(pxSpec->usHighMin * 1000 - ulSync), ulTPresc);
+        if (ulSclL < (ulSclDel + ulSdaDel + 2))
+        {   ulSclL = ulSclDel + ulSdaDel + 2; }
+        if (ulSclH == 0)
+        {   ulSclH = 1; }
+
+        /* The kernel clock has to be sufficiently fast: tLOW > 4 * tI2CCLK */
+        if ((ulSclL * ulTPresc) <= (4 * ulClk))
+        {
+            continue;
+        }
 
-        if (ulScl > (ulOffset + (ulLimit * ulScaler)))
+        /* tSCL = tSYNC1 + tSYNC2 + (SCLL + 1 + SCLH + 1) * tPRESC + tr + tf,
+         * the bus frequency must not exceed the target */
+        ulSclSum = I2C_prvDivCeil((int32_t)(ulTarget - 2 * ulSync - ulRise - ulFall), ulTPresc);
+        if (ulSclSum > (ulSclL + ulSclH))
         {
-            ulTSetUp = ulLimit;
-            ulScl -= ulTSetUp;
+            /* Extend the phases evenly, with the low phase taking precedence */
+            ulSclSum -= ulSclL + ulSclH;
+            ulSclL += (ulSclSum + 1) / 2;
+            ulSclH += ulSclSum / 2;
         }
-        else if (ulScl >= (ulOffset + (2 * ulScaler)))
+        if ((ulSclL > I2C_TIMINGR_SCL_MAX) || (ulSclH > I2C_TIMINGR_SCL_MAX))
         {
-            ulTSetUp = (ulScl - ulOffset) / ulScaler;
-            ulScl -= ulTSetUp;
+            continue;
+        }
+
+        /* Keep the setting that is the closest to the target */
+        ulScl = 2 * ulSync + (ulSclL + ulSclH) * ulTPresc + ulRise + ulFall;
+        if ((ulBestScl == 0) || (ulScl < ulBestScl))
+        {
+            ulBestScl = ulScl;
+            ulTimingR = (ulPresc         << I2C_TIMINGR_PRESC_Pos)
+                      | (ulSclDel        << I2C_TIMINGR_SCLDEL_Pos)
+                      | (ulSdaDel        << I2C_TIMINGR_SDADEL_Pos)
+                      | ((ulSclH - 1)    << I2C_TIMINGR_SCLH_Pos)
+                      | ((ulSclL - 1)    << I2C_TIMINGR_SCLL_Pos);
+
+            if (ulScl <= ulTarget)
+            {   break; }
         }
     }
-#endif
 
-    pxI2C->Inst->TIMINGR.b.SCLH   = ulScl - 1;
-    pxI2C->Inst->TIMINGR.b.SCLDEL = ulTSetUp - 1;
-    pxI2C->Inst->TIMINGR.b.SDADEL = 0;
+    /* If the requirements cannot be met, the slowest setting is applied */
+    pxI2C->Inst->TIMINGR.w = ulTimingR;
+
+    return (ulBestScl != 0) ? 1000000000 / (ulBestScl / 1000) : 0;
 }
 
 /* Clears the TXIS flag and subsequently the TXDR */
@@ -163,9 +266,9 @@ static void I2C_prvStopDMA(I2C_HandleType* pxI2C)
         /* Only one DMA can be active at a time */
         if ((ulCR1 & I2C_CR1_TXDMAEN) != 0)
         {
-            /* If TXIS isn't set, there's a byte data loaded
+            /* If TXE isn't set, there's a byte data loaded
              * in TXDR that isn't sent */
-            usLenCorr = 1 - I2C_REG_BIT(pxI2C, ISR, TXIS);
+            usLenCorr = 1 - I2C_FLAG_STATUS(pxI2C, TXE);
             pxDMA = pxI2C->DMA.Transmit;
         }
         else
@@ -408,6 +511,13 @@ static void I2C_prvMasterSetCmdStage(I2C_HandleType * pxI2C)
     I2C_prvSetTransfer(pxI2C, I2C_START_WRITE, pxI2C->Transfers.pMaster->CmdSize);
 }
 
+/* Returns the end of the master data stage: STOP for the last transfer,
+ * repeated START is used to chain the transfers of a batch */
+static I2C_RequestType I2C_prvMasterEndRequest(I2C_HandleType * pxI2C)
+{
+    return (pxI2C->Batch.Count > 1) ? I2C_NOSTOP : I2C_AUTOSTOP;
+}
+
 /* Sets the handle context to transfer the data */
 static void I2C_prvMasterSetDataStage(I2C_HandleType * pxI2C)
 {
@@ -415,11 +525,11 @@ static void I2C_prvMasterSetDataStage(I2C_HandleType * pxI2C)
 
     if (pxI2C->Transfers.pMaster->Direction == I2C_DIRECTION_WRITE)
     {
-        eRequest = I2C_START_WRITE_AUTOSTOP;
+        eRequest = I2C_START_WRITE | I2C_prvMasterEndRequest(pxI2C);
     }
     else
     {
-        eRequest = I2C_START_READ_AUTOSTOP;
+        eRequest = I2C_START_READ | I2C_prvMasterEndRequest(pxI2C);
     }
 
     /* Set stream context to data */
@@ -615,6 +725,586 @@ static XPD_ReturnType I2C_prvReceiveDMA(I2C_HandleType * pxI2C, uint8_t * pucDat
     return eResult;
 }
 
+/* Returns the data stage DMA and data register of the current master transfer */
+static DMA_HandleType * I2C_prvMasterDataDMA(I2C_HandleType * pxI2C, void ** ppvRegister)
+{
+    if (pxI2C->Transfers.pMaster->Direction == I2C_DIRECTION_WRITE)
+    {
+        *ppvRegister = (void*)&pxI2C->Inst->TXDR;
+        return pxI2C->DMA.Transmit;
+    }
+    else
+    {
+        *ppvRegister = (void*)&pxI2C->Inst->RXDR;
+        return pxI2C->DMA.Receive;
+    }
+}
+
+/* Sets up the DMA for the data stage of a batched transfer, the progress is tracked by the I2C events */
+static XPD_ReturnType I2C_prvMasterBatchDMA(I2C_HandleType * pxI2C, uint16_t usLength)
+{
+    XPD_ReturnType eResult;
+    void * pvRegister;
+    DMA_HandleType * pxDMA = I2C_prvMasterDataDMA(pxI2C, &pvRegister);
+
+#ifdef __XPD_DMA_ERROR_DETECT
+    eResult = DMA_eStart_IT(pxDMA, pvRegister, pxI2C->Stream.buffer, usLength);
+
+    if (eResult == XPD_OK)
+    {
+        pxDMA->Owner = pxI2C;
+        pxDMA->Callbacks.Complete = NULL;
+        pxDMA->Callbacks.Error    = I2C_prvDmaErrorRedirect;
+    }
+#else
+    eResult = DMA_eStart(pxDMA, pvRegister, pxI2C->Stream.buffer, usLength);
+#endif
+
+    return eResult;
+}
+
+/* Starts the current transfer of the batch */
+static XPD_ReturnType I2C_prvMasterBatchStart(I2C_HandleType * pxI2C)
+{
+    XPD_ReturnType eResult = XPD_OK;
+    const I2C_TransferType * pxTransfer = pxI2C->Transfers.pMaster;
+    uint32_t ulITs = I2C_MASTER_BATCH_ITS;
+
+    I2C_RESET_ERRORS(pxI2C);
+    pxI2C->DataCtrlBits = 0;
+
+    /* The data stage DMA is set up in advance, its requests are only enabled for the data stage.
+     * A single DMA covers the whole data stage, the NBYTES reloads don't interrupt it */
+    if (pxTransfer->Length > 0)
+    {
+        pxI2C->Stream.buffer = pxTransfer->Data;
+        eResult = I2C_prvMasterBatchDMA(pxI2C, pxTransfer->Length);
+
+        pxI2C->DataCtrlBits = (pxTransfer->Direction == I2C_DIRECTION_WRITE) ?
+                I2C_CR1_TXDMAEN : I2C_CR1_RXDMAEN;
+    }
+
+    if (eResult == XPD_OK)
+    {
+        pxI2C->Inst->CR2.b.SADD = pxTransfer->SlaveAddress_10bit;
+
+        if (pxTransfer->CmdSize > 0)
+        {
+            /* Command is transferred by the TXIS interrupt */
+            ulITs |= I2C_CR1_TXIE;
+            I2C_prvMasterSetCmdStage(pxI2C);
+        }
+        else
+        {
+            ulITs |= pxI2C->DataCtrlBits;
+            I2C_prvMasterSetDataStage(pxI2C);
+        }
+
+        pxI2C->Inst->CR1.w = (pxI2C->Inst->CR1.w &
+                ~(I2C_CR1_TXIE | I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN)) | ulITs;
+    }
+
+    return eResult;
+}
+
+/* Records the result of the current batch transfer and continues with the next one */
+static void I2C_prvMasterBatchNext(I2C_HandleType * pxI2C)
+{
+    *pxI2C->Batch.pStatus++ = pxI2C->Errors;
+    pxI2C->Batch.Count--;
+
+    while (pxI2C->Batch.Count > 0)
+    {
+        pxI2C->Transfers.pMaster++;
+
+        if (I2C_prvMasterBatchStart(pxI2C) == XPD_OK)
+        {
+            return;
+        }
+
+        /* The DMA is occupied, skip the transfer */
+        *pxI2C->Batch.pStatus++ = I2C_ERROR_DMA;
+        pxI2C->Batch.Count--;
+    }
+
+    /* If the bus is still held after the last chained transfer, release it */
+    if (I2C_FLAG_STATUS(pxI2C, TC) != 0)
+    {
+        I2C_REG_BIT(pxI2C, CR2, STOP) = 1;
+    }
+
+    /* Clear master transfer */
+    I2C_prvClearTransfer(pxI2C);
+
+    /* Disable interrupts as the batch is over */
+    CLEAR_BIT(pxI2C->Inst->CR1.w, I2C_MASTER_BATCH_ITS |
+            I2C_CR1_TXIE | I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN);
+
+    if (I2C_REG_BIT(pxI2C, CR1, ADDRIE) != 0)
+    {
+        /* Switch to slave IRQHandler if address is listened to */
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler;
+    }
+
+    XPD_SAFE_CALLBACK(pxI2C->Callbacks.MasterComplete, pxI2C);
+}
+
+/* Master mode batch EV signals interrupt handler */
+static void I2C_prvMasterBatchIRQHandler(I2C_HandleType * pxI2C)
+{
+    /* Interrupt enable and status bits are at the same position */
+    uint32_t ulCR1 = pxI2C->Inst->CR1.w;
+    uint32_t ulISR = pxI2C->Inst->ISR.w;
+    uint32_t ulIT = ulCR1 & ulISR;
+
+    /* Transmit register empty in command stage */
+    if ((ulIT & I2C_ISR_TXIS) != 0)
+    {
+        /* Write data to TXDR */
+        pxI2C->Inst->TXDR = *(uint8_t*)pxI2C->Stream.buffer++;
+        pxI2C->Stream.size--;
+    }
+    /* Transfer reload complete */
+    else if ((ulIT & I2C_ISR_TCR) != 0)
+    {
+        if ((ulCR1 & I2C_CR1_TXIE) != 0)
+        {
+            /* Request next NBYTES command transfer */
+            I2C_prvSetTransfer(pxI2C, I2C_NOSTOP, pxI2C->Stream.length);
+        }
+        else
+        {
+            /* Request next NBYTES data transfer, the DMA continues with the same stream */
+            pxI2C->Stream.buffer += pxI2C->Stream.size;
+            I2C_prvSetTransfer(pxI2C, I2C_prvMasterEndRequest(pxI2C), pxI2C->Stream.length);
+        }
+    }
+    /* Transfer complete */
+    else if ((ulIT & I2C_ISR_TC) != 0)
+    {
+        if ((ulCR1 & I2C_CR1_TXIE) != 0)
+        {
+            /* Change to data stage with repeated START */
+            pxI2C->Inst->CR1.w = (ulCR1 & ~I2C_CR1_TXIE) | pxI2C->DataCtrlBits;
+
+            /* Set stream context to data */
+            I2C_prvMasterSetDataStage(pxI2C);
+        }
+        else
+        {
+            /* Data stage is complete, the next transfer is started with repeated START */
+            I2C_prvMasterBatchNext(pxI2C);
+        }
+    }
+
+    /* STOP generated by autoend or NACK */
+    if ((ulIT & I2C_ISR_STOPF) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, STOP);
+
+        /* Check if NACK error triggered it */
+        if ((ulISR & I2C_ISR_NACKF) != 0)
+        {
+            void * pvRegister;
+
+            I2C_FLAG_CLEAR(pxI2C, NACK);
+
+            pxI2C->Errors |= I2C_ERROR_NACK;
+
+            /* Flush TX register */
+            I2C_prvFlushTx(pxI2C);
+
+            /* Release the DMA that is set up for the data stage */
+            if (pxI2C->DataCtrlBits != 0)
+            {
+                DMA_vStop_IT(I2C_prvMasterDataDMA(pxI2C, &pvRegister));
+            }
+        }
+
+        pxI2C->Inst->CR1.w &= ~(I2C_CR1_TXIE | I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN);
+
+        I2C_prvMasterBatchNext(pxI2C);
+    }
+}
+
+#define I2C_POLL_STOP_TIMEOUT       10
+
+/* Arms the DMAs for the next polling sequence, which is started by the next timer update */
+static void I2C_prvPollArm(I2C_HandleType * pxI2C)
+{
+    const I2C_TransferType * pxTransfer = pxI2C->Transfers.pMaster;
+    TIM_HandleType * pxTIM = pxI2C->Poll.pTIM;
+
+    /* The sample is received to the back buffer */
+    (void) DMA_eStart(pxI2C->DMA.Receive, (void*)&pxI2C->Inst->RXDR,
+            pxTransfer->Data + (pxTransfer->Length * (pxI2C->Poll.Front ^ 1)), pxTransfer->Length);
+
+    if (pxTransfer->CmdSize > 0)
+    {
+        /* Flush any leftover transmit data */
+        I2C_FLAG_CLEAR(pxI2C, TXE);
+
+        (void) DMA_eStart(pxI2C->DMA.Transmit, (void*)&pxI2C->Inst->TXDR,
+                I2C_TRANSFER_CMD(pxTransfer), pxTransfer->CmdSize);
+    }
+
+    /* Drop the request of a period missed by the previous sequence */
+    TIM_DMA_DISABLE(pxTIM, U);
+    (void) DMA_eStart(pxTIM->DMA.Update, (void*)&pxI2C->Inst->CR2.w, &pxI2C->Poll.Start, 1);
+    TIM_DMA_ENABLE(pxTIM, U);
+}
+
+/* Timed polling EV signals interrupt handler */
+static void I2C_prvPollIRQHandler(I2C_HandleType * pxI2C)
+{
+    uint32_t ulISR = pxI2C->Inst->ISR.w;
+
+    /* Register address is sent, read the sample with repeated START */
+    if ((ulISR & I2C_ISR_TC) != 0)
+    {
+        I2C_prvSetTransfer(pxI2C, I2C_START_READ_AUTOSTOP, pxI2C->Transfers.pMaster->Length);
+    }
+
+    /* End of sequence */
+    if ((ulISR & I2C_ISR_STOPF) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, STOP);
+
+        /* The sensor didn't respond, the STOP was generated automatically */
+        if ((ulISR & I2C_ISR_NACKF) != 0)
+        {
+            I2C_FLAG_CLEAR(pxI2C, NACK);
+            pxI2C->Errors |= I2C_ERROR_NACK;
+
+            I2C_prvPollArm(pxI2C);
+
+            XPD_SAFE_CALLBACK(pxI2C->Callbacks.Error, pxI2C);
+        }
+        else if (DMA_usGetStatus(pxI2C->DMA.Receive) == 0)
+        {
+            /* Publish the new sample, then start receiving to the other buffer */
+            pxI2C->Poll.Front ^= 1;
+            pxI2C->Poll.Sequence++;
+
+            I2C_prvPollArm(pxI2C);
+
+            XPD_SAFE_CALLBACK(pxI2C->Callbacks.MasterComplete, pxI2C);
+        }
+        else
+        {
+            I2C_prvPollArm(pxI2C);
+        }
+    }
+}
+
+#define I2C_REGMAP_PADDING          0xFF
+
+#ifdef __XPD_I2C_ERROR_DETECT
+#define I2C_SLAVE_REGMAP_ITS        (I2C_CR1_ADDRIE | I2C_CR1_STOPIE | I2C_CR1_ERRIE)
+#else
+#define I2C_SLAVE_REGMAP_ITS        (I2C_CR1_ADDRIE | I2C_CR1_STOPIE)
+#endif
+
+/* Finds the register map region containing the register address */
+static I2C_RegionType * I2C_prvRegMapFind(I2C_HandleType * pxI2C, uint16_t usAddress)
+{
+    I2C_RegionType * pxRegion = pxI2C->RegMap.Regions;
+    uint8_t ucCount;
+
+    for (ucCount = pxI2C->RegMap.Count; ucCount > 0; ucCount--, pxRegion++)
+    {
+        if ((uint16_t)(usAddress - pxRegion->Address) < pxRegion->Size)
+        {
+            return pxRegion;
+        }
+    }
+    return NULL;
+}
+
+/* Ends the data phase: advances the register pointer with the transferred amount,
+ * and applies the deferred bank swap of the read region */
+static void I2C_prvRegMapEndData(I2C_HandleType * pxI2C)
+{
+    I2C_RegionType * pxReading = pxI2C->RegMap.pReading;
+    uint32_t ulDmaReading = I2C_REG_BIT(pxI2C, CR1, TXDMAEN);
+
+    I2C_prvStopDMA(pxI2C);
+
+    if (pxI2C->Transfers.Slave.Data == NULL)
+    {
+        pxI2C->Transfers.Slave.Length = 0;
+    }
+    else
+    {
+        /* Without an ongoing DMA the last region byte is still in TXDR
+         * if the master ended the read before it, and no padding followed */
+        if ((pxReading != NULL) && (ulDmaReading == 0) &&
+            (pxI2C->Stream.length == 0) && (I2C_FLAG_STATUS(pxI2C, TXE) == 0))
+        {
+            pxI2C->Stream.buffer--;
+        }
+
+        pxI2C->Transfers.Slave.Length = (uint8_t*)pxI2C->Stream.buffer - pxI2C->Transfers.Slave.Data;
+
+        pxI2C->RegMap.Address += pxI2C->Transfers.Slave.Length;
+        pxI2C->RegMap.pActive = I2C_prvRegMapFind(pxI2C, pxI2C->RegMap.Address);
+    }
+    pxI2C->Stream.size = 0;
+
+    if (pxReading != NULL)
+    {
+        pxI2C->RegMap.pReading = NULL;
+
+        if (pxReading->Pending != 0)
+        {
+            pxReading->Front ^= 1;
+            pxReading->Pending = 0;
+        }
+    }
+}
+
+/* The data phase reached the end of the region */
+static void I2C_prvRegMapDmaRedirect(void * pxDMA)
+{
+    I2C_HandleType * pxI2C = (I2C_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+
+    pxI2C->Stream.buffer += pxI2C->Stream.size;
+    pxI2C->Stream.size = 0;
+
+    if (I2C_REG_BIT(pxI2C, CR1, TXDMAEN) != 0)
+    {
+        /* Continue with padding */
+        pxI2C->Inst->CR1.w = (pxI2C->Inst->CR1.w & ~I2C_CR1_TXDMAEN) | I2C_CR1_TXIE;
+    }
+    else
+    {
+        /* Reject data past the region */
+        I2C_REG_BIT(pxI2C, CR1, RXDMAEN) = 0;
+        I2C_REG_BIT(pxI2C, CR2, NACK) = 1;
+    }
+}
+
+/* Sets up the DMA data phase on the active region, returns the memory address of the data */
+static uint8_t * I2C_prvRegMapStartDMA(I2C_HandleType * pxI2C, DMA_HandleType * pxDMA,
+        void * pvRegister, uint8_t ucBank)
+{
+    I2C_RegionType * pxRegion = pxI2C->RegMap.pActive;
+    uint16_t usOffset = pxI2C->RegMap.Address - pxRegion->Address;
+    uint8_t * pucData = pxRegion->Bank[ucBank] + usOffset;
+
+    /* Offset into the region until its end */
+    pxI2C->Stream.buffer = pucData;
+    pxI2C->Stream.size   = pxRegion->Size - usOffset;
+    pxI2C->Stream.length = 0;
+
+    if (DMA_eStart_IT(pxDMA, pvRegister, pucData, pxI2C->Stream.size) != XPD_OK)
+    {
+        pxI2C->Stream.size = 0;
+        pucData = NULL;
+    }
+    else
+    {
+        pxDMA->Owner = pxI2C;
+        pxDMA->Callbacks.Complete = I2C_prvRegMapDmaRedirect;
+#ifdef __XPD_DMA_ERROR_DETECT
+        pxDMA->Callbacks.Error    = I2C_prvDmaErrorRedirect;
+#endif
+    }
+    return pucData;
+}
+
+/* Starts writing the active region by the master right after the register address */
+static void I2C_prvRegMapStartWrite(I2C_HandleType * pxI2C)
+{
+    I2C_RegionType * pxRegion = pxI2C->RegMap.pActive;
+
+    /* Only single buffered writable regions accept data */
+    if ((pxRegion != NULL) && (pxRegion->Access == I2C_REGION_READ_WRITE) &&
+        (pxRegion->Bank[1] == NULL) &&
+        (I2C_prvRegMapStartDMA(pxI2C, pxI2C->DMA.Receive, (void*)&pxI2C->Inst->RXDR, 0) != NULL))
+    {
+        pxI2C->Transfers.Slave.Data = pxI2C->Stream.buffer;
+        I2C_REG_BIT(pxI2C, CR1, RXDMAEN) = 1;
+    }
+    else
+    {
+        /* Reject any data */
+        I2C_REG_BIT(pxI2C, CR2, NACK) = 1;
+    }
+}
+
+/* Preloads the read data phase at the register pointer in advance: the first byte is written
+ * to TXDR and the DMA is set up for the rest of the region, so that the read address match
+ * only has to enable the DMA requests */
+static void I2C_prvRegMapArmRead(I2C_HandleType * pxI2C)
+{
+    I2C_RegionType * pxRegion = pxI2C->RegMap.pActive;
+
+    /* Nothing to do if the register pointer is already preloaded */
+    if ((pxI2C->RegMap.Armed == 0) || (pxI2C->RegMap.ArmedAddress != pxI2C->RegMap.Address))
+    {
+        /* Release the previous preload */
+        if (pxI2C->RegMap.Armed != 0)
+        {
+            DMA_vStop_IT(pxI2C->DMA.Transmit);
+        }
+
+        /* Flush any stale transmit data */
+        I2C_FLAG_CLEAR(pxI2C, TXE);
+
+        pxI2C->RegMap.Armed = 1;
+        pxI2C->RegMap.ArmedAddress = pxI2C->RegMap.Address;
+        pxI2C->RegMap.pArmed = NULL;
+
+        if (pxRegion != NULL)
+        {
+            uint16_t usOffset = pxI2C->RegMap.Address - pxRegion->Address;
+            uint8_t * pucData = pxRegion->Bank[pxRegion->Front] + usOffset;
+
+            /* The rest of the region is moved by DMA */
+            if ((usOffset == (pxRegion->Size - 1)) ||
+                (DMA_eStart_IT(pxI2C->DMA.Transmit, (void*)&pxI2C->Inst->TXDR,
+                        pucData + 1, pxRegion->Size - usOffset - 1) == XPD_OK))
+            {
+                pxI2C->DMA.Transmit->Owner = pxI2C;
+                pxI2C->DMA.Transmit->Callbacks.Complete = I2C_prvRegMapDmaRedirect;
+#ifdef __XPD_DMA_ERROR_DETECT
+                pxI2C->DMA.Transmit->Callbacks.Error    = I2C_prvDmaErrorRedirect;
+#endif
+                pxI2C->RegMap.pArmed = pxRegion;
+                pxI2C->Inst->TXDR = *pucData;
+            }
+        }
+
+        if (pxI2C->RegMap.pArmed == NULL)
+        {
+            /* Unmapped registers are read as padding */
+            pxI2C->Inst->TXDR = I2C_REGMAP_PADDING;
+        }
+    }
+}
+
+/* Starts reading the preloaded data phase by the master */
+static void I2C_prvRegMapStartRead(I2C_HandleType * pxI2C)
+{
+    I2C_RegionType * pxRegion;
+
+    /* The register pointer is only different from the preloaded one
+     * if the master has written data before the repeated START */
+    I2C_prvRegMapArmRead(pxI2C);
+
+    pxRegion = pxI2C->RegMap.pArmed;
+    pxI2C->RegMap.Armed = 0;
+    pxI2C->Stream.length = 0;
+
+    if (pxRegion != NULL)
+    {
+        uint16_t usOffset = pxI2C->RegMap.Address - pxRegion->Address;
+        uint8_t * pucData = pxRegion->Bank[pxRegion->Front] + usOffset;
+
+        /* The front bank is locked until the end of the read */
+        pxI2C->RegMap.pReading = pxRegion;
+        pxI2C->Transfers.Slave.Data = pucData;
+        pxI2C->Stream.buffer = pucData + 1;
+        pxI2C->Stream.size   = pxRegion->Size - usOffset - 1;
+
+        /* The application may have changed single buffered memory since the preload */
+        if (pxRegion->Bank[1] == NULL)
+        {
+            I2C_FLAG_CLEAR(pxI2C, TXE);
+            pxI2C->Inst->TXDR = *pucData;
+        }
+    }
+
+    if (pxI2C->Stream.size > 0)
+    {
+        I2C_REG_BIT(pxI2C, CR1, TXDMAEN) = 1;
+    }
+    else
+    {
+        /* Beyond the region padding is sent */
+        I2C_IT_ENABLE(pxI2C, TX);
+    }
+}
+
+/* Slave register map EV signals interrupt handler */
+static void I2C_prvRegMapIRQHandler(I2C_HandleType * pxI2C)
+{
+    /* Interrupt enable and status bits are at the same position */
+    uint32_t ulCR1 = pxI2C->Inst->CR1.w;
+    uint32_t ulISR = pxI2C->Inst->ISR.w;
+    uint32_t ulIT = ulCR1 & ulISR;
+
+    /* Register address byte received, MSB first */
+    if ((ulIT & I2C_ISR_RXNE) != 0)
+    {
+        pxI2C->RegMap.Address = (pxI2C->RegMap.Address << 8) | pxI2C->Inst->RXDR;
+        pxI2C->Stream.size--;
+
+        if (pxI2C->Stream.size == 0)
+        {
+            pxI2C->Inst->CR1.w = ulCR1 & ~I2C_CR1_RXIE;
+
+            /* Resolve the region now, so the next address match only has to start the DMA */
+            pxI2C->RegMap.pActive = I2C_prvRegMapFind(pxI2C, pxI2C->RegMap.Address);
+
+            /* Any further bytes are written to the region */
+            I2C_prvRegMapStartWrite(pxI2C);
+
+            /* A repeated START reads from the new register pointer */
+            I2C_prvRegMapArmRead(pxI2C);
+        }
+    }
+    /* Transmit register empty outside of the readable region */
+    else if ((ulIT & I2C_ISR_TXIS) != 0)
+    {
+        pxI2C->Inst->TXDR = I2C_REGMAP_PADDING;
+        pxI2C->Stream.length++;
+    }
+    /* Slave address match */
+    else if ((ulIT & I2C_ISR_ADDR) != 0)
+    {
+        /* Repeated START ends the previous data phase */
+        I2C_prvRegMapEndData(pxI2C);
+        pxI2C->Inst->CR1.w &= ~(I2C_CR1_TXIE | I2C_CR1_RXIE);
+
+        I2C_prvGetTransferInfo(pxI2C);
+        pxI2C->Transfers.Slave.Data = NULL;
+
+        if (pxI2C->Transfers.Slave.Direction == I2C_DIRECTION_WRITE)
+        {
+            /* The register address is received first */
+            pxI2C->RegMap.Address = 0;
+            pxI2C->Stream.size = pxI2C->RegMap.AddressSize;
+            I2C_IT_ENABLE(pxI2C, RX);
+        }
+        else
+        {
+            I2C_prvRegMapStartRead(pxI2C);
+        }
+
+        /* Clear ADDR flag to start data transfer */
+        I2C_FLAG_CLEAR(pxI2C, ADDR);
+    }
+
+    /* STOP */
+    if ((ulIT & I2C_ISR_STOPF) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, STOP);
+
+        I2C_prvRegMapEndData(pxI2C);
+        pxI2C->Inst->CR1.w &= ~(I2C_CR1_TXIE | I2C_CR1_RXIE);
+
+        I2C_prvFlushTx(pxI2C);
+
+        /* Transfers.Slave.Data and Length describe the accessed memory */
+        XPD_SAFE_CALLBACK(pxI2C->Callbacks.SlaveComplete, pxI2C);
+
+        /* Prepare the next read */
+        I2C_prvRegMapArmRead(pxI2C);
+    }
+}
+
 /** @defgroup I2C_Common_Exported_Functions I2C Common Exported Functions
  * @{ */
 
@@ -631,11 +1321,11 @@ void I2C_vInit(I2C_HandleType * pxI2C, const I2C_InitType * pxConfig)
     /* disable peripheral */
     pxI2C->Inst->CR1.w = 0;
 
-    I2C_prvSetTiming(pxI2C, pxConfig->BusFreq_Hz);
+    pxI2C->BusFreq_Hz = I2C_prvSetTiming(pxI2C, pxConfig);
 
-    /* Slave configuration */
+    /* Input filters and slave configuration */
     MODIFY_REG(pxI2C->Inst->CR1.w,
-            I2C_CR1_GCEN | I2C_CR1_NOSTRETCH,
+            I2C_CR1_DNF | I2C_CR1_ANFOFF | I2C_CR1_GCEN | I2C_CR1_NOSTRETCH,
             pxConfig->wCfg << 8);
 
     /* Set Address 1 */
@@ -670,6 +1360,7 @@ void I2C_vInit(I2C_HandleType * pxI2C, const I2C_InitType * pxConfig)
     }
 
     pxI2C->IRQHandler = NULL;
+    pxI2C->Batch.Count = 0;
     I2C_prvEnable(pxI2C);
 
     /* Dependencies initialization */
@@ -764,6 +1455,13 @@ void I2C_vIRQHandler_ER(I2C_HandleType * pxI2C)
 
         if (pxI2C->Errors != ePrevErrors)
         {
+            /* The aborted polling sequence is restarted with the next period */
+            if ((pxI2C->IRQHandler == (XPD_HandleCallbackType)I2C_prvPollIRQHandler) &&
+                ((ulISR & (I2C_ISR_BERR | I2C_ISR_ARLO)) != 0))
+            {
+                I2C_prvPollArm(pxI2C);
+            }
+
             XPD_SAFE_CALLBACK(pxI2C->Callbacks.Error, pxI2C);
         }
     }
@@ -777,6 +1475,12 @@ void I2C_vStop_DMA(I2C_HandleType *pxI2C)
 {
     I2C_prvStopDMA(pxI2C);
 
+    /* A running batch is finished with the current transfer */
+    if (pxI2C->Batch.Count > 1)
+    {
+        pxI2C->Batch.Count = 1;
+    }
+
     /* Generate STOP in master mode, NACK in slave mode */
     SET_BIT(pxI2C->Inst->CR2.w, I2C_CR2_STOP | I2C_CR2_NACK);
 }
@@ -943,6 +1647,211 @@ XPD_ReturnType I2C_eMasterTransfer_DMA(I2C_HandleType * pxI2C, const I2C_Transfe
     return eResult;
 }
 
+/**
+ * @brief Performs a batch of I2C transfers as master back to back, using the EV interrupt stack
+ *        and DMA for the data stages. The transfers are chained by repeated START conditions,
+ *        only the last one is terminated by STOP. The MasterComplete callback is only called
+ *        when the whole batch is finished.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param paxTransfers: array of transfer contexts, which is processed in order
+ * @param usCount: the number of transfers in the batch
+ * @param paeStatus: array of the same size where the error status of each transfer is stored
+ *                   (@ref I2C_ERROR_NONE for a successful transfer)
+ * @return ERROR if the batch is empty, BUSY if DMA is in use, OK if the batch is started
+ * @note A NACK-ed transfer is terminated by STOP, the batch continues with the next transfer.
+ *       @ref I2C_vStop_DMA finishes the batch after the current transfer, in this case
+ *       the status of the remaining transfers is left unchanged.
+ */
+XPD_ReturnType I2C_eMasterBatch_DMA(I2C_HandleType * pxI2C, const I2C_TransferType * paxTransfers,
+                                    uint16_t usCount, I2C_ErrorType * paeStatus)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if (usCount > 0)
+    {
+        /* Initialize: set batch, first transfer */
+        pxI2C->Transfers.pMaster = paxTransfers;
+        pxI2C->Batch.pStatus = paeStatus;
+        pxI2C->Batch.Count = usCount;
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvMasterBatchIRQHandler;
+
+        eResult = I2C_prvMasterBatchStart(pxI2C);
+
+        if (eResult != XPD_OK)
+        {
+            pxI2C->Batch.Count = 0;
+        }
+    }
+
+    return eResult;
+}
+
+
+/**
+ * @brief Starts polling a sensor autonomously, paced by the update events of a timer.
+ *        At each timer update, a DMA request of the timer starts the prepared transfer:
+ *        the register address (transfer command) is written by DMA, followed by the
+ *        sample read to a double buffer by DMA. The next sequence is armed from the I2C interrupt
+ *        at the end of the current one, so the sampling period is free of interrupt latency jitter.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxTIM: pointer to the pacing TIM handle structure (initialized with the sampling period)
+ * @param pxTransfer: the read transfer, its data buffer has to fit two samples (2 * Length)
+ * @return ERROR if the sample size is invalid, BUSY if a DMA is in use, OK if polling is started
+ * @note  The timer's Update DMA has to be configured in normal mode, with word sized transfers
+ *        towards the peripheral. The I2C DMAs have to be configured in normal mode.
+ * @note  Each published sample is signalled by the MasterComplete callback, and can be read
+ *        with @ref I2C_ulPollSnapshot at any time. When the sensor doesn't respond,
+ *        the Error callback is called, and polling continues with the next period.
+ *        A sequence which doesn't finish within the period skips the following update event.
+ * @note  With @ref __XPD_I2C_ERROR_DETECT the bus errors and lost arbitrations are also signalled
+ *        by the Error callback, and the aborted sequence is restarted with the next period.
+ */
+XPD_ReturnType I2C_ePollStart_DMA(I2C_HandleType * pxI2C, TIM_HandleType * pxTIM,
+        const I2C_TransferType * pxTransfer)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    I2C_RequestType eRequest;
+    uint16_t usLength;
+
+    /* The sample has to fit a single read request */
+    if ((pxTransfer->Length > 0) && (pxTransfer->Length <= I2C_NBYTES_MASK))
+    {
+        eResult = DMA_eStart(pxI2C->DMA.Receive, (void*)&pxI2C->Inst->RXDR,
+                pxTransfer->Data + pxTransfer->Length, pxTransfer->Length);
+    }
+
+    if ((eResult == XPD_OK) && (pxTransfer->CmdSize > 0))
+    {
+        eResult = DMA_eStart(pxI2C->DMA.Transmit, (void*)&pxI2C->Inst->TXDR,
+                I2C_TRANSFER_CMD(pxTransfer), pxTransfer->CmdSize);
+
+        if (eResult != XPD_OK)
+        {
+            DMA_vStop(pxI2C->DMA.Receive);
+        }
+    }
+
+    if (eResult == XPD_OK)
+    {
+        I2C_RESET_ERRORS(pxI2C);
+
+        /* Set transfer context */
+        pxI2C->Transfers.pMaster = pxTransfer;
+        pxI2C->Poll.pTIM = pxTIM;
+        pxI2C->Poll.Front = 0;
+        pxI2C->Poll.Sequence = 0;
+
+        /* The sequence starts with the command write if present, otherwise with the read */
+        if (pxTransfer->CmdSize > 0)
+        {
+            eRequest = I2C_START_WRITE;
+            usLength = pxTransfer->CmdSize;
+        }
+        else
+        {
+            eRequest = I2C_START_READ_AUTOSTOP;
+            usLength = pxTransfer->Length;
+        }
+        pxI2C->Poll.Start = (pxI2C->Inst->CR2.w & I2C_CR2_ADD10) | pxTransfer->SlaveAddress_10bit |
+                (usLength << I2C_CR2_NBYTES_Pos) | eRequest;
+
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvPollIRQHandler;
+        SET_BIT(pxI2C->Inst->CR1.w, I2C_MASTER_POLL_ITS | I2C_CR1_RXDMAEN |
+                ((pxTransfer->CmdSize > 0) ? I2C_CR1_TXDMAEN : 0));
+
+        /* Flush any leftover transmit data */
+        I2C_FLAG_CLEAR(pxI2C, TXE);
+
+        /* Hand over the start to the timer */
+        TIM_DMA_DISABLE(pxTIM, U);
+        eResult = DMA_eStart(pxTIM->DMA.Update, (void*)&pxI2C->Inst->CR2.w, &pxI2C->Poll.Start, 1);
+        TIM_DMA_ENABLE(pxTIM, U);
+
+        if (eResult == XPD_OK)
+        {
+            TIM_vCounterStart(pxTIM);
+        }
+        else
+        {
+            I2C_vPollStop_DMA(pxI2C);
+        }
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Stops the timed polling.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @note  An ongoing sequence is ended on the bus with a STOP condition,
+ *        and its sample isn't published.
+ */
+void I2C_vPollStop_DMA(I2C_HandleType * pxI2C)
+{
+    TIM_HandleType * pxTIM = pxI2C->Poll.pTIM;
+
+    /* Stop pacing first */
+    TIM_vCounterStop(pxTIM);
+    TIM_DMA_DISABLE(pxTIM, U);
+    DMA_vStop(pxTIM->DMA.Update);
+
+    pxI2C->Inst->CR1.w &= ~I2C_MASTER_POLL_ITS;
+    pxI2C->IRQHandler = NULL;
+
+    /* Release the bus while the DMAs still serve the ongoing sequence */
+    if ((I2C_FLAG_STATUS(pxI2C, BUSY) != 0) || (I2C_REG_BIT(pxI2C, CR2, START) != 0))
+    {
+        uint32_t ulTimeout = I2C_POLL_STOP_TIMEOUT;
+
+        I2C_REG_BIT(pxI2C, CR2, STOP) = 1;
+        (void) XPD_eWaitForMatch(&pxI2C->Inst->ISR.w, I2C_ISR_STOPF, I2C_ISR_STOPF, &ulTimeout);
+    }
+    I2C_FLAG_CLEAR(pxI2C, STOP);
+    I2C_FLAG_CLEAR(pxI2C, NACK);
+
+    pxI2C->Inst->CR1.w &= ~(I2C_CR1_RXDMAEN | I2C_CR1_TXDMAEN);
+
+    DMA_vStop(pxI2C->DMA.Receive);
+    DMA_vStop(pxI2C->DMA.Transmit);
+}
+
+/**
+ * @brief Copies the latest published sample of the timed polling.
+ *        The copy is lock-free: it is retried when a new sample is published meanwhile,
+ *        so the polling is never blocked by the reader.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pucData: target buffer of the sample
+ * @return The sequence number of the copied sample, 0 if no sample has been published yet
+ */
+uint32_t I2C_ulPollSnapshot(I2C_HandleType * pxI2C, uint8_t * pucData)
+{
+    const I2C_TransferType * pxTransfer = pxI2C->Transfers.pMaster;
+    uint32_t ulSequence;
+
+    do
+    {
+        const uint8_t * pucFront;
+        uint16_t usIndex;
+
+        ulSequence = pxI2C->Poll.Sequence;
+        pucFront = pxTransfer->Data + (pxTransfer->Length * pxI2C->Poll.Front);
+
+        /* The sample is only read after the sequence number */
+        __DMB();
+
+        for (usIndex = 0; usIndex < pxTransfer->Length; usIndex++)
+        {
+            pucData[usIndex] = pucFront[usIndex];
+        }
+
+        /* The sequence number is only checked after the sample is read */
+        __DMB();
+    }
+    while (ulSequence != pxI2C->Poll.Sequence);
+
+    return ulSequence;
+}
+
 /** @} */
 
 /** @defgroup I2C_Slave_Exported_Functions I2C Slave Exported Functions
@@ -1150,4 +2059,92 @@ XPD_ReturnType I2C_eSlaveTransferData_DMA(I2C_HandleType * pxI2C)
 
 /** @} */
 
+/** @defgroup I2C_RegMap_Exported_Functions I2C Slave Register Map Exported Functions
+ * @{ */
+
+/**
+ * @brief Serves a register map as slave in interrupt mode. Write transfers start with
+ *        the register address (MSB first), which selects the region and offset of the following data,
+ *        while read transfers continue at the register pointer. The data phase is performed by DMA
+ *        directly from/to the region memory, the CPU is only involved at the register address reception,
+ *        the address matches and at STOP. The read at the register pointer is preloaded in advance,
+ *        so the read address match only enables the DMA requests.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param paxRegions: array of non-overlapping register regions
+ * @param ucCount: number of regions in the array
+ * @param ucAddressSize: size of the register address in bytes (1 or 2)
+ * @return ERROR if the register address size is invalid, OK otherwise
+ * @note  A transfer is limited to a single region: data written beyond the region or into
+ *        a read-only region is NACK-ed, while reading beyond the region or unmapped registers
+ *        returns 0xFF. At each STOP the @ref I2C_HandleType::Callbacks.SlaveComplete is called,
+ *        with @ref I2C_pxSlaveTransferInfo describing the accessed memory.
+ * @note  To serve the master without stretching the clock, the DMA channels should have
+ *        high priority, as each data byte is only moved by DMA.
+ */
+XPD_ReturnType I2C_eSlaveRegMap_IT(I2C_HandleType * pxI2C, I2C_RegionType * paxRegions,
+        uint8_t ucCount, uint8_t ucAddressSize)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if ((ucAddressSize == 1) || (ucAddressSize == 2))
+    {
+        I2C_RESET_ERRORS(pxI2C);
+
+        pxI2C->RegMap.Regions = paxRegions;
+        pxI2C->RegMap.Count = ucCount;
+        pxI2C->RegMap.AddressSize = ucAddressSize;
+        pxI2C->RegMap.Address = 0;
+        pxI2C->RegMap.pActive = I2C_prvRegMapFind(pxI2C, 0);
+        pxI2C->RegMap.pReading = NULL;
+        pxI2C->RegMap.Armed = 0;
+        pxI2C->Transfers.Slave.Data = NULL;
+
+        I2C_prvRegMapArmRead(pxI2C);
+
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvRegMapIRQHandler;
+        SET_BIT(pxI2C->Inst->CR1.w, I2C_SLAVE_REGMAP_ITS);
+
+        eResult = XPD_OK;
+    }
+    return eResult;
+}
+
+/**
+ * @brief Publishes the back bank of a double buffered region to the master.
+ *        If the master is currently reading the region, the swap is deferred until
+ *        the end of the read, so multi-byte values are always read consistently.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxRegion: pointer to the register region
+ * @note  The back bank is unavailable while the swap is deferred
+ *        (@ref I2C_pucRegionBackBank returns NULL).
+ */
+void I2C_vRegionPublish(I2C_HandleType * pxI2C, I2C_RegionType * pxRegion)
+{
+    if (pxRegion->Bank[1] != NULL)
+    {
+        XPD_ENTER_CRITICAL(pxI2C);
+
+        if (pxI2C->RegMap.pReading == pxRegion)
+        {
+            pxRegion->Pending = 1;
+        }
+        else
+        {
+            pxRegion->Front ^= 1;
+
+            /* The preloaded read has to follow the new front bank */
+            if ((pxI2C->RegMap.Armed != 0) && (pxI2C->RegMap.pArmed == pxRegion))
+            {
+                pxI2C->RegMap.Armed = 0;
+                DMA_vStop_IT(pxI2C->DMA.Transmit);
+                I2C_prvRegMapArmRead(pxI2C);
+            }
+        }
+
+        XPD_EXIT_CRITICAL(pxI2C);
+    }
+}
+
+/** @} */
+
 /** @} */
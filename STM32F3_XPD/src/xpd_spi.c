@@ -196,6 +196,75 @@ static void SPI_prvDmaTransmitReceiveRedirect(void * pxDMA)
     XPD_SAFE_CALLBACK(pxSPI->Callbacks.Receive, pxSPI);
 }
 
+/* Dummy frame for the timer-triggered sample readouts */
+static const uint16_t spi_usDummy = 0xFFFF;
+
+/* Timer channels whose compare DMA requests start the frames of a sample */
+static const TIM_ChannelType spi_aeTimedFrameChannels[] = { TIM_CH1, TIM_CH3, TIM_CH4 };
+
+#define SPI_TIMED_MAX_FRAMES    (sizeof(spi_aeTimedFrameChannels) / sizeof(spi_aeTimedFrameChannels[0]))
+
+#define SPI_TIMED_DMA_REQUESTS  (TIM_DIER_UDE | TIM_DIER_CC1DE | TIM_DIER_CC2DE | \
+                                 TIM_DIER_CC3DE | TIM_DIER_CC4DE)
+
+/* Number of samples in the timed sampling buffer */
+#define SPI_TIMED_SAMPLES(HANDLE)   \
+    ((HANDLE)->RxStream.length / ((HANDLE)->FrameStream.size / (HANDLE)->RxStream.size))
+
+static void SPI_prvDmaTimedHalfRedirect(void * pxDMA)
+{
+    SPI_HandleType * pxSPI = (SPI_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+
+    /* First half of the samples is ready */
+    pxSPI->FrameStream.buffer = pxSPI->RxStream.buffer;
+    pxSPI->FrameStream.length = SPI_TIMED_SAMPLES(pxSPI) / 2;
+
+    XPD_SAFE_CALLBACK(pxSPI->Callbacks.Receive, pxSPI);
+}
+
+static void SPI_prvDmaTimedRedirect(void * pxDMA)
+{
+    SPI_HandleType * pxSPI = (SPI_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+    uint16_t usSamples = SPI_TIMED_SAMPLES(pxSPI);
+    uint16_t usHalf = usSamples / 2;
+
+    /* Second half of the samples is ready */
+    pxSPI->FrameStream.buffer = pxSPI->RxStream.buffer + usHalf * pxSPI->FrameStream.size;
+    pxSPI->FrameStream.length = usSamples - usHalf;
+
+    XPD_SAFE_CALLBACK(pxSPI->Callbacks.Receive, pxSPI);
+}
+
+/* Checks that the timer DMAs run in circular mode, and that each frame DMA request
+ * writes a single data frame */
+static bool SPI_prvTimedDmaValid(SPI_HandleType * pxSPI, TIM_HandleType * pxTIM, uint8_t ucFrames)
+{
+    bool bValid = (DMA_eCircularMode(pxTIM->DMA.Update) != 0) &&
+                  (DMA_eCircularMode(pxTIM->DMA.Channel[TIM_CH2]) != 0);
+    uint8_t ucFrame;
+
+    for (ucFrame = 0; ucFrame < ucFrames; ucFrame++)
+    {
+        DMA_HandleType * pxDMA = pxTIM->DMA.Channel[spi_aeTimedFrameChannels[ucFrame]];
+
+        if (DMA_eCircularMode(pxDMA) == 0)
+        {
+            bValid = false;
+        }
+#ifdef SPI_SR_FRLVL
+        /* A halfword write is packed to two 8 bit frames in the Tx FIFO */
+        else if ((pxSPI->RxStream.size == 1) && ((pxDMA->Inst->CCR.w & DMA_CCR_PSIZE) != 0))
+        {
+            bValid = false;
+        }
+#endif
+    }
+#ifndef SPI_SR_FRLVL
+    (void)pxSPI;
+#endif
+    return bValid;
+}
+
 #ifdef __XPD_DMA_ERROR_DETECT
 static void SPI_prvDmaErrorRedirect(void * pxDMA)
 {
@@ -225,6 +294,86 @@ void SPI_prvDisable(SPI_HandleType * pxSPI)
     SPI_REG_BIT(pxSPI, CR1, SPE) = 0;
 }
 
+#ifdef SPI_SR_FRLVL
+/* Converts a FIFO level to data frames,
+ * full level is 3 bytes with 8 bit frames, 4 bytes with 16 bit frames */
+static uint16_t SPI_prvFifoFrames(uint32_t ulLevel, uint8_t ucSize)
+{
+    if (ulLevel == 3)
+    {
+        ulLevel += ucSize - 1;
+    }
+    return (uint16_t)(ulLevel / ucSize);
+}
+#endif
+
+/* Amount of received frames which are not yet moved by the DMA */
+static uint16_t SPI_prvRxPending(SPI_HandleType * pxSPI)
+{
+#ifdef SPI_SR_FRLVL
+    return SPI_prvFifoFrames((pxSPI->Inst->SR.w & SPI_SR_FRLVL) >> SPI_SR_FRLVL_Pos,
+            pxSPI->RxStream.size);
+#else
+    return (SPI_FLAG_STATUS(pxSPI, RXNE) != 0) ? 1 : 0;
+#endif
+}
+
+/* Checks if the transmit buffer holds data which the master hasn't clocked out */
+static bool SPI_prvTxStale(SPI_HandleType * pxSPI)
+{
+#ifdef SPI_SR_FTLVL
+    return (pxSPI->Inst->SR.w & SPI_SR_FTLVL) != 0;
+#else
+    return SPI_FLAG_STATUS(pxSPI, TXE) == 0;
+#endif
+}
+
+/* Restarts the transmit DMA with the armed slave reply, starting from an empty transmit buffer */
+static void SPI_prvSlaveReplyStart(SPI_HandleType * pxSPI)
+{
+    if (pxSPI->DMA.Transmit != NULL)
+    {
+        /* Unsent data of the previous reply is discarded from the DMA */
+        SPI_REG_BIT(pxSPI, CR2, TXDMAEN) = 0;
+        DMA_vStop(pxSPI->DMA.Transmit);
+
+        /* When the master clocked less data than the previous reply,
+         * the frames left in the transmit buffer are flushed by disabling the peripheral */
+        if (SPI_prvTxStale(pxSPI))
+        {
+            SPI_prvDisable(pxSPI);
+            SPI_prvEnable(pxSPI);
+
+            /* If the transmit buffer is still not empty,
+             * the peripheral is reset and its configuration restored */
+            if (SPI_prvTxStale(pxSPI))
+            {
+                uint32_t ulCR1 = pxSPI->Inst->CR1.w;
+                uint32_t ulCR2 = pxSPI->Inst->CR2.w;
+
+                RCC_vReset(pxSPI->CtrlPos);
+
+                pxSPI->Inst->CR2.w = ulCR2;
+                pxSPI->Inst->CR1.w = ulCR1;
+            }
+        }
+
+        /* Current reply is the transmit stream */
+        pxSPI->TxStream = pxSPI->ReplyStream;
+
+        if ((pxSPI->TxStream.length > 0) &&
+            (DMA_eStart(pxSPI->DMA.Transmit, (void*)&pxSPI->Inst->DR,
+                    pxSPI->TxStream.buffer, pxSPI->TxStream.length) == XPD_OK))
+        {
+            /* Set the callback owner */
+            pxSPI->DMA.Transmit->Owner = pxSPI;
+
+            /* Enable Tx DMA Request */
+            SPI_REG_BIT(pxSPI, CR2, TXDMAEN) = 1;
+        }
+    }
+}
+
 /** @defgroup SPI_Exported_Functions SPI Exported Functions
  * @{ */
 
@@ -1185,6 +1334,292 @@ void SPI_vStop_DMA(SPI_HandleType * pxSPI)
     }
 }
 
+/**
+ * @brief Starts DMA-managed slave streaming over SPI, with frames delimited by the NSS signal.
+ * @note  The reception DMA has to be configured in circular mode. The end of each frame
+ *        (rising edge of NSS) has to be signaled by calling @ref SPI_vSlaveStreamIRQHandler
+ *        from the EXTI callback of the NSS pin.
+ * @param pxSPI: pointer to the SPI handle structure
+ * @param pvRxRing: pointer to the circular reception buffer
+ * @param usRingLength: length of the circular reception buffer in data units
+ *                      (shall be greater than the longest frame)
+ * @param pvTxData: pointer to the reply data of the first frame (may be NULL)
+ * @param usTxLength: amount of reply data transfers
+ * @return ERROR if the reception DMA isn't circular, BUSY if a DMA is in use, OK if streaming is started
+ */
+XPD_ReturnType SPI_eSlaveStreamStart_DMA(
+        SPI_HandleType *    pxSPI,
+        void *              pvRxRing,
+        uint16_t            usRingLength,
+        void *              pvTxData,
+        uint16_t            usTxLength)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if (DMA_eCircularMode(pxSPI->DMA.Receive) != 0)
+    {
+        /* The ring is the reception stream, the first frame starts at its beginning */
+        pxSPI->RxStream.buffer    = pvRxRing;
+        pxSPI->RxStream.length    = usRingLength;
+        pxSPI->FrameStream.buffer = pvRxRing;
+        pxSPI->FrameStream.length = 0;
+        pxSPI->FrameStream.size   = pxSPI->RxStream.size;
+
+        /* Frames are reported by the NSS edge, no DMA interrupts are necessary */
+        eResult = DMA_eStart(pxSPI->DMA.Receive,
+                (void*)&pxSPI->Inst->DR, pvRxRing, usRingLength);
+    }
+
+    if (eResult == XPD_OK)
+    {
+        /* Set the callback owner */
+        pxSPI->DMA.Receive->Owner = pxSPI;
+        SPI_RESET_ERRORS(pxSPI);
+
+        /* Enable Rx DMA Request */
+        SPI_REG_BIT(pxSPI, CR2, RXDMAEN) = 1;
+
+        /* Arm the first reply */
+        SPI_vSlaveStreamReply(pxSPI, pvTxData, usTxLength);
+        SPI_prvSlaveReplyStart(pxSPI);
+
+        /* Check if the SPI is already enabled */
+        SPI_prvEnable(pxSPI);
+    }
+    return eResult;
+}
+
+/**
+ * @brief Sets the reply data which is transmitted during the following frame(s) in slave streaming mode.
+ * @note  The reply is loaded to the transmitter at the end of the current frame,
+ *        therefore calling this from the Receive callback prepares the answer to the next frame.
+ *        The reply stays armed (and is resent) until it's replaced.
+ * @param pxSPI: pointer to the SPI handle structure
+ * @param pvTxData: pointer to the reply data (may be NULL)
+ * @param usTxLength: amount of reply data transfers
+ */
+void SPI_vSlaveStreamReply(
+        SPI_HandleType *    pxSPI,
+        void *              pvTxData,
+        uint16_t            usTxLength)
+{
+    pxSPI->ReplyStream.buffer = pvTxData;
+    pxSPI->ReplyStream.length = (pvTxData != NULL) ? usTxLength : 0;
+    pxSPI->ReplyStream.size   = pxSPI->TxStream.size;
+}
+
+/**
+ * @brief SPI slave streaming frame end handler, to be called on the NSS rising edge.
+ * @note  The Receive callback is called with the new frame's span within the circular buffer
+ *        in @ref SPI_HandleType::FrameStream. The frame data is wrapped at the end of
+ *        the circular buffer, and it remains valid until the master overwrites it with
+ *        a subsequent frame.
+ * @param pxSPI: pointer to the SPI handle structure
+ */
+void SPI_vSlaveStreamIRQHandler(SPI_HandleType * pxSPI)
+{
+    uint16_t usRing = pxSPI->RxStream.length;
+    uint16_t usHead, usTail, usRemaining;
+
+    /* The previous frame ended where the current one begins */
+    usHead = (uint16_t)((pxSPI->FrameStream.buffer - pxSPI->RxStream.buffer) / pxSPI->RxStream.size)
+            + pxSPI->FrameStream.length;
+    if (usHead >= usRing)
+    {
+        usHead -= usRing;
+    }
+
+    /* The DMA write position marks the end of the current frame, extended by
+     * the last frames still in the receive buffer, which the DMA moves to the ring
+     * without waiting for them here; the counter is reread to avoid counting a frame twice */
+    do
+    {
+        usRemaining = DMA_usGetStatus(pxSPI->DMA.Receive);
+        usTail = usRing - usRemaining + SPI_prvRxPending(pxSPI);
+    }
+    while (usRemaining != DMA_usGetStatus(pxSPI->DMA.Receive));
+    if (usTail >= usRing)
+    {
+        usTail -= usRing;
+    }
+
+    /* Report the frame span without copying */
+    pxSPI->FrameStream.buffer = pxSPI->RxStream.buffer + usHead * pxSPI->RxStream.size;
+    pxSPI->FrameStream.length = (usTail >= usHead) ? (usTail - usHead) : (usRing - usHead + usTail);
+
+    XPD_SAFE_CALLBACK(pxSPI->Callbacks.Receive, pxSPI);
+
+    /* Load the (possibly updated) reply for the next frame */
+    SPI_prvSlaveReplyStart(pxSPI);
+
+    XPD_SAFE_CALLBACK(pxSPI->Callbacks.Transmit, pxSPI);
+}
+
+/**
+ * @brief Starts timer-paced sampling of an external converter over SPI master.
+ * @note  Each sample period is driven solely by DMA requests of the timer:
+ *        @arg Update: the chip select pin is asserted (driven low)
+ *        @arg Channel 1, 3, 4 compare: a dummy frame is written to the SPI, starting the readout
+ *             of the first, second and third frame of the sample respectively
+ *        @arg Channel 2 compare: the chip select pin is released (driven high)
+ *        The timer has to be initialized with the sample period and the used channels in
+ *        @ref TIM_OUTPUT_TIMING mode with the compare values setting the chip select timing
+ *        and the frame spacing (at least one frame time).
+ * @note  The reception DMA and the timer's Update, Channel 2 and the used frame channel DMAs
+ *        have to be configured in circular mode. The timer DMAs need access to the GPIO port.
+ *        On SPI peripherals with FIFO and 8 bit frames the frame DMAs have to perform byte writes.
+ * @note  The samples are double buffered: the Receive callback is called when either half of the
+ *        sample buffer is filled, with the completed half provided in @ref SPI_HandleType::FrameStream.
+ *        Each sample consists of ucFrames consecutive frames in the buffer.
+ * @param pxSPI: pointer to the SPI handle structure
+ * @param pxTIM: pointer to the pacing TIM handle structure
+ * @param eChipSelect: the chip select output pin of the converter
+ * @param pvRxData: pointer to the sample buffer
+ * @param usLength: amount of samples in the buffer (both halves, even for multi-frame samples)
+ * @param ucFrames: number of SPI data frames of a sample [1 .. 3]
+ * @return ERROR if the parameters or the DMA configurations are invalid,
+ *         BUSY if a DMA is in use, OK if sampling is started
+ */
+XPD_ReturnType SPI_eTimedReceive_DMA(
+        SPI_HandleType *    pxSPI,
+        TIM_HandleType *    pxTIM,
+        GPIO_PinType        eChipSelect,
+        void *              pvRxData,
+        uint16_t            usLength,
+        uint8_t             ucFrames)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    GPIO_TypeDef * pxGPIO = __GPIO_PORT_FROM_PIN(eChipSelect);
+    uint32_t ulPin = 1 << (eChipSelect & __GPIO_PIN_MASK);
+    uint32_t ulFrameCount = (uint32_t)usLength * ucFrames;
+
+    /* The DMA half transfer has to split the buffer at a sample boundary */
+    if ((ucFrames > 0) && (ucFrames <= SPI_TIMED_MAX_FRAMES) &&
+        ((ucFrames == 1) || ((usLength & 1) == 0)) &&
+        (ulFrameCount <= 0xFFFF) &&
+        (DMA_eCircularMode(pxSPI->DMA.Receive) != 0) &&
+        SPI_prvTimedDmaValid(pxSPI, pxTIM, ucFrames))
+    {
+        /* save stream info */
+        pxSPI->RxStream.buffer    = pvRxData;
+        pxSPI->RxStream.length    = (uint16_t)ulFrameCount;
+        pxSPI->FrameStream.size   = pxSPI->RxStream.size * ucFrames;
+
+        /* Assert is reset, release is set */
+        pxSPI->CSControl[0] = ulPin << 16;
+        pxSPI->CSControl[1] = ulPin;
+
+        /* Set up DMA for sample reception */
+        eResult = DMA_eStart_IT(pxSPI->DMA.Receive,
+                (void*)&pxSPI->Inst->DR, pvRxData, ulFrameCount);
+    }
+
+    if (eResult == XPD_OK)
+    {
+        uint32_t ulRequests = TIM_DIER_UDE | TIM_DIER_CC2DE;
+        uint8_t ucFrame = 0;
+
+        /* Set up the timer event DMAs */
+        eResult = DMA_eStart(pxTIM->DMA.Update,
+                (void*)&pxGPIO->BSRR, &pxSPI->CSControl[0], 1);
+        if (eResult == XPD_OK)
+        {
+            eResult = DMA_eStart(pxTIM->DMA.Channel[TIM_CH2],
+                    (void*)&pxGPIO->BSRR, &pxSPI->CSControl[1], 1);
+            if (eResult != XPD_OK)
+            {
+                DMA_vStop(pxTIM->DMA.Update);
+            }
+        }
+
+        /* Each frame of the sample is started by its own compare event */
+        while ((eResult == XPD_OK) && (ucFrame < ucFrames))
+        {
+            TIM_ChannelType eChannel = spi_aeTimedFrameChannels[ucFrame];
+
+            eResult = DMA_eStart(pxTIM->DMA.Channel[eChannel],
+                    (void*)&pxSPI->Inst->DR, (void*)&spi_usDummy, 1);
+            if (eResult == XPD_OK)
+            {
+                ulRequests |= TIM_DIER_CC1DE << eChannel;
+                ucFrame++;
+            }
+            else
+            {
+                /* Stop the already started DMAs */
+                while (ucFrame > 0)
+                {
+                    ucFrame--;
+                    DMA_vStop(pxTIM->DMA.Channel[spi_aeTimedFrameChannels[ucFrame]]);
+                }
+                DMA_vStop(pxTIM->DMA.Channel[TIM_CH2]);
+                DMA_vStop(pxTIM->DMA.Update);
+            }
+        }
+
+        /* If one DMA allocation failed, reset the reception and exit */
+        if (eResult != XPD_OK)
+        {
+            DMA_vStop_IT(pxSPI->DMA.Receive);
+            return eResult;
+        }
+
+        /* Set the callback owner */
+        pxSPI->DMA.Receive->Owner = pxSPI;
+
+        /* Set the DMA transfer callbacks */
+        pxSPI->DMA.Receive->Callbacks.HalfComplete = SPI_prvDmaTimedHalfRedirect;
+        pxSPI->DMA.Receive->Callbacks.Complete     = SPI_prvDmaTimedRedirect;
+#ifdef __XPD_DMA_ERROR_DETECT
+        pxSPI->DMA.Receive->Callbacks.Error        = SPI_prvDmaErrorRedirect;
+#endif
+        DMA_IT_ENABLE(pxSPI->DMA.Receive, HT);
+        SPI_RESET_ERRORS(pxSPI);
+
+#ifdef SPI_SR_FRLVL
+        /* Each 8 bit frame is moved by the reception DMA separately */
+        SPI_REG_BIT(pxSPI, CR2, FRXTH) = (uint32_t)(pxSPI->RxStream.size == 1);
+#endif
+
+        /* Start with released chip select */
+        pxGPIO->BSRR = pxSPI->CSControl[1];
+
+        /* Enable Rx DMA Request */
+        SPI_REG_BIT(pxSPI, CR2, RXDMAEN) = 1;
+
+        /* Check if the SPI is already enabled */
+        SPI_prvEnable(pxSPI);
+
+        /* Enable the timer event DMA requests and start pacing */
+        SET_BIT(pxTIM->Inst->DIER.w, ulRequests);
+        TIM_vCounterStart(pxTIM);
+    }
+    return eResult;
+}
+
+/**
+ * @brief Stops the timer-paced sampling over SPI.
+ * @param pxSPI: pointer to the SPI handle structure
+ * @param pxTIM: pointer to the pacing TIM handle structure
+ */
+void SPI_vTimedStop_DMA(SPI_HandleType * pxSPI, TIM_HandleType * pxTIM)
+{
+    uint8_t ucFrame, ucFrames = pxSPI->FrameStream.size / pxSPI->RxStream.size;
+
+    /* Stop pacing first */
+    TIM_vCounterStop(pxTIM);
+    CLEAR_BIT(pxTIM->Inst->DIER.w, SPI_TIMED_DMA_REQUESTS);
+
+    DMA_vStop(pxTIM->DMA.Update);
+    DMA_vStop(pxTIM->DMA.Channel[TIM_CH2]);
+    for (ucFrame = 0; ucFrame < ucFrames; ucFrame++)
+    {
+        DMA_vStop(pxTIM->DMA.Channel[spi_aeTimedFrameChannels[ucFrame]]);
+    }
+
+    SPI_vStop_DMA(pxSPI);
+}
+
 /** @} */
 
 /** @} */
@@ -30,6 +30,7 @@ extern "C"
 
 #include <xpd_common.h>
 #include <xpd_rcc.h>
+#include <xpd_tim.h>
 
 #if defined(CAN) || defined(CAN1)
 
@@ -57,6 +58,15 @@ typedef struct
     uint8_t  SJW;       /*!< Synchronization jump width. Permitted values: @arg 1 .. 4 */
 }CAN_TimingConfigType;
 
+/** @brief CAN bit timing solution structure */
+typedef struct
+{
+    CAN_TimingConfigType Timing;      /*!< Bit timing configuration */
+    uint32_t             Bitrate;     /*!< Achieved bitrate [bit/s] */
+    uint16_t             SamplePoint; /*!< Achieved sample point [per mille of the bit time] */
+    uint16_t             Tolerance;   /*!< Allowed oscillator frequency tolerance [ppm] */
+}CAN_TimingSolutionType;
+
 /** @brief CAN setup structure */
 typedef struct
 {
@@ -104,8 +114,54 @@ typedef struct
                                      @arg Received frames: Filter Match Index,
                                           for pairing with acceptance filter
                                      @arg Transmitted frames: Mailbox Index */
+    uint32_t                Timestamp; /*!< Start of frame time in CAN bit times (TTCAN mode only),
+                                            extended to 32 bits when statistics are enabled */
 }CAN_FrameType;
 
+/** @brief CAN receive ring structure */
+typedef struct
+{
+    CAN_FrameType *   Frames;   /*!< Frame storage of the ring */
+    uint16_t          Size;     /*!< Number of frames in the storage, has to be a power of 2 */
+    volatile uint16_t Head;     /*!< [Internal] Write index, only advanced by the receive interrupt */
+    volatile uint16_t Tail;     /*!< [Internal] Read index, only advanced by the consumer */
+    volatile uint16_t Overruns; /*!< Number of frames lost due to full ring or hardware FIFO */
+}CAN_RxRingType;
+
+/** @brief CAN transmit queue structure */
+typedef struct
+{
+    CAN_FrameType *   Frames;    /*!< Frame storage of the queue */
+    uint16_t          Size;      /*!< Number of frames in the storage */
+    uint16_t          Count;     /*!< [Internal] Number of queued frames */
+    uint8_t           Mailboxes; /*!< [Internal] Transmit mailboxes loaded from the queue */
+    uint8_t           Aborting;  /*!< [Internal] Transmit mailboxes being aborted for a higher priority frame */
+    volatile uint16_t Failed;    /*!< Number of frames dropped due to transmission error or lost arbitration */
+}CAN_TxQueueType;
+
+/* the CAN handle is referenced by the gateway routes */
+struct CAN_HandleStruct;
+
+/** @brief CAN gateway route structure */
+typedef struct
+{
+    struct CAN_HandleStruct * Destination; /*!< CAN handle to forward the frames to, NULL to keep the frames locally */
+    CAN_IdentifierFieldType   Id;          /*!< Identifier of the forwarded frames, if Rewrite is set */
+    uint8_t                   Rewrite;     /*!< Set to replace the Identifier of the forwarded frames */
+    uint8_t                   Limit;       /*!< Maximal number of forwarded frames per gateway period, 0 for unlimited */
+    volatile uint8_t          Count;       /*!< [Internal] Number of frames forwarded in the current period */
+}CAN_RouteType;
+
+/** @brief CAN gateway structure */
+typedef struct
+{
+    CAN_RouteType *   Routes;     /*!< Routing table indexed by the Filter Match Index */
+    uint8_t           RouteCount; /*!< Number of routes in the table */
+    volatile uint16_t Forwarded;  /*!< Number of forwarded frames */
+    volatile uint16_t Limited;    /*!< Number of frames dropped by the route rate limit */
+    volatile uint16_t Dropped;    /*!< Number of frames dropped due to full destination transmit queue */
+}CAN_GatewayType;
+
 /** @brief CAN Error types */
 typedef enum
 {
@@ -121,6 +177,49 @@ typedef enum
     CAN_ERROR_BUSOFF       = 0x04, /*!< Bus off state */
 }CAN_ErrorType;
 
+/** @brief CAN frame arrival statistics structure */
+typedef struct
+{
+    uint32_t Last;              /*!< Time stamp of the last arrival */
+    uint32_t Period;            /*!< Average inter-arrival time [CAN bit times] */
+    uint32_t Jitter;            /*!< Largest deviation from the average inter-arrival time [CAN bit times] */
+    uint16_t Count;             /*!< Number of arrivals */
+}CAN_ArrivalStatsType;
+
+/** @brief CAN error counter record structure */
+typedef struct
+{
+    uint32_t      Timestamp;    /*!< Time stamp of the last frame before the record */
+    uint8_t       TEC;          /*!< Transmit error counter */
+    uint8_t       REC;          /*!< Receive error counter */
+    CAN_ErrorType Error;        /*!< Error state and last error code */
+}CAN_ErrorRecordType;
+
+/** @brief CAN statistics structure */
+typedef struct
+{
+    TIM_HandleType *       pTIM;            /*!< Timer extending the time stamps, its update callback
+                                                 has to call @ref CAN_vStatsTick */
+    uint16_t               TickBits;        /*!< Timer update period in CAN bit times [1 .. 32767],
+                                                 less than half of the hardware time stamp range */
+    uint8_t                ArrivalCount;    /*!< Number of elements in the arrival statistics arrays */
+    uint8_t                ErrorSize;       /*!< Number of elements in the error history, has to be a power of 2 */
+    CAN_ArrivalStatsType * Arrivals[2];     /*!< Arrival statistics of each FIFO indexed by the Filter Match Index, or NULL */
+    CAN_ErrorRecordType *  Errors;          /*!< Error counter history ring, or NULL */
+    volatile uint16_t      ErrorHead;       /*!< Number of error records written to the history */
+    uint32_t               TxTimestamp[3];  /*!< Time stamp of the last transmitted frame of each mailbox */
+    uint32_t               TxLatencyMax;    /*!< Longest time from mailbox load to transmission complete [timer counts] */
+    uint32_t               TxLatencySum;    /*!< Sum of mailbox latencies [timer counts] */
+    uint32_t               TxCount;         /*!< Number of transmitted frames */
+    uint32_t               LastTime;        /*!< [Internal] Latest 32-bit time stamp */
+    volatile uint16_t      Ticks;           /*!< [Internal] Timer updates since the latest time stamp */
+    volatile uint32_t      TickCount;       /*!< [Internal] Timer updates since the start */
+    uint32_t               LoadStart;       /*!< [Internal] Start of the bus load measurement window */
+    uint32_t               LoadBits;        /*!< [Internal] Frame bits in the bus load measurement window */
+    uint32_t               TxLoadTime[3];   /*!< [Internal] Mailbox load times [timer counts] */
+    uint32_t               ErrorCounters;   /*!< [Internal] Last recorded error counters */
+}CAN_StatsType;
+
 /** @brief CAN Filter types */
 typedef enum
 {
@@ -140,8 +239,35 @@ typedef struct
     uint8_t                 FIFO;    /*!< The selected receive FIFO [0 .. 1]*/
 }CAN_FilterType;
 
-/** @brief CAN Handle structure */
+/** @brief CAN Identifier range structure for filter compilation */
 typedef struct
+{
+    uint32_t   First;           /*!< Lowest accepted Identifier field value */
+    uint32_t   Last;            /*!< Highest accepted Identifier field value */
+    CAN_IdType Type;            /*!< ID and data type (Std/Ext, Data/RTR) of the range */
+    uint8_t    FIFO;            /*!< The selected receive FIFO [0 .. 1]*/
+    uint8_t    Tag;             /*!< Application value to dispatch the matching frames with */
+}CAN_FilterRangeType;
+
+#ifdef CAN2
+#define CAN_FILTER_FMI_COUNT    (4 * 28) /*!< Maximal number of Filter Match Indexes per FIFO */
+#else
+#define CAN_FILTER_FMI_COUNT    (4 * 14) /*!< Maximal number of Filter Match Indexes per FIFO */
+#endif
+#define CAN_FILTER_TAG_NONE     0xFF     /*!< Dispatch table value of unused Filter Match Indexes */
+
+/** @brief CAN filter compiler structure */
+typedef struct
+{
+    CAN_FilterType * Filters;   /*!< Storage for the compiled hardware filters */
+    uint8_t *        Tags;      /*!< Storage for the application tags of the compiled filters */
+    uint8_t          Size;      /*!< Number of elements in the storages */
+    uint8_t          Count;     /*!< [Output] Number of compiled hardware filters */
+    uint8_t          Dispatch[2][CAN_FILTER_FMI_COUNT]; /*!< [Output] Application tags of each FIFO's Filter Match Indexes */
+}CAN_FilterCompilerType;
+
+/** @brief CAN Handle structure */
+typedef struct CAN_HandleStruct
 {
     CAN_TypeDef * Inst;                    /*!< The address of the peripheral instance used by the handle */
 #ifdef CAN_BB
@@ -155,6 +281,10 @@ typedef struct
         XPD_HandleCallbackType Error;      /*!< Error detection callback */
     } Callbacks;                           /*   Handle Callbacks */
     CAN_FrameType * RxFrame[2];            /*!< [Internal] Pointers to where the received frames will be stored */
+    CAN_RxRingType * RxRing[2];            /*!< [Internal] Receive rings of the FIFOs (NULL when unused) */
+    CAN_TxQueueType * TxQueue;             /*!< [Internal] Priority ordered transmit queue (NULL when unused) */
+    CAN_GatewayType * Gateway[2];          /*!< [Internal] Frame routing of the FIFOs (NULL when unused) */
+    CAN_StatsType * Stats;                 /*!< [Internal] Time stamping and bus statistics (NULL when unused) */
     RCC_PositionType CtrlPos;              /*!< Relative position for reset and clock control */
     volatile uint8_t State;                /*!< [Internal] CAN interrupt-controlled communication state */
 }CAN_HandleType;
@@ -369,6 +499,8 @@ typedef struct
  * @{ */
 
 XPD_ReturnType  CAN_eBitrateConfig      (uint32_t ulBitrate, CAN_TimingConfigType * pxTimingConfig);
+uint8_t         CAN_ucTimingSolve       (uint32_t ulBitrate, uint16_t usSamplePoint,
+                                         CAN_TimingSolutionType axSolutions[], uint8_t ucCount);
 
 /** @addtogroup CAN_Exported_Functions_State
  * @{ */
@@ -381,6 +513,10 @@ XPD_ReturnType  CAN_eWakeUp             (CAN_HandleType * pxCAN);
 CAN_ErrorType   CAN_eGetError           (CAN_HandleType * pxCAN);
 
 void            CAN_vIRQHandlerSCE      (CAN_HandleType * pxCAN);
+
+void            CAN_vStatsInit          (CAN_HandleType * pxCAN, CAN_StatsType * pxStats);
+void            CAN_vStatsTick          (CAN_HandleType * pxCAN);
+uint16_t        CAN_usStatsBusLoad      (CAN_HandleType * pxCAN);
 /** @} */
 
 /** @addtogroup CAN_Exported_Functions_Filter
@@ -388,6 +524,21 @@ void            CAN_vIRQHandlerSCE      (CAN_HandleType * pxCAN);
 XPD_ReturnType  CAN_eFilterBankConfig   (CAN_HandleType * pxCAN, uint8_t ucNewSize);
 XPD_ReturnType  CAN_eFilterConfig       (CAN_HandleType * pxCAN, const CAN_FilterType axFilters[],
                                          uint8_t aucMatchIndexes[], uint8_t ucFilterCount);
+XPD_ReturnType  CAN_eFilterCompile      (CAN_HandleType * pxCAN, const CAN_FilterRangeType axRanges[],
+                                         uint8_t ucRangeCount, CAN_FilterCompilerType * pxCompiler);
+
+/**
+ * @brief Returns the application tag of a received frame based on its Filter Match Index.
+ * @param pxCompiler: pointer to the filter compiler used to configure the filters
+ * @param pxFrame: pointer to the received frame
+ * @param ucFIFONumber: the receive FIFO of the frame [0 .. 1]
+ * @return The tag of the matching range, or CAN_FILTER_TAG_NONE
+ */
+__STATIC_INLINE uint8_t CAN_ucFilterTag(const CAN_FilterCompilerType * pxCompiler,
+        const CAN_FrameType * pxFrame, uint8_t ucFIFONumber)
+{
+    return pxCompiler->Dispatch[ucFIFONumber][pxFrame->Index];
+}
 /** @} */
 
 /** @addtogroup CAN_Exported_Functions_Transmit
@@ -398,6 +549,9 @@ XPD_ReturnType  CAN_eSend               (CAN_HandleType * pxCAN, CAN_FrameType *
                                          uint32_t ulTimeout);
 XPD_ReturnType  CAN_eSend_IT            (CAN_HandleType * pxCAN, CAN_FrameType * pxFrame);
 
+void            CAN_vTxQueueInit        (CAN_HandleType * pxCAN, CAN_TxQueueType * pxQueue);
+XPD_ReturnType  CAN_eEnqueue_IT         (CAN_HandleType * pxCAN, const CAN_FrameType * pxFrame);
+
 void            CAN_vIRQHandlerTX       (CAN_HandleType * pxCAN);
 /** @} */
 
@@ -408,6 +562,26 @@ XPD_ReturnType  CAN_eReceive            (CAN_HandleType * pxCAN, CAN_FrameType *
 XPD_ReturnType  CAN_eReceive_IT         (CAN_HandleType * pxCAN, CAN_FrameType * pxFrame,
                                          uint8_t ucFIFONumber);
 
+XPD_ReturnType  CAN_eReceiveRing_IT     (CAN_HandleType * pxCAN, CAN_RxRingType * pxRing,
+                                         uint8_t ucFIFONumber);
+void            CAN_vReceiveRingStop_IT (CAN_HandleType * pxCAN, uint8_t ucFIFONumber);
+
+XPD_ReturnType  CAN_eRxRingPop          (CAN_RxRingType * pxRing, CAN_FrameType * pxFrame);
+
+/**
+ * @brief Returns the number of frames waiting in the receive ring.
+ * @param pxRing: pointer to the receive ring
+ * @return The number of stored frames
+ */
+__STATIC_INLINE uint16_t CAN_usRxRingCount(CAN_RxRingType * pxRing)
+{
+    return (uint16_t)(pxRing->Head - pxRing->Tail);
+}
+
+void            CAN_vGatewayConfig      (CAN_HandleType * pxCAN, CAN_GatewayType * pxGateway,
+                                         uint8_t ucFIFONumber);
+void            CAN_vGatewayTick        (CAN_GatewayType * pxGateway);
+
 void            CAN_vIRQHandlerRX0      (CAN_HandleType * pxCAN);
 void            CAN_vIRQHandlerRX1      (CAN_HandleType * pxCAN);
 /** @} */
@@ -0,0 +1,142 @@
+/**
+  ******************************************************************************
+  * @file    xpd_can_j1939.h
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-02
+  * @brief   STM32 eXtensible Peripheral Drivers CAN J1939 Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __XPD_CAN_J1939_H_
+#define __XPD_CAN_J1939_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <xpd_common.h>
+#include <xpd_can.h>
+#include <xpd_tim.h>
+
+#if defined(CAN) || defined(CAN1)
+
+/** @ingroup CAN
+ * @defgroup CAN_J1939 CAN J1939
+ * @brief    SAE J1939 network management and transport protocol over the CAN peripheral
+ * @{ */
+
+/** @defgroup CAN_J1939_Exported_Types CAN J1939 Exported Types
+ * @{ */
+
+#ifndef CAN_J1939_TICK_ms
+#define CAN_J1939_TICK_ms           10   /*!< Update period of the J1939 timer [ms] */
+#endif
+#ifndef CAN_J1939_CTS_PACKETS
+#define CAN_J1939_CTS_PACKETS       16   /*!< Number of packets requested by a single CTS */
+#endif
+#define CAN_J1939_MAX_LENGTH        1785 /*!< Maximal message length of the transport protocol */
+#define CAN_J1939_ADDRESS_GLOBAL    0xFF /*!< Global (broadcast) destination address */
+#define CAN_J1939_ADDRESS_NULL      0xFE /*!< Source address of nodes without claimed address */
+
+/** @brief J1939 address claim states */
+typedef enum
+{
+    CAN_J1939_CLAIM_NONE    = 0, /*!< Address claiming is not started */
+    CAN_J1939_CLAIM_PENDING = 1, /*!< Address claim is sent, waiting for contending claims */
+    CAN_J1939_CLAIM_DONE    = 2, /*!< Address is claimed successfully */
+    CAN_J1939_CLAIM_FAILED  = 3, /*!< No address could be claimed */
+}CAN_J1939ClaimStateType;
+
+/** @brief J1939 message structure */
+typedef struct
+{
+    const uint8_t * Data;        /*!< Message data */
+    uint32_t        PGN;         /*!< Parameter Group Number */
+    uint16_t        Length;      /*!< Message length [0 .. CAN_J1939_MAX_LENGTH] */
+    uint8_t         Priority;    /*!< Message priority [0 .. 7] */
+    uint8_t         Source;      /*!< Source address */
+    uint8_t         Destination; /*!< Destination address, CAN_J1939_ADDRESS_GLOBAL for broadcast */
+}CAN_J1939MessageType;
+
+/** @brief J1939 PGN dispatch table entry structure */
+typedef struct
+{
+    uint32_t               PGN;      /*!< Parameter Group Number to receive */
+    XPD_HandleCallbackType Callback; /*!< Reception callback, called with the received message pointer */
+}CAN_J1939PgnType;
+
+/** @brief J1939 transport session structure */
+typedef struct
+{
+    uint8_t *            Buffer;     /*!< Reception buffer, NULL for transmit only sessions */
+    uint16_t             Size;       /*!< Reception buffer size */
+    CAN_J1939MessageType Message;    /*!< [Internal] Transferred message */
+    uint16_t             Offset;     /*!< [Internal] Number of transferred data bytes */
+    volatile uint16_t    Timer;      /*!< [Internal] Remaining ticks until the next action */
+    uint8_t              Packets;    /*!< [Internal] Total number of packets */
+    uint8_t              Next;       /*!< [Internal] Next packet sequence number */
+    uint8_t              WindowEnd;  /*!< [Internal] Last packet of the current CTS window */
+    uint8_t              MaxWindow;  /*!< [Internal] Maximal number of packets per CTS */
+    volatile uint8_t     State;      /*!< [Internal] Session state */
+}CAN_J1939SessionType;
+
+/** @brief J1939 layer structure */
+typedef struct
+{
+    CAN_HandleType *         pCAN;        /*!< CAN handle, its transmit queue has to be set up */
+    TIM_HandleType *         pTIM;        /*!< Timer handle with CAN_J1939_TICK_ms update period */
+    uint8_t                  Name[8];     /*!< ECU NAME in transmission (little endian) order */
+    uint8_t                  PreferredAddress; /*!< Address to claim first */
+    uint8_t                  FIFO;        /*!< The receive FIFO of the layer's filters [0 .. 1] */
+    const CAN_J1939PgnType * Pgns;        /*!< PGN dispatch table */
+    uint8_t                  PgnCount;    /*!< Number of entries in the PGN dispatch table */
+    uint8_t                  SessionCount;/*!< Number of transport sessions */
+    CAN_J1939SessionType *   Sessions;    /*!< Array of transport sessions */
+    struct {
+        XPD_HandleCallbackType Claimed;   /*!< Address claim complete (or failed) callback */
+        XPD_HandleCallbackType Transmit;  /*!< Message transmission complete callback, called with the message pointer */
+        XPD_HandleCallbackType Error;     /*!< Transport failure callback, called with the message pointer */
+    } Callbacks;                          /*   Layer Callbacks */
+    volatile uint8_t         Address;     /*!< Claimed source address, CAN_J1939_ADDRESS_NULL if none */
+    volatile CAN_J1939ClaimStateType ClaimState; /*!< Address claiming state */
+    volatile uint16_t        ClaimTimer;  /*!< [Internal] Remaining ticks of the address claim */
+    uint8_t                  Ticking;     /*!< [Internal] Set while the timer is running */
+    uint8_t                  Dispatch[CAN_FILTER_FMI_COUNT]; /*!< [Internal] PGN table index of the Filter Match Indexes */
+}CAN_J1939Type;
+
+/** @} */
+
+/** @addtogroup CAN_J1939_Exported_Functions
+ * @{ */
+XPD_ReturnType  CAN_eJ1939Init          (CAN_J1939Type * pxJ);
+void            CAN_vJ1939Claim         (CAN_J1939Type * pxJ);
+
+XPD_ReturnType  CAN_eJ1939Send          (CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage);
+
+XPD_ReturnType  CAN_eJ1939Process       (CAN_J1939Type * pxJ, const CAN_FrameType * pxFrame);
+void            CAN_vJ1939Tick          (CAN_J1939Type * pxJ);
+/** @} */
+
+/** @} */
+
+#endif /* defined(CAN) || defined(CAN1) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XPD_CAN_J1939_H_ */
@@ -30,6 +30,7 @@ extern "C"
 
 #include <xpd_common.h>
 #include <xpd_dma.h>
+#include <xpd_rcc.h>
 
 /** @defgroup I2C
  * @{ */
@@ -37,39 +38,316 @@ extern "C"
 /** @defgroup I2C_Exported_Types I2C Exported Types
  * @{ */
 
-/** @brief I2C Handle structure */
+/** @brief I2C addressing modes */
+typedef enum
+{
+    I2C_ADDRESS_7BIT    = 0, /*!< Normal 7 bit addressing */
+    I2C_ADDRESS_10BIT   = 1, /*!< 10 bit addressing mode */
+}I2C_AddressModeType;
+
+/** @brief I2C error types */
+typedef enum
+{
+    I2C_ERROR_NONE      = 0,                /*!< No error */
+    I2C_ERROR_NACK      = I2C_SR1_AF,       /*!< Not acknowledge error */
+    I2C_ERROR_BUS       = I2C_SR1_BERR,     /*!< Bus error */
+    I2C_ERROR_ARBIT     = I2C_SR1_ARLO,     /*!< Arbitration lost error */
+    I2C_ERROR_OVERRUN   = I2C_SR1_OVR,      /*!< Overrun/Underrun error */
+    I2C_ERROR_TIMEOUT   = I2C_SR1_TIMEOUT,  /*!< Timeout error */
+    I2C_ERROR_DMA       = 1,                /*!< DMA transfer error */
+}I2C_ErrorType;
+
+/** @brief I2C transfer directions */
+typedef enum
+{
+    I2C_DIRECTION_WRITE = 0, /*!< The master sends data to the receiver slave */
+    I2C_DIRECTION_READ  = 1  /*!< The master receives data from the sender slave */
+}I2C_DirectionType;
+
+/** @brief I2C transfer context */
 typedef struct
 {
-    I2C_TypeDef * Inst;                      /*!< The address of the peripheral instance used by the handle */
-#ifdef I2C_BB
-    I2C_BitBand_TypeDef * Inst_BB;           /*!< The address of the peripheral instance in the bit-band region */
+    union {
+    struct {
+    uint16_t SlaveAddress_10bit : 10; /*!< The slave's address stored in 10 bits (7 bit addresses are left shifted by one) */
+    I2C_DirectionType Direction : 1;  /*!< The transfer direction (from the master's point of view) */
+#ifdef __XPD_I2C_LONG_CMD
+    uint16_t : 5;
+#else
+    uint16_t CmdSize : 2;             /*!< The size of the optional slave command */
+    uint16_t : 3;
 #endif
+    };
     struct {
-        XPD_HandleCallbackType DepInit;      /*!< Callback to initialize module dependencies (GPIOs, IRQs, DMAs) */
-        XPD_HandleCallbackType DepDeinit;    /*!< Callback to restore module dependencies (GPIOs, IRQs, DMAs) */
-        XPD_HandleCallbackType Transmit;     /*!< Data stream transmission successful callback */
-        XPD_HandleCallbackType Receive;      /*!< Data stream reception successful callback */
-#if defined(__XPD_I2C_ERROR_DETECT) || defined(__XPD_DMA_ERROR_DETECT)
-        XPD_HandleCallbackType Error;        /*!< Error callbacks */
+    uint16_t : 1;
+    uint16_t SlaveAddress_7bit : 7;   /*!< The slave's address stored in 7 bits
+                    @warning Do not set in struct initialization, as it will conflict with
+                             @ref I2C_TransferType::Slave10bitAddress,
+                             @ref I2C_TransferType::CmdSize and
+                             @ref I2C_TransferType::Direction,
+                             either this or they will be set to 0. */
+    uint16_t : 8;
+    };
+    uint16_t wHeader;   /* [Internal] */
+    };
+#ifdef __XPD_I2C_LONG_CMD
+    uint16_t CmdSize;   /*!< The size of the optional slave command */
+    uint8_t *pCmd;      /*!< The command that is sent to the slave for servicing.
+                             The command stage is only performed when @ref I2C_TransferType::CmdSize is set. */
+#else
+    uint16_t Cmd;       /*!< The command that is sent to the slave for servicing.
+                             The command stage is only performed when @ref I2C_TransferType::CmdSize is set. */
 #endif
-    }Callbacks;                              /*   Handle Callbacks */
+    uint8_t *Data;      /*!< Source/target buffer for the transferred data, depending on
+                             the current role in the transfer and @ref I2C_TransferType::Direction */
+    uint16_t Length;    /*!< The desired length of the data transfer */
+}I2C_TransferType;
+
+/** @brief I2C setup structure */
+typedef struct
+{
+    uint32_t BusFreq_Hz;                    /*!< Desired I2C bus frequency [Hz], up to 400 kHz */
+    union {
     struct {
-        DMA_HandleType * Transmit;           /*!< DMA handle for data transmission */
-        DMA_HandleType * Receive;            /*!< DMA handle for data reception */
-    }DMA;                                    /*   DMA handle references */
-    DataStreamType RxStream;                 /*!< Data reception stream */
-    DataStreamType TxStream;                 /*!< Data transmission stream */
-    RCC_PositionType CtrlPos;                /*!< Relative position for reset and clock control */
-#if defined(__XPD_I2C_ERROR_DETECT) || defined(__XPD_DMA_ERROR_DETECT)
-    //volatile I2C_ErrorType Errors;           /*!< Transfer errors */
+    uint16_t : 6;
+    FunctionalState GeneralCall : 1;        /*!< [Slave] Acknowledge and handle a General Call (address=00h) */
+    FunctionalState NoStretch : 1;          /*!< [Slave] Do not stretch SCL low when waiting for software
+                                                 to control the transfer */
+    uint16_t DigitalFilter : 4;             /*!< Digital noise filter length in kernel clock periods
+                                                 (0 to disable, only on devices with I2C_FLTR) */
+    FunctionalState NoAnalogFilter : 1;     /*!< Disable the analog noise filter (only on devices with I2C_FLTR) */
+    I2C_AddressModeType AddressingMode : 1; /*!< Global addressing mode */
+    uint16_t : 2;
+    };
+    uint16_t wCfg;                  /* [Internal] */
+    };
+    union {
+        struct {
+        uint16_t : 1;
+        uint16_t _7bit : 7;         /*!< The address stored in 7 bits (disabled when set to 0) */
+        uint16_t : 8;
+        };
+        struct {
+        uint16_t _10bit : 10;       /*!< The address stored in 10 bits (disabled when set to 0) */
+        uint16_t : 6;
+        };
+        uint16_t wValue;
+    }OwnAddress1;                   /*!< [Slave] The module's address, either 7 or 10 bit,
+                                          depending on @ref I2C_InitType::AddressingMode */
+    union {
+        struct {
+        uint16_t : 1;
+        uint16_t _7bit : 7;         /*!< The address stored in 7 bits (disabled when set to 0) */
+        uint16_t : 8;
+        };
+        uint16_t wValue;
+    }OwnAddress2;                   /*!< [Slave] The module's secondary address, only used with 7 bit addressing */
+    uint16_t RiseTime_ns;           /*!< Maximal SCL rise time of the bus [ns]
+                                         (0 selects the maximal value allowed in the speed mode) */
+}I2C_InitType;
+
+/** @brief I2C Handle structure */
+typedef struct
+{
+    I2C_TypeDef * Inst;                         /*!< The address of the peripheral instance used by the handle */
+#ifdef I2C_BB
+    I2C_BitBand_TypeDef * Inst_BB;              /*!< The address of the peripheral instance in the bit-band region */
 #endif
+    struct {
+        XPD_HandleCallbackType DepInit;         /*!< Callback to initialize module dependencies (GPIOs, IRQs, DMAs) */
+        XPD_HandleCallbackType DepDeinit;       /*!< Callback to restore module dependencies (GPIOs, IRQs, DMAs) */
+        XPD_HandleCallbackType MasterComplete;  /*!< Master transfer complete callback */
+        XPD_HandleCallbackType SlaveAddressed;  /*!< Slave address match callback */
+        XPD_HandleCallbackType SlaveComplete;   /*!< Slave transfer complete callback */
+        XPD_HandleCallbackType Error;           /*!< Error callbacks */
+    }Callbacks;                                 /*   Handle Callbacks */
+    struct {
+        DMA_HandleType * Transmit;              /*!< DMA handle for data transmission */
+        DMA_HandleType * Receive;               /*!< DMA handle for data reception */
+    }DMA;                                       /*   DMA handle references */
+    XPD_HandleCallbackType IRQHandler;          /*!< Contextual interrupt request handler reference */
+    struct {
+        const I2C_TransferType * pMaster;       /*!< Current master mode transfer */
+        I2C_TransferType Slave;                 /*!< Slave mode transfer */
+    }Transfers;                                 /*   Current transfer references */
+    DataStreamType Stream;                      /*!< Data transfer management */
+    uint16_t DataCtrlBits;                      /*!< Data stage control bits to use */
+    uint8_t Stage;                              /*!< [Internal] Current stage of the transfer */
+    uint8_t Listening;                          /*!< [Internal] Slave address listening is active */
+    uint32_t BusFreq_Hz;                        /*!< The bus frequency achieved by the configured timing [Hz] */
+    RCC_PositionType CtrlPos;                   /*!< Relative position for reset and clock control */
+    volatile I2C_ErrorType Errors;              /*!< Transfer errors */
 }I2C_HandleType;
 
 /** @} */
 
-/** @addtogroup I2C_Exported_Functions
+/** @defgroup I2C_Exported_Macros I2C Exported Macros
  * @{ */
 
+#ifdef I2C_BB
+/**
+ * @brief I2C Instance to handle binder macro
+ * @param HANDLE: specifies the peripheral handle.
+ * @param INSTANCE: specifies the I2C peripheral instance.
+ */
+#define         I2C_INST2HANDLE(HANDLE,INSTANCE)                \
+    ((HANDLE)->Inst    = (INSTANCE),                            \
+     (HANDLE)->Inst_BB = I2C_BB(INSTANCE),                      \
+     (HANDLE)->CtrlPos = RCC_POS_##INSTANCE)
+
+/**
+ * @brief I2C register bit accessing macro
+ * @param HANDLE: specifies the peripheral handle.
+ * @param REG_NAME: specifies the register name.
+ * @param BIT_NAME: specifies the register bit name.
+ */
+#define         I2C_REG_BIT(HANDLE, REG_NAME, BIT_NAME)         \
+    ((HANDLE)->Inst_BB->REG_NAME.BIT_NAME)
+
+#else
+/**
+ * @brief I2C Instance to handle binder macro
+ * @param HANDLE: specifies the peripheral handle.
+ * @param INSTANCE: specifies the I2C peripheral instance.
+ */
+#define         I2C_INST2HANDLE(HANDLE,INSTANCE)                \
+    ((HANDLE)->Inst    = (INSTANCE),                            \
+     (HANDLE)->CtrlPos = RCC_POS_##INSTANCE)
+
+/**
+ * @brief I2C register bit accessing macro
+ * @param HANDLE: specifies the peripheral handle.
+ * @param REG_NAME: specifies the register name.
+ * @param BIT_NAME: specifies the register bit name.
+ */
+#define         I2C_REG_BIT(HANDLE, REG_NAME, BIT_NAME)         \
+    ((HANDLE)->Inst->REG_NAME.b.BIT_NAME)
+
+#endif /* I2C_BB */
+
+/* Most I2C use-cases only need support for 1 / 2 byte long
+ * command / register address, so keep it optimized while
+ * permitting extended use with compiler flag */
+#ifdef __XPD_I2C_LONG_CMD
+#define         I2C_TRANSFER_CMD(TRANSFER)                      \
+    ((uint8_t*)((TRANSFER)->pCmd))
+#else
+#define         I2C_TRANSFER_CMD(TRANSFER)                      \
+    ((uint8_t*)&((TRANSFER)->Cmd))
+#endif
+
+/**
+ * @brief  Enable the specified I2C interrupt.
+ * @param  HANDLE: specifies the I2C Handle.
+ * @param  IT_NAME: specifies the interrupt to enable.
+ *         This parameter can be one of the following values:
+ *            @arg EVT:     Event Interrupt
+ *            @arg BUF:     Buffer (TXE and RXNE) Interrupt
+ *            @arg ERR:     Error Interrupt
+ */
+#define         I2C_IT_ENABLE(HANDLE, IT_NAME)                  \
+    (I2C_REG_BIT((HANDLE),CR2,IT##IT_NAME##EN) = 1)
+
+/**
+ * @brief  Disable the specified I2C interrupt.
+ * @param  HANDLE: specifies the I2C Handle.
+ * @param  IT_NAME: specifies the interrupt to disable.
+ *         This parameter can be one of the following values:
+ *            @arg EVT:     Event Interrupt
+ *            @arg BUF:     Buffer (TXE and RXNE) Interrupt
+ *            @arg ERR:     Error Interrupt
+ */
+#define         I2C_IT_DISABLE(HANDLE, IT_NAME)                 \
+    (I2C_REG_BIT((HANDLE),CR2,IT##IT_NAME##EN) = 0)
+
+/**
+ * @brief  Get the specified I2C state flag.
+ * @param  HANDLE: specifies the I2C Handle.
+ * @param  FLAG_NAME: specifies the flag to return.
+ *         This parameter can be one of the following values:
+ *            @arg SB:      Start bit (master mode)
+ *            @arg ADDR:    Address sent (master mode) / matched (slave mode)
+ *            @arg BTF:     Byte transfer finished
+ *            @arg ADD10:   10-bit header sent (master mode)
+ *            @arg STOPF:   Stop detection (slave mode)
+ *            @arg RXNE:    Receive data register not empty
+ *            @arg TXE:     Transmit data register empty
+ *            @arg BERR:    Bus error
+ *            @arg ARLO:    Arbitration lost
+ *            @arg AF:      Acknowledge failure
+ *            @arg OVR:     Overrun/Underrun
+ *            @arg PECERR:  PEC Error in reception
+ *            @arg TIMEOUT: Timeout or tLOW detection
+ *            @arg SMBALERT:SMBus alert
+ * @return The state of the flag.
+ */
+#define         I2C_FLAG_STATUS(HANDLE, FLAG_NAME)              \
+    (((HANDLE)->Inst->SR1.w >> I2C_SR1_##FLAG_NAME##_Pos) & 1)
+
+/**
+ * @brief  Clear the specified I2C error flag.
+ * @param  HANDLE: specifies the I2C Handle.
+ * @param  FLAG_NAME: specifies the flag to clear.
+ *         This parameter can be one of the following values:
+ *            @arg BERR:    Bus error
+ *            @arg ARLO:    Arbitration lost
+ *            @arg AF:      Acknowledge failure
+ *            @arg OVR:     Overrun/Underrun
+ *            @arg PECERR:  PEC Error in reception
+ *            @arg TIMEOUT: Timeout or tLOW detection
+ *            @arg SMBALERT:SMBus alert
+ */
+#define         I2C_FLAG_CLEAR(HANDLE, FLAG_NAME)               \
+    ((HANDLE)->Inst->SR1.w = ~I2C_SR1_##FLAG_NAME)
+
+/** @} */
+
+/** @addtogroup I2C_Common_Exported_Functions
+ * @{ */
+void            I2C_vInit                   (I2C_HandleType * pxI2C, const I2C_InitType * pxConfig);
+void            I2C_vDeinit                 (I2C_HandleType * pxI2C);
+
+XPD_ReturnType  I2C_eGetStatus              (I2C_HandleType * pxI2C);
+XPD_ReturnType  I2C_ePollStatus             (I2C_HandleType * pxI2C, uint32_t ulTimeout);
+
+uint16_t        I2C_usGetRejectedLength     (I2C_HandleType * pxI2C);
+
+void            I2C_vIRQHandler_EV          (I2C_HandleType * pxI2C);
+void            I2C_vIRQHandler_ER          (I2C_HandleType * pxI2C);
+
+void            I2C_vStop_DMA               (I2C_HandleType * pxI2C);
+/** @} */
+
+/** @addtogroup I2C_Master_Exported_Functions
+ * @{ */
+XPD_ReturnType  I2C_eMasterTransfer         (I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer,
+                                             uint32_t ulTimeout);
+void            I2C_vMasterTransfer_IT      (I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer);
+XPD_ReturnType  I2C_eMasterTransfer_DMA     (I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer);
+/** @} */
+
+/** @addtogroup I2C_Slave_Exported_Functions
+ * @{ */
+XPD_ReturnType  I2C_eSlaveListen            (I2C_HandleType * pxI2C, uint8_t ucCmdSize,
+                                             uint32_t ulTimeout);
+void            I2C_vSlaveListen_IT         (I2C_HandleType * pxI2C, uint8_t ucCmdSize);
+void            I2C_vSlaveSuspend_IT        (I2C_HandleType * pxI2C);
+
+XPD_ReturnType  I2C_eSlaveTransferData      (I2C_HandleType * pxI2C, uint32_t ulTimeout);
+void            I2C_vSlaveTransferData_IT   (I2C_HandleType * pxI2C);
+XPD_ReturnType  I2C_eSlaveTransferData_DMA  (I2C_HandleType * pxI2C);
+
+/**
+ * @brief Returns the slave transfer info reference, which specifies the current I2C transfer request,
+ *        and where the application has to configure the data used for the transfer.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @return The slave transfer info reference
+ */
+__STATIC_INLINE I2C_TransferType * I2C_pxSlaveTransferInfo(I2C_HandleType * pxI2C)
+{
+    return &pxI2C->Transfers.Slave;
+}
+
 /** @} */
 
 /** @} */
@@ -0,0 +1,137 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_msc.h
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-28
+  * @brief   STM32 eXtensible Peripheral Drivers USB Mass Storage Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __XPD_USB_MSC_H_
+#define __XPD_USB_MSC_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <xpd_common.h>
+#include <xpd_usb.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/** @ingroup USB
+ * @defgroup USB_MSC USB Mass Storage
+ * @brief    Mass Storage Class Bulk-Only Transport of SCSI block commands over the USB endpoints
+ * @{ */
+
+/** @defgroup USB_MSC_Exported_Types USB MSC Exported Types
+ * @{ */
+
+#define USB_MSC_BOT_RESET           0xFF /*!< Class request to reset the Bulk-Only Transport */
+#define USB_MSC_GET_MAX_LUN         0xFE /*!< Class request to read the highest logical unit number */
+
+/**
+ * @brief Block medium operation type.
+ * @param Handle: pointer to the MSC function structure
+ * @param pucData: pointer to the block data buffer
+ * @param ulBlock: the logical block address
+ * @return OK if the operation is started, ERROR otherwise
+ */
+typedef XPD_ReturnType (*USB_MscBlockOpType)(void * Handle, uint8_t * pucData, uint32_t ulBlock);
+
+/** @brief MSC block medium structure */
+typedef struct
+{
+    uint32_t           BlockCount;  /*!< Number of blocks of the medium, 0 if not present */
+    uint16_t           BlockSize;   /*!< Size of a block, has to be a multiple of the MaxPacketSize */
+    uint8_t            ReadOnly;    /*!< Set if the medium is write protected */
+    USB_MscBlockOpType Read;        /*!< Starts reading a block to the buffer */
+    USB_MscBlockOpType Write;       /*!< Starts writing a block from the buffer */
+}USB_MscMediumType;
+
+/** @brief MSC SCSI command status structure */
+typedef struct
+{
+    uint32_t Tag;           /*!< Tag of the command block wrapper */
+    uint32_t DataLength;    /*!< Data transfer length expected by the host */
+    uint32_t Residue;       /*!< Amount of data not processed */
+    uint8_t  Flags;         /*!< Data transfer direction in bit 7 */
+    uint8_t  Status;        /*!< Command status */
+    uint8_t  Length;        /*!< Length of the command block */
+    uint8_t  Block[16];     /*!< SCSI command block */
+}USB_MscCommandType;
+
+/** @brief MSC function structure */
+typedef struct
+{
+    USB_HandleType *      pUSB;             /*!< USB handle of the device */
+    uint8_t               InEpAddress;      /*!< Bulk IN (device to host) endpoint address */
+    uint8_t               OutEpAddress;     /*!< Bulk OUT (host to device) endpoint address */
+    uint16_t              MaxPacketSize;    /*!< Bulk endpoint packet size */
+    USB_MscMediumType     Medium;           /*!< Block medium of the single logical unit */
+    uint8_t *             Buffer[2];        /*!< Two word aligned block buffers of Medium.BlockSize */
+    const char *          VendorId;         /*!< Inquiry vendor identification [8 characters] */
+    const char *          ProductId;        /*!< Inquiry product identification [16 characters] */
+    const char *          Revision;         /*!< Inquiry product revision level [4 characters] */
+    USB_MscCommandType    Command;          /*!< [Internal] Current command context */
+    struct {
+        uint32_t Block;                     /*!< Next block address of the medium operation */
+        uint16_t ProduceLeft;               /*!< Blocks left to fill a buffer with */
+        uint16_t ConsumeLeft;               /*!< Blocks left to empty a buffer of */
+        uint8_t  Head;                      /*!< Buffer index of the next production */
+        uint8_t  Tail;                      /*!< Buffer index of the next consumption */
+        uint8_t  Used;                      /*!< Number of buffers being filled or holding data */
+        uint8_t  Ready;                     /*!< Number of buffers holding data */
+        uint8_t  ProducerBusy;              /*!< Set while a buffer is being filled */
+        uint8_t  ConsumerBusy;              /*!< Set while a buffer is being emptied */
+        uint8_t  Failed;                    /*!< Set when a medium operation of the pipe failed */
+    } Pipe;                                 /*   [Internal] Block transfer pipeline */
+    struct {
+        uint8_t Key;                        /*!< Sense key */
+        uint8_t Code;                       /*!< Additional sense code */
+    } Sense;                                /*   [Internal] Error information of the last command */
+    uint8_t               State;            /*!< [Internal] Transport state */
+    uint32_t              Status[4];        /*!< [Internal] Command status wrapper buffer */
+}USB_MscType;
+
+/** @} */
+
+/** @addtogroup USB_MSC_Exported_Functions
+ * @{ */
+XPD_ReturnType  USB_eMscInit            (USB_MscType * pxMsc);
+void            USB_vMscOpen            (USB_MscType * pxMsc);
+void            USB_vMscClose           (USB_MscType * pxMsc);
+
+XPD_ReturnType  USB_eMscSetupRequest    (USB_MscType * pxMsc, const uint8_t * pucSetup,
+                                         uint8_t ** ppucData, uint16_t * pusLength);
+void            USB_vMscClearFeature    (USB_MscType * pxMsc, uint8_t ucEpAddress);
+
+void            USB_vMscDataIn          (USB_MscType * pxMsc);
+void            USB_vMscDataOut         (USB_MscType * pxMsc, USB_EndPointHandleType * pxEP);
+
+void            USB_vMscMediumComplete  (USB_MscType * pxMsc, XPD_ReturnType eResult);
+/** @} */
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XPD_USB_MSC_H_ */
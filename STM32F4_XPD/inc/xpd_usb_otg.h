@@ -49,6 +49,106 @@ typedef enum
     USB_BCD_PS2_PROPRIETARY_PORT     = 4, /*!< PS2 or proprietary charging port detected */
     USB_BCD_NOT_SUPPORTED            = 0xFF /*!< Battery Charge Detection is not supported on the device */
 }USB_ChargerType;
+
+#ifndef USB_FIFO_STREAM_DEPTH
+#define USB_FIFO_STREAM_DEPTH   3   /*!< Default packet buffering depth of bulk and isochronous endpoints */
+#endif
+
+/** @brief USB OTG FIFO allocation request of an endpoint */
+typedef struct
+{
+    uint8_t          Address;       /*!< Endpoint address */
+    USB_EndPointType Type;          /*!< Endpoint type */
+    uint16_t         MaxPacketSize; /*!< Endpoint maximum packet size */
+    uint8_t          Depth;         /*!< Desired number of buffered packets */
+}USB_FifoRequestType;
+
+/** @brief USB OTG FIFO RAM layout structure */
+typedef struct
+{
+    uint16_t RxSize;                     /*!< Shared receive FIFO size [words] */
+    uint16_t TxSize[USBD_MAX_EP_COUNT];  /*!< Transmit FIFO sizes of the IN endpoints [words] */
+    uint8_t  RxDepth;                    /*!< Number of largest OUT packets the receive FIFO buffers */
+    uint8_t  TxDepth[USBD_MAX_EP_COUNT]; /*!< Number of packets the transmit FIFOs buffer */
+    uint16_t Used;                       /*!< Allocated FIFO RAM [words] */
+    uint16_t Total;                      /*!< Available FIFO RAM [words] */
+}USB_FifoLayoutType;
+
+#ifndef USBH_MAX_PIPE_COUNT
+#define USBH_MAX_PIPE_COUNT     16  /*!< Number of pipes the host scheduler serves */
+#endif
+
+#ifdef USB_OTG_HS
+#define USBH_MAX_CHANNEL_COUNT  USB_OTG_HS_HOST_MAX_CHANNEL_NBR
+#else
+#define USBH_MAX_CHANNEL_COUNT  USB_OTG_FS_HOST_MAX_CHANNEL_NBR
+#endif
+
+/** @brief USB host port speed types */
+typedef enum
+{
+    USB_HOST_SPEED_HIGH = 0, /*!< High speed device, only available with HS PHY */
+    USB_HOST_SPEED_FULL = 1, /*!< Full speed device */
+    USB_HOST_SPEED_LOW  = 2, /*!< Low speed device */
+}USB_HostSpeedType;
+
+/** @brief USB host pipe transfer status types */
+typedef enum
+{
+    USB_PIPE_IDLE   = 0, /*!< No transfer is submitted */
+    USB_PIPE_BUSY   = 1, /*!< Transfer is waiting for a channel or in progress */
+    USB_PIPE_DONE   = 2, /*!< Transfer completed */
+    USB_PIPE_STALL  = 3, /*!< The endpoint responded with STALL handshake */
+    USB_PIPE_ERROR  = 4, /*!< Transfer failed due to repeated bus errors or device detach */
+}USB_PipeStatusType;
+
+/** @brief USB host pipe structure */
+typedef struct
+{
+    struct {
+        uint8_t *Data;                  /*!< Transfer data buffer */
+        uint32_t Length;                /*!< Requested length, the actual transferred length on completion */
+        uint32_t Progress;              /*!< [Internal] Amount of data transferred so far */
+        uint32_t Request;               /*!< [Internal] Size of the current channel request */
+        uint32_t Written;               /*!< [Internal] Data of the request passed through the FIFO */
+    }Transfer;                          /*!< Pipe data transfer context */
+    XPD_HandleCallbackType Complete;    /*!< Transfer completion callback, receives the pipe */
+    uint16_t            MaxPacketSize;  /*!< Endpoint Max packet size */
+    USB_EndPointType    Type;           /*!< Endpoint type */
+    uint8_t             DevAddress;     /*!< Address of the device */
+    uint8_t             EpAddress;      /*!< Endpoint address, with direction for non-control endpoints */
+    uint8_t             Interval;       /*!< Polling interval of periodic endpoints [(micro)frames] */
+    volatile USB_PipeStatusType Status; /*!< Status of the last submitted transfer */
+    const uint8_t *     Setup;          /*!< [Internal] Setup packet of the control transfer */
+    uint8_t             Stage;          /*!< [Internal] Control transfer stage */
+    uint8_t             Toggle;         /*!< [Internal] Data PID of the next transaction */
+    uint8_t             Channel;        /*!< [Internal] Serving host channel number */
+    uint8_t             Halt;           /*!< [Internal] Reason of the channel halt */
+    uint8_t             Errors;         /*!< [Internal] Consecutive transaction error count */
+    uint8_t             Deferred;       /*!< [Internal] NAKed non-periodic pipe waits for the next frame */
+    uint8_t             Slot;           /*!< [Internal] Index in the host's pipe list */
+    uint16_t            NextFrame;      /*!< [Internal] Frame number of the next periodic transaction */
+}USB_PipeType;
+
+/** @brief USB host handle structure */
+typedef struct
+{
+    USB_OTG_TypeDef * Inst;                 /*!< The address of the peripheral instance used by the handle */
+    struct {
+        XPD_HandleCallbackType DepInit;     /*!< Initialize module dependencies */
+        XPD_HandleCallbackType DepDeinit;   /*!< Restore module dependencies */
+        XPD_HandleCallbackType Connect;     /*!< A device is attached, the port shall be reset */
+        XPD_HandleCallbackType Disconnect;  /*!< The device is detached */
+        XPD_HandleCallbackType PortEnable;  /*!< The port is enabled after reset, Speed is valid */
+        XPD_HandleCallbackType SOF;         /*!< Start Of Frame */
+    }Callbacks;                                         /*   Handle Callbacks */
+    USB_PipeType *              Pipes[USBH_MAX_PIPE_COUNT];     /*!< [Internal] Open pipes */
+    USB_PipeType *              Channels[USBH_MAX_CHANNEL_COUNT];/*!< [Internal] Pipes served by the channels */
+    uint16_t                    Halting;                /*!< [Internal] Released channels waiting for their halt */
+    USB_HostSpeedType           Speed;                  /*!< Speed of the attached device */
+    uint8_t                     PeriodicCount;          /*!< [Internal] Number of open periodic pipes */
+    uint8_t                     NextPipe;               /*!< [Internal] Round-robin index of non-periodic pipes */
+}USB_HostHandleType;
 /** @} */
 
 
@@ -174,9 +274,9 @@ void            USB_vEpSetStall         (USB_HandleType * pxUSB, uint8_t ucEpAdd
 void            USB_vEpClearStall       (USB_HandleType * pxUSB, uint8_t ucEpAddress);
 
 void            USB_vEpSend             (USB_HandleType * pxUSB, uint8_t ucEpAddress,
-                                         const uint8_t * pucData, uint16_t usLength);
+                                         const uint8_t * pucData, uint32_t ulLength);
 void            USB_vEpReceive          (USB_HandleType * pxUSB, uint8_t ucEpAddress,
-                                         uint8_t * pucData, uint16_t usLength);
+                                         uint8_t * pucData, uint32_t ulLength);
 void            USB_vEpFlush            (USB_HandleType * pxUSB, uint8_t ucEpAddress);
 
 void            USB_vSetRemoteWakeup    (USB_HandleType * pxUSB);
@@ -188,9 +288,33 @@ USB_ChargerType USB_eChargerDetect      (USB_HandleType * pxUSB);
 
 void            USB_vDevIRQHandler      (USB_HandleType * pxUSB);
 
+XPD_ReturnType  USB_eFifoPlan           (USB_HandleType * pxUSB, const USB_FifoRequestType axRequests[],
+                                         uint8_t ucCount, USB_FifoLayoutType * pxLayout);
+void            USB_vFifoConfig         (USB_HandleType * pxUSB, const USB_FifoLayoutType * pxLayout);
+
 /* Used internally, has a weak definition */
 void            USB_vAllocateEPs        (USB_HandleType * pxUSB);
 
+void            USB_vHostInit           (USB_HostHandleType * pxHost, const USB_InitType * pxConfig);
+void            USB_vHostDeinit         (USB_HostHandleType * pxHost);
+
+void            USB_vHostStart_IT       (USB_HostHandleType * pxHost);
+void            USB_vHostStop_IT        (USB_HostHandleType * pxHost);
+
+void            USB_vHostSetPortReset   (USB_HostHandleType * pxHost);
+void            USB_vHostClearPortReset (USB_HostHandleType * pxHost);
+
+void            USB_vHostIRQHandler     (USB_HostHandleType * pxHost);
+
+XPD_ReturnType  USB_ePipeOpen           (USB_HostHandleType * pxHost, USB_PipeType * pxPipe);
+void            USB_vPipeClose          (USB_HostHandleType * pxHost, USB_PipeType * pxPipe);
+
+XPD_ReturnType  USB_ePipeTransfer       (USB_HostHandleType * pxHost, USB_PipeType * pxPipe,
+                                         uint8_t * pucData, uint32_t ulLength);
+XPD_ReturnType  USB_ePipeControl        (USB_HostHandleType * pxHost, USB_PipeType * pxPipe,
+                                         const uint8_t * pucSetup, uint8_t * pucData);
+void            USB_vPipeCancel         (USB_HostHandleType * pxHost, USB_PipeType * pxPipe);
+
 /**
  * @brief Sets the USB PHY clock status.
  * @param pxUSB: pointer to the USB handle structure
@@ -201,6 +325,26 @@ __STATIC_INLINE void USB_vPhyClockCtrl(USB_HandleType * pxUSB, FunctionalState N
     USB_REG_BIT(pxUSB, PCGCCTL, STOPCLK) = ~NewState;
 }
 
+/**
+ * @brief Returns the current (micro)frame number of the host.
+ * @param pxHost: pointer to the USB host handle structure
+ * @return The frame number
+ */
+__STATIC_INLINE uint16_t USB_usHostFrameNumber(USB_HostHandleType * pxHost)
+{
+    return pxHost->Inst->HFNUM.b.FRNUM;
+}
+
+/**
+ * @brief Restarts the data toggling of a pipe with DATA0,
+ *        after the endpoint halt is cleared or the device configuration is set.
+ * @param pxPipe: pointer to the USB pipe structure
+ */
+__STATIC_INLINE void USB_vPipeResetToggle(USB_PipeType * pxPipe)
+{
+    pxPipe->Toggle = 0;
+}
+
 /** @} */
 
 #define XPD_USB_API
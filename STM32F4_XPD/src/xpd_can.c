@@ -93,6 +93,9 @@
 #define CAN_INPUT_CLOCK_RATE    \
     (RCC_ulClockFreq_Hz(PCLK1))
 
+/* CiA recommended sample point [per mille] */
+#define CAN_DEFAULT_SAMPLE_POINT    875
+
 /* Filter types */
 #define FILTER_SIZE_FLAG_Pos    1
 #define FILTER_SIZE_FLAG        2
@@ -100,11 +103,173 @@
 #define FILTER_MODE_FLAG        1
 #define FMI_INVALID             0xFF
 
-static const uint8_t can_aucFilterTypeSpace[] = {2, 1, 4, 2};
+static const uint8_t can_aucFilterTypeSpace[] = {2, 4, 1, 2};
 
 /** @defgroup CAN_Private_Functions CAN Private Functions
  * @{ */
 
+/**
+ * @brief Reads the fine time of the statistics timer.
+ * @param pxStats: pointer to the statistics
+ * @return The time since the statistics start [timer counts]
+ */
+static uint32_t CAN_prvStatsTime(CAN_StatsType * pxStats)
+{
+    uint32_t ulTicks = pxStats->TickCount;
+    uint32_t ulCount = *TIM_pulCounter(pxStats->pTIM);
+    uint32_t ulReload = *TIM_pulReload(pxStats->pTIM);
+
+    /* the counter has already wrapped, but the update is not yet processed */
+    if ((TIM_FLAG_STATUS(pxStats->pTIM, U) != 0) && (ulCount < (ulReload / 2)))
+    {
+        ulTicks++;
+    }
+    return (ulTicks * (ulReload + 1)) + ulCount;
+}
+
+/**
+ * @brief Converts a 16-bit hardware time stamp to a frame time stamp.
+ *        With statistics enabled, the time stamp is extended to 32 bits
+ *        by determining the number of hardware counter wraps from the timer updates.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param usStamp: the hardware time stamp
+ * @return The frame time stamp [CAN bit times]
+ */
+static uint32_t CAN_prvTimestamp(CAN_HandleType * pxCAN, uint16_t usStamp)
+{
+    CAN_StatsType * pxStats = pxCAN->Stats;
+    uint32_t ulStamp = usStamp;
+
+    if (pxStats != NULL)
+    {
+        int32_t lElapsed = (int16_t)(usStamp - (uint16_t)pxStats->LastTime);
+        uint32_t ulCoarse = (uint32_t)pxStats->Ticks * pxStats->TickBits;
+
+        /* the coarse elapsed time rounds to the number of wraps */
+        lElapsed += ((ulCoarse - (uint32_t)lElapsed + 0x8000) >> 16) << 16;
+
+        ulStamp = pxStats->LastTime + lElapsed;
+
+        /* only advance with newer stamps */
+        if (lElapsed > 0)
+        {
+            pxStats->LastTime = ulStamp;
+            pxStats->Ticks = 0;
+        }
+    }
+    return ulStamp;
+}
+
+/**
+ * @brief Calculates the nominal length of a frame (without stuff bits).
+ * @param eType: the frame Id type
+ * @param ucDLC: the frame data length code
+ * @return The frame length including the interframe space [bits]
+ */
+static uint32_t CAN_prvFrameBits(CAN_IdType eType, uint8_t ucDLC)
+{
+    uint32_t ulBits = ((eType & CAN_IDTYPE_EXT_DATA) == CAN_IDTYPE_STD_DATA) ? 47 : 67;
+
+    if ((eType & CAN_IDTYPE_STD_RTR) == 0)
+    {
+        ulBits += 8 * ((ucDLC < 8) ? ucDLC : 8);
+    }
+    return ulBits;
+}
+
+/**
+ * @brief Updates the statistics with a received frame.
+ * @param pxStats: pointer to the statistics
+ * @param ucFIFONumber: the receive FIFO of the frame [0 .. 1]
+ * @param pxFrame: pointer to the received frame
+ */
+static void CAN_prvStatsArrival(CAN_StatsType * pxStats, uint8_t ucFIFONumber,
+        const CAN_FrameType * pxFrame)
+{
+    pxStats->LoadBits += CAN_prvFrameBits(pxFrame->Id.Type, pxFrame->DLC);
+
+    if ((pxStats->Arrivals[ucFIFONumber] != NULL) && (pxFrame->Index < pxStats->ArrivalCount))
+    {
+        CAN_ArrivalStatsType * pxArrival = &pxStats->Arrivals[ucFIFONumber][pxFrame->Index];
+
+        if (pxArrival->Count > 0)
+        {
+            uint32_t ulPeriod = pxFrame->Timestamp - pxArrival->Last;
+            uint32_t ulDeviation;
+
+            /* the average period is a 1/8 weighted moving average */
+            if (pxArrival->Count == 1)
+            {
+                pxArrival->Period = ulPeriod;
+            }
+            else
+            {
+                pxArrival->Period += (int32_t)(ulPeriod - pxArrival->Period) / 8;
+            }
+
+            ulDeviation = (ulPeriod > pxArrival->Period) ?
+                    (ulPeriod - pxArrival->Period) : (pxArrival->Period - ulPeriod);
+            if (ulDeviation > pxArrival->Jitter)
+            {
+                pxArrival->Jitter = ulDeviation;
+            }
+        }
+
+        pxArrival->Last = pxFrame->Timestamp;
+        if (pxArrival->Count < 0xFFFF)
+        {
+            pxArrival->Count++;
+        }
+    }
+}
+
+/**
+ * @brief Adds the current error state and counters to the error history.
+ * @param pxCAN: pointer to the CAN handle structure
+ */
+static void CAN_prvStatsError(CAN_HandleType * pxCAN)
+{
+    CAN_StatsType * pxStats = pxCAN->Stats;
+    uint32_t ulESR = pxCAN->Inst->ESR.w;
+
+    pxStats->ErrorCounters = ulESR & (CAN_ESR_TEC | CAN_ESR_REC);
+
+    if (pxStats->Errors != NULL)
+    {
+        CAN_ErrorRecordType * pxRecord = &pxStats->Errors[pxStats->ErrorHead & (pxStats->ErrorSize - 1)];
+
+        pxRecord->Timestamp = pxStats->LastTime;
+        pxRecord->TEC       = (ulESR & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+        pxRecord->REC       = (ulESR & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
+        pxRecord->Error     = ulESR & (CAN_ESR_LEC | CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF);
+
+        pxStats->ErrorHead++;
+    }
+}
+
+/**
+ * @brief Updates the statistics with a successfully transmitted mailbox.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param ulTxMB: the transmit mailbox index
+ */
+static void CAN_prvStatsTransmit(CAN_HandleType * pxCAN, uint32_t ulTxMB)
+{
+    CAN_StatsType * pxStats = pxCAN->Stats;
+    uint32_t ulTDTR = pxCAN->Inst->sTxMailBox[ulTxMB].TDTR.w;
+    uint32_t ulLatency = CAN_prvStatsTime(pxStats) - pxStats->TxLoadTime[ulTxMB];
+
+    pxStats->TxTimestamp[ulTxMB] = CAN_prvTimestamp(pxCAN, ulTDTR >> CAN_TDT0R_TIME_Pos);
+    pxStats->LoadBits += CAN_prvFrameBits(pxCAN->Inst->sTxMailBox[ulTxMB].TIR.w & CAN_IDTYPE_EXT_RTR,
+            ulTDTR & CAN_TDT0R_DLC);
+
+    if (ulLatency > pxStats->TxLatencyMax)
+    {
+        pxStats->TxLatencyMax = ulLatency;
+    }
+    pxStats->TxLatencySum += ulLatency;
+    pxStats->TxCount++;
+}
+
 /**
  * @brief Gets an empty transmit mailbox.
  * @param pxCAN: pointer to the CAN handle structure
@@ -160,6 +325,11 @@ static XPD_ReturnType CAN_prvFrameTransmit(CAN_HandleType * pxCAN, CAN_FrameType
         pxCAN->Inst->sTxMailBox[pxFrame->Index].TDLR.w = pxFrame->Data.Word[0];
         pxCAN->Inst->sTxMailBox[pxFrame->Index].TDHR.w = pxFrame->Data.Word[1];
 
+        if (pxCAN->Stats != NULL)
+        {
+            pxCAN->Stats->TxLoadTime[pxFrame->Index] = CAN_prvStatsTime(pxCAN->Stats);
+        }
+
         /* request transmission */
         CAN_REG_BIT(pxCAN,sTxMailBox[pxFrame->Index].TIR,TXRQ) = 1;
     }
@@ -167,6 +337,153 @@ static XPD_ReturnType CAN_prvFrameTransmit(CAN_HandleType * pxCAN, CAN_FrameType
     return eResult;
 }
 
+/**
+ * @brief Calculates the bus arbitration order of an identifier.
+ * @param pxId: pointer to the identifier
+ * @return The arbitration key, lower values win the arbitration
+ */
+static uint32_t CAN_prvArbitrationKey(const CAN_IdentifierFieldType * pxId)
+{
+    uint32_t ulKey;
+
+    if ((pxId->Type & CAN_IDTYPE_EXT_DATA) == CAN_IDTYPE_STD_DATA)
+    {
+        /* base Id, RTR */
+        ulKey = (pxId->Value << 21) | ((pxId->Type & CAN_IDTYPE_STD_RTR) << 19);
+    }
+    else
+    {
+        /* base Id, recessive SRR and IDE, extended Id, RTR */
+        ulKey = ((pxId->Value >> 18) << 21) | (3 << 19)
+              | ((pxId->Value & 0x3FFFF) << 1) | ((pxId->Type & CAN_IDTYPE_STD_RTR) >> 1);
+    }
+    return ulKey;
+}
+
+/**
+ * @brief Reads back the frame identifier from a transmit mailbox.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param ucMb: the transmit mailbox index
+ * @param pxId: pointer to the identifier to fill
+ */
+static void CAN_prvMailboxId(CAN_HandleType * pxCAN, uint8_t ucMb, CAN_IdentifierFieldType * pxId)
+{
+    uint32_t ulTIR = pxCAN->Inst->sTxMailBox[ucMb].TIR.w;
+
+    pxId->Type = ulTIR & CAN_IDTYPE_EXT_RTR;
+
+    if ((pxId->Type & CAN_IDTYPE_EXT_DATA) == CAN_IDTYPE_STD_DATA)
+    {
+        pxId->Value = ulTIR >> CAN_TI0R_STID_Pos;
+    }
+    else
+    {
+        pxId->Value = ulTIR >> CAN_TI0R_EXID_Pos;
+    }
+}
+
+/**
+ * @brief Inserts a frame to the transmit queue. The queue storage is kept in
+ *        descending priority order, so the next frame to send is always the last one.
+ * @param pxQueue: pointer to the transmit queue
+ * @param pxFrame: pointer to the frame to insert
+ * @param ucFirst: set to place the frame before the same priority frames (used for requeueing)
+ * @return The inserted frame in the queue storage
+ */
+static CAN_FrameType * CAN_prvTxQueueInsert(CAN_TxQueueType * pxQueue, const CAN_FrameType * pxFrame,
+        uint8_t ucFirst)
+{
+    uint32_t ulKey = CAN_prvArbitrationKey(&pxFrame->Id);
+    uint16_t usIndex;
+
+    /* frames of the same priority are sent in the order of queueing */
+    for (usIndex = pxQueue->Count; usIndex > 0; usIndex--)
+    {
+        uint32_t ulQueuedKey = CAN_prvArbitrationKey(&pxQueue->Frames[usIndex - 1].Id);
+
+        if ((ulQueuedKey > ulKey) || ((ucFirst != 0) && (ulQueuedKey == ulKey)))
+        {
+            break;
+        }
+        pxQueue->Frames[usIndex] = pxQueue->Frames[usIndex - 1];
+    }
+    pxQueue->Frames[usIndex] = *pxFrame;
+    pxQueue->Count++;
+
+    return &pxQueue->Frames[usIndex];
+}
+
+/**
+ * @brief Moves back an aborted frame from its transmit mailbox to the transmit queue.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param ucMb: the transmit mailbox index
+ */
+static void CAN_prvTxQueueRequeue(CAN_HandleType * pxCAN, uint8_t ucMb)
+{
+    CAN_FrameType xFrame;
+
+    CAN_prvMailboxId(pxCAN, ucMb, &xFrame.Id);
+    xFrame.DLC = pxCAN->Inst->sTxMailBox[ucMb].TDTR.w & CAN_TDT0R_DLC;
+    xFrame.Data.Word[0] = pxCAN->Inst->sTxMailBox[ucMb].TDLR.w;
+    xFrame.Data.Word[1] = pxCAN->Inst->sTxMailBox[ucMb].TDHR.w;
+    xFrame.Index = ucMb;
+
+    (void) CAN_prvTxQueueInsert(pxCAN->TxQueue, &xFrame, 1);
+}
+
+/**
+ * @brief Loads the empty transmit mailboxes with the highest priority queued frames.
+ *        If all mailboxes are occupied by lower priority frames than the queue head,
+ *        the lowest priority mailbox is aborted to make place for it.
+ * @param pxCAN: pointer to the CAN handle structure
+ */
+static void CAN_prvTxQueueRefill(CAN_HandleType * pxCAN)
+{
+    CAN_TxQueueType * pxQueue = pxCAN->TxQueue;
+
+    while ((pxQueue->Count > 0) &&
+           (CAN_prvFrameTransmit(pxCAN, &pxQueue->Frames[pxQueue->Count - 1]) == XPD_OK))
+    {
+        uint8_t ucMbState = 1 << pxQueue->Frames[pxQueue->Count - 1].Index;
+
+        SET_BIT(pxCAN->State, ucMbState);
+        SET_BIT(pxQueue->Mailboxes, ucMbState);
+        pxQueue->Count--;
+    }
+
+    /* preempt a lower priority mailbox, if the aborted frame can be requeued */
+    if ((pxQueue->Count > 0) && (pxQueue->Aborting == 0) && (pxQueue->Count < pxQueue->Size))
+    {
+        uint32_t ulHeadKey = CAN_prvArbitrationKey(&pxQueue->Frames[pxQueue->Count - 1].Id);
+        uint32_t ulLowestKey = ulHeadKey;
+        uint8_t ucMb, ucLowestMb = 0xFF;
+
+        for (ucMb = 0; ucMb < 3; ucMb++)
+        {
+            if ((pxQueue->Mailboxes & (1 << ucMb)) != 0)
+            {
+                CAN_IdentifierFieldType xId;
+                uint32_t ulKey;
+
+                CAN_prvMailboxId(pxCAN, ucMb, &xId);
+                ulKey = CAN_prvArbitrationKey(&xId);
+
+                if (ulKey > ulLowestKey)
+                {
+                    ulLowestKey = ulKey;
+                    ucLowestMb = ucMb;
+                }
+            }
+        }
+
+        if (ucLowestMb < 3)
+        {
+            SET_BIT(pxQueue->Aborting, 1 << ucLowestMb);
+            CAN_TXFLAG_CLEAR(pxCAN, ucLowestMb, ABRQ);
+        }
+    }
+}
+
 /**
  * @brief Gets the data from the receive FIFO to the receive frame pointer of the handle
  *        and flushes the frame from the FIFO.
@@ -195,6 +512,10 @@ static void CAN_prvFrameReceive(CAN_HandleType * pxCAN, uint8_t ucFIFONumber)
     /* Get the FMI */
     pxCAN->RxFrame[ucFIFONumber]->Index = (ulRDTR & CAN_RDT0R_FMI) >> CAN_RDT0R_FMI_Pos;
 
+    /* Get the time stamp */
+    pxCAN->RxFrame[ucFIFONumber]->Timestamp =
+            CAN_prvTimestamp(pxCAN, ulRDTR >> CAN_RDT0R_TIME_Pos);
+
     /* Get the data field */
     pxCAN->RxFrame[ucFIFONumber]->Data.Word[0] =
             pxCAN->Inst->sFIFOMailBox[ucFIFONumber].RDLR.w;
@@ -203,6 +524,342 @@ static void CAN_prvFrameReceive(CAN_HandleType * pxCAN, uint8_t ucFIFONumber)
 
     /* Release the FIFO */
     CAN_RXFLAG_CLEAR(pxCAN, ucFIFONumber, RFOM);
+
+    if (pxCAN->Stats != NULL)
+    {
+        CAN_prvStatsArrival(pxCAN->Stats, ucFIFONumber, pxCAN->RxFrame[ucFIFONumber]);
+    }
+}
+
+/**
+ * @brief Forwards a received frame to the destination of its route.
+ * @param pxGateway: pointer to the gateway
+ * @param pxFrame: pointer to the received frame
+ * @return 1 if the frame is consumed by the gateway, 0 if it is kept locally
+ */
+static uint8_t CAN_prvGatewayForward(CAN_GatewayType * pxGateway, CAN_FrameType * pxFrame)
+{
+    uint8_t ucConsumed = 0;
+
+    if ((pxFrame->Index < pxGateway->RouteCount) &&
+        (pxGateway->Routes[pxFrame->Index].Destination != NULL))
+    {
+        CAN_RouteType * pxRoute = &pxGateway->Routes[pxFrame->Index];
+
+        ucConsumed = 1;
+
+        if ((pxRoute->Limit != 0) && (pxRoute->Count >= pxRoute->Limit))
+        {
+            pxGateway->Limited++;
+        }
+        else
+        {
+            if (pxRoute->Rewrite != 0)
+            {
+                pxFrame->Id = pxRoute->Id;
+            }
+
+            if (CAN_eEnqueue_IT(pxRoute->Destination, pxFrame) == XPD_OK)
+            {
+                pxRoute->Count++;
+                pxGateway->Forwarded++;
+            }
+            else
+            {
+                pxGateway->Dropped++;
+            }
+        }
+    }
+    return ucConsumed;
+}
+
+/**
+ * @brief Empties the receive FIFO into the receive ring, so the hardware FIFO
+ *        is serviced completely in a single interrupt entry.
+ *        Frames with a gateway route are forwarded instead of being stored.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param ucFIFONumber: the selected receive FIFO [0 .. 1]
+ */
+static void CAN_prvRingFill(CAN_HandleType * pxCAN, uint8_t ucFIFONumber)
+{
+    CAN_RxRingType * pxRing = pxCAN->RxRing[ucFIFONumber];
+    CAN_GatewayType * pxGateway = pxCAN->Gateway[ucFIFONumber];
+    uint16_t usHead = pxRing->Head;
+    uint32_t ulRFR;
+
+    do
+    {
+        CAN_FrameType xFrame;
+        uint8_t ucStore = (uint16_t)(usHead - pxRing->Tail) < pxRing->Size;
+
+        if (ucStore != 0)
+        {
+            /* get the FIFO contents to the next free ring element */
+            pxCAN->RxFrame[ucFIFONumber] = &pxRing->Frames[usHead & (pxRing->Size - 1)];
+        }
+        else
+        {
+            /* the ring is full, the frame can still be forwarded */
+            pxCAN->RxFrame[ucFIFONumber] = &xFrame;
+        }
+
+        if ((pxGateway == NULL) && (ucStore == 0))
+        {
+            /* ring is full, the frame is dropped */
+            CAN_RXFLAG_CLEAR(pxCAN, ucFIFONumber, RFOM);
+            pxRing->Overruns++;
+        }
+        else
+        {
+            CAN_prvFrameReceive(pxCAN, ucFIFONumber);
+
+            if ((pxGateway != NULL) && (CAN_prvGatewayForward(pxGateway, pxCAN->RxFrame[ucFIFONumber]) != 0))
+            {
+                /* the ring element is reused */
+            }
+            else if (ucStore != 0)
+            {
+                usHead++;
+            }
+            else
+            {
+                pxRing->Overruns++;
+            }
+        }
+
+        /* wait until the FIFO output is released, so FMP is up to date */
+        do {
+            ulRFR = pxCAN->Inst->RFR[ucFIFONumber].w;
+        } while ((ulRFR & CAN_RF0R_RFOM0) != 0);
+    }
+    while ((ulRFR & CAN_RF0R_FMP0) != 0);
+
+    /* count the frames lost by the hardware FIFO as well */
+    if ((ulRFR & CAN_RF0R_FOVR0) != 0)
+    {
+        CAN_RXFLAG_CLEAR(pxCAN, ucFIFONumber, FOVR);
+        pxRing->Overruns++;
+    }
+
+    /* make the frames available to the consumer */
+    pxRing->Head = usHead;
+}
+
+/**
+ * @brief Appends a hardware filter to the filter compiler storage.
+ * @param pxCompiler: pointer to the filter compiler
+ * @param pxFilter: pointer to the filter to add
+ * @param ucTag: the application tag of the filter
+ * @return ERROR if the storage is full, OK if the filter is added
+ */
+static XPD_ReturnType CAN_prvFilterAppend(CAN_FilterCompilerType * pxCompiler,
+        const CAN_FilterType * pxFilter, uint8_t ucTag)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if (pxCompiler->Count < pxCompiler->Size)
+    {
+        pxCompiler->Filters[pxCompiler->Count] = *pxFilter;
+        pxCompiler->Tags[pxCompiler->Count] = ucTag;
+        pxCompiler->Count++;
+        eResult = XPD_OK;
+    }
+    return eResult;
+}
+
+/**
+ * @brief Removes a hardware filter from the filter compiler storage.
+ * @param pxCompiler: pointer to the filter compiler
+ * @param ucIndex: the index of the filter to remove
+ */
+static void CAN_prvFilterRemove(CAN_FilterCompilerType * pxCompiler, uint8_t ucIndex)
+{
+    pxCompiler->Count--;
+    pxCompiler->Filters[ucIndex] = pxCompiler->Filters[pxCompiler->Count];
+    pxCompiler->Tags[ucIndex] = pxCompiler->Tags[pxCompiler->Count];
+}
+
+/**
+ * @brief Splits an Identifier range to the minimal set of aligned filter blocks.
+ * @param pxCompiler: pointer to the filter compiler
+ * @param pxRange: pointer to the Identifier range
+ * @return ERROR if the range is invalid or the storage is full, OK if the range is added
+ */
+static XPD_ReturnType CAN_prvFilterAddRange(CAN_FilterCompilerType * pxCompiler,
+        const CAN_FilterRangeType * pxRange)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint32_t ulIdMask = ((pxRange->Type & CAN_IDTYPE_EXT_DATA) != 0) ? 0x1FFFFFFF : 0x7FF;
+    uint32_t ulValue = pxRange->First;
+    CAN_FilterType xFilter;
+
+    xFilter.Pattern.Type = pxRange->Type;
+    xFilter.FIFO = pxRange->FIFO;
+
+    if ((pxRange->First <= pxRange->Last) && (pxRange->Last <= ulIdMask))
+    {
+        eResult = XPD_OK;
+    }
+
+    while ((eResult == XPD_OK) && (ulValue <= pxRange->Last))
+    {
+        uint32_t ulBlock = 1;
+
+        /* take the largest aligned block which fits in the remaining range */
+        while (((ulValue & ulBlock) == 0) && (ulBlock <= ulIdMask)
+                && ((ulValue + (ulBlock << 1) - 1) <= pxRange->Last))
+        {
+            ulBlock <<= 1;
+        }
+
+        xFilter.Pattern.Value = ulValue;
+        xFilter.Mask = ulIdMask & ~(ulBlock - 1);
+        xFilter.Mode = (xFilter.Mask == ulIdMask) ? CAN_FILTER_MATCH : CAN_FILTER_MASK;
+
+        eResult = CAN_prvFilterAppend(pxCompiler, &xFilter, pxRange->Tag);
+
+        ulValue += ulBlock;
+    }
+    return eResult;
+}
+
+/**
+ * @brief Reduces the number of filters by removing the covered filters
+ *        and by joining the filter pairs which only differ in a single Identifier bit.
+ * @param pxCompiler: pointer to the filter compiler
+ */
+static void CAN_prvFilterMerge(CAN_FilterCompilerType * pxCompiler)
+{
+    uint8_t ucMerged;
+
+    do
+    {
+        uint8_t ucA, ucB;
+
+        ucMerged = 0;
+
+        for (ucA = 0; ucA < pxCompiler->Count; ucA++)
+        {
+            for (ucB = ucA + 1; ucB < pxCompiler->Count; )
+            {
+                CAN_FilterType * pxA = &pxCompiler->Filters[ucA];
+                CAN_FilterType * pxB = &pxCompiler->Filters[ucB];
+                uint32_t ulDiff = pxA->Pattern.Value ^ pxB->Pattern.Value;
+
+                if ((pxCompiler->Tags[ucA] != pxCompiler->Tags[ucB]) ||
+                    (pxA->FIFO != pxB->FIFO) || (pxA->Pattern.Type != pxB->Pattern.Type))
+                {
+                    ucB++;
+                    continue;
+                }
+
+                /* B is covered by A */
+                if (((pxA->Mask & ~pxB->Mask) == 0) && ((ulDiff & pxA->Mask) == 0))
+                {
+                    CAN_prvFilterRemove(pxCompiler, ucB);
+                    ucMerged = 1;
+                }
+                /* A is covered by B */
+                else if (((pxB->Mask & ~pxA->Mask) == 0) && ((ulDiff & pxB->Mask) == 0))
+                {
+                    *pxA = *pxB;
+                    CAN_prvFilterRemove(pxCompiler, ucB);
+                    ucMerged = 1;
+                }
+                /* A and B are two halves of a larger block */
+                else if ((pxA->Mask == pxB->Mask) && ((ulDiff & (ulDiff - 1)) == 0))
+                {
+                    pxA->Mask &= ~ulDiff;
+                    pxA->Pattern.Value &= pxA->Mask;
+                    pxA->Mode = CAN_FILTER_MASK;
+                    CAN_prvFilterRemove(pxCompiler, ucB);
+                    ucMerged = 1;
+                }
+                else
+                {
+                    ucB++;
+                }
+            }
+        }
+    }
+    while (ucMerged != 0);
+}
+
+/**
+ * @brief Determines the filter bank type of a filter.
+ * @param pxFilter: pointer to the filter
+ * @return The filter bank type, also encoding the FIFO selection
+ */
+static uint8_t CAN_prvFilterBankType(const CAN_FilterType * pxFilter)
+{
+    return (pxFilter->Mode & FILTER_MODE_FLAG)
+         | (((pxFilter->Pattern.Type >> CAN_RI0R_IDE_Pos) & 1) << FILTER_SIZE_FLAG_Pos)
+         | (pxFilter->FIFO << 2);
+}
+
+/**
+ * @brief Fills the partially used filter banks to reduce the bank demand,
+ *        and so that each Filter Match Index has a known application tag.
+ * @param pxCompiler: pointer to the filter compiler
+ * @return The number of filter banks needed, or 0xFF if the storage is too small
+ */
+static uint8_t CAN_prvFilterPack(CAN_FilterCompilerType * pxCompiler)
+{
+    uint8_t aucTypeCount[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t ucIndex, ucType, ucBanks = 0;
+
+    for (ucIndex = 0; ucIndex < pxCompiler->Count; ucIndex++)
+    {
+        aucTypeCount[CAN_prvFilterBankType(&pxCompiler->Filters[ucIndex])]++;
+    }
+
+    for (ucType = 0; ucType < 8; ucType += 4)
+    {
+        /* a single 16-bit list filter fits in the free slot of a 16-bit mask bank */
+        if (((aucTypeCount[ucType + FILTER_MODE_FLAG] % 4) == 1) && ((aucTypeCount[ucType] % 2) == 1))
+        {
+            for (ucIndex = pxCompiler->Count; ucIndex > 0; ucIndex--)
+            {
+                if (CAN_prvFilterBankType(&pxCompiler->Filters[ucIndex - 1]) == (ucType + FILTER_MODE_FLAG))
+                {
+                    pxCompiler->Filters[ucIndex - 1].Mode = CAN_FILTER_MASK;
+                    aucTypeCount[ucType + FILTER_MODE_FLAG]--;
+                    aucTypeCount[ucType]++;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (ucType = 0; ucType < 8; ucType++)
+    {
+        uint8_t ucSpace = can_aucFilterTypeSpace[ucType & (FILTER_MODE_FLAG | FILTER_SIZE_FLAG)];
+
+        if ((aucTypeCount[ucType] % ucSpace) != 0)
+        {
+            /* find the last filter of the type */
+            for (ucIndex = pxCompiler->Count; ucIndex > 0; ucIndex--)
+            {
+                if (CAN_prvFilterBankType(&pxCompiler->Filters[ucIndex - 1]) == ucType)
+                {
+                    break;
+                }
+            }
+
+            /* duplicate it to the remaining filters of the bank */
+            while ((aucTypeCount[ucType] % ucSpace) != 0)
+            {
+                if (CAN_prvFilterAppend(pxCompiler, &pxCompiler->Filters[ucIndex - 1],
+                        pxCompiler->Tags[ucIndex - 1]) != XPD_OK)
+                {
+                    return 0xFF;
+                }
+                aucTypeCount[ucType]++;
+            }
+        }
+        ucBanks += aucTypeCount[ucType] / ucSpace;
+    }
+    return ucBanks;
 }
 
 /**
@@ -221,54 +878,174 @@ __STATIC_INLINE void CAN_prvFilterReset(CAN_HandleType * pxCAN)
     {
         RCC_vClockEnable(RCC_POS_CAN1);
     }
-#endif /* CAN2 */
+#endif /* CAN2 */
+
+    CLEAR_BIT(CAN_MASTER(pxCAN)->FA1R, ulMask << ucFBOffset);
+}
+
+/**
+ * @brief Compares two bit timing solutions.
+ * @param pxA: pointer to the evaluated solution
+ * @param pxB: pointer to the reference solution
+ * @param ulBitrate: the target bitrate
+ * @param usSamplePoint: the target sample point [per mille]
+ * @return 1 if the evaluated solution is better than the reference, 0 otherwise
+ */
+static uint8_t CAN_prvTimingIsBetter(const CAN_TimingSolutionType * pxA,
+        const CAN_TimingSolutionType * pxB, uint32_t ulBitrate, uint16_t usSamplePoint)
+{
+    uint32_t ulErrA  = (pxA->Bitrate > ulBitrate) ? (pxA->Bitrate - ulBitrate) : (ulBitrate - pxA->Bitrate);
+    uint32_t ulErrB  = (pxB->Bitrate > ulBitrate) ? (pxB->Bitrate - ulBitrate) : (ulBitrate - pxB->Bitrate);
+    uint16_t usSPErrA = (pxA->SamplePoint > usSamplePoint) ?
+            (pxA->SamplePoint - usSamplePoint) : (usSamplePoint - pxA->SamplePoint);
+    uint16_t usSPErrB = (pxB->SamplePoint > usSamplePoint) ?
+            (pxB->SamplePoint - usSamplePoint) : (usSamplePoint - pxB->SamplePoint);
+    uint8_t ucResult;
+
+    if (ulErrA != ulErrB)
+    {
+        ucResult = ulErrA < ulErrB;
+    }
+    else if (usSPErrA != usSPErrB)
+    {
+        ucResult = usSPErrA < usSPErrB;
+    }
+    else
+    {
+        ucResult = pxA->Tolerance > pxB->Tolerance;
+    }
+    return ucResult;
+}
+
+/** @} */
+
+/** @defgroup CAN_Exported_Functions CAN Exported Functions
+ * @{ */
+
+/**
+ * @brief Calculates the bit timing setups which best match the desired bitrate
+ *        and sample point, and returns them in ranked order. All prescaler and bit segment
+ *        combinations are evaluated, the ranking criteria are (in decreasing significance):
+ *        @arg The bitrate error
+ *        @arg The sample point error
+ *        @arg The allowed oscillator tolerance
+ * @param ulBitrate: The target bitrate to achieve
+ * @param usSamplePoint: The target sample point in per mille of the bit time (e.g. 875 for CANopen, J1939)
+ * @param axSolutions: array to fill with the ranked timing solutions
+ * @param ucCount: the number of elements in the solutions array
+ * @return The number of found solutions, 0 if the bitrate is not supported
+ * @note  The oscillator tolerance is calculated according to ISO 11898-1, with BS1 used as phase segment 1.
+ *        Solutions with larger bitrate error than their allowed oscillator tolerance are discarded.
+ */
+uint8_t CAN_ucTimingSolve(
+        uint32_t                    ulBitrate,
+        uint16_t                    usSamplePoint,
+        CAN_TimingSolutionType      axSolutions[],
+        uint8_t                     ucCount)
+{
+    uint32_t ulClockRate = CAN_INPUT_CLOCK_RATE;
+    uint8_t ucFound = 0;
+    uint32_t ulNBT;
+
+    /* 1bit: 1TQ sync + 1-16TQ BS1 + 1-8TQ BS2 */
+    for (ulNBT = 3; ulNBT <= 25; ulNBT++)
+    {
+        uint32_t ulPres = (ulClockRate + (ulBitrate * ulNBT) / 2) / (ulBitrate * ulNBT);
+        uint32_t ulBS2, ulError;
+
+        if ((ulPres < 1) || (ulPres > 1024))
+        {
+            continue;
+        }
+
+        /* bitrate error in ppm, only evaluated under 1% */
+        ulError = ulPres * ulNBT * ulBitrate;
+        ulError = (ulError > ulClockRate) ? (ulError - ulClockRate) : (ulClockRate - ulError);
+        if (ulError > (ulClockRate / 100))
+        {
+            continue;
+        }
+        ulError = (ulError * 1000) / (ulClockRate / 1000);
+
+        for (ulBS2 = 1; (ulBS2 <= 8) && (ulBS2 < (ulNBT - 1)); ulBS2++)
+        {
+            uint32_t ulBS1 = ulNBT - 1 - ulBS2;
+            uint32_t ulSJW, ulPhase, ulTol1, ulTol2;
+            CAN_TimingSolutionType xSolution;
+            uint8_t ucRank;
+
+            if (ulBS1 > 16)
+            {
+                continue;
+            }
+
+            /* SJW is maximized to allow the largest tolerance */
+            ulPhase = (ulBS1 < ulBS2) ? ulBS1 : ulBS2;
+            ulSJW   = (ulPhase < 4) ? ulPhase : 4;
+
+            /* tolerance limits from resynchronization, and from sampling through error flags */
+            ulTol1 = (ulSJW * 1000000) / (20 * ulNBT);
+            ulTol2 = (ulPhase * 1000000) / (2 * (13 * ulNBT - ulBS2));
+
+            xSolution.Timing.Prescaler  = ulPres;
+            xSolution.Timing.BS1        = ulBS1;
+            xSolution.Timing.BS2        = ulBS2;
+            xSolution.Timing.SJW        = ulSJW;
+            xSolution.Bitrate           = ulClockRate / (ulPres * ulNBT);
+            xSolution.SamplePoint       = ((1 + ulBS1) * 1000) / ulNBT;
+            xSolution.Tolerance         = (ulTol1 < ulTol2) ? ulTol1 : ulTol2;
+
+            if (ulError >= xSolution.Tolerance)
+            {
+                continue;
+            }
+
+            /* find the rank of the solution, drop it if it doesn't make the list */
+            for (ucRank = ucFound; ucRank > 0; ucRank--)
+            {
+                if (!CAN_prvTimingIsBetter(&xSolution, &axSolutions[ucRank - 1],
+                        ulBitrate, usSamplePoint))
+                {
+                    break;
+                }
+            }
+            if (ucRank < ucCount)
+            {
+                uint8_t ucIndex;
+
+                if (ucFound < ucCount)
+                {
+                    ucFound++;
+                }
+                for (ucIndex = ucFound - 1; ucIndex > ucRank; ucIndex--)
+                {
+                    axSolutions[ucIndex] = axSolutions[ucIndex - 1];
+                }
+                axSolutions[ucRank] = xSolution;
+            }
+        }
+    }
 
-    CLEAR_BIT(CAN_MASTER(pxCAN)->FA1R, ulMask << ucFBOffset);
+    return ucFound;
 }
 
-/** @} */
-
-/** @defgroup CAN_Exported_Functions CAN Exported Functions
- * @{ */
-
 /**
- * @brief Attempts to calculate a possible bit timing setup based on the desired bitrate.
+ * @brief Calculates the best bit timing setup for the desired bitrate,
+ *        with the sample point at 87.5% of the bit time.
  * @param ulBitrate: The target bitrate to achieve
- * @param pxConfig: The timing configuration to set
+ * @param pxTimingConfig: The timing configuration to set
  * @return OK if successful, ERROR if bitrate is not supported
  */
 XPD_ReturnType CAN_eBitrateConfig(uint32_t ulBitrate, CAN_TimingConfigType * pxTimingConfig)
 {
     XPD_ReturnType eResult = XPD_ERROR;
+    CAN_TimingSolutionType xSolution;
 
-    /* 1bit: 4TQ <= 1TQ sync + 2-16TQ BS1 + 1-8TQ BS2 <= 25TQ */
-    uint32_t ulOvers = CAN_INPUT_CLOCK_RATE / ulBitrate;
-    uint32_t ulTQs = 25;
-    uint32_t ulPres;
-
-    do
+    if (CAN_ucTimingSolve(ulBitrate, CAN_DEFAULT_SAMPLE_POINT, &xSolution, 1) > 0)
     {
-        ulPres = ulOvers / ulTQs;
-
-        /* Division without remainder? */
-        if (0 == (ulOvers - (ulTQs * ulPres)))
-        {
-            ulTQs--;
-            pxTimingConfig->Prescaler = ulPres;
-
-            /* Sample point is set at 2/3 of the bit */
-            pxTimingConfig->BS1 = (ulTQs * 2) / 3;
-            pxTimingConfig->BS2 = ulTQs - pxTimingConfig->BS1;
-
-            /* Simply set to valid value, not part of the bitrate */
-            pxTimingConfig->SJW = 4;
-
-            eResult = XPD_OK;
-            break;
-        }
-        ulTQs--;
+        *pxTimingConfig = xSolution.Timing;
+        eResult = XPD_OK;
     }
-    while (ulTQs >= 4);
 
     return eResult;
 }
@@ -296,6 +1073,12 @@ XPD_ReturnType CAN_eInit(CAN_HandleType * pxCAN, const CAN_InitType * pxConfig)
 
     /* reset operation state */
     pxCAN->State = 0;
+    pxCAN->RxRing[0] = NULL;
+    pxCAN->RxRing[1] = NULL;
+    pxCAN->TxQueue = NULL;
+    pxCAN->Gateway[0] = NULL;
+    pxCAN->Gateway[1] = NULL;
+    pxCAN->Stats = NULL;
 
     /* Dependencies initialization */
     XPD_SAFE_CALLBACK(pxCAN->Callbacks.DepInit, pxCAN);
@@ -414,11 +1197,109 @@ void CAN_vIRQHandlerSCE(CAN_HandleType * pxCAN)
         /* Clear error interrupt flag */
         CAN_FLAG_CLEAR(pxCAN, ERRI);
 
+        if (pxCAN->Stats != NULL)
+        {
+            CAN_prvStatsError(pxCAN);
+        }
+
         /* call error callback function if interrupt is not by state change */
         XPD_SAFE_CALLBACK(pxCAN->Callbacks.Error, pxCAN);
     }
 }
 
+/**
+ * @brief Enables frame time stamp extension and bus statistics collection.
+ *        The statistics timer is started with update interrupt.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param pxStats: pointer to the statistics with its configuration fields set
+ * @note  The CAN peripheral has to be initialized with TTCAN mode enabled
+ *        for the hardware to provide frame time stamps.
+ */
+void CAN_vStatsInit(CAN_HandleType * pxCAN, CAN_StatsType * pxStats)
+{
+    uint8_t ucIndex;
+
+    for (ucIndex = 0; ucIndex < pxStats->ArrivalCount; ucIndex++)
+    {
+        if (pxStats->Arrivals[0] != NULL)
+        {
+            pxStats->Arrivals[0][ucIndex].Count = 0;
+            pxStats->Arrivals[0][ucIndex].Jitter = 0;
+        }
+        if (pxStats->Arrivals[1] != NULL)
+        {
+            pxStats->Arrivals[1][ucIndex].Count = 0;
+            pxStats->Arrivals[1][ucIndex].Jitter = 0;
+        }
+    }
+    pxStats->ErrorHead     = 0;
+    pxStats->ErrorCounters = 0;
+    pxStats->TxLatencyMax  = 0;
+    pxStats->TxLatencySum  = 0;
+    pxStats->TxCount       = 0;
+    pxStats->LastTime      = 0;
+    pxStats->Ticks         = 0;
+    pxStats->TickCount     = 0;
+    pxStats->LoadStart     = 0;
+    pxStats->LoadBits      = 0;
+
+    pxCAN->Stats = pxStats;
+
+    TIM_vCounterStart_IT(pxStats->pTIM);
+}
+
+/**
+ * @brief Advances the statistics time base, and records the error counter changes.
+ *        Shall be called from the update callback of the statistics timer.
+ * @param pxCAN: pointer to the CAN handle structure
+ */
+void CAN_vStatsTick(CAN_HandleType * pxCAN)
+{
+    CAN_StatsType * pxStats = pxCAN->Stats;
+
+    pxStats->TickCount++;
+    if (pxStats->Ticks < 0xFFFF)
+    {
+        pxStats->Ticks++;
+    }
+
+    if ((pxCAN->Inst->ESR.w & (CAN_ESR_TEC | CAN_ESR_REC)) != pxStats->ErrorCounters)
+    {
+        CAN_prvStatsError(pxCAN);
+    }
+}
+
+/**
+ * @brief Calculates the bus load since the previous call, based on the nominal
+ *        bit lengths of the received and transmitted frames.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @return The bus load [per mille]
+ */
+uint16_t CAN_usStatsBusLoad(CAN_HandleType * pxCAN)
+{
+    CAN_StatsType * pxStats = pxCAN->Stats;
+    uint32_t ulNow, ulWindow, ulBits;
+    uint16_t usLoad = 0;
+
+    XPD_ENTER_CRITICAL(pxCAN);
+
+    ulNow  = pxStats->LastTime + ((uint32_t)pxStats->Ticks * pxStats->TickBits);
+    ulBits = pxStats->LoadBits;
+    pxStats->LoadBits = 0;
+
+    XPD_EXIT_CRITICAL(pxCAN);
+
+    ulWindow = ulNow - pxStats->LoadStart;
+    pxStats->LoadStart = ulNow;
+
+    if (ulWindow > 0)
+    {
+        ulBits = (uint32_t)(((uint64_t)ulBits * 1000) / ulWindow);
+        usLoad = (ulBits < 1000) ? ulBits : 1000;
+    }
+    return usLoad;
+}
+
 /** @} */
 
 /** @defgroup CAN_Exported_Functions_Transmit CAN Transmit Control Functions
@@ -486,6 +1367,11 @@ XPD_ReturnType CAN_eSend(
         {
             CAN_TXFLAG_CLEAR(pxCAN, pxFrame->Index, ABRQ);
         }
+        else
+        {
+            pxFrame->Timestamp = CAN_prvTimestamp(pxCAN,
+                    pxCAN->Inst->sTxMailBox[pxFrame->Index].TDTR.w >> CAN_TDT0R_TIME_Pos);
+        }
     }
 
     return eResult;
@@ -516,6 +1402,65 @@ XPD_ReturnType CAN_eSend_IT(
     return eResult;
 }
 
+/**
+ * @brief Sets up the transmit queue of the CAN peripheral. The queued frames are
+ *        loaded to the transmit mailboxes in bus arbitration order,
+ *        and a mailbox holding a lower priority frame is aborted and requeued
+ *        when a higher priority frame would be blocked by it.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param pxQueue: pointer to the transmit queue with its Frames and Size fields set
+ * @note  The transmit FIFO mode shall be disabled, so that the mailboxes
+ *        are also transmitted in identifier priority order.
+ * @note  When automatic retransmission is disabled, a frame which ends with
+ *        transmission error or lost arbitration is counted as failed,
+ *        and the Error callback is called.
+ */
+void CAN_vTxQueueInit(
+        CAN_HandleType *    pxCAN,
+        CAN_TxQueueType *   pxQueue)
+{
+    pxQueue->Count = 0;
+    pxQueue->Mailboxes = 0;
+    pxQueue->Aborting = 0;
+    pxQueue->Failed = 0;
+
+    pxCAN->TxQueue = pxQueue;
+}
+
+/**
+ * @brief Puts a frame in the transmit queue and loads it to a mailbox
+ *        if its priority allows it. Completion callback is provided
+ *        for each frame using the interrupt stack.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param pxFrame: pointer to the frame to transmit, the frame is copied to the queue
+ * @return BUSY if the queue is full, OK if frame is queued for transmission
+ */
+XPD_ReturnType CAN_eEnqueue_IT(
+        CAN_HandleType *        pxCAN,
+        const CAN_FrameType *   pxFrame)
+{
+    XPD_ReturnType eResult = XPD_BUSY;
+    CAN_TxQueueType * pxQueue = pxCAN->TxQueue;
+
+    XPD_ENTER_CRITICAL(pxCAN);
+
+    /* a slot is reserved for the frame under abortion */
+    if ((pxQueue->Count + ((pxQueue->Aborting != 0) ? 1 : 0)) < pxQueue->Size)
+    {
+        (void) CAN_prvTxQueueInsert(pxQueue, pxFrame, 0);
+
+        CAN_prvTxQueueRefill(pxCAN);
+
+        SET_BIT(pxCAN->Inst->IER.w, CAN_ERROR_INTERRUPTS | CAN_TRANSMIT_INTERRUPTS);
+
+        eResult = XPD_OK;
+    }
+
+    XPD_EXIT_CRITICAL(pxCAN);
+
+    return eResult;
+}
+
 /**
  * @brief CAN transmit interrupt handler that provides handle callbacks.
  * @param pxCAN: pointer to the CAN handle structure
@@ -526,6 +1471,7 @@ void CAN_vIRQHandlerTX(CAN_HandleType * pxCAN)
     if (CAN_REG_BIT(pxCAN,IER,TMEIE) && ((pxCAN->State & CAN_STATE_TRANSMIT) != 0))
     {
         uint32_t ulTxMB;
+        uint8_t ucFailed = 0;
 
         /* check all mailboxes for successful interrupt requests */
         for (ulTxMB = 0; ulTxMB < 3; ulTxMB++)
@@ -535,9 +1481,53 @@ void CAN_vIRQHandlerTX(CAN_HandleType * pxCAN)
             {
                 CLEAR_BIT(pxCAN->State, ucMbState);
 
+                if (pxCAN->Stats != NULL)
+                {
+                    CAN_prvStatsTransmit(pxCAN, ulTxMB);
+                }
+
+                if (pxCAN->TxQueue != NULL)
+                {
+                    CLEAR_BIT(pxCAN->TxQueue->Mailboxes, ucMbState);
+                    CLEAR_BIT(pxCAN->TxQueue->Aborting, ucMbState);
+                    CAN_TXFLAG_CLEAR(pxCAN, ulTxMB, RQCP);
+                }
+
                 /* transmission complete callback */
                 XPD_SAFE_CALLBACK(pxCAN->Callbacks.Transmit, pxCAN);
             }
+            else if ((pxCAN->TxQueue != NULL) && ((pxCAN->TxQueue->Mailboxes & ucMbState) != 0)
+                    && CAN_TXFLAG_STATUS(pxCAN, ulTxMB, RQCP))
+            {
+                /* preempted frame is put back to the queue */
+                if ((pxCAN->TxQueue->Aborting & ucMbState) != 0)
+                {
+                    CAN_prvTxQueueRequeue(pxCAN, ulTxMB);
+                }
+                /* the frame failed without automatic retransmission */
+                else
+                {
+                    pxCAN->TxQueue->Failed++;
+                    ucFailed = 1;
+                }
+
+                CLEAR_BIT(pxCAN->State, ucMbState);
+                CLEAR_BIT(pxCAN->TxQueue->Mailboxes, ucMbState);
+                CLEAR_BIT(pxCAN->TxQueue->Aborting, ucMbState);
+                CAN_TXFLAG_CLEAR(pxCAN, ulTxMB, RQCP);
+            }
+        }
+
+        /* load the freed mailboxes from the queue */
+        if (pxCAN->TxQueue != NULL)
+        {
+            CAN_prvTxQueueRefill(pxCAN);
+        }
+
+        /* report the failed frames */
+        if (ucFailed != 0)
+        {
+            XPD_SAFE_CALLBACK(pxCAN->Callbacks.Error, pxCAN);
         }
 
         /* if no more transmission requests are pending */
@@ -635,6 +1625,147 @@ XPD_ReturnType CAN_eReceive_IT(
     return eResult;
 }
 
+/**
+ * @brief Starts continuous frame reception to a receive ring using the interrupt stack.
+ *        Each interrupt entry drains the hardware FIFO completely, preserving the
+ *        Filter Match Index of the frames. The Receive callback of the FIFO is called
+ *        once per interrupt entry, after the new frames are available in the ring.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param pxRing: pointer to the receive ring to fill
+ * @param ucFIFONumber: the selected receive FIFO [0 .. 1]
+ * @return ERROR if the ring size is not a power of 2, BUSY if the FIFO is already in use, OK otherwise
+ * @note  The ring is lock-free for a single consumer, which reads it with @ref CAN_eRxRingPop.
+ *        Both FIFOs can fill the same ring, if their interrupts cannot preempt each other.
+ */
+XPD_ReturnType CAN_eReceiveRing_IT(
+        CAN_HandleType *    pxCAN,
+        CAN_RxRingType *    pxRing,
+        uint8_t             ucFIFONumber)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint8_t ucRecState = CAN_STATE_RECEIVE0 << ucFIFONumber;
+
+    if ((pxRing->Size == 0) || ((pxRing->Size & (pxRing->Size - 1)) != 0))
+    {
+    }
+    /* check if FIFO is not in use */
+    else if ((pxCAN->State & ucRecState) == 0)
+    {
+        SET_BIT(pxCAN->State, ucRecState);
+
+        /* save receive ring */
+        pxCAN->RxRing[ucFIFONumber] = pxRing;
+
+        SET_BIT(pxCAN->Inst->IER.w, CAN_ERROR_INTERRUPTS
+            | ((ucFIFONumber == 0) ? CAN_RECEIVE0_INTERRUPTS : CAN_RECEIVE1_INTERRUPTS));
+
+        eResult = XPD_OK;
+    }
+    else
+    {
+        eResult = XPD_BUSY;
+    }
+    return eResult;
+}
+
+/**
+ * @brief Stops the continuous frame reception to the receive ring.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param ucFIFONumber: the selected receive FIFO [0 .. 1]
+ */
+void CAN_vReceiveRingStop_IT(CAN_HandleType * pxCAN, uint8_t ucFIFONumber)
+{
+    uint8_t ucRecState = CAN_STATE_RECEIVE0 << ucFIFONumber;
+
+    if (pxCAN->RxRing[ucFIFONumber] != NULL)
+    {
+        uint32_t ulIEs = (ucFIFONumber == 0) ? CAN_RECEIVE0_INTERRUPTS : CAN_RECEIVE1_INTERRUPTS;
+
+        CLEAR_BIT(pxCAN->State, ucRecState);
+#ifdef __XPD_CAN_ERROR_DETECT
+        if ((pxCAN->State & (CAN_STATE_TRANSMIT | CAN_STATE_RECEIVE)) == 0)
+        {
+            ulIEs |= CAN_ERROR_INTERRUPTS;
+        }
+#endif
+        CLEAR_BIT(pxCAN->Inst->IER.w, ulIEs);
+
+        pxCAN->RxRing[ucFIFONumber] = NULL;
+    }
+}
+
+/**
+ * @brief Sets up frame forwarding from a receive FIFO to other CAN controllers.
+ *        The frames are routed by their Filter Match Index, and are placed
+ *        in the transmit queue of the destination directly in the receive interrupt.
+ *        Frames without a route are stored in the receive ring.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param pxGateway: pointer to the gateway, or NULL to stop forwarding
+ * @param ucFIFONumber: the selected receive FIFO [0 .. 1]
+ * @note  The FIFO reception has to be started with @ref CAN_eReceiveRing_IT,
+ *        and the destination controllers need to have their transmit queues set up.
+ *        The interrupts of the source and destination controllers shall not preempt each other
+ *        unless XPD_ENTER_CRITICAL is configured.
+ */
+void CAN_vGatewayConfig(
+        CAN_HandleType *    pxCAN,
+        CAN_GatewayType *   pxGateway,
+        uint8_t             ucFIFONumber)
+{
+    if (pxGateway != NULL)
+    {
+        uint8_t ucRoute;
+
+        for (ucRoute = 0; ucRoute < pxGateway->RouteCount; ucRoute++)
+        {
+            pxGateway->Routes[ucRoute].Count = 0;
+        }
+        pxGateway->Forwarded = 0;
+        pxGateway->Limited = 0;
+        pxGateway->Dropped = 0;
+    }
+
+    pxCAN->Gateway[ucFIFONumber] = pxGateway;
+}
+
+/**
+ * @brief Starts a new rate limiting period for the gateway routes.
+ *        Shall be called periodically, e.g. from a timer update callback.
+ * @param pxGateway: pointer to the gateway
+ */
+void CAN_vGatewayTick(CAN_GatewayType * pxGateway)
+{
+    uint8_t ucRoute;
+
+    for (ucRoute = 0; ucRoute < pxGateway->RouteCount; ucRoute++)
+    {
+        pxGateway->Routes[ucRoute].Count = 0;
+    }
+}
+
+/**
+ * @brief Takes the oldest frame from the receive ring.
+ * @param pxRing: pointer to the receive ring
+ * @param pxFrame: pointer to the frame to put the received frame data to
+ * @return ERROR if the ring is empty, OK if a frame is taken
+ */
+XPD_ReturnType CAN_eRxRingPop(CAN_RxRingType * pxRing, CAN_FrameType * pxFrame)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint16_t usTail = pxRing->Tail;
+
+    if (usTail != pxRing->Head)
+    {
+        *pxFrame = pxRing->Frames[usTail & (pxRing->Size - 1)];
+
+        /* release the element only after it has been copied */
+        pxRing->Tail = usTail + 1;
+
+        eResult = XPD_OK;
+    }
+    return eResult;
+}
+
 /**
  * @brief CAN receive FIFO 0 interrupt handler that provides handle callbacks.
  * @param pxCAN: pointer to the CAN handle structure
@@ -644,23 +1775,31 @@ void CAN_vIRQHandlerRX0(CAN_HandleType * pxCAN)
     /* check reception completion */
     if (CAN_REG_BIT(pxCAN,IER,FMP0IE) && (CAN_REG_BIT(pxCAN,RFR[0],FMP) != 0))
     {
-        /* get the FIFO contents to the requested frame structure */
-        CAN_prvFrameReceive(pxCAN, 0);
-
-        /* only clear interrupt requests if they were enabled through XPD API */
-        if ((pxCAN->State & CAN_STATE_RECEIVE0) != 0)
+        if (pxCAN->RxRing[0] != NULL)
+        {
+            /* drain the FIFO to the ring, reception stays enabled */
+            CAN_prvRingFill(pxCAN, 0);
+        }
+        else
         {
-            uint32_t ulIEs = CAN_RECEIVE0_INTERRUPTS;
+            /* get the FIFO contents to the requested frame structure */
+            CAN_prvFrameReceive(pxCAN, 0);
 
-#ifdef __XPD_CAN_ERROR_DETECT
-            if ((pxCAN->State & (CAN_STATE_TRANSMIT | CAN_STATE_RECEIVE1)) == 0)
+            /* only clear interrupt requests if they were enabled through XPD API */
+            if ((pxCAN->State & CAN_STATE_RECEIVE0) != 0)
             {
-                ulIEs |= CAN_ERROR_INTERRUPTS;
-            }
+                uint32_t ulIEs = CAN_RECEIVE0_INTERRUPTS;
+
+#ifdef __XPD_CAN_ERROR_DETECT
+                if ((pxCAN->State & (CAN_STATE_TRANSMIT | CAN_STATE_RECEIVE1)) == 0)
+                {
+                    ulIEs |= CAN_ERROR_INTERRUPTS;
+                }
 #endif
-            CLEAR_BIT(pxCAN->State, CAN_STATE_RECEIVE0);
+                CLEAR_BIT(pxCAN->State, CAN_STATE_RECEIVE0);
 
-            CLEAR_BIT(pxCAN->Inst->IER.w, ulIEs);
+                CLEAR_BIT(pxCAN->Inst->IER.w, ulIEs);
+            }
         }
 
         /* receive complete callback */
@@ -677,23 +1816,31 @@ void CAN_vIRQHandlerRX1(CAN_HandleType * pxCAN)
     /* check reception completion */
     if (CAN_REG_BIT(pxCAN,IER,FMP1IE) && (CAN_REG_BIT(pxCAN,RFR[1],FMP) != 0))
     {
-        /* get the FIFO contents to the requested frame structure */
-        CAN_prvFrameReceive(pxCAN, 1);
-
-        /* only clear interrupt requests if they were enabled through XPD API */
-        if ((pxCAN->State & CAN_STATE_RECEIVE1) != 0)
+        if (pxCAN->RxRing[1] != NULL)
+        {
+            /* drain the FIFO to the ring, reception stays enabled */
+            CAN_prvRingFill(pxCAN, 1);
+        }
+        else
         {
-            uint32_t ulIEs = CAN_RECEIVE1_INTERRUPTS;
+            /* get the FIFO contents to the requested frame structure */
+            CAN_prvFrameReceive(pxCAN, 1);
 
-#ifdef __XPD_CAN_ERROR_DETECT
-            if ((pxCAN->State & (CAN_STATE_TRANSMIT | CAN_STATE_RECEIVE0)) == 0)
+            /* only clear interrupt requests if they were enabled through XPD API */
+            if ((pxCAN->State & CAN_STATE_RECEIVE1) != 0)
             {
-                ulIEs |= CAN_ERROR_INTERRUPTS;
-            }
+                uint32_t ulIEs = CAN_RECEIVE1_INTERRUPTS;
+
+#ifdef __XPD_CAN_ERROR_DETECT
+                if ((pxCAN->State & (CAN_STATE_TRANSMIT | CAN_STATE_RECEIVE0)) == 0)
+                {
+                    ulIEs |= CAN_ERROR_INTERRUPTS;
+                }
 #endif
-            CLEAR_BIT(pxCAN->State, CAN_STATE_RECEIVE1);
+                CLEAR_BIT(pxCAN->State, CAN_STATE_RECEIVE1);
 
-            CLEAR_BIT(pxCAN->Inst->IER.w, ulIEs);
+                CLEAR_BIT(pxCAN->Inst->IER.w, ulIEs);
+            }
         }
 
         /* receive complete callback */
@@ -728,7 +1875,7 @@ XPD_ReturnType CAN_eFilterConfig(
         uint8_t                 ucFilterCount)
 {
     XPD_ReturnType eResult = XPD_OK;
-    uint8_t ucFilterIndex, ucBase, ucFBDemand = 0, ucCurrentFMI = 0;
+    uint8_t ucFilterIndex, ucBase, ucFBDemand = 0, aucCurrentFMI[2] = {0, 0};
     CAN_TypeDef * CANx = CAN_MASTER(pxCAN);
 #ifdef CAN_BB
     CAN_BitBand_TypeDef * CANx_BB = CAN_BB(CANx);
@@ -753,6 +1900,14 @@ XPD_ReturnType CAN_eFilterConfig(
     /* Deactivate all filter banks assigned to this peripheral */
     CLEAR_BIT(CANx->FA1R, ulMask << ucFBOffset);
 
+    /* FMIs are numbered per FIFO, including the filter banks of the master peripheral */
+    for (ucBase = 0; ucBase < ucFBOffset; ucBase++)
+    {
+        uint8_t ucFBType = ((CANx->FM1R >> ucBase) & 1) | (((CANx->FS1R >> ucBase) & 1) << FILTER_SIZE_FLAG_Pos);
+
+        aucCurrentFMI[(CANx->FFA1R >> ucBase) & 1] += can_aucFilterTypeSpace[ucFBType];
+    }
+
     /* Initially set invalid value to FMI, to indicate missing configuration */
     for (ucFilterIndex = 0; ucFilterIndex < ucFilterCount; ucFilterIndex++)
     {
@@ -798,14 +1953,18 @@ XPD_ReturnType CAN_eFilterConfig(
             }xFilterBank;
 
             xSelectedType.Mode = axFilters[ucBase].Mode;
-            xSelectedType.Size = axFilters[ucBase].Pattern.Type >> (CAN_RI0R_IDE_Pos - FILTER_SIZE_FLAG_Pos);
+            xSelectedType.Size = axFilters[ucBase].Pattern.Type >> CAN_RI0R_IDE_Pos;
             xSelectedType.FIFO = axFilters[ucBase].FIFO;
             ucFilterSize = can_aucFilterTypeSpace[xSelectedType.w & (FILTER_MODE_FLAG | FILTER_SIZE_FLAG)];
-            xCurrentType.w = xSelectedType.w;
             ucFilterIndex = ucBase;
 
             do
             {
+                xCurrentType.w    = 0;
+                xCurrentType.Mode = axFilters[ucFilterIndex].Mode;
+                xCurrentType.Size = axFilters[ucFilterIndex].Pattern.Type >> CAN_RI0R_IDE_Pos;
+                xCurrentType.FIFO = axFilters[ucFilterIndex].FIFO;
+
                 /* If the xCurrentType of the currently indexed filter matches the base */
                 if (xCurrentType.w == xSelectedType.w)
                 {
@@ -885,18 +2044,18 @@ XPD_ReturnType CAN_eFilterConfig(
                         if (xCurrentType.Mode == 0)
                         {
                             /* Filter bank size fixes the mask field location */
-                            xFilterBank.u16[1].w = (axFilters[ucFilterIndex].Mask << CAN_RI0R_EXID_Pos)
+                            xFilterBank.u32[1].w = (axFilters[ucFilterIndex].Mask << CAN_RI0R_EXID_Pos)
                                                   | axFilters[ucFilterIndex].Mode;
                         }
                     }
 
                     /* Set the current filter's FMI */
-                    aucMatchIndexes[ucFilterIndex] = ucCurrentFMI + ucFBPos;
+                    aucMatchIndexes[ucFilterIndex] = aucCurrentFMI[xCurrentType.FIFO] + ucFBPos;
 
                     /* If the last element of the bank */
                     if ((ucFBPos + 1) >= ucFilterSize)
                     {
-                        ucCurrentFMI += ucFilterSize;
+                        aucCurrentFMI[xCurrentType.FIFO] += ucFilterSize;
 
                         /* Set the configured bank in the peripheral */
                         CANx->sFilterRegister[ucFBIndex].FR1 = xFilterBank.u32[0].w;
@@ -920,17 +2079,13 @@ XPD_ReturnType CAN_eFilterConfig(
 
                 /* Advance to the next filter */
                 ucFilterIndex++;
-
-                xCurrentType.Mode = axFilters[ucBase].Mode;
-                xCurrentType.Size = axFilters[ucBase].Pattern.Type >> (CAN_RI0R_IDE_Pos - FILTER_SIZE_FLAG_Pos);
-                xCurrentType.FIFO = axFilters[ucBase].FIFO;
             }
             while (ucFilterIndex < ucFilterCount);
 
             /* If the last bank was not filled completely */
             if (ucFBPos < ucFilterSize)
             {
-                ucCurrentFMI += ucFilterSize;
+                aucCurrentFMI[xSelectedType.FIFO] += ucFilterSize;
 
                 /* Set the configured bank in the peripheral */
                 CANx->sFilterRegister[ucFBIndex].FR1 = xFilterBank.u32[0].w;
@@ -949,6 +2104,69 @@ XPD_ReturnType CAN_eFilterConfig(
     return eResult;
 }
 
+/**
+ * @brief Compiles a set of Identifier ranges to a minimal filter bank layout
+ *        and configures the receive filters of the peripheral with it.
+ *        Each range is split to aligned Identifier blocks, which are merged
+ *        and placed in list or mask mode, 16 or 32 bit scale filters.
+ *        The dispatch table of the compiler maps each Filter Match Index of the FIFOs
+ *        to the tag of the range that the filter was compiled from.
+ * @param pxCAN: pointer to the CAN handle structure
+ * @param axRanges: Identifier range list (array), single Identifiers have equal First and Last
+ * @param ucRangeCount: the number of input ranges
+ * @param pxCompiler: pointer to the filter compiler with its storages set
+ * @return ERROR if a range is invalid or the filters do not fit in the storage
+ *         or the filter bank, OK if filters are configured
+ * @note  Ranges with different tags shall not overlap, as the hardware picks one of the matching filters.
+ */
+XPD_ReturnType CAN_eFilterCompile(
+        CAN_HandleType *            pxCAN,
+        const CAN_FilterRangeType   axRanges[],
+        uint8_t                     ucRangeCount,
+        CAN_FilterCompilerType *    pxCompiler)
+{
+    XPD_ReturnType eResult = XPD_OK;
+    uint8_t ucIndex;
+
+    pxCompiler->Count = 0;
+
+    for (ucIndex = 0; (ucIndex < ucRangeCount) && (eResult == XPD_OK); ucIndex++)
+    {
+        eResult = CAN_prvFilterAddRange(pxCompiler, &axRanges[ucIndex]);
+    }
+
+    if (eResult == XPD_OK)
+    {
+        CAN_prvFilterMerge(pxCompiler);
+
+        if (CAN_prvFilterPack(pxCompiler) > FILTERBANK_COUNT(pxCAN))
+        {
+            eResult = XPD_ERROR;
+        }
+    }
+
+    if (eResult == XPD_OK)
+    {
+        uint8_t aucMatchIndexes[CAN_FILTER_FMI_COUNT];
+
+        eResult = CAN_eFilterConfig(pxCAN, pxCompiler->Filters, aucMatchIndexes, pxCompiler->Count);
+
+        for (ucIndex = 0; ucIndex < CAN_FILTER_FMI_COUNT; ucIndex++)
+        {
+            pxCompiler->Dispatch[0][ucIndex] = CAN_FILTER_TAG_NONE;
+            pxCompiler->Dispatch[1][ucIndex] = CAN_FILTER_TAG_NONE;
+        }
+
+        for (ucIndex = 0; (ucIndex < pxCompiler->Count) && (eResult == XPD_OK); ucIndex++)
+        {
+            pxCompiler->Dispatch[pxCompiler->Filters[ucIndex].FIFO][aucMatchIndexes[ucIndex]] =
+                    pxCompiler->Tags[ucIndex];
+        }
+    }
+
+    return eResult;
+}
+
 /**
  * @brief Sets the filter bank size for the CAN peripheral.
  * @note  This operation resets the filter configuration for the slave CAN controller.
@@ -0,0 +1,655 @@
+/**
+  ******************************************************************************
+  * @file    xpd_can_isotp.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-06-28
+  * @brief   STM32 eXtensible Peripheral Drivers CAN ISO-TP Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_can_isotp.h>
+#include <xpd_utils.h>
+
+#if defined(CAN) || defined(CAN1)
+
+/* Protocol Control Information types */
+#define ISOTP_PCI_SF            0x00
+#define ISOTP_PCI_FF            0x10
+#define ISOTP_PCI_CF            0x20
+#define ISOTP_PCI_FC            0x30
+
+/* Flow status values */
+#define ISOTP_FS_CTS            0x00
+#define ISOTP_FS_WAIT           0x01
+#define ISOTP_FS_OVFLW          0x02
+#define ISOTP_FS_NONE           0xFF
+
+/* Transmit states */
+#define ISOTP_TX_IDLE           0
+#define ISOTP_TX_WAIT_FC        1
+#define ISOTP_TX_SEND           2
+
+/* Receive states */
+#define ISOTP_RX_IDLE           0
+#define ISOTP_RX_ARMED          1
+#define ISOTP_RX_RECEIVING      2
+
+#define ISOTP_TIMEOUT_TICKS     ((CAN_ISOTP_TIMEOUT_ms * 1000) / CAN_ISOTP_TICK_us)
+
+/* the session timers are 16 bits wide */
+#if (ISOTP_TIMEOUT_TICKS > 0xFFFF)
+#error "CAN_ISOTP_TIMEOUT_ms doesn't fit the session timers, increase CAN_ISOTP_TICK_us"
+#endif
+
+/** @defgroup CAN_ISOTP_Private_Functions CAN ISO-TP Private Functions
+ * @{ */
+
+/**
+ * @brief Converts the separation time encoding to timer ticks.
+ * @param ucSTmin: the separation time in ISO 15765-2 encoding
+ * @return The number of ticks guaranteeing at least the separation time
+ */
+static uint16_t CAN_prvIsoTpSTminTicks(uint8_t ucSTmin)
+{
+    uint32_t ulTime_us;
+    uint16_t usTicks = 0;
+
+    if (ucSTmin <= 0x7F)
+    {
+        ulTime_us = (uint32_t)ucSTmin * 1000;
+    }
+    else if ((ucSTmin >= 0xF1) && (ucSTmin <= 0xF9))
+    {
+        ulTime_us = (uint32_t)(ucSTmin - 0xF0) * 100;
+    }
+    else
+    {
+        /* reserved values are handled as the longest separation time */
+        ulTime_us = 0x7F * 1000;
+    }
+
+    if (ulTime_us > 0)
+    {
+        /* the first tick period is partial */
+        usTicks = ((ulTime_us + CAN_ISOTP_TICK_us - 1) / CAN_ISOTP_TICK_us) + 1;
+    }
+    return usTicks;
+}
+
+/**
+ * @brief Pads and queues a frame of the session for transmission.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param pxFrame: pointer to the frame with the used data bytes set
+ * @param ucUsed: the number of used data bytes
+ * @return BUSY if the transmit queue is full, OK if the frame is queued
+ */
+static XPD_ReturnType CAN_prvIsoTpPost(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+        CAN_FrameType * pxFrame, uint8_t ucUsed)
+{
+    for (; ucUsed < 8; ucUsed++)
+    {
+        pxFrame->Data.Byte[ucUsed] = pxSession->Padding;
+    }
+    pxFrame->Id  = pxSession->TxId;
+    pxFrame->DLC = 8;
+
+    return CAN_eEnqueue_IT(pxTP->pCAN, pxFrame);
+}
+
+/**
+ * @brief Sends a flow control frame for the received message.
+ *        If the transmit queue is full, the frame is retried at the next tick.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param ucFlowStatus: the flow status to send
+ */
+static void CAN_prvIsoTpFlowControl(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+        uint8_t ucFlowStatus)
+{
+    CAN_FrameType xFrame;
+
+    xFrame.Data.Byte[0] = ISOTP_PCI_FC | ucFlowStatus;
+    xFrame.Data.Byte[1] = pxSession->BlockSize;
+    xFrame.Data.Byte[2] = pxSession->STmin;
+
+    if (CAN_prvIsoTpPost(pxTP, pxSession, &xFrame, 3) == XPD_OK)
+    {
+        pxSession->Rx.FlowStatus = ISOTP_FS_NONE;
+    }
+    else
+    {
+        pxSession->Rx.FlowStatus = ucFlowStatus;
+    }
+}
+
+/**
+ * @brief Terminates the transmission of the session with an error.
+ * @param pxSession: pointer to the session
+ * @param eError: the cause of the termination
+ */
+static void CAN_prvIsoTpTxError(CAN_IsoTpSessionType * pxSession, CAN_IsoTpErrorType eError)
+{
+    pxSession->Tx.State = ISOTP_TX_IDLE;
+    pxSession->Tx.Timer = 0;
+    pxSession->Error = eError;
+
+    XPD_SAFE_CALLBACK(pxSession->Callbacks.Error, pxSession);
+}
+
+/**
+ * @brief Terminates the reception of the session with an error.
+ * @param pxSession: pointer to the session
+ * @param eError: the cause of the termination
+ */
+static void CAN_prvIsoTpRxError(CAN_IsoTpSessionType * pxSession, CAN_IsoTpErrorType eError)
+{
+    pxSession->Rx.State = ISOTP_RX_ARMED;
+    pxSession->Rx.Timer = 0;
+    pxSession->Rx.FlowStatus = ISOTP_FS_NONE;
+    pxSession->Error = eError;
+
+    XPD_SAFE_CALLBACK(pxSession->Callbacks.Error, pxSession);
+}
+
+/**
+ * @brief Sends consecutive frames until the separation time, the block size,
+ *        the transmit queue or the message end stops the transmission.
+ *        The data is segmented directly from the caller buffer.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ */
+static void CAN_prvIsoTpTxContinue(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession)
+{
+    while (pxSession->Tx.State == ISOTP_TX_SEND)
+    {
+        CAN_FrameType xFrame;
+        uint16_t usRemaining = pxSession->Tx.Length - pxSession->Tx.Offset;
+        uint8_t ucCount = (usRemaining < 7) ? usRemaining : 7;
+        uint8_t i;
+
+        xFrame.Data.Byte[0] = ISOTP_PCI_CF | pxSession->Tx.SN;
+        for (i = 0; i < ucCount; i++)
+        {
+            xFrame.Data.Byte[1 + i] = pxSession->Tx.Data[pxSession->Tx.Offset + i];
+        }
+
+        /* transmit queue is full, retry at the next tick */
+        if (CAN_prvIsoTpPost(pxTP, pxSession, &xFrame, 1 + ucCount) != XPD_OK)
+        {
+            pxSession->Tx.Timer = 1;
+            break;
+        }
+
+        pxSession->Tx.Offset += ucCount;
+        pxSession->Tx.SN = (pxSession->Tx.SN + 1) & 0xF;
+
+        if (pxSession->Tx.Offset >= pxSession->Tx.Length)
+        {
+            pxSession->Tx.State = ISOTP_TX_IDLE;
+            pxSession->Tx.Timer = 0;
+
+            XPD_SAFE_CALLBACK(pxSession->Callbacks.Transmit, pxSession);
+        }
+        else if ((pxSession->Tx.BlockCount != 0) && (--pxSession->Tx.BlockCount == 0))
+        {
+            /* block is complete, wait for the next flow control */
+            pxSession->Tx.State = ISOTP_TX_WAIT_FC;
+            pxSession->Tx.Timer = ISOTP_TIMEOUT_TICKS;
+        }
+        else if (pxSession->Tx.STmin != 0)
+        {
+            pxSession->Tx.Timer = pxSession->Tx.STmin;
+            break;
+        }
+        else {}
+    }
+}
+
+/**
+ * @brief Processes a received flow control frame for the transmitted message.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param pucData: the frame data
+ */
+static void CAN_prvIsoTpFlowStatus(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+        const uint8_t * pucData)
+{
+    if (pxSession->Tx.State == ISOTP_TX_WAIT_FC)
+    {
+        switch (pucData[0] & 0xF)
+        {
+            case ISOTP_FS_CTS:
+                pxSession->Tx.BlockCount = pucData[1];
+                pxSession->Tx.STmin = CAN_prvIsoTpSTminTicks(pucData[2]);
+                pxSession->Tx.State = ISOTP_TX_SEND;
+                pxSession->Tx.Timer = 0;
+
+                CAN_prvIsoTpTxContinue(pxTP, pxSession);
+                break;
+
+            case ISOTP_FS_WAIT:
+                pxSession->Tx.Timer = ISOTP_TIMEOUT_TICKS;
+                break;
+
+            case ISOTP_FS_OVFLW:
+                CAN_prvIsoTpTxError(pxSession, CAN_ISOTP_ERROR_OVERFLOW);
+                break;
+
+            default:
+                CAN_prvIsoTpTxError(pxSession, CAN_ISOTP_ERROR_INVALID_FS);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Processes a received data frame of the session.
+ *        The data is reassembled directly in the caller buffer.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param pxFrame: pointer to the received frame
+ */
+static void CAN_prvIsoTpRxData(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession,
+        const CAN_FrameType * pxFrame)
+{
+    const uint8_t * pucData = pxFrame->Data.Byte;
+    uint8_t ucCount = 0, ucStart = 0;
+
+    switch (pucData[0] & 0xF0)
+    {
+        case ISOTP_PCI_SF:
+            /* a new message terminates the ongoing reception */
+            pxSession->Rx.Length = pucData[0] & 0xF;
+            if ((pxSession->Rx.Length == 0) || (pxSession->Rx.Length > 7)
+                    || (pxSession->Rx.Length >= pxFrame->DLC))
+            {
+                return;
+            }
+            if (pxSession->Rx.Length > pxSession->Rx.Size)
+            {
+                CAN_prvIsoTpRxError(pxSession, CAN_ISOTP_ERROR_OVERFLOW);
+                return;
+            }
+            pxSession->Rx.Offset = 0;
+            ucStart = 1;
+            ucCount = pxSession->Rx.Length;
+            break;
+
+        case ISOTP_PCI_FF:
+            pxSession->Rx.Length = ((uint16_t)(pucData[0] & 0xF) << 8) | pucData[1];
+            if ((pxSession->Rx.Length < 8) || (pxFrame->DLC < 8))
+            {
+                return;
+            }
+            if (pxSession->Rx.Length > pxSession->Rx.Size)
+            {
+                CAN_prvIsoTpRxError(pxSession, CAN_ISOTP_ERROR_OVERFLOW);
+                CAN_prvIsoTpFlowControl(pxTP, pxSession, ISOTP_FS_OVFLW);
+                return;
+            }
+            pxSession->Rx.Offset = 0;
+            pxSession->Rx.SN = 1;
+            pxSession->Rx.BlockCount = pxSession->BlockSize;
+            pxSession->Rx.State = ISOTP_RX_RECEIVING;
+            pxSession->Rx.Timer = ISOTP_TIMEOUT_TICKS;
+            ucStart = 2;
+            ucCount = 6;
+
+            CAN_prvIsoTpFlowControl(pxTP, pxSession, ISOTP_FS_CTS);
+            break;
+
+        case ISOTP_PCI_CF:
+            if (pxSession->Rx.State != ISOTP_RX_RECEIVING)
+            {
+                return;
+            }
+            if ((pucData[0] & 0xF) != pxSession->Rx.SN)
+            {
+                CAN_prvIsoTpRxError(pxSession, CAN_ISOTP_ERROR_WRONG_SN);
+                return;
+            }
+            pxSession->Rx.SN = (pxSession->Rx.SN + 1) & 0xF;
+            pxSession->Rx.Timer = ISOTP_TIMEOUT_TICKS;
+            ucStart = 1;
+            ucCount = pxSession->Rx.Length - pxSession->Rx.Offset;
+            if (ucCount > 7)
+            {
+                ucCount = 7;
+            }
+            break;
+
+        default:
+            return;
+    }
+
+    for (; ucCount > 0; ucCount--)
+    {
+        pxSession->Rx.Data[pxSession->Rx.Offset++] = pucData[ucStart++];
+    }
+
+    if (pxSession->Rx.Offset >= pxSession->Rx.Length)
+    {
+        /* the buffer is handed over to the application */
+        pxSession->Rx.State = ISOTP_RX_IDLE;
+        pxSession->Rx.Timer = 0;
+
+        XPD_SAFE_CALLBACK(pxSession->Callbacks.Receive, pxSession);
+    }
+    else if (((pucData[0] & 0xF0) == ISOTP_PCI_CF)
+            && (pxSession->Rx.BlockCount != 0) && (--pxSession->Rx.BlockCount == 0))
+    {
+        /* block is complete, request the next one */
+        pxSession->Rx.BlockCount = pxSession->BlockSize;
+
+        CAN_prvIsoTpFlowControl(pxTP, pxSession, ISOTP_FS_CTS);
+    }
+    else {}
+}
+
+/**
+ * @brief Runs the timer only while any of the sessions needs timing.
+ * @param pxTP: pointer to the ISO-TP layer
+ */
+static void CAN_prvIsoTpTimerUpdate(CAN_IsoTpType * pxTP)
+{
+    uint8_t ucIndex, ucTicking = 0;
+
+    for (ucIndex = 0; ucIndex < pxTP->SessionCount; ucIndex++)
+    {
+        if ((pxTP->Sessions[ucIndex]->Tx.Timer != 0) || (pxTP->Sessions[ucIndex]->Rx.Timer != 0) ||
+            (pxTP->Sessions[ucIndex]->Rx.FlowStatus != ISOTP_FS_NONE))
+        {
+            ucTicking = 1;
+            break;
+        }
+    }
+
+    if (ucTicking != pxTP->Ticking)
+    {
+        pxTP->Ticking = ucTicking;
+
+        if (ucTicking != 0)
+        {
+            TIM_vCounterStart_IT(pxTP->pTIM);
+        }
+        else
+        {
+            TIM_vCounterStop_IT(pxTP->pTIM);
+        }
+    }
+}
+
+/** @} */
+
+/** @defgroup CAN_ISOTP_Exported_Functions CAN ISO-TP Exported Functions
+ *  @brief    ISO-TP message transfer functions
+ *  @details  The layer segments messages into single, first and consecutive frames,
+ *            which are queued in the CAN transmit queue, and reassembles the received
+ *            frames of the sessions in their reception buffers. Flow control separation times
+ *            and timeouts are measured by a timer, which is only running while needed.
+ * @{
+ */
+
+/**
+ * @brief Resets all sessions of the ISO-TP layer.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @note  The timer's update callback has to call @ref CAN_vIsoTpTick,
+ *        and the received frames have to be passed to @ref CAN_eIsoTpProcess.
+ */
+void CAN_vIsoTpInit(CAN_IsoTpType * pxTP)
+{
+    uint8_t ucIndex;
+
+    for (ucIndex = 0; ucIndex < pxTP->SessionCount; ucIndex++)
+    {
+        CAN_IsoTpSessionType * pxSession = pxTP->Sessions[ucIndex];
+
+        pxSession->Tx.State = ISOTP_TX_IDLE;
+        pxSession->Tx.Timer = 0;
+        pxSession->Rx.State = ISOTP_RX_IDLE;
+        pxSession->Rx.Timer = 0;
+        pxSession->Rx.FlowStatus = ISOTP_FS_NONE;
+        pxSession->Error = CAN_ISOTP_ERROR_NONE;
+    }
+
+    pxTP->Ticking = 0;
+    TIM_vCounterStop_IT(pxTP->pTIM);
+}
+
+/**
+ * @brief Starts the transmission of a message in the session.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param pucData: pointer to the message, has to remain valid until the transfer completes
+ * @param usLength: the message length [1 .. CAN_ISOTP_MAX_LENGTH]
+ * @return ERROR if the length is invalid, BUSY if a transmission is ongoing
+ *         or the transmit queue is full, OK if the transmission is started
+ */
+XPD_ReturnType CAN_eIsoTpSend(
+        CAN_IsoTpType *         pxTP,
+        CAN_IsoTpSessionType *  pxSession,
+        const uint8_t *         pucData,
+        uint16_t                usLength)
+{
+    XPD_ReturnType eResult = XPD_BUSY;
+
+    if ((usLength == 0) || (usLength > CAN_ISOTP_MAX_LENGTH))
+    {
+        eResult = XPD_ERROR;
+    }
+    else if (pxSession->Tx.State == ISOTP_TX_IDLE)
+    {
+        CAN_FrameType xFrame;
+        uint8_t ucUsed, i;
+
+        XPD_ENTER_CRITICAL(pxTP);
+
+        if (usLength <= 7)
+        {
+            xFrame.Data.Byte[0] = ISOTP_PCI_SF | usLength;
+            ucUsed = 1 + usLength;
+            for (i = 0; i < usLength; i++)
+            {
+                xFrame.Data.Byte[1 + i] = pucData[i];
+            }
+        }
+        else
+        {
+            xFrame.Data.Byte[0] = ISOTP_PCI_FF | (usLength >> 8);
+            xFrame.Data.Byte[1] = usLength;
+            ucUsed = 8;
+            for (i = 0; i < 6; i++)
+            {
+                xFrame.Data.Byte[2 + i] = pucData[i];
+            }
+        }
+
+        eResult = CAN_prvIsoTpPost(pxTP, pxSession, &xFrame, ucUsed);
+
+        if (eResult == XPD_OK)
+        {
+            pxSession->Error = CAN_ISOTP_ERROR_NONE;
+
+            if (usLength <= 7)
+            {
+                XPD_SAFE_CALLBACK(pxSession->Callbacks.Transmit, pxSession);
+            }
+            else
+            {
+                pxSession->Tx.Data   = pucData;
+                pxSession->Tx.Length = usLength;
+                pxSession->Tx.Offset = 6;
+                pxSession->Tx.SN     = 1;
+                pxSession->Tx.State  = ISOTP_TX_WAIT_FC;
+                pxSession->Tx.Timer  = ISOTP_TIMEOUT_TICKS;
+
+                CAN_prvIsoTpTimerUpdate(pxTP);
+            }
+        }
+
+        XPD_EXIT_CRITICAL(pxTP);
+    }
+    else {}
+
+    return eResult;
+}
+
+/**
+ * @brief Provides a reception buffer for the next message of the session.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ * @param pucBuffer: pointer to the reception buffer
+ * @param usSize: the size of the reception buffer
+ * @return BUSY if a reception is ongoing, OK if the session is ready for reception
+ * @note  The buffer is owned by the layer until the reception callback is called.
+ */
+XPD_ReturnType CAN_eIsoTpReceive(
+        CAN_IsoTpType *         pxTP,
+        CAN_IsoTpSessionType *  pxSession,
+        uint8_t *               pucBuffer,
+        uint16_t                usSize)
+{
+    XPD_ReturnType eResult = XPD_BUSY;
+
+    (void)pxTP;
+
+    XPD_ENTER_CRITICAL(pxTP);
+
+    if (pxSession->Rx.State != ISOTP_RX_RECEIVING)
+    {
+        pxSession->Rx.Data  = pucBuffer;
+        pxSession->Rx.Size  = usSize;
+        pxSession->Rx.State = ISOTP_RX_ARMED;
+        eResult = XPD_OK;
+    }
+
+    XPD_EXIT_CRITICAL(pxTP);
+
+    return eResult;
+}
+
+/**
+ * @brief Stops the ongoing transfers of the session.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxSession: pointer to the session
+ */
+void CAN_vIsoTpAbort(CAN_IsoTpType * pxTP, CAN_IsoTpSessionType * pxSession)
+{
+    XPD_ENTER_CRITICAL(pxTP);
+
+    pxSession->Tx.State = ISOTP_TX_IDLE;
+    pxSession->Tx.Timer = 0;
+    pxSession->Rx.State = ISOTP_RX_IDLE;
+    pxSession->Rx.Timer = 0;
+    pxSession->Rx.FlowStatus = ISOTP_FS_NONE;
+
+    CAN_prvIsoTpTimerUpdate(pxTP);
+
+    XPD_EXIT_CRITICAL(pxTP);
+}
+
+/**
+ * @brief Processes a received CAN frame by the session which it is addressed to.
+ *        Shall be called from the context where the frames are received.
+ * @param pxTP: pointer to the ISO-TP layer
+ * @param pxFrame: pointer to the received frame
+ * @return ERROR if the frame doesn't belong to any session, OK if it was processed
+ */
+XPD_ReturnType CAN_eIsoTpProcess(CAN_IsoTpType * pxTP, const CAN_FrameType * pxFrame)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint8_t ucIndex;
+
+    for (ucIndex = 0; ucIndex < pxTP->SessionCount; ucIndex++)
+    {
+        CAN_IsoTpSessionType * pxSession = pxTP->Sessions[ucIndex];
+
+        if ((pxFrame->Id.Value == pxSession->RxId.Value) && (pxFrame->Id.Type == pxSession->RxId.Type))
+        {
+            XPD_ENTER_CRITICAL(pxTP);
+
+            if ((pxFrame->Data.Byte[0] & 0xF0) == ISOTP_PCI_FC)
+            {
+                CAN_prvIsoTpFlowStatus(pxTP, pxSession, pxFrame->Data.Byte);
+            }
+            else if (pxSession->Rx.State != ISOTP_RX_IDLE)
+            {
+                CAN_prvIsoTpRxData(pxTP, pxSession, pxFrame);
+            }
+            else {}
+
+            CAN_prvIsoTpTimerUpdate(pxTP);
+
+            XPD_EXIT_CRITICAL(pxTP);
+
+            eResult = XPD_OK;
+            break;
+        }
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Advances the timing of the sessions, sends the consecutive frames
+ *        after the separation time, retries the pending flow control frames,
+ *        and detects the timeouts.
+ *        Shall be called from the update callback of the layer's timer.
+ * @param pxTP: pointer to the ISO-TP layer
+ */
+void CAN_vIsoTpTick(CAN_IsoTpType * pxTP)
+{
+    uint8_t ucIndex;
+
+    XPD_ENTER_CRITICAL(pxTP);
+
+    for (ucIndex = 0; ucIndex < pxTP->SessionCount; ucIndex++)
+    {
+        CAN_IsoTpSessionType * pxSession = pxTP->Sessions[ucIndex];
+
+        if ((pxSession->Tx.Timer != 0) && (--pxSession->Tx.Timer == 0))
+        {
+            if (pxSession->Tx.State == ISOTP_TX_SEND)
+            {
+                CAN_prvIsoTpTxContinue(pxTP, pxSession);
+            }
+            else
+            {
+                CAN_prvIsoTpTxError(pxSession, CAN_ISOTP_ERROR_TIMEOUT_BS);
+            }
+        }
+
+        if ((pxSession->Rx.Timer != 0) && (--pxSession->Rx.Timer == 0))
+        {
+            CAN_prvIsoTpRxError(pxSession, CAN_ISOTP_ERROR_TIMEOUT_CR);
+        }
+
+        /* retry the flow control frame which didn't fit the transmit queue */
+        if (pxSession->Rx.FlowStatus != ISOTP_FS_NONE)
+        {
+            CAN_prvIsoTpFlowControl(pxTP, pxSession, pxSession->Rx.FlowStatus);
+        }
+    }
+
+    CAN_prvIsoTpTimerUpdate(pxTP);
+
+    XPD_EXIT_CRITICAL(pxTP);
+}
+
+/** @} */
+
+#endif /* defined(CAN) || defined(CAN1) */
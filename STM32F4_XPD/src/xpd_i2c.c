@@ -0,0 +1,1261 @@
+/**
+  ******************************************************************************
+  * @file    xpd_i2c.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-06-21
+  * @brief   STM32 eXtensible Peripheral Drivers I2C Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_i2c.h>
+#include <xpd_utils.h>
+
+/** @addtogroup I2C
+ * @{ */
+
+/* Transfer stages */
+typedef enum
+{
+    I2C_STAGE_IDLE      = 0, /* No ongoing transfer (slave: listening) */
+    I2C_STAGE_CMD       = 1, /* Command transfer */
+    I2C_STAGE_ADDR10    = 2, /* [Master] 10-bit write addressing before reading */
+    I2C_STAGE_HEADER    = 3, /* [Master] 10-bit read header after repeated START */
+    I2C_STAGE_ADDRESSED = 4, /* [Slave] Addressed, waiting for the data transfer setup */
+    I2C_STAGE_DATA      = 5, /* Data transfer */
+}I2C_StageType;
+
+#define I2C_RESET_ERRORS(HANDLE)    ((HANDLE)->Errors = 0)
+
+#define I2C_EVENT_ITS               (I2C_CR2_ITEVTEN | I2C_CR2_ITERREN)
+
+#define I2C_EVENT_FLAGS             (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF |\
+                                     I2C_SR1_ADD10 | I2C_SR1_STOPF)
+
+#define I2C_ERROR_FLAGS             (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF |\
+                                     I2C_SR1_OVR | I2C_SR1_TIMEOUT)
+
+#define I2C_DUMMY_BYTE              0xFF
+
+static void I2C_prvMasterIRQHandler(I2C_HandleType * pxI2C);
+static void I2C_prvSlaveIRQHandler(I2C_HandleType * pxI2C);
+
+/* Enables the peripheral */
+__STATIC_INLINE void I2C_prvEnable(I2C_HandleType* pxI2C)
+{
+    I2C_REG_BIT(pxI2C, CR1, PE) = 1;
+}
+
+/* Disables the peripheral */
+__STATIC_INLINE void I2C_prvDisable(I2C_HandleType* pxI2C)
+{
+    I2C_REG_BIT(pxI2C, CR1, PE) = 0;
+}
+
+/* Clears the ADDR flag by reading SR1 and SR2, returns SR2 */
+__STATIC_INLINE uint32_t I2C_prvClearADDR(I2C_HandleType* pxI2C)
+{
+    (void) pxI2C->Inst->SR1.w;
+    return pxI2C->Inst->SR2.w;
+}
+
+/* Determines whether the handle is currently operating as master */
+__STATIC_INLINE uint32_t I2C_prvIsMaster(I2C_HandleType* pxI2C)
+{
+    return pxI2C->IRQHandler == (XPD_HandleCallbackType)I2C_prvMasterIRQHandler;
+}
+
+/* Configure the I2C bus timing based on the peripheral clock and the desired bus speed,
+ * and return the achieved bus frequency */
+static uint32_t I2C_prvSetTiming(I2C_HandleType * pxI2C, const I2C_InitType * pxConfig)
+{
+    uint32_t ulClkFreq_Hz = I2C_ulClockFreq_Hz(pxI2C);
+    uint32_t ulFreq_MHz = ulClkFreq_Hz / 1000000;
+    uint32_t ulBusFreq_Hz = pxConfig->BusFreq_Hz;
+    uint32_t ulRise = pxConfig->RiseTime_ns;
+    uint32_t ulCCR, ulDiv;
+
+    pxI2C->Inst->CR2.b.FREQ = ulFreq_MHz;
+
+    /* Standard mode */
+    if (ulBusFreq_Hz <= 100000)
+    {
+        /* SCL: tHIGH = tLOW = CCR * tPCLK */
+        ulDiv = 2;
+        ulCCR = (ulClkFreq_Hz + (ulDiv * ulBusFreq_Hz) - 1) / (ulDiv * ulBusFreq_Hz);
+        if (ulCCR < 4)
+        {   ulCCR = 4; }
+
+        if (ulRise == 0)
+        {   ulRise = 1000; }
+
+        pxI2C->Inst->CCR.w = ulCCR;
+    }
+    else /* Fast mode */
+    {
+        uint32_t ulCCR169;
+
+        if (ulBusFreq_Hz > 400000)
+        {   ulBusFreq_Hz = 400000; }
+
+        /* SCL: tLOW = 2 * tHIGH = 2 * CCR * tPCLK */
+        ulDiv = 3;
+        ulCCR = (ulClkFreq_Hz + (3 * ulBusFreq_Hz) - 1) / (3 * ulBusFreq_Hz);
+
+        /* SCL: tLOW = 16/9 * tHIGH = 16 * CCR * tPCLK, used when it gets closer to the target */
+        ulCCR169 = (ulClkFreq_Hz + (25 * ulBusFreq_Hz) - 1) / (25 * ulBusFreq_Hz);
+        if ((25 * ulCCR169) < (3 * ulCCR))
+        {
+            ulDiv = 25;
+            ulCCR = ulCCR169;
+        }
+        if (ulCCR < 1)
+        {   ulCCR = 1; }
+
+        if (ulRise == 0)
+        {   ulRise = 300; }
+
+        pxI2C->Inst->CCR.w = I2C_CCR_FS | ((ulDiv == 25) ? I2C_CCR_DUTY : 0) | ulCCR;
+    }
+
+    /* Maximal SCL rise time in peripheral clock cycles */
+    pxI2C->Inst->TRISE.w = ((ulRise * ulFreq_MHz) / 1000) + 1;
+
+    return ulClkFreq_Hz / (ulDiv * ulCCR);
+}
+
+/* Returns the DMA used by the current transfer */
+static DMA_HandleType * I2C_prvActiveDMA(I2C_HandleType* pxI2C)
+{
+    I2C_DirectionType eDirection;
+
+    /* The transmitter is the master when writing, or the slave when read */
+    if (I2C_prvIsMaster(pxI2C))
+    {
+        eDirection = pxI2C->Transfers.pMaster->Direction;
+    }
+    else
+    {
+        eDirection = I2C_DIRECTION_READ - pxI2C->Transfers.Slave.Direction;
+    }
+
+    return (eDirection == I2C_DIRECTION_WRITE) ? pxI2C->DMA.Transmit : pxI2C->DMA.Receive;
+}
+
+/* Stops ongoing DMA request and transfer */
+static void I2C_prvStopDMA(I2C_HandleType* pxI2C)
+{
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+
+    /* Check if DMA requests are still active */
+    if ((ulCR2 & I2C_CR2_DMAEN) != 0)
+    {
+        DMA_HandleType *pxDMA = I2C_prvActiveDMA(pxI2C);
+        uint16_t usLenCorr = 0;
+
+        pxI2C->Inst->CR2.w = ulCR2 & ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+
+        /* If TXE isn't set, there's a byte data loaded
+         * in DR that isn't sent */
+        if (pxDMA == pxI2C->DMA.Transmit)
+        {
+            usLenCorr = 1 - I2C_FLAG_STATUS(pxI2C, TXE);
+        }
+
+        /* Set stream data:
+         * size now holds the configured length of the DMA transfer
+         * since the transfer is stopped without completion,
+         * we have to subtract the remaining amount */
+        pxI2C->Stream.buffer += pxI2C->Stream.size;
+        pxI2C->Stream.size = usLenCorr + DMA_usGetStatus(pxDMA);
+        pxI2C->Stream.buffer -= pxI2C->Stream.size;
+
+        DMA_vStop_IT(pxDMA);
+    }
+}
+
+/* Reads the transfer info (direction and slave address) to the slave transfer context */
+static void I2C_prvGetTransferInfo(I2C_HandleType * pxI2C, uint32_t ulSR2)
+{
+    /* The slave is the transmitter when the master reads */
+    pxI2C->Transfers.Slave.Direction = ulSR2 >> I2C_SR2_TRA_Pos;
+
+    if ((ulSR2 & I2C_SR2_GENCALL) != 0)
+    {
+        pxI2C->Transfers.Slave.SlaveAddress_10bit = 0;
+    }
+    else if ((ulSR2 & I2C_SR2_DUALF) != 0)
+    {
+        pxI2C->Transfers.Slave.SlaveAddress_10bit = pxI2C->Inst->OAR2.w & I2C_OAR2_ADD2;
+    }
+    else if (I2C_REG_BIT(pxI2C, OAR1, ADDMODE) != 0)
+    {
+        pxI2C->Transfers.Slave.SlaveAddress_10bit = pxI2C->Inst->OAR1.b.ADD1;
+    }
+    else
+    {
+        pxI2C->Transfers.Slave.SlaveAddress_10bit = pxI2C->Inst->OAR1.b.ADD1 & 0xFE;
+    }
+}
+
+/* Ends the slave transfer */
+static void I2C_prvSlaveComplete(I2C_HandleType * pxI2C)
+{
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+
+    I2C_prvStopDMA(pxI2C);
+
+    /* Disable data interrupts as transfer is over */
+    CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_CR2_ITBUFEN);
+    pxI2C->Stage = I2C_STAGE_IDLE;
+
+    /* Acknowledge the next addressing */
+    I2C_REG_BIT(pxI2C, CR1, ACK) = 1;
+
+    if ((ulCR2 & I2C_CR2_ITEVTEN) != 0)
+    {
+        XPD_SAFE_CALLBACK(pxI2C->Callbacks.SlaveComplete, pxI2C);
+    }
+}
+
+/* Slave mode EV signals interrupt handler */
+static void I2C_prvSlaveIRQHandler(I2C_HandleType * pxI2C)
+{
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+    uint32_t ulSR1 = pxI2C->Inst->SR1.w;
+
+    /* Slave address match */
+    if ((ulSR1 & I2C_SR1_ADDR) != 0)
+    {
+        /* Reading SR2 clears ADDR, the clock is stretched until the data is serviced */
+        I2C_prvGetTransferInfo(pxI2C, pxI2C->Inst->SR2.w);
+
+        if ((pxI2C->Transfers.Slave.CmdSize > 0) && (pxI2C->Stage == I2C_STAGE_IDLE) &&
+            (pxI2C->Transfers.Slave.Direction == I2C_DIRECTION_WRITE))
+        {
+            /* Save stream info */
+            pxI2C->Stream.buffer = I2C_TRANSFER_CMD(&pxI2C->Transfers.Slave);
+            pxI2C->Stream.size   = pxI2C->Transfers.Slave.CmdSize;
+
+            pxI2C->Stage = I2C_STAGE_CMD;
+            SET_BIT(pxI2C->Inst->CR2.w, I2C_CR2_ITBUFEN);
+        }
+        else
+        {
+            pxI2C->Stage = I2C_STAGE_ADDRESSED;
+            CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_CR2_ITBUFEN | I2C_CR2_DMAEN);
+
+            if ((ulCR2 & I2C_CR2_ITEVTEN) != 0)
+            {
+                XPD_SAFE_CALLBACK(pxI2C->Callbacks.SlaveAddressed, pxI2C);
+
+                /* Mask the pending data events until the data transfer is set up */
+                if (pxI2C->Stage == I2C_STAGE_ADDRESSED)
+                {
+                    I2C_IT_DISABLE(pxI2C, EVT);
+                }
+            }
+        }
+    }
+    /* STOP (end of slave receiver transfer) */
+    else if ((ulSR1 & I2C_SR1_STOPF) != 0)
+    {
+        /* STOPF is cleared by writing CR1 after reading SR1 */
+        pxI2C->Inst->CR1.w = pxI2C->Inst->CR1.w;
+
+        I2C_prvSlaveComplete(pxI2C);
+    }
+    /* Receive register not empty */
+    else if (((ulSR1 & I2C_SR1_RXNE) != 0) &&
+            (((ulCR2 & I2C_CR2_ITBUFEN) != 0) || ((ulSR1 & I2C_SR1_BTF) != 0)))
+    {
+        /* Read data from DR */
+        uint8_t ucData = pxI2C->Inst->DR;
+
+        if (pxI2C->Stream.size > 0)
+        {
+            *(uint8_t*)pxI2C->Stream.buffer++ = ucData;
+            pxI2C->Stream.size--;
+
+            /* When the expected data length is received, send NACK
+             * (the command stage has to keep acknowledging the repeated addressing) */
+            if ((pxI2C->Stream.size == 0) && (pxI2C->Stage == I2C_STAGE_DATA))
+            {
+                I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+            }
+        }
+    }
+    /* Transmit register empty */
+    else if (((ulSR1 & I2C_SR1_TXE) != 0) &&
+            (((ulCR2 & I2C_CR2_ITBUFEN) != 0) || ((ulSR1 & I2C_SR1_BTF) != 0)))
+    {
+        /* Write data to DR, the master decides the transfer length */
+        if (pxI2C->Stream.size > 0)
+        {
+            pxI2C->Inst->DR = *(uint8_t*)pxI2C->Stream.buffer++;
+            pxI2C->Stream.size--;
+        }
+        else
+        {
+            pxI2C->Inst->DR = I2C_DUMMY_BYTE;
+        }
+    }
+}
+
+/* Sets the handle context to transfer the data */
+static void I2C_prvMasterSetDataStage(I2C_HandleType * pxI2C, I2C_StageType eReadStage)
+{
+    const I2C_TransferType * pxTransfer = pxI2C->Transfers.pMaster;
+
+    /* 10-bit addressed reading requires write addressing first */
+    if ((pxTransfer->Direction == I2C_DIRECTION_READ) &&
+        (I2C_REG_BIT(pxI2C, OAR1, ADDMODE) != 0))
+    {
+        pxI2C->Stage = eReadStage;
+    }
+    else
+    {
+        pxI2C->Stage = I2C_STAGE_DATA;
+    }
+
+    /* Set stream context to data */
+    pxI2C->Stream.buffer = pxTransfer->Data;
+    pxI2C->Stream.size   = pxTransfer->Length;
+    pxI2C->Stream.length = 0;
+}
+
+/* Ends the master transfer without notification */
+static void I2C_prvMasterFinish(I2C_HandleType * pxI2C)
+{
+    pxI2C->Stage = I2C_STAGE_IDLE;
+
+    I2C_REG_BIT(pxI2C, CR1, POS) = 0;
+    I2C_REG_BIT(pxI2C, CR1, ACK) = pxI2C->Listening;
+
+    if (pxI2C->Listening != 0)
+    {
+        /* Switch to slave IRQHandler if address is listened to */
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler;
+        CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    }
+    else
+    {
+        CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_EVENT_ITS |
+                I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    }
+}
+
+/* Ends the master transfer */
+static void I2C_prvMasterComplete(I2C_HandleType * pxI2C)
+{
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+
+    I2C_prvMasterFinish(pxI2C);
+
+    /* Callbacks are only used in interrupt mode */
+    if ((ulCR2 & I2C_CR2_ITEVTEN) == 0)
+    {
+    }
+    else if (pxI2C->Errors != I2C_ERROR_NONE)
+    {
+        XPD_SAFE_CALLBACK(pxI2C->Callbacks.Error, pxI2C);
+    }
+    else
+    {
+        XPD_SAFE_CALLBACK(pxI2C->Callbacks.MasterComplete, pxI2C);
+    }
+}
+
+/* Sends the slave address (header) after a (repeated) START */
+static void I2C_prvMasterSendHeader(I2C_HandleType * pxI2C)
+{
+    const I2C_TransferType * pxTransfer = pxI2C->Transfers.pMaster;
+
+    if (I2C_REG_BIT(pxI2C, OAR1, ADDMODE) == 0)
+    {
+        uint32_t ulDirection = (pxI2C->Stage == I2C_STAGE_DATA) ?
+                pxTransfer->Direction : I2C_DIRECTION_WRITE;
+
+        pxI2C->Inst->DR = (pxTransfer->SlaveAddress_10bit & 0xFE) | ulDirection;
+    }
+    else
+    {
+        /* 10-bit header: 11110XXD */
+        uint32_t ulHeader = 0xF0 | ((pxTransfer->SlaveAddress_10bit >> 7) & 0x06);
+
+        if (pxI2C->Stage == I2C_STAGE_HEADER)
+        {
+            /* Repeated header for reading, no address low byte follows */
+            ulHeader |= I2C_DIRECTION_READ;
+            pxI2C->Stage = I2C_STAGE_DATA;
+        }
+        pxI2C->Inst->DR = ulHeader;
+    }
+}
+
+/* Prepares the data reception after addressing, based on the number of bytes to receive */
+static void I2C_prvMasterReceiveSetup(I2C_HandleType * pxI2C)
+{
+    uint16_t usSize = pxI2C->Stream.size;
+
+    if ((usSize > 1) && ((pxI2C->DataCtrlBits & I2C_CR2_DMAEN) != 0))
+    {
+        /* DMA generates NACK for the last byte */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 1;
+        SET_BIT(pxI2C->Inst->CR2.w, I2C_CR2_DMAEN | I2C_CR2_LAST);
+
+        (void) I2C_prvClearADDR(pxI2C);
+    }
+    else if (usSize <= 1)
+    {
+        /* Single byte: NACK and STOP right after the address phase */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+
+        XPD_ENTER_CRITICAL(pxI2C);
+        (void) I2C_prvClearADDR(pxI2C);
+        I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+        XPD_EXIT_CRITICAL(pxI2C);
+
+        if (usSize == 0)
+        {
+            I2C_prvMasterComplete(pxI2C);
+        }
+        else
+        {
+            I2C_IT_ENABLE(pxI2C, BUF);
+        }
+    }
+    else if (usSize == 2)
+    {
+        /* Two bytes: NACK applies to the byte in the shift register, wait for BTF */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+        I2C_REG_BIT(pxI2C, CR1, POS) = 1;
+
+        (void) I2C_prvClearADDR(pxI2C);
+    }
+    else
+    {
+        /* N bytes: receive until the last 3 bytes, which are handled on BTF */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 1;
+
+        (void) I2C_prvClearADDR(pxI2C);
+
+        if (usSize > 3)
+        {
+            I2C_IT_ENABLE(pxI2C, BUF);
+        }
+    }
+}
+
+/* Writes one byte of the master transmission */
+static void I2C_prvMasterWriteByte(I2C_HandleType * pxI2C)
+{
+    pxI2C->Inst->DR = *(uint8_t*)pxI2C->Stream.buffer++;
+    pxI2C->Stream.size--;
+
+    /* The end of the transmission is signalled by BTF */
+    if (pxI2C->Stream.size == 0)
+    {
+        I2C_IT_DISABLE(pxI2C, BUF);
+    }
+}
+
+/* Reads one byte of the master reception */
+static void I2C_prvMasterReadByte(I2C_HandleType * pxI2C)
+{
+    *(uint8_t*)pxI2C->Stream.buffer++ = pxI2C->Inst->DR;
+    pxI2C->Stream.size--;
+
+    /* The last 3 bytes are received on BTF */
+    if (pxI2C->Stream.size == 3)
+    {
+        I2C_IT_DISABLE(pxI2C, BUF);
+    }
+}
+
+/* Master mode EV signals interrupt handler */
+static void I2C_prvMasterIRQHandler(I2C_HandleType * pxI2C)
+{
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+    uint32_t ulSR1 = pxI2C->Inst->SR1.w;
+
+    /* START generated */
+    if ((ulSR1 & I2C_SR1_SB) != 0)
+    {
+        I2C_prvMasterSendHeader(pxI2C);
+    }
+    /* 10-bit header sent */
+    else if ((ulSR1 & I2C_SR1_ADD10) != 0)
+    {
+        pxI2C->Inst->DR = (uint8_t)pxI2C->Transfers.pMaster->SlaveAddress_10bit;
+    }
+    /* Address sent */
+    else if ((ulSR1 & I2C_SR1_ADDR) != 0)
+    {
+        if (pxI2C->Stage == I2C_STAGE_ADDR10)
+        {
+            /* 10-bit write addressing is done, send the read header */
+            (void) I2C_prvClearADDR(pxI2C);
+
+            pxI2C->Stage = I2C_STAGE_HEADER;
+            I2C_REG_BIT(pxI2C, CR1, START) = 1;
+        }
+        else if ((pxI2C->Stage == I2C_STAGE_DATA) &&
+                 (pxI2C->Transfers.pMaster->Direction == I2C_DIRECTION_READ))
+        {
+            I2C_prvMasterReceiveSetup(pxI2C);
+        }
+        else
+        {
+            (void) I2C_prvClearADDR(pxI2C);
+
+            if (pxI2C->Stream.size == 0)
+            {
+                /* Nothing to send */
+                I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+                I2C_prvMasterComplete(pxI2C);
+            }
+            else
+            {
+                /* The command is always sent by interrupts */
+                SET_BIT(pxI2C->Inst->CR2.w, (pxI2C->Stage == I2C_STAGE_CMD) ?
+                        I2C_CR2_ITBUFEN : pxI2C->DataCtrlBits);
+            }
+        }
+    }
+    /* Byte transfer finished */
+    else if ((ulSR1 & I2C_SR1_BTF) != 0)
+    {
+        if ((ulSR1 & I2C_SR1_TXE) == 0)
+        {
+            if ((ulCR2 & I2C_CR2_DMAEN) != 0)
+            {
+                /* The DMA reads the data, the last byte is NACKed by the DMA LAST setting */
+            }
+            else if (pxI2C->Stream.size == 3)
+            {
+                /* N-2th byte in DR, N-1th in shift register: NACK the last byte */
+                I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+
+                I2C_prvMasterReadByte(pxI2C);
+            }
+            else if (pxI2C->Stream.size == 2)
+            {
+                /* Last 2 bytes received */
+                I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+                I2C_prvMasterReadByte(pxI2C);
+                I2C_prvMasterReadByte(pxI2C);
+
+                I2C_prvMasterComplete(pxI2C);
+            }
+            else
+            {
+                I2C_prvMasterReadByte(pxI2C);
+            }
+        }
+        else if ((pxI2C->Stream.size > 0) && ((ulCR2 & I2C_CR2_DMAEN) != 0))
+        {
+            /* Wait for the DMA to finish */
+        }
+        else if (pxI2C->Stream.size > 0)
+        {
+            /* TXE was not served within a byte time, continue the transmission here */
+            I2C_prvMasterWriteByte(pxI2C);
+        }
+        else if (pxI2C->Stage == I2C_STAGE_CMD)
+        {
+            I2C_prvMasterSetDataStage(pxI2C, I2C_STAGE_HEADER);
+
+            if (pxI2C->Transfers.pMaster->Direction == I2C_DIRECTION_READ)
+            {
+                /* Repeated START for reading */
+                I2C_REG_BIT(pxI2C, CR1, START) = 1;
+            }
+            else if (pxI2C->Stream.size == 0)
+            {
+                I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+                I2C_prvMasterComplete(pxI2C);
+            }
+            else
+            {
+                /* Write data follows the command seamlessly */
+                SET_BIT(pxI2C->Inst->CR2.w, pxI2C->DataCtrlBits);
+            }
+        }
+        else
+        {
+            /* All data is sent */
+            I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+            I2C_prvMasterComplete(pxI2C);
+        }
+    }
+    else if ((ulCR2 & I2C_CR2_ITBUFEN) != 0)
+    {
+        /* Transmit register empty */
+        if ((ulSR1 & I2C_SR1_TXE) != 0)
+        {
+            I2C_prvMasterWriteByte(pxI2C);
+        }
+        /* Receive register not empty */
+        else if ((ulSR1 & I2C_SR1_RXNE) != 0)
+        {
+            I2C_prvMasterReadByte(pxI2C);
+
+            /* Single byte reception completes here */
+            if (pxI2C->Stream.size == 0)
+            {
+                I2C_prvMasterComplete(pxI2C);
+            }
+        }
+    }
+}
+
+/* Common error signals handler */
+static void I2C_prvErrorHandler(I2C_HandleType * pxI2C)
+{
+    uint32_t ulSR1 = pxI2C->Inst->SR1.w;
+    uint32_t ulCR2 = pxI2C->Inst->CR2.w;
+    I2C_ErrorType ePrevErrors = pxI2C->Errors;
+
+    if ((ulSR1 & I2C_SR1_BERR) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, BERR);
+        pxI2C->Errors |= I2C_ERROR_BUS;
+    }
+    if ((ulSR1 & I2C_SR1_OVR) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, OVR);
+        pxI2C->Errors |= I2C_ERROR_OVERRUN;
+    }
+    if ((ulSR1 & I2C_SR1_TIMEOUT) != 0)
+    {
+        I2C_FLAG_CLEAR(pxI2C, TIMEOUT);
+        pxI2C->Errors |= I2C_ERROR_TIMEOUT;
+    }
+
+    if (!I2C_prvIsMaster(pxI2C))
+    {
+        /* The master NACKs the last byte it reads from the slave transmitter */
+        if ((ulSR1 & I2C_SR1_AF) != 0)
+        {
+            I2C_FLAG_CLEAR(pxI2C, AF);
+
+            I2C_prvSlaveComplete(pxI2C);
+        }
+    }
+    else if ((ulSR1 & (I2C_SR1_AF | I2C_SR1_ARLO)) != 0)
+    {
+        if ((ulSR1 & I2C_SR1_AF) != 0)
+        {
+            I2C_FLAG_CLEAR(pxI2C, AF);
+            pxI2C->Errors |= I2C_ERROR_NACK;
+
+            /* Terminate the transfer */
+            I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+        }
+        if ((ulSR1 & I2C_SR1_ARLO) != 0)
+        {
+            /* The peripheral has switched to slave mode */
+            I2C_FLAG_CLEAR(pxI2C, ARLO);
+            pxI2C->Errors |= I2C_ERROR_ARBIT;
+        }
+
+        I2C_prvStopDMA(pxI2C);
+
+        /* Error callback is provided by the completion */
+        I2C_prvMasterComplete(pxI2C);
+        ePrevErrors = pxI2C->Errors;
+    }
+
+    if ((pxI2C->Errors != ePrevErrors) && ((ulCR2 & I2C_CR2_ITERREN) != 0))
+    {
+        XPD_SAFE_CALLBACK(pxI2C->Callbacks.Error, pxI2C);
+    }
+}
+
+/* Runs the event handler by polling, until the transfer reaches the end stage */
+static XPD_ReturnType I2C_prvPollEvents(I2C_HandleType * pxI2C, XPD_HandleCallbackType pxHandler,
+        I2C_StageType eEndStage, uint32_t * pulTimeout)
+{
+    XPD_ReturnType eResult = XPD_OK;
+
+    while ((pxI2C->Stage != eEndStage) && (eResult == XPD_OK))
+    {
+        uint32_t ulFlags = I2C_EVENT_FLAGS | I2C_ERROR_FLAGS;
+
+        /* Data register events are only handled when buffer interrupt would be enabled */
+        if (I2C_REG_BIT(pxI2C, CR2, ITBUFEN) != 0)
+        {
+            ulFlags |= I2C_SR1_TXE | I2C_SR1_RXNE;
+        }
+
+        eResult = XPD_eWaitForDiff(&pxI2C->Inst->SR1.w, ulFlags, 0, pulTimeout);
+
+        if (eResult != XPD_OK)
+        {
+        }
+        else if ((pxI2C->Inst->SR1.w & I2C_ERROR_FLAGS) != 0)
+        {
+            I2C_prvErrorHandler(pxI2C);
+        }
+        else
+        {
+            pxHandler(pxI2C);
+        }
+    }
+
+    return eResult;
+}
+
+/* Starts the master transfer with a START condition */
+static void I2C_prvMasterStart(I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer,
+        uint32_t ulITs)
+{
+    I2C_RESET_ERRORS(pxI2C);
+
+    /* Initialize: set transfer */
+    pxI2C->Transfers.pMaster = pxTransfer;
+
+    if (pxTransfer->CmdSize > 0)
+    {
+        /* Set stream context to command */
+        pxI2C->Stream.buffer = I2C_TRANSFER_CMD(pxTransfer);
+        pxI2C->Stream.size   = pxTransfer->CmdSize;
+        pxI2C->Stream.length = 0;
+        pxI2C->Stage = I2C_STAGE_CMD;
+    }
+    else
+    {
+        I2C_prvMasterSetDataStage(pxI2C, I2C_STAGE_ADDR10);
+    }
+
+    pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvMasterIRQHandler;
+
+    CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    SET_BIT(pxI2C->Inst->CR2.w, ulITs);
+
+    /* Generate START */
+    I2C_REG_BIT(pxI2C, CR1, START) = 1;
+}
+
+static void I2C_prvDmaTransmitRedirect(void * pxDMA)
+{
+    I2C_HandleType * pxI2C = (I2C_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+
+    /* All bytes are transferred, the end is signalled by BTF (master) or NACK (slave) */
+    pxI2C->Stream.buffer += pxI2C->Stream.size;
+    pxI2C->Stream.size = 0;
+    I2C_REG_BIT(pxI2C, CR2, DMAEN) = 0;
+}
+
+static void I2C_prvDmaReceiveRedirect(void * pxDMA)
+{
+    I2C_HandleType * pxI2C = (I2C_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+
+    /* All bytes are transferred */
+    pxI2C->Stream.buffer += pxI2C->Stream.size;
+    pxI2C->Stream.size = 0;
+    CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_CR2_DMAEN | I2C_CR2_LAST);
+
+    if (I2C_prvIsMaster(pxI2C))
+    {
+        /* The last byte has been NACK-ed */
+        I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+        I2C_prvMasterComplete(pxI2C);
+    }
+    else
+    {
+        /* Further data is NACK-ed */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+    }
+}
+
+#ifdef __XPD_DMA_ERROR_DETECT
+static void I2C_prvDmaErrorRedirect(void * pxDMA)
+{
+    I2C_HandleType * pxI2C = (I2C_HandleType*) ((DMA_HandleType*) pxDMA)->Owner;
+
+    /* Update error code */
+    pxI2C->Errors |= I2C_ERROR_DMA;
+
+    /* stop DMA and abort transfer */
+    I2C_vStop_DMA(pxI2C);
+
+    XPD_SAFE_CALLBACK(pxI2C->Callbacks.Error, pxI2C);
+}
+#endif
+
+static XPD_ReturnType I2C_prvTransmitDMA(I2C_HandleType * pxI2C, uint8_t * pucData, uint16_t usLength)
+{
+    XPD_ReturnType eResult;
+
+    /* Set up DMA for transfer */
+    eResult = DMA_eStart_IT(pxI2C->DMA.Transmit, (void*)&pxI2C->Inst->DR,
+            pucData, usLength);
+
+    if (eResult == XPD_OK)
+    {
+        I2C_RESET_ERRORS(pxI2C);
+
+        /* Set the callback owner */
+        pxI2C->DMA.Transmit->Owner = pxI2C;
+
+        /* Set the DMA transfer callbacks */
+        pxI2C->DMA.Transmit->Callbacks.Complete = I2C_prvDmaTransmitRedirect;
+#ifdef __XPD_DMA_ERROR_DETECT
+        pxI2C->DMA.Transmit->Callbacks.Error    = I2C_prvDmaErrorRedirect;
+#endif
+    }
+
+    return eResult;
+}
+
+static XPD_ReturnType I2C_prvReceiveDMA(I2C_HandleType * pxI2C, uint8_t * pucData, uint16_t usLength)
+{
+    XPD_ReturnType eResult;
+
+    /* Set up DMA for transfer */
+    eResult = DMA_eStart_IT(pxI2C->DMA.Receive, (void*)&pxI2C->Inst->DR,
+            pucData, usLength);
+
+    if (eResult == XPD_OK)
+    {
+        I2C_RESET_ERRORS(pxI2C);
+
+        /* Set the callback owner */
+        pxI2C->DMA.Receive->Owner = pxI2C;
+
+        /* Set the DMA transfer callbacks */
+        pxI2C->DMA.Receive->Callbacks.Complete = I2C_prvDmaReceiveRedirect;
+#ifdef __XPD_DMA_ERROR_DETECT
+        pxI2C->DMA.Receive->Callbacks.Error    = I2C_prvDmaErrorRedirect;
+#endif
+    }
+
+    return eResult;
+}
+
+/** @defgroup I2C_Common_Exported_Functions I2C Common Exported Functions
+ * @{ */
+
+/**
+ * @brief Initializes the I2C peripheral using the setup configuration
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxConfig: I2C master setup configuration
+ */
+void I2C_vInit(I2C_HandleType * pxI2C, const I2C_InitType * pxConfig)
+{
+    /* Enable clock */
+    RCC_vClockEnable(pxI2C->CtrlPos);
+
+    /* Software reset to release a possibly stuck peripheral state */
+    pxI2C->Inst->CR1.w = I2C_CR1_SWRST;
+    pxI2C->Inst->CR1.w = 0;
+
+    pxI2C->BusFreq_Hz = I2C_prvSetTiming(pxI2C, pxConfig);
+
+    /* Slave configuration */
+    pxI2C->Inst->CR1.w = pxConfig->wCfg & (I2C_CR1_ENGC | I2C_CR1_NOSTRETCH);
+
+#ifdef I2C_FLTR_ANOFF
+    /* Input filters */
+    pxI2C->Inst->FLTR.w = (pxConfig->wCfg >> 8) & (I2C_FLTR_DNF | I2C_FLTR_ANOFF);
+#endif
+
+    /* Set Address 1 (bit 14 has to be kept set) */
+    pxI2C->Inst->OAR1.w = (1 << 14) | pxConfig->OwnAddress1.wValue |
+            (pxConfig->AddressingMode << I2C_OAR1_ADDMODE_Pos);
+
+    /* Slave Address 2 is only used with 7 bit addressing */
+    if ((pxConfig->AddressingMode == I2C_ADDRESS_10BIT) || (pxConfig->OwnAddress2.wValue == 0))
+    {
+        pxI2C->Inst->OAR2.w = 0;
+    }
+    else
+    {
+        pxI2C->Inst->OAR2.w = I2C_OAR2_ENDUAL | pxConfig->OwnAddress2.wValue;
+    }
+
+    pxI2C->IRQHandler = NULL;
+    pxI2C->Stage = I2C_STAGE_IDLE;
+    pxI2C->Listening = 0;
+    I2C_prvEnable(pxI2C);
+
+    /* Dependencies initialization */
+    XPD_SAFE_CALLBACK(pxI2C->Callbacks.DepInit, pxI2C);
+}
+
+/**
+ * @brief Restores the I2C peripheral to its default inactive state
+ * @param pxI2C: pointer to the I2C handle structure
+ */
+void I2C_vDeinit(I2C_HandleType * pxI2C)
+{
+    I2C_prvDisable(pxI2C);
+
+    /* Deinitialize peripheral dependencies */
+    XPD_SAFE_CALLBACK(pxI2C->Callbacks.DepDeinit, pxI2C);
+
+    /* Disable clock */
+    RCC_vClockDisable(pxI2C->CtrlPos);
+}
+
+/**
+ * @brief Determines the current status of I2C bus.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @return BUSY if a transfer is in progress, OK if I2C bus is idle
+ */
+XPD_ReturnType I2C_eGetStatus(I2C_HandleType * pxI2C)
+{
+    return (I2C_REG_BIT(pxI2C, SR2, BUSY) != 0) ? XPD_BUSY : XPD_OK;
+}
+
+/**
+ * @brief Polls the status of the I2C bus.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param ulTimeout: the timeout in ms for the polling
+ * @return TIMEOUT if timed out, OK if successful
+ */
+XPD_ReturnType I2C_ePollStatus(I2C_HandleType * pxI2C, uint32_t ulTimeout)
+{
+    XPD_ReturnType eResult = XPD_eWaitForMatch(&pxI2C->Inst->SR2.w, I2C_SR2_BUSY, 0, &ulTimeout);
+
+    return eResult;
+}
+
+/**
+ * @brief Returns the number of bytes that failed to get transferred due to a NACK (or bus error).
+ * @param pxI2C: pointer to the I2C handle structure
+ * @return The amount of data that was rejected during the last transfer
+ */
+uint16_t I2C_usGetRejectedLength(I2C_HandleType * pxI2C)
+{
+    return pxI2C->Stream.length + pxI2C->Stream.size;
+}
+
+/**
+ * @brief I2C event interrupt handler that manages the transfer and provides handle callbacks.
+ * @param pxI2C: pointer to the I2C handle structure
+ */
+void I2C_vIRQHandler_EV(I2C_HandleType * pxI2C)
+{
+    XPD_HandleCallbackType pxHandler = pxI2C->IRQHandler;
+
+    XPD_SAFE_CALLBACK(pxHandler, pxI2C);
+}
+
+/**
+ * @brief I2C error interrupt handler that provides handle error callback.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @note  The acknowledge failure signals the end of the slave transmission,
+ *        therefore the error interrupt has to be serviced in slave mode as well.
+ */
+void I2C_vIRQHandler_ER(I2C_HandleType * pxI2C)
+{
+    if (I2C_REG_BIT(pxI2C, CR2, ITERREN) != 0)
+    {
+        I2C_prvErrorHandler(pxI2C);
+    }
+}
+
+/**
+ * @brief Stops the ongoing DMA-managed I2C transfer.
+ * @param pxI2C: pointer to the I2C handle structure
+ */
+void I2C_vStop_DMA(I2C_HandleType *pxI2C)
+{
+    I2C_prvStopDMA(pxI2C);
+
+    /* Generate STOP in master mode, NACK in slave mode */
+    if (I2C_prvIsMaster(pxI2C) && (pxI2C->Stage != I2C_STAGE_IDLE))
+    {
+        I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+        I2C_prvMasterFinish(pxI2C);
+    }
+    else
+    {
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+    }
+}
+
+/** @} */
+
+/** @defgroup I2C_Master_Exported_Functions I2C Master Exported Functions
+ * @{ */
+
+/**
+ * @brief Performs an I2C transfer as master.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxTransfer: transfer context reference (its Direction field determines the data transfer's direction)
+ * @param ulTimeout: the timeout in ms for the transfer
+ * @return TIMEOUT if timed out, ERROR if the transfer was NACK-ed prematurely, OK if successful
+ */
+XPD_ReturnType I2C_eMasterTransfer(I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer, uint32_t ulTimeout)
+{
+    XPD_ReturnType eResult;
+
+    /* The interrupt flow is followed by polling the events */
+    pxI2C->DataCtrlBits = I2C_CR2_ITBUFEN;
+    I2C_prvMasterStart(pxI2C, pxTransfer, 0);
+
+    eResult = I2C_prvPollEvents(pxI2C, (XPD_HandleCallbackType)I2C_prvMasterIRQHandler,
+            I2C_STAGE_IDLE, &ulTimeout);
+
+    if (eResult != XPD_OK)
+    {
+        /* Release the bus */
+        I2C_REG_BIT(pxI2C, CR1, STOP) = 1;
+
+        I2C_prvMasterFinish(pxI2C);
+    }
+    else if (pxI2C->Errors != I2C_ERROR_NONE)
+    {
+        eResult = XPD_ERROR;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Performs an I2C transfer as master using the EV interrupt stack.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxTransfer: transfer context reference (its Direction field determines the data transfer's direction)
+ */
+void I2C_vMasterTransfer_IT(I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer)
+{
+    pxI2C->DataCtrlBits = I2C_CR2_ITBUFEN;
+    I2C_prvMasterStart(pxI2C, pxTransfer, I2C_EVENT_ITS);
+}
+
+/**
+ * @brief Performs an I2C transfer as master using the EV interrupt stack and DMA for data stage transfer.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param pxTransfer: transfer context reference (its Direction field determines the data transfer's direction)
+ * @return BUSY if DMA is in use, OK if transfer is started
+ * @note Single byte reads are performed by interrupts, as the reception has to be stopped
+ *       right after addressing.
+ */
+XPD_ReturnType I2C_eMasterTransfer_DMA(I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer)
+{
+    XPD_ReturnType eResult = XPD_OK;
+
+    /* Set up DMA for transfer */
+    if (pxTransfer->Length == 0)
+    {
+        pxI2C->DataCtrlBits = 0;
+    }
+    else if (pxTransfer->Direction == I2C_DIRECTION_WRITE)
+    {
+        eResult = I2C_prvTransmitDMA(pxI2C, pxTransfer->Data, pxTransfer->Length);
+        pxI2C->DataCtrlBits = I2C_CR2_DMAEN;
+    }
+    else if (pxTransfer->Length > 1)
+    {
+        eResult = I2C_prvReceiveDMA(pxI2C, pxTransfer->Data, pxTransfer->Length);
+        pxI2C->DataCtrlBits = I2C_CR2_DMAEN;
+    }
+    else
+    {
+        pxI2C->DataCtrlBits = I2C_CR2_ITBUFEN;
+    }
+
+    if (eResult == XPD_OK)
+    {
+        I2C_prvMasterStart(pxI2C, pxTransfer, I2C_EVENT_ITS);
+    }
+
+    return eResult;
+}
+
+/** @} */
+
+/** @defgroup I2C_Slave_Exported_Functions I2C Slave Exported Functions
+ * @{ */
+
+/**
+ * @brief Listens on the I2C bus until being addressed as a slave, and optionally receives the slave command.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param ucCmdSize: size of the slave command that will be received in this stage
+ * @param ulTimeout: the timeout in ms for the operation
+ * @return TIMEOUT if timed out, ERROR if the master didn't provide the expected command, OK if successful
+ */
+XPD_ReturnType I2C_eSlaveListen(I2C_HandleType * pxI2C, uint8_t ucCmdSize, uint32_t ulTimeout)
+{
+    XPD_ReturnType eResult;
+
+    I2C_RESET_ERRORS(pxI2C);
+    pxI2C->Transfers.Slave.CmdSize = ucCmdSize;
+    pxI2C->Stream.size = ucCmdSize;
+    pxI2C->Stage = I2C_STAGE_IDLE;
+    I2C_REG_BIT(pxI2C, CR1, ACK) = 1;
+
+    /* Wait for address match, receive cmd first */
+    eResult = I2C_prvPollEvents(pxI2C, (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler,
+            I2C_STAGE_ADDRESSED, &ulTimeout);
+
+    if ((eResult == XPD_OK) && (pxI2C->Stream.size > 0))
+    {
+        /* Wrong direction selected by master */
+        eResult = XPD_ERROR;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Performs the slave data transfer based on the values set in the listen stage
+ *        and by the application in @ref I2C_pxSlaveTransferInfo .
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param ulTimeout: the timeout in ms for the operation
+ * @return TIMEOUT if timed out, ERROR if the transfer was NACK-ed prematurely, OK if successful
+ */
+XPD_ReturnType I2C_eSlaveTransferData(I2C_HandleType * pxI2C, uint32_t ulTimeout)
+{
+    XPD_ReturnType eResult;
+
+    I2C_RESET_ERRORS(pxI2C);
+
+    /* Set stream context to data */
+    pxI2C->Stream.buffer = pxI2C->Transfers.Slave.Data;
+    pxI2C->Stream.size   = pxI2C->Transfers.Slave.Length;
+    pxI2C->Stream.length = 0;
+    pxI2C->Stage = I2C_STAGE_DATA;
+
+    /* Wait for end of transfer */
+    I2C_IT_ENABLE(pxI2C, BUF);
+    eResult = I2C_prvPollEvents(pxI2C, (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler,
+            I2C_STAGE_IDLE, &ulTimeout);
+    I2C_IT_DISABLE(pxI2C, BUF);
+
+    if ((eResult == XPD_OK) && (pxI2C->Stream.size > 0))
+    {
+        eResult = XPD_ERROR;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Listens on the I2C bus until being addressed as a slave,
+ *        and optionally receives the slave command, in interrupt mode.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @param ucCmdSize: size of the slave command that will be received in this stage
+ */
+void I2C_vSlaveListen_IT(I2C_HandleType * pxI2C, uint8_t ucCmdSize)
+{
+    pxI2C->Transfers.Slave.CmdSize = ucCmdSize;
+    pxI2C->Listening = 1;
+
+    /* An ongoing master transfer switches to slave mode when finished */
+    if (!I2C_prvIsMaster(pxI2C) || (pxI2C->Stage == I2C_STAGE_IDLE))
+    {
+        pxI2C->Stage = I2C_STAGE_IDLE;
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler;
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 1;
+    }
+    SET_BIT(pxI2C->Inst->CR2.w, I2C_EVENT_ITS);
+}
+
+/**
+ * @brief Stops listening for its slave address(es) in interrupt mode.
+ * @param pxI2C: pointer to the I2C handle structure
+ */
+void I2C_vSlaveSuspend_IT(I2C_HandleType * pxI2C)
+{
+    pxI2C->Listening = 0;
+
+    if (!I2C_prvIsMaster(pxI2C))
+    {
+        /* Addresses are no longer acknowledged */
+        I2C_REG_BIT(pxI2C, CR1, ACK) = 0;
+
+        if (pxI2C->Stage == I2C_STAGE_IDLE)
+        {
+            CLEAR_BIT(pxI2C->Inst->CR2.w, I2C_EVENT_ITS);
+        }
+    }
+}
+
+/**
+ * @brief Once addressed, performs the slave data transfer based on the values set
+ *        in the listen stage and by the application in @ref I2C_pxSlaveTransferInfo .
+ * @param pxI2C: pointer to the I2C handle structure
+ */
+void I2C_vSlaveTransferData_IT(I2C_HandleType * pxI2C)
+{
+    I2C_RESET_ERRORS(pxI2C);
+
+    /* Set stream context to data */
+    pxI2C->Stream.buffer = pxI2C->Transfers.Slave.Data;
+    pxI2C->Stream.size   = pxI2C->Transfers.Slave.Length;
+    pxI2C->Stream.length = 0;
+    pxI2C->Stage = I2C_STAGE_DATA;
+
+    pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler;
+
+    /* Enable data interrupts, the clock is stretched until then */
+    SET_BIT(pxI2C->Inst->CR2.w, I2C_EVENT_ITS | I2C_CR2_ITBUFEN);
+}
+
+/**
+ * @brief Once addressed, performs the slave data transfer based on the values set
+ *        in the listen stage and by the application in @ref I2C_pxSlaveTransferInfo
+ *        using DMA for data transfer.
+ * @param pxI2C: pointer to the I2C handle structure
+ * @return BUSY if DMA is in use, OK if transfer is started
+ */
+XPD_ReturnType I2C_eSlaveTransferData_DMA(I2C_HandleType * pxI2C)
+{
+    XPD_ReturnType eResult;
+
+    /* Set up DMA for transfer */
+    if (pxI2C->Transfers.Slave.Direction == I2C_DIRECTION_WRITE)
+    {
+        eResult = I2C_prvReceiveDMA(pxI2C,
+                pxI2C->Transfers.Slave.Data, pxI2C->Transfers.Slave.Length);
+    }
+    else
+    {
+        eResult = I2C_prvTransmitDMA(pxI2C,
+                pxI2C->Transfers.Slave.Data, pxI2C->Transfers.Slave.Length);
+    }
+
+    if (eResult == XPD_OK)
+    {
+        /* Set stream context to data */
+        pxI2C->Stream.buffer = pxI2C->Transfers.Slave.Data;
+        pxI2C->Stream.size   = pxI2C->Transfers.Slave.Length;
+        pxI2C->Stream.length = 0;
+        pxI2C->Stage = I2C_STAGE_DATA;
+
+        pxI2C->IRQHandler = (XPD_HandleCallbackType)I2C_prvSlaveIRQHandler;
+        pxI2C->DataCtrlBits = I2C_CR2_DMAEN;
+
+        /* Enable DMA requests, the clock is stretched until then */
+        SET_BIT(pxI2C->Inst->CR2.w, I2C_EVENT_ITS | I2C_CR2_DMAEN);
+    }
+
+    return eResult;
+}
+
+/** @} */
+
+/** @} */
@@ -0,0 +1,550 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_audio.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-08-04
+  * @brief   STM32 eXtensible Peripheral Drivers USB Audio Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_usb_audio.h>
+#include <xpd_utils.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/* Setup packet fields */
+#define AUDIO_SETUP_REQUEST_TYPE(SETUP) ((SETUP)[0])
+#define AUDIO_SETUP_REQUEST(SETUP)      ((SETUP)[1])
+#define AUDIO_SETUP_CONTROL(SETUP)      ((SETUP)[3])
+#define AUDIO_SETUP_INDEX_LOW(SETUP)    ((SETUP)[4])
+#define AUDIO_SETUP_INDEX_HIGH(SETUP)   ((SETUP)[5])
+#define AUDIO_SETUP_LENGTH(SETUP)       ((uint16_t)(SETUP)[6] | ((uint16_t)(SETUP)[7] << 8))
+
+#define AUDIO_REQUEST_DIR_IN            0x80
+#define AUDIO_REQUEST_TYPE_MASK         0x60
+#define AUDIO_REQUEST_TYPE_CLASS        0x20
+#define AUDIO_REQUEST_RECIPIENT_MASK    0x1F
+#define AUDIO_REQUEST_RECIPIENT_IF      0x01
+#define AUDIO_REQUEST_RECIPIENT_EP      0x02
+
+/* Audio 1.0 endpoint control requests */
+#define AUDIO1_SET_CUR                  0x01
+#define AUDIO1_GET_CUR                  0x81
+#define AUDIO1_SAMPLING_FREQ_CONTROL    0x01
+
+/* Audio 2.0 clock source control requests */
+#define AUDIO2_CUR                      0x01
+#define AUDIO2_RANGE                    0x02
+#define AUDIO2_SAM_FREQ_CONTROL         0x01
+#define AUDIO2_CLOCK_VALID_CONTROL      0x02
+
+#define AUDIO_RUNNING_PREFILL           0
+#define AUDIO_RUNNING_ACTIVE            1
+#define AUDIO_RUNNING_UNDERRUN          2
+
+#define AUDIO_STAGED_RING               0
+#define AUDIO_STAGED_PACKET             1
+#define AUDIO_STAGED_DROPPED            2
+
+/* The ring level deviation is corrected in this many (micro)frames */
+#define AUDIO_LEVEL_CORRECTION_FRAMES   256
+
+/** @defgroup USB_Audio_Private_Functions USB Audio Private Functions
+ * @{ */
+
+/**
+ * @brief Stores a value in little endian byte order.
+ * @param pucData: pointer to the destination
+ * @param ulValue: the value to store
+ */
+static void USB_prvAudioPutLE32(uint8_t * pucData, uint32_t ulValue)
+{
+    pucData[0] = (uint8_t)(ulValue);
+    pucData[1] = (uint8_t)(ulValue >> 8);
+    pucData[2] = (uint8_t)(ulValue >> 16);
+    pucData[3] = (uint8_t)(ulValue >> 24);
+}
+
+/**
+ * @brief Determines the amount of data in the ring that the codec hasn't consumed yet.
+ * @param pxAudio: pointer to the Audio function structure
+ * @return The ring level in bytes
+ */
+static uint32_t USB_prvAudioLevel(USB_AudioType * pxAudio)
+{
+    uint32_t ulRead = 0;
+
+    if (pxAudio->Running == AUDIO_RUNNING_ACTIVE)
+    {
+        /* The DMA counts the items down to the reload */
+        ulRead = pxAudio->Size - (uint32_t)DMA_usGetStatus(pxAudio->pDMA) * pxAudio->DmaWidth;
+        if (ulRead >= pxAudio->Size)
+        {
+            ulRead = 0;
+        }
+    }
+
+    return (pxAudio->Head >= ulRead) ?
+            (pxAudio->Head - ulRead) : (pxAudio->Head + pxAudio->Size - ulRead);
+}
+
+/**
+ * @brief Sets the nominal feedback of the current sample rate, and restarts the measurement.
+ * @param pxAudio: pointer to the Audio function structure
+ */
+static void USB_prvAudioResetFeedback(USB_AudioType * pxAudio)
+{
+    /* Samples per (micro)frame */
+    pxAudio->Feedback = (uint32_t)(((uint64_t)pxAudio->SampleRate << pxAudio->FracBits)
+            / ((pxAudio->FracBits == 16) ? 8000 : 1000));
+
+    pxAudio->CaptureSum = 0;
+    pxAudio->Frames     = 0;
+    pxAudio->Captured   = 0;
+}
+
+/**
+ * @brief Sends the current feedback value.
+ * @param pxAudio: pointer to the Audio function structure
+ */
+static void USB_prvAudioSendFeedback(USB_AudioType * pxAudio)
+{
+    pxAudio->FeedbackBusy = 1;
+
+    /* Full speed uses 10.14 format in 3 bytes, high speed 16.16 in 4 bytes */
+    USB_prvAudioPutLE32((uint8_t*)&pxAudio->FeedbackData, pxAudio->Feedback);
+
+    USB_vEpSend(pxAudio->pUSB, pxAudio->FeedbackEpAddress, (const uint8_t*)&pxAudio->FeedbackData,
+            (pxAudio->FracBits == 16) ? 4 : 3);
+}
+
+/**
+ * @brief Starts the reception of the next packet, directly to the ring if it fits.
+ * @param pxAudio: pointer to the Audio function structure
+ */
+static void USB_prvAudioReceive(USB_AudioType * pxAudio)
+{
+    uint8_t * pucData = (uint8_t*)pxAudio->Packet;
+
+    /* The writer must not reach the codec's read position */
+    if ((pxAudio->Size - USB_prvAudioLevel(pxAudio)) <= pxAudio->MaxPacketSize)
+    {
+        pxAudio->Staged = AUDIO_STAGED_DROPPED;
+    }
+    else if ((pxAudio->Size - pxAudio->Head) >= pxAudio->MaxPacketSize)
+    {
+        pxAudio->Staged = AUDIO_STAGED_RING;
+        pucData = &pxAudio->Buffer[pxAudio->Head];
+    }
+    else
+    {
+        pxAudio->Staged = AUDIO_STAGED_PACKET;
+    }
+
+    USB_vEpReceive(pxAudio->pUSB, pxAudio->OutEpAddress, pucData, pxAudio->MaxPacketSize);
+}
+
+/** @} */
+
+/** @defgroup USB_Audio_Exported_Functions USB Audio Exported Functions
+ * @{ */
+
+/**
+ * @brief Initializes the Audio function and sets up its endpoints in the USB handle,
+ *        so that they are considered by the endpoint resource allocation.
+ * @param pxAudio: pointer to the Audio function structure
+ * @return ERROR if the ring, packet or sample rate setup is invalid, OK otherwise
+ * @note  This function shall be called before the USB device is started.
+ */
+XPD_ReturnType USB_eAudioInit(USB_AudioType * pxAudio)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    if ((pxAudio->MaxPacketSize == 0) || (pxAudio->MaxPacketSize > USB_AUDIO_MAX_PACKET_SIZE) ||
+        (pxAudio->FrameSize == 0) || (pxAudio->DmaWidth == 0) || (pxAudio->MclkRatio == 0))
+    {
+    }
+    else if ((pxAudio->Size <= (4 * (uint32_t)pxAudio->MaxPacketSize)) ||
+             ((pxAudio->Size % pxAudio->FrameSize) != 0) ||
+             ((pxAudio->Size % pxAudio->DmaWidth) != 0) ||
+             ((pxAudio->Size / pxAudio->DmaWidth) > 0xFFFF))
+    {
+    }
+    else if ((pxAudio->SampleRateCount == 0) ||
+             (pxAudio->SampleRateCount > USB_AUDIO_MAX_SAMPLE_RATES))
+    {
+    }
+    else
+    {
+        USB_EndPointHandleType * pxOut = &pxAudio->pUSB->EP.OUT[pxAudio->OutEpAddress & 0xF];
+        USB_EndPointHandleType * pxFb  = &pxAudio->pUSB->EP.IN[pxAudio->FeedbackEpAddress & 0xF];
+
+        pxAudio->SampleRate = pxAudio->SampleRates[0];
+        pxAudio->Streaming  = 0;
+        pxAudio->Running    = AUDIO_RUNNING_PREFILL;
+        pxAudio->Underruns  = 0;
+        pxAudio->Overruns   = 0;
+
+        /* Endpoint properties for the resource allocation */
+        pxOut->MaxPacketSize = pxAudio->MaxPacketSize;
+        pxOut->Type          = USB_EP_TYPE_ISOCHRONOUS;
+        pxFb->MaxPacketSize  = sizeof(pxAudio->FeedbackData);
+        pxFb->Type           = USB_EP_TYPE_ISOCHRONOUS;
+
+        eResult = XPD_OK;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Opens the streaming endpoints of the Audio function.
+ *        The codec DMA is started when half of the ring is filled.
+ * @param pxAudio: pointer to the Audio function structure
+ * @note  This function shall be called when the host selects the operational
+ *        alternate setting of the streaming interface.
+ *        When the OTG core uses DMA, the OUT endpoint's BounceBuffer has to be set
+ *        unless the FrameSize is a multiple of 4.
+ */
+void USB_vAudioStart(USB_AudioType * pxAudio)
+{
+    pxAudio->FracBits = 14;
+#ifdef USB_OTG_HS
+    if (USB_eDevSpeed(pxAudio->pUSB) == USB_SPEED_HIGH)
+    {
+        pxAudio->FracBits = 16;
+    }
+#endif
+    USB_prvAudioResetFeedback(pxAudio);
+
+    pxAudio->Head         = 0;
+    pxAudio->Running      = AUDIO_RUNNING_PREFILL;
+    pxAudio->FeedbackBusy = 0;
+
+    USB_vEpOpen(pxAudio->pUSB, pxAudio->OutEpAddress, USB_EP_TYPE_ISOCHRONOUS,
+            pxAudio->MaxPacketSize);
+    USB_vEpOpen(pxAudio->pUSB, pxAudio->FeedbackEpAddress, USB_EP_TYPE_ISOCHRONOUS,
+            (pxAudio->FracBits == 16) ? 4 : 3);
+
+    pxAudio->Streaming = 1;
+
+    USB_prvAudioReceive(pxAudio);
+    USB_prvAudioSendFeedback(pxAudio);
+}
+
+/**
+ * @brief Closes the streaming endpoints of the Audio function, and stops the codec DMA.
+ * @param pxAudio: pointer to the Audio function structure
+ * @note  This function shall be called when the host selects the zero bandwidth
+ *        alternate setting of the streaming interface.
+ */
+void USB_vAudioStop(USB_AudioType * pxAudio)
+{
+    pxAudio->Streaming = 0;
+
+    USB_vEpClose(pxAudio->pUSB, pxAudio->OutEpAddress);
+    USB_vEpClose(pxAudio->pUSB, pxAudio->FeedbackEpAddress);
+
+    if (pxAudio->Running == AUDIO_RUNNING_ACTIVE)
+    {
+        DMA_vStop(pxAudio->pDMA);
+    }
+    pxAudio->Running = AUDIO_RUNNING_PREFILL;
+}
+
+/**
+ * @brief Processes the Audio class-specific control requests of the sample rate.
+ * @param pxAudio: pointer to the Audio function structure
+ * @param pucSetup: pointer to the setup packet
+ * @param ppucData: set to the data stage buffer (data to send, or to receive)
+ * @param pusLength: set to the data stage length
+ * @return OK if the request is supported, ERROR if it shall be stalled
+ * @note  Version 1 uses the sampling frequency control of the data endpoint,
+ *        version 2 the frequency control of the clock source entity.
+ *        After the OUT data stage of a request is complete,
+ *        @ref USB_vAudioSetupData has to be called.
+ */
+XPD_ReturnType USB_eAudioSetupRequest(
+        USB_AudioType *     pxAudio,
+        const uint8_t *     pucSetup,
+        uint8_t **          ppucData,
+        uint16_t *          pusLength)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint8_t * pucData = (uint8_t*)pxAudio->Control;
+    uint8_t ucType = AUDIO_SETUP_REQUEST_TYPE(pucSetup);
+    uint16_t usLength = 0;
+
+    *ppucData  = NULL;
+    *pusLength = 0;
+
+    if ((ucType & AUDIO_REQUEST_TYPE_MASK) != AUDIO_REQUEST_TYPE_CLASS)
+    {
+    }
+    else if (pxAudio->Version == 1)
+    {
+        if (((ucType & AUDIO_REQUEST_RECIPIENT_MASK) == AUDIO_REQUEST_RECIPIENT_EP) &&
+            (AUDIO_SETUP_INDEX_LOW(pucSetup) == pxAudio->OutEpAddress) &&
+            (AUDIO_SETUP_CONTROL(pucSetup) == AUDIO1_SAMPLING_FREQ_CONTROL))
+        {
+            if (AUDIO_SETUP_REQUEST(pucSetup) == AUDIO1_GET_CUR)
+            {
+                USB_prvAudioPutLE32(pucData, pxAudio->SampleRate);
+                usLength = 3;
+                eResult = XPD_OK;
+            }
+            else if (AUDIO_SETUP_REQUEST(pucSetup) == AUDIO1_SET_CUR)
+            {
+                usLength = 3;
+                eResult = XPD_OK;
+            }
+        }
+    }
+    else if (((ucType & AUDIO_REQUEST_RECIPIENT_MASK) == AUDIO_REQUEST_RECIPIENT_IF) &&
+             (AUDIO_SETUP_INDEX_HIGH(pucSetup) == pxAudio->ClockSourceId))
+    {
+        uint8_t ucDirIn = (ucType & AUDIO_REQUEST_DIR_IN) != 0;
+
+        if (AUDIO_SETUP_CONTROL(pucSetup) == AUDIO2_SAM_FREQ_CONTROL)
+        {
+            if (AUDIO_SETUP_REQUEST(pucSetup) == AUDIO2_CUR)
+            {
+                if (ucDirIn != 0)
+                {
+                    USB_prvAudioPutLE32(pucData, pxAudio->SampleRate);
+                }
+                usLength = 4;
+                eResult = XPD_OK;
+            }
+            else if ((AUDIO_SETUP_REQUEST(pucSetup) == AUDIO2_RANGE) && (ucDirIn != 0))
+            {
+                uint8_t i;
+
+                /* Each selectable rate is a discrete subrange */
+                pucData[0] = pxAudio->SampleRateCount;
+                pucData[1] = 0;
+                usLength = 2;
+
+                for (i = 0; i < pxAudio->SampleRateCount; i++)
+                {
+                    USB_prvAudioPutLE32(&pucData[usLength + 0], pxAudio->SampleRates[i]);
+                    USB_prvAudioPutLE32(&pucData[usLength + 4], pxAudio->SampleRates[i]);
+                    USB_prvAudioPutLE32(&pucData[usLength + 8], 0);
+                    usLength += 12;
+                }
+                eResult = XPD_OK;
+            }
+        }
+        else if ((AUDIO_SETUP_CONTROL(pucSetup) == AUDIO2_CLOCK_VALID_CONTROL) &&
+                 (AUDIO_SETUP_REQUEST(pucSetup) == AUDIO2_CUR) && (ucDirIn != 0))
+        {
+            pucData[0] = 1;
+            usLength = 1;
+            eResult = XPD_OK;
+        }
+    }
+
+    if (eResult == XPD_OK)
+    {
+        if (usLength > AUDIO_SETUP_LENGTH(pucSetup))
+        {
+            usLength = AUDIO_SETUP_LENGTH(pucSetup);
+        }
+        *ppucData  = pucData;
+        *pusLength = usLength;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Completes the Audio class-specific control requests with OUT data stage.
+ *        A new sample rate is only accepted if it is one of the SampleRates,
+ *        and the data stage carried the complete rate.
+ * @param pxAudio: pointer to the Audio function structure
+ * @param pucSetup: pointer to the setup packet
+ */
+void USB_vAudioSetupData(USB_AudioType * pxAudio, const uint8_t * pucSetup)
+{
+    const uint8_t * pucData = (const uint8_t*)pxAudio->Control;
+    uint32_t ulRate = (uint32_t)pucData[0] | ((uint32_t)pucData[1] << 8) | ((uint32_t)pucData[2] << 16);
+    uint16_t usRateSize = 3;
+    uint8_t i;
+
+    if (pxAudio->Version != 1)
+    {
+        ulRate |= (uint32_t)pucData[3] << 24;
+        usRateSize = 4;
+    }
+
+    /* A shorter data stage leaves stale bytes of the rate in the buffer */
+    if (AUDIO_SETUP_LENGTH(pucSetup) >= usRateSize)
+    {
+        for (i = 0; i < pxAudio->SampleRateCount; i++)
+        {
+            if ((pxAudio->SampleRates[i] == ulRate) && (pxAudio->SampleRate != ulRate))
+            {
+                pxAudio->SampleRate = ulRate;
+
+                if (pxAudio->Streaming != 0)
+                {
+                    USB_prvAudioResetFeedback(pxAudio);
+                }
+
+                XPD_SAFE_CALLBACK(pxAudio->Callbacks.SampleRate, pxAudio);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Measures the codec master clock against the USB (micro)frames,
+ *        and sends the resulting sample rate feedback to the host.
+ *        The measured rate is adjusted by the deviation of the ring level from half,
+ *        so the ring stays centered regardless of the initial offset.
+ * @param pxAudio: pointer to the Audio function structure
+ * @param usCapture: the master clock counting timer's value captured at the SOF
+ * @note  This function shall be called at each SOF, from the timer's capture interrupt
+ *        that is triggered by the USB SOF. The timer shall be clocked by the master clock,
+ *        the difference of consecutive captures is taken modulo 2^16.
+ *        It shall not preempt the USB endpoint completion callbacks, or vice versa.
+ */
+void USB_vAudioSofCapture(USB_AudioType * pxAudio, uint16_t usCapture)
+{
+    if (pxAudio->Streaming != 0)
+    {
+        if (pxAudio->Captured != 0)
+        {
+            pxAudio->CaptureSum += (uint16_t)(usCapture - pxAudio->LastCapture);
+            pxAudio->Frames++;
+        }
+        pxAudio->LastCapture = usCapture;
+        pxAudio->Captured    = 1;
+
+        if (pxAudio->Frames >= USB_AUDIO_FEEDBACK_FRAMES)
+        {
+            /* Samples per (micro)frame in the feedback format */
+            int32_t lFeedback = (int32_t)(((uint64_t)pxAudio->CaptureSum << pxAudio->FracBits)
+                    / ((uint32_t)pxAudio->MclkRatio * pxAudio->Frames));
+
+            if (pxAudio->Running == AUDIO_RUNNING_ACTIVE)
+            {
+                int32_t lOffset = ((int32_t)(pxAudio->Size / 2) - (int32_t)USB_prvAudioLevel(pxAudio))
+                        / pxAudio->FrameSize;
+
+                lFeedback += (lOffset * (1 << pxAudio->FracBits)) / AUDIO_LEVEL_CORRECTION_FRAMES;
+            }
+
+            pxAudio->Feedback   = (uint32_t)lFeedback;
+            pxAudio->CaptureSum = 0;
+            pxAudio->Frames     = 0;
+        }
+
+        /* The codec is about to consume the data that is not yet received */
+        if ((pxAudio->Running == AUDIO_RUNNING_ACTIVE) &&
+            (USB_prvAudioLevel(pxAudio) < pxAudio->MaxPacketSize))
+        {
+            DMA_vStop(pxAudio->pDMA);
+            pxAudio->Running = AUDIO_RUNNING_UNDERRUN;
+            pxAudio->Underruns++;
+        }
+
+        if (pxAudio->FeedbackBusy == 0)
+        {
+            USB_prvAudioSendFeedback(pxAudio);
+        }
+    }
+}
+
+/**
+ * @brief Handles the completion of the feedback endpoint transfer.
+ * @param pxAudio: pointer to the Audio function structure
+ * @note  This function shall be called from @ref USB_vDataInCallback
+ *        for the Audio function's feedback endpoint.
+ */
+void USB_vAudioDataIn(USB_AudioType * pxAudio)
+{
+    pxAudio->FeedbackBusy = 0;
+}
+
+/**
+ * @brief Handles the completion of the OUT packet:
+ *        the audio data is released to the codec, and the reception is restarted immediately.
+ * @param pxAudio: pointer to the Audio function structure
+ * @param pxEP: pointer to the isochronous OUT endpoint handle
+ * @note  This function shall be called from @ref USB_vDataOutCallback
+ *        for the Audio function's data endpoint.
+ */
+void USB_vAudioDataOut(USB_AudioType * pxAudio, USB_EndPointHandleType * pxEP)
+{
+    uint32_t ulLength = pxEP->Transfer.Length;
+
+    if (pxAudio->Streaming == 0)
+    {
+    }
+    else if (pxAudio->Running == AUDIO_RUNNING_UNDERRUN)
+    {
+        /* Restart from an empty ring, the packet is dropped */
+        pxAudio->Head    = 0;
+        pxAudio->Running = AUDIO_RUNNING_PREFILL;
+    }
+    else if (pxAudio->Staged == AUDIO_STAGED_DROPPED)
+    {
+        pxAudio->Overruns++;
+    }
+    else
+    {
+        if (pxAudio->Staged == AUDIO_STAGED_PACKET)
+        {
+            const uint8_t * pucPacket = (const uint8_t*)pxAudio->Packet;
+            uint32_t ulIndex = pxAudio->Head, ulCount;
+
+            for (ulCount = 0; ulCount < ulLength; ulCount++)
+            {
+                pxAudio->Buffer[ulIndex++] = pucPacket[ulCount];
+                if (ulIndex == pxAudio->Size)
+                {
+                    ulIndex = 0;
+                }
+            }
+        }
+
+        pxAudio->Head += ulLength;
+        if (pxAudio->Head >= pxAudio->Size)
+        {
+            pxAudio->Head -= pxAudio->Size;
+        }
+
+        /* Start the codec when the ring is half full */
+        if ((pxAudio->Running == AUDIO_RUNNING_PREFILL) && (pxAudio->Head >= (pxAudio->Size / 2)))
+        {
+            pxAudio->Running = AUDIO_RUNNING_ACTIVE;
+
+            (void) DMA_eStart(pxAudio->pDMA, pxAudio->PeriphAddress, pxAudio->Buffer,
+                    pxAudio->Size / pxAudio->DmaWidth);
+        }
+    }
+
+    if (pxAudio->Streaming != 0)
+    {
+        USB_prvAudioReceive(pxAudio);
+    }
+}
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
@@ -87,7 +87,12 @@ typedef struct {
          uint32_t __RESERVED2;
 } USB_OTG_GenEndpointType;
 
-#define USB_OTG_DMA_SUPPORT         (defined(USB_OTG_HS) && 1)
+/* Only the HS core has internal DMA */
+#ifdef USB_OTG_HS
+#define USB_OTG_DMA_SUPPORT         1
+#else
+#define USB_OTG_DMA_SUPPORT         0
+#endif
 
 #if (USB_OTG_DMA_SUPPORT != 0)
 #define USB_DMA_CONFIG(HANDLE)      USB_REG_BIT((HANDLE),GAHBCFG,DMAEN)
@@ -95,6 +100,10 @@ typedef struct {
 #define USB_DMA_CONFIG(HANDLE)      0
 #endif
 
+/* Transfer request limits of the DxEPTSIZ fields */
+#define USB_EP_MAX_XFRSIZ           0x7FFFF
+#define USB_EP_MAX_PKTCNT           0x3FF
+
 #define STS_GOUT_NAK                (1 << USB_OTG_GRXSTSP_PKTSTS_Pos)
 #define STS_DATA_UPDT               (2 << USB_OTG_GRXSTSP_PKTSTS_Pos)
 #define STS_XFER_COMP               (3 << USB_OTG_GRXSTSP_PKTSTS_Pos)
@@ -103,6 +112,41 @@ typedef struct {
 
 #define USB_ALL_TX_FIFOS            0x10
 
+/* Host mode Rx status of IN data packets */
+#define STS_IN_DATA                 (2 << USB_OTG_GRXSTSP_PKTSTS_Pos)
+
+/* Host channel data PIDs */
+#define USB_PID_DATA0               0
+#define USB_PID_DATA1               2
+#define USB_PID_SETUP               3
+
+/* Host control transfer stages */
+#define USB_STAGE_SETUP             0
+#define USB_STAGE_DATA              1
+#define USB_STAGE_STATUS            2
+
+/* Host channel halt reasons */
+#define USB_HALT_NONE               0
+#define USB_HALT_XFRC               1
+#define USB_HALT_NAK                2
+#define USB_HALT_STALL              3
+#define USB_HALT_XACTERR            4
+#define USB_HALT_FRMOR              5
+#define USB_HALT_FATAL              6
+
+#define USB_NO_CHANNEL              0xFF
+#define USB_HOST_MAX_ERRORS         3
+#define USB_FRNUM_MASK              0x3FFF
+
+#define USB_HCINT_ALL               0x7FF
+
+#define USB_HNPTXSTS(HANDLE)        (*(__IO uint32_t *)&(HANDLE)->Inst->HNPTXSTS)
+
+#define USB_PIPE_PERIODIC(PIPE)     (((PIPE)->Type == USB_EP_TYPE_INTERRUPT) || \
+                                     ((PIPE)->Type == USB_EP_TYPE_ISOCHRONOUS))
+
+#define USB_SETUP_LENGTH(SETUP)     ((uint16_t)(SETUP)[6] | ((uint16_t)(SETUP)[7] << 8))
+
 #define USB_GET_EP_AT(HANDLE, NUMBER)   (((NUMBER) > 0x7F) ?            \
         (&(HANDLE)->EP.IN[(NUMBER) & 0xF]) :                            \
         (&(HANDLE)->EP.OUT[NUMBER]))
@@ -125,11 +169,16 @@ typedef struct {
 
 #define USB_TOTAL_FIFO_SIZE(HANDLE) (IS_USB_OTG_HS((HANDLE)->Inst) ?        \
         USB_OTG_HS_TOTAL_FIFO_SIZE : USB_OTG_FS_TOTAL_FIFO_SIZE)
+
+#define USB_CHANNEL_COUNT(HANDLE)   (IS_USB_OTG_HS((HANDLE)->Inst) ?        \
+        USB_OTG_HS_HOST_MAX_CHANNEL_NBR : USB_OTG_FS_HOST_MAX_CHANNEL_NBR)
 #else
 #define IS_USB_OTG_HS(INST)     0
 #define USB_ENDPOINT_COUNT(HANDLE)  6
 
 #define USB_TOTAL_FIFO_SIZE(HANDLE) 1280
+
+#define USB_CHANNEL_COUNT(HANDLE)   USB_OTG_FS_HOST_MAX_CHANNEL_NBR
 #endif
 
 /* Set the status of the DP pull-up resistor */
@@ -139,16 +188,16 @@ __STATIC_INLINE void USB_prvConnectCtrl(USB_HandleType * pxUSB, FunctionalState
 }
 
 /* Flush an IN FIFO */
-__STATIC_INLINE void USB_prvFlushTxFifo(USB_HandleType * pxUSB, uint8_t FifoNumber)
+__STATIC_INLINE void USB_prvFlushTxFifo(USB_OTG_TypeDef * pxInst, uint8_t FifoNumber)
 {
-    pxUSB->Inst->GRSTCTL.w = USB_OTG_GRSTCTL_TXFFLSH |
+    pxInst->GRSTCTL.w = USB_OTG_GRSTCTL_TXFFLSH |
             ((uint32_t)FifoNumber << USB_OTG_GRSTCTL_TXFNUM_Pos);
 }
 
 /* Flush global OUT FIFO */
-__STATIC_INLINE void USB_prvFlushRxFifo(USB_HandleType * pxUSB)
+__STATIC_INLINE void USB_prvFlushRxFifo(USB_OTG_TypeDef * pxInst)
 {
-    pxUSB->Inst->GRSTCTL.w = USB_OTG_GRSTCTL_RXFFLSH;
+    pxInst->GRSTCTL.w = USB_OTG_GRSTCTL_RXFFLSH;
 }
 
 /* Clears all endpoint interrupt request flags */
@@ -164,38 +213,126 @@ static void USB_prvClearEpInts(USB_HandleType * pxUSB)
     }
 }
 
-/* Push packet data to IN FIFO */
-static void USB_prvWriteFifo(USB_HandleType * pxUSB,
+/* Push packet data to IN FIFO,
+ * only called from the interrupt handler, which is the sole owner of the FIFOs */
+static void USB_prvWriteFifo(USB_OTG_TypeDef * pxInst,
         uint8_t ucFIFOx, uint8_t * pucData, uint16_t usLength)
 {
     uint16_t usWordCount;
 
-    /* Disable interrupts while FIFO is being accessed */
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
-
     for (usWordCount = (usLength + 3) / 4; usWordCount > 0; usWordCount--, pucData += 4)
     {
-        pxUSB->Inst->DFIFO[ucFIFOx].DR = *((__packed uint32_t *) pucData);
+        pxInst->DFIFO[ucFIFOx].DR = *((__packed uint32_t *) pucData);
     }
-
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 1;
 }
 
-/* Pop packet data from OUT FIFO */
-static void USB_prvReadFifo(USB_HandleType * pxUSB,
+/* Pop packet data from OUT FIFO,
+ * only called from the interrupt handler, which is the sole owner of the FIFOs */
+static void USB_prvReadFifo(USB_OTG_TypeDef * pxInst,
         uint8_t * pucData, uint16_t usLength)
 {
     uint16_t usWordCount;
 
-    /* Disable interrupts while FIFO is being accessed */
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
+    for (usWordCount = usLength / 4; usWordCount > 0; usWordCount--, pucData += 4)
+    {
+        *(__packed uint32_t *) pucData = pxInst->DFIFO[0].DR;
+    }
 
-    for (usWordCount = (usLength + 3) / 4; usWordCount > 0; usWordCount--, pucData += 4)
+    /* The trailing bytes are copied from the last word, not to write past the data */
+    usLength &= 3;
+    if (usLength > 0)
     {
-        *(__packed uint32_t *) pucData = pxUSB->Inst->DFIFO[0].DR;
+        uint32_t ulData = pxInst->DFIFO[0].DR;
+
+        for (; usLength > 0; usLength--, ulData >>= 8)
+        {
+            *pucData++ = (uint8_t)ulData;
+        }
     }
+}
 
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 1;
+#if (USB_OTG_DMA_SUPPORT != 0)
+/* Determine if the DMA transfer has to go through the bounce buffer */
+static uint8_t USB_prvDmaBounce(USB_EndPointHandleType * pxEP,
+        uint32_t ulRemaining, uint8_t ucOut)
+{
+    uint8_t ucBounce = 0;
+
+    if (pxEP->BounceBuffer != NULL)
+    {
+        /* DMA accesses memory in words, and received packets
+         * mustn't overrun the end of the transfer buffer */
+        if ((((uint32_t)pxEP->Transfer.Data & 3) != 0) ||
+            ((ucOut != 0) && (ulRemaining < pxEP->MaxPacketSize)))
+        {
+            ucBounce = 1;
+        }
+    }
+    return ucBounce;
+}
+
+/* Copy packet data between the bounce and the transfer buffers */
+static void USB_prvDmaCopy(uint8_t * pucDest, const uint8_t * pucSource, uint16_t usLength)
+{
+    for (; usLength > 0; usLength--)
+    {
+        *pucDest++ = *pucSource++;
+    }
+}
+#endif
+
+/* Determine the maximal packet count of a single EP transfer request */
+static uint16_t USB_prvMaxPacketCount(USB_EndPointHandleType * pxEP)
+{
+    uint32_t ulPktCnt = USB_EP_MAX_XFRSIZ / pxEP->MaxPacketSize;
+
+    if (ulPktCnt > USB_EP_MAX_PKTCNT)
+    {
+        ulPktCnt = USB_EP_MAX_PKTCNT;
+    }
+    return ulPktCnt;
+}
+
+/* Determine the packet count of the next OUT EP transfer */
+static uint16_t USB_prvOutPacketCount(USB_HandleType * pxUSB, uint8_t ucEpNum)
+{
+    USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpNum];
+    uint32_t ulRemaining = pxEP->Transfer.Progress - pxEP->Transfer.Length;
+    uint32_t ulPktCnt = (ulRemaining + pxEP->MaxPacketSize - 1) / pxEP->MaxPacketSize;
+    uint16_t usPktCnt;
+
+    /* Large transfers are split to requests within the DxEPTSIZ limits */
+    if (ulPktCnt > USB_prvMaxPacketCount(pxEP))
+    {
+        ulPktCnt = USB_prvMaxPacketCount(pxEP);
+    }
+    usPktCnt = ulPktCnt;
+
+    /* Zero Length Packet or EP0 with limited transfer size */
+    if ((usPktCnt == 0) || (ucEpNum == 0))
+    {
+        usPktCnt = 1;
+    }
+#if (USB_OTG_DMA_SUPPORT != 0)
+    else if (USB_DMA_CONFIG(pxUSB) == 0)
+    {
+    }
+    else if (USB_prvDmaBounce(pxEP, ulRemaining, 1) != 0)
+    {
+        /* Single packet to the bounce buffer */
+        usPktCnt = 1;
+    }
+    else if ((pxEP->BounceBuffer != NULL) &&
+             (usPktCnt > (ulRemaining / pxEP->MaxPacketSize)))
+    {
+        /* Only complete packets go directly to the transfer buffer,
+         * the partial last packet is received through the bounce buffer */
+        usPktCnt = ulRemaining / pxEP->MaxPacketSize;
+    }
+#endif
+    else {}
+
+    return usPktCnt;
 }
 
 /* Handle IN EP transfer */
@@ -206,40 +343,32 @@ static void USB_prvTransmitPacket(USB_HandleType * pxUSB, uint8_t ucEpNum)
     uint32_t ulEpFlag = 1 << ucEpNum;
 
     /* If there is enough space in the FIFO for a packet, fill immediately */
-    if (ulFifoSpace >= (uint32_t)pxEP->MaxPacketSize)
+    if ((pxEP->Transfer.Request > 0) && (ulFifoSpace >= (uint32_t)pxEP->MaxPacketSize))
     {
         uint16_t usPacketLength;
 
         /* Multi packet transfer */
-        if (pxEP->Transfer.Progress > pxEP->MaxPacketSize)
+        if (pxEP->Transfer.Request > pxEP->MaxPacketSize)
         {
             usPacketLength = pxEP->MaxPacketSize;
         }
         else
         {
-            usPacketLength = pxEP->Transfer.Progress;
+            usPacketLength = pxEP->Transfer.Request;
         }
 
         /* Write a packet to the FIFO */
-        USB_prvWriteFifo(pxUSB, ucEpNum, pxEP->Transfer.Data, usPacketLength);
+        USB_prvWriteFifo(pxUSB->Inst, ucEpNum, pxEP->Transfer.Data, usPacketLength);
         pxEP->Transfer.Data += usPacketLength;
         pxEP->Transfer.Progress -= usPacketLength;
+        pxEP->Transfer.Request -= usPacketLength;
     }
 
-    if (ucEpNum == 0)
-    {
-        /* Interrupt isn't used */
-    }
-    else if (pxEP->Transfer.Progress == 0)
+    if (pxEP->Transfer.Request == 0)
     {
-        /* Disable Tx FIFO interrupts when all data is written */
+        /* Disable Tx FIFO interrupts when all data of the request is written */
         CLEAR_BIT(pxUSB->Inst->DIEPEMPMSK, ulEpFlag);
     }
-    else
-    {
-        /* Enable Tx FIFO interrupts when more data is available */
-        SET_BIT(pxUSB->Inst->DIEPEMPMSK, ulEpFlag);
-    }
 }
 
 /* Internal handling of EP transmission */
@@ -247,7 +376,16 @@ static void USB_prvEpSend(USB_HandleType * pxUSB, uint8_t ucEpNum)
 {
     USB_EndPointHandleType * pxEP = &pxUSB->EP.IN[ucEpNum];
     USB_OTG_GenEndpointType * pxDEP = USB_IEPR(pxUSB, ucEpNum);
-    uint16_t usTransferSize = pxEP->Transfer.Progress;
+    uint32_t ulTransferSize = pxEP->Transfer.Progress;
+    uint8_t ucBounce = 0;
+
+#if (USB_OTG_DMA_SUPPORT != 0)
+    if (USB_DMA_CONFIG(pxUSB) != 0)
+    {
+        /* Unaligned data is sent through the bounce buffer packet by packet */
+        ucBounce = USB_prvDmaBounce(pxEP, ulTransferSize, 0);
+    }
+#endif
 
     if (pxEP->Transfer.Progress == 0)
     {
@@ -255,17 +393,28 @@ static void USB_prvEpSend(USB_HandleType * pxUSB, uint8_t ucEpNum)
         pxDEP->DxEPTSIZ.w = 1 << USB_OTG_DIEPTSIZ_PKTCNT_Pos;
     }
     /* EP0 has limited transfer size */
-    else if ((ucEpNum == 0) && (pxEP->Transfer.Progress > pxEP->MaxPacketSize))
+    else if (((ucEpNum == 0) || (ucBounce != 0)) &&
+             (pxEP->Transfer.Progress > pxEP->MaxPacketSize))
     {
         pxDEP->DxEPTSIZ.b.PKTCNT = 1;
-        pxDEP->DxEPTSIZ.b.XFRSIZ = usTransferSize = pxEP->MaxPacketSize;
+        pxDEP->DxEPTSIZ.b.XFRSIZ = ulTransferSize = pxEP->MaxPacketSize;
     }
     else
     {
-        uint16_t usPktCnt = (pxEP->Transfer.Progress + pxEP->MaxPacketSize - 1)
-                / pxEP->MaxPacketSize;
+        uint16_t usPktCnt = USB_prvMaxPacketCount(pxEP);
+
+        /* Large transfers are split to requests within the DxEPTSIZ limits,
+         * the requests are complete packets so no short packet ends the transfer early */
+        if (ulTransferSize > ((uint32_t)usPktCnt * pxEP->MaxPacketSize))
+        {
+            ulTransferSize = (uint32_t)usPktCnt * pxEP->MaxPacketSize;
+        }
+        else
+        {
+            usPktCnt = (ulTransferSize + pxEP->MaxPacketSize - 1) / pxEP->MaxPacketSize;
+        }
         pxDEP->DxEPTSIZ.b.PKTCNT = usPktCnt;
-        pxDEP->DxEPTSIZ.b.XFRSIZ = pxEP->Transfer.Progress;
+        pxDEP->DxEPTSIZ.b.XFRSIZ = ulTransferSize;
 
         if (pxEP->Type == USB_EP_TYPE_ISOCHRONOUS)
         {
@@ -289,19 +438,36 @@ static void USB_prvEpSend(USB_HandleType * pxUSB, uint8_t ucEpNum)
     if (USB_DMA_CONFIG(pxUSB) != 0)
     {
         /* Set DMA start address */
-        pxDEP->DxEPDMA = (uint32_t)pxEP->Transfer.Data;
-        pxEP->Transfer.Data += usTransferSize;
-        pxEP->Transfer.Progress -= usTransferSize;
+        if (ucBounce != 0)
+        {
+            USB_prvDmaCopy((uint8_t*)pxEP->BounceBuffer, pxEP->Transfer.Data, ulTransferSize);
+            pxDEP->DxEPDMA = (uint32_t)pxEP->BounceBuffer;
+        }
+        else
+        {
+            pxDEP->DxEPDMA = (uint32_t)pxEP->Transfer.Data;
+        }
+        pxEP->Transfer.Data += ulTransferSize;
+        pxEP->Transfer.Progress -= ulTransferSize;
+        ulTransferSize = 0;
     }
 #endif
+    /* Data to be written to the FIFO for this request */
+    pxEP->Transfer.Request = ulTransferSize;
+
     /* EP enable */
     SET_BIT(pxDEP->DxEPCTL.w, USB_OTG_DIEPCTL_CNAK | USB_OTG_DIEPCTL_EPENA);
 
-    if ((pxEP->Transfer.Progress > 0) &&
-        (USB_DMA_CONFIG(pxUSB) == 0))
+    if (pxEP->Transfer.Request > 0)
     {
-        /* Push the nonzero packet to FIFO */
-        USB_prvTransmitPacket(pxUSB, ucEpNum);
+        /* The nonzero packets are pushed to the FIFO by the Tx FIFO empty interrupt.
+         * The interrupt handler also modifies the shared mask register,
+         * so the read-modify-write is protected when called from thread context */
+        XPD_ENTER_CRITICAL(pxUSB);
+
+        SET_BIT(pxUSB->Inst->DIEPEMPMSK, 1 << ucEpNum);
+
+        XPD_EXIT_CRITICAL(pxUSB);
     }
 }
 
@@ -310,26 +476,24 @@ static void USB_prvEpReceive(USB_HandleType * pxUSB, uint8_t ucEpNum)
 {
     USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpNum];
     USB_OTG_GenEndpointType * pxDEP = USB_OEPR(pxUSB, ucEpNum);
+    uint16_t usPktCnt = USB_prvOutPacketCount(pxUSB, ucEpNum);
 
-    /* Zero Length Packet or EP0 with limited transfer size */
-    if ((pxEP->Transfer.Progress == 0) || (ucEpNum == 0))
-    {
-        pxDEP->DxEPTSIZ.b.PKTCNT = 1;
-        pxDEP->DxEPTSIZ.b.XFRSIZ = pxEP->MaxPacketSize;
-    }
-    else
-    {
-        uint16_t usPktCnt = (pxEP->Transfer.Progress + pxEP->MaxPacketSize - 1)
-                / pxEP->MaxPacketSize;
-        pxDEP->DxEPTSIZ.b.PKTCNT = usPktCnt;
-        pxDEP->DxEPTSIZ.b.XFRSIZ = pxEP->Transfer.Progress;
-    }
+    /* OUT transfer size is a multiple of the packet size */
+    pxDEP->DxEPTSIZ.b.PKTCNT = usPktCnt;
+    pxDEP->DxEPTSIZ.b.XFRSIZ = usPktCnt * pxEP->MaxPacketSize;
 
 #if (USB_OTG_DMA_SUPPORT != 0)
     if (USB_DMA_CONFIG(pxUSB) != 0)
     {
         /* Set DMA start address */
-        pxDEP->DxEPDMA = (uint32_t)pxEP->Transfer.Data;
+        if (USB_prvDmaBounce(pxEP, pxEP->Transfer.Progress - pxEP->Transfer.Length, 1) != 0)
+        {
+            pxDEP->DxEPDMA = (uint32_t)pxEP->BounceBuffer;
+        }
+        else
+        {
+            pxDEP->DxEPDMA = (uint32_t)pxEP->Transfer.Data;
+        }
     }
 #endif
 
@@ -400,31 +564,24 @@ static void USB_prvInEpEventHandler(USB_HandleType * pxUSB, uint8_t ucEpNum)
         /* Clear IT flag */
         pxDEP->DxEPINT.w = USB_OTG_DIEPINT_XFRC;
 
-        if (ucEpNum > 0)
+        if (pxEP->Transfer.Progress == 0)
         {
             /* Transmission complete */
             USB_vDataInCallback(pxUSB, pxEP);
-        }
-        else /* EP0 packetization requires software handling */
-        {
-            if (pxEP->Transfer.Progress == 0)
-            {
-                /* Transmission complete */
-                USB_vDataInCallback(pxUSB, pxEP);
 
-                if ((USB_DMA_CONFIG(pxUSB) != 0) &&
-                    (pxEP->Transfer.Length == 0))
-                {
-                    /* this is ZLP, so prepare EP0 for next setup */
-                    USB_prvPrepareSetup(pxUSB);
-                }
-            }
-            else
+            if ((ucEpNum == 0) && (USB_DMA_CONFIG(pxUSB) != 0) &&
+                (pxEP->Transfer.Length == 0))
             {
-                /* Transfer next packet */
-                USB_prvEpSend(pxUSB, 0);
+                /* this is ZLP, so prepare EP0 for next setup */
+                USB_prvPrepareSetup(pxUSB);
             }
         }
+        else
+        {
+            /* EP0 and bounce buffered DMA packetization
+             * requires software handling */
+            USB_prvEpSend(pxUSB, ucEpNum);
+        }
     }
 }
 
@@ -454,36 +611,60 @@ static void USB_prvOutEpEventHandler(USB_HandleType * pxUSB, uint8_t ucEpNum)
     else if ((ulEpFlags & USB_OTG_DOEPINT_XFRC) != 0)
     {
         USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpNum];
+        /* EP0 is served packet by packet, other endpoints continue
+         * after a large transfer's request is completely received */
+        uint8_t ucContinue = (ucEpNum == 0) ?
+                (pxEP->Transfer.Progress != pxEP->Transfer.Length) :
+                ((pxEP->Transfer.Length < pxEP->Transfer.Progress) &&
+                 (pxDEP->DxEPTSIZ.b.XFRSIZ == 0));
 
         /* Clear IT flag */
         pxDEP->DxEPINT.w = USB_OTG_DOEPINT_XFRC;
 
+#if (USB_OTG_DMA_SUPPORT != 0)
         if (USB_DMA_CONFIG(pxUSB) != 0)
         {
             /* XFRSIZ holds the unfilled byte count
-             * after the transfer is complete;
-             * EP0 transfers are limited to MPS */
-            uint16_t usTransferSize =
-                    pxEP->MaxPacketSize - pxDEP->DxEPTSIZ.b.XFRSIZ;
-            pxEP->Transfer.Length += usTransferSize;
-            pxEP->Transfer.Data += usTransferSize;
+             * after the transfer is complete */
+            uint32_t ulRemaining = pxEP->Transfer.Progress - pxEP->Transfer.Length;
+            uint32_t ulRequested = (uint32_t)USB_prvOutPacketCount(pxUSB, ucEpNum) * pxEP->MaxPacketSize;
+            uint32_t ulTransferSize = ulRequested - pxDEP->DxEPTSIZ.b.XFRSIZ;
+
+            if (USB_prvDmaBounce(pxEP, ulRemaining, 1) != 0)
+            {
+                /* Data exceeding the transfer buffer is dropped */
+                if (ulTransferSize > ulRemaining)
+                {
+                    ulTransferSize = ulRemaining;
+                }
+                USB_prvDmaCopy(pxEP->Transfer.Data, (const uint8_t*)pxEP->BounceBuffer,
+                        ulTransferSize);
+            }
+            pxEP->Transfer.Length += ulTransferSize;
+            pxEP->Transfer.Data += ulTransferSize;
 
             if ((ucEpNum + pxEP->Transfer.Length) == 0)
             {
                 /* this is ZLP, so prepare EP0 for next setup */
                 USB_prvPrepareSetup(pxUSB);
             }
+
+            /* Without a short packet the rest of the transfer is received
+             * in a new request (EP0 is re-evaluated after the update) */
+            ucContinue = (pxEP->Transfer.Length < pxEP->Transfer.Progress) &&
+                    ((ucEpNum == 0) || (ulTransferSize == ulRequested));
         }
+#endif
 
-        if ((ucEpNum > 0) || (pxEP->Transfer.Progress == pxEP->Transfer.Length))
+        if (ucContinue == 0)
         {
             /* Reception finished */
             USB_vDataOutCallback(pxUSB, pxEP);
         }
         else
         {
-            /* EP0 packetization requires software handling */
-            USB_prvEpReceive(pxUSB, 0);
+            /* EP0 and partial DMA transfers require software handling */
+            USB_prvEpReceive(pxUSB, ucEpNum);
         }
     }
 }
@@ -571,33 +752,33 @@ static void USB_prvPhycInit(void)
 #endif
 
 /* Resets the USB OTG core */
-static void USB_prvReset(USB_HandleType * pxUSB)
+static void USB_prvReset(USB_OTG_TypeDef * pxInst)
 {
-    if (USB_REG_BIT(pxUSB,GRSTCTL,AHBIDL) != 0)
+    if (pxInst->GRSTCTL.b.AHBIDL != 0)
     {
-        USB_REG_BIT(pxUSB,GRSTCTL,CSRST) = 1;
+        pxInst->GRSTCTL.b.CSRST = 1;
     }
 }
 
 /* Initializes the selected PHY for the USB */
-static void USB_prvPhyInit(USB_HandleType * pxUSB, USB_PHYType ePHY)
+static void USB_prvPhyInit(USB_OTG_TypeDef * pxInst, USB_PHYType ePHY)
 {
 #ifdef USB_OTG_HS
-    if (IS_USB_OTG_HS(pxUSB->Inst) && (ePHY != USB_PHY_EMBEDDED_FS))
+    if (IS_USB_OTG_HS(pxInst) && (ePHY != USB_PHY_EMBEDDED_FS))
     {
 #if defined(USB_HS_PHYC) && defined(HSE_VALUE_Hz)
         if (ePHY == USB_PHY_EMBEDDED_HS)
         {
             /* Embedded UTMI HS PHY */
-            USB_REG_BIT(pxUSB, GCCFG, PWRDWN) = 0;
+            pxInst->GCCFG.b.PWRDWN = 0;
 
-            CLEAR_BIT(pxUSB->Inst->GUSBCFG.w,
+            CLEAR_BIT(pxInst->GUSBCFG.w,
                 USB_OTG_GUSBCFG_TSDPS  | USB_OTG_GUSBCFG_ULPIFSLS |
                 USB_OTG_GUSBCFG_PHYSEL | USB_OTG_GUSBCFG_ULPI_UTMI_SEL |
                 USB_OTG_GUSBCFG_ULPIEVBUSD | USB_OTG_GUSBCFG_ULPIEVBUSI);
 
             /* Select UTMI Interface */
-            USB_REG_BIT(pxUSB, GCCFG, PHYHSEN) = 1;
+            pxInst->GCCFG.b.PHYHSEN = 1;
 
             USB_prvPhycInit();
         }
@@ -607,34 +788,34 @@ static void USB_prvPhyInit(USB_HandleType * pxUSB, USB_PHYType ePHY)
             /* ULPI HS PHY */
             RCC_vClockEnable(RCC_POS_OTG_HS_ULPI);
 
-            USB_REG_BIT(pxUSB, GCCFG, PWRDWN) = 0;
+            pxInst->GCCFG.b.PWRDWN = 0;
 
-            CLEAR_BIT(pxUSB->Inst->GUSBCFG.w,
+            CLEAR_BIT(pxInst->GUSBCFG.w,
                 USB_OTG_GUSBCFG_TSDPS  | USB_OTG_GUSBCFG_ULPIFSLS |
                 USB_OTG_GUSBCFG_PHYSEL |
                 USB_OTG_GUSBCFG_ULPIEVBUSD | USB_OTG_GUSBCFG_ULPIEVBUSI);
         }
 
-        USB_prvReset(pxUSB);
+        USB_prvReset(pxInst);
     }
     else
 #endif /* USB_OTG_HS */
     {
         /* Select FS Embedded PHY */
-        USB_REG_BIT(pxUSB, GUSBCFG, PHYSEL) = 1;
+        pxInst->GUSBCFG.b.PHYSEL = 1;
 
-        USB_prvReset(pxUSB);
+        USB_prvReset(pxInst);
 
-        pxUSB->Inst->GCCFG.w = USB_OTG_GCCFG_PWRDWN;
+        pxInst->GCCFG.w = USB_OTG_GCCFG_PWRDWN;
     }
 }
 
 #ifdef USB_OTG_HS
 /* Shuts down the HS PHY */
-static void USB_prvHsPhyDeinit(USB_HandleType * pxUSB)
+static void USB_prvHsPhyDeinit(USB_OTG_TypeDef * pxInst)
 {
 #if defined(USB_HS_PHYC) && defined(HSE_VALUE_Hz)
-    if (USB_REG_BIT(pxUSB, GCCFG, PHYHSEN) != 0)
+    if (pxInst->GCCFG.b.PHYHSEN != 0)
     {
         RCC_vClockDisable(RCC_POS_USBPHYC);
     }
@@ -646,852 +827,2225 @@ static void USB_prvHsPhyDeinit(USB_HandleType * pxUSB)
 }
 #endif /* USB_OTG_HS */
 
-/** @defgroup USB_Exported_Functions USB Exported Functions
- * @{ */
+/* Modifies the root port control bits without acknowledging its status changes */
+__STATIC_INLINE void USB_prvPortModify(USB_OTG_TypeDef * pxInst, uint32_t ulClear, uint32_t ulSet)
+{
+    uint32_t ulHPRT = pxInst->HPRT.w & ~(USB_OTG_HPRT_PENA | USB_OTG_HPRT_PCDET |
+            USB_OTG_HPRT_PENCHNG | USB_OTG_HPRT_POCCHNG);
 
-/**
- * @brief Initializes the USB OTG peripheral using the setup configuration
- * @param pxUSB: pointer to the USB handle structure
- * @param pxConfig: USB setup configuration
- */
-void USB_vDevInit(USB_HandleType * pxUSB, const USB_InitType * pxConfig)
+    pxInst->HPRT.w = (ulHPRT & ~ulClear) | ulSet;
+}
+
+/* Determine the direction of the pipe's current transaction */
+static uint8_t USB_prvPipeIsIn(USB_PipeType * pxPipe)
 {
-    /* Enable peripheral clock */
-#ifdef USB_OTG_HS
-    if (IS_USB_OTG_HS(pxUSB->Inst))
+    uint8_t ucIn;
+
+    if (pxPipe->Type != USB_EP_TYPE_CONTROL)
     {
-        RCC_vClockEnable(RCC_POS_OTG_HS);
+        ucIn = pxPipe->EpAddress >> 7;
+    }
+    else if (pxPipe->Stage == USB_STAGE_SETUP)
+    {
+        ucIn = 0;
+    }
+    else if (pxPipe->Stage == USB_STAGE_DATA)
+    {
+        ucIn = pxPipe->Setup[0] >> 7;
+    }
+    else if (USB_SETUP_LENGTH(pxPipe->Setup) == 0)
+    {
+        /* Status stage without data stage is IN */
+        ucIn = 1;
     }
     else
-#endif
     {
-        RCC_vClockEnable(RCC_POS_OTG_FS);
+        /* Status stage is opposite to the data stage */
+        ucIn = (pxPipe->Setup[0] >> 7) ^ 1;
     }
+    return ucIn;
+}
 
-    /* Initialize handle variables */
-    pxUSB->EP.OUT[0].MaxPacketSize =
-    pxUSB->EP.IN [0].MaxPacketSize = USBD_EP0_MAX_PACKET_SIZE;
-    pxUSB->EP.OUT[0].Type =
-    pxUSB->EP.IN [0].Type = USB_EP_TYPE_CONTROL;
-    pxUSB->LinkState = USB_LINK_STATE_OFF;
-
-    /* Disable interrupts */
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
-
-    /* Initialize dependencies (pins, IRQ lines) */
-    XPD_SAFE_CALLBACK(pxUSB->Callbacks.DepInit, pxUSB);
-
-    /* Initialize selected PHY */
-    USB_prvPhyInit(pxUSB, pxConfig->PHY);
+/* Get the data buffer position of the pipe's current transaction */
+static uint8_t * USB_prvPipeData(USB_PipeType * pxPipe)
+{
+    uint8_t * pucData;
 
-#if (USB_OTG_DMA_SUPPORT != 0)
-    /* Set dedicated DMA */
-    if (pxConfig->DMA != DISABLE)
+    if (pxPipe->Stage == USB_STAGE_SETUP)
     {
-        SET_BIT(pxUSB->Inst->GAHBCFG.w,
-                USB_OTG_GAHBCFG_HBSTLEN_2 | USB_OTG_GAHBCFG_DMAEN);
+        pucData = (uint8_t *)pxPipe->Setup;
     }
-#endif
-
+    else
     {
-        uint8_t ucEpNum;
-        uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
+        pucData = pxPipe->Transfer.Data + pxPipe->Transfer.Progress;
+    }
+    return pucData;
+}
 
-        /* Set Device Mode */
-        MODIFY_REG(pxUSB->Inst->GUSBCFG.w,
-                USB_OTG_GUSBCFG_FHMOD | USB_OTG_GUSBCFG_FDMOD,
-                USB_OTG_GUSBCFG_FDMOD);
+/* Determine the packet count of a channel request */
+static uint32_t USB_prvPacketCount(USB_PipeType * pxPipe, uint32_t ulLength)
+{
+    uint32_t ulPktCnt = (ulLength + pxPipe->MaxPacketSize - 1) / pxPipe->MaxPacketSize;
 
-        /* Immediate soft disconnect */
-        USB_REG_BIT(pxUSB,DCTL,SDIS) = 1;
+    /* Zero length packet */
+    if (ulPktCnt == 0)
+    {
+        ulPktCnt = 1;
+    }
+    return ulPktCnt;
+}
 
-        /* VBUS sensing unused */
-#ifdef USB_OTG_GCCFG_VBDEN
-        {
-            USB_REG_BIT(pxUSB,GCCFG,VBDEN) = 0;
+/* Pushes the OUT packets of the channel request to the Tx FIFO while there is space,
+ * returns the amount of data left to push */
+static uint32_t USB_prvChannelWrite(USB_HostHandleType * pxHost, uint8_t ucCh)
+{
+    USB_PipeType * pxPipe = pxHost->Channels[ucCh];
+    uint8_t * pucData = USB_prvPipeData(pxPipe);
+    uint32_t ulLeft = pxPipe->Transfer.Request - pxPipe->Transfer.Written;
+    bool bSpace = true;
 
-            SET_BIT(pxUSB->Inst->GOTGCTL.w,
-                    USB_OTG_GOTGCTL_BVALOEN | USB_OTG_GOTGCTL_BVALOVAL);
-        }
-#else
+    while ((ulLeft > 0) && bSpace)
+    {
+        /* Both status registers have the same layout */
+        uint32_t ulTxStatus = USB_PIPE_PERIODIC(pxPipe) ?
+                pxHost->Inst->HPTXSTS.w : USB_HNPTXSTS(pxHost);
+        uint32_t ulSpace = (ulTxStatus & USB_OTG_GNPTXSTS_NPTXFSAV) * sizeof(uint32_t);
+        uint16_t usPacketLength = pxPipe->MaxPacketSize;
+
+        if (ulLeft < usPacketLength)
         {
-            USB_REG_BIT(pxUSB,GCCFG,NOVBUSSENS) = 1;
+            usPacketLength = ulLeft;
         }
-#endif
-
-        /* Restart the Phy Clock */
-        pxUSB->Inst->PCGCCTL.w = 0;
 
-#ifdef USB_OTG_HS
-        /* HS PHY interfaces */
-        if (pxConfig->PHY != USB_PHY_EMBEDDED_FS)
+        if ((ulSpace < usPacketLength) || ((ulTxStatus & USB_OTG_GNPTXSTS_NPTQXSAV) == 0))
         {
-            pxUSB->Inst->DCFG.b.DSPD = 0;
+            bSpace = false;
         }
         else
-#endif
         {
-            /* Internal FS Phy */
-            pxUSB->Inst->DCFG.b.DSPD = 3;
+            USB_prvWriteFifo(pxHost->Inst, ucCh,
+                    pucData + pxPipe->Transfer.Written, usPacketLength);
+            pxPipe->Transfer.Written += usPacketLength;
+            ulLeft -= usPacketLength;
         }
+    }
+    return ulLeft;
+}
 
-        /* Init endpoints */
-        for (ucEpNum = 0; ucEpNum < ucEpCount; ucEpNum++)
-        {
-            USB_vEpClose(pxUSB, ucEpNum);
-            USB_vEpClose(pxUSB, 0x80 | ucEpNum);
-        }
-        USB_REG_BIT(pxUSB,DIEPMSK,TXFURM) = 0;
+/* Programs and enables the channel with the next request of its pipe */
+static void USB_prvChannelStart(USB_HostHandleType * pxHost, uint8_t ucCh)
+{
+    USB_PipeType * pxPipe = pxHost->Channels[ucCh];
+    USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+    uint8_t  ucIn     = USB_prvPipeIsIn(pxPipe);
+    uint32_t ulLength = pxPipe->Transfer.Length - pxPipe->Transfer.Progress;
+    uint32_t ulPid    = pxPipe->Toggle;
+    uint32_t ulMaxLength, ulPktCnt, ulHCCHAR;
+
+    if (pxPipe->Stage == USB_STAGE_SETUP)
+    {
+        ulLength = 8;
+        ulPid    = USB_PID_SETUP;
+    }
+    else if (pxPipe->Stage == USB_STAGE_STATUS)
+    {
+        ulLength = 0;
+        ulPid    = USB_PID_DATA1;
+    }
+    else if (pxPipe->Type == USB_EP_TYPE_ISOCHRONOUS)
+    {
+        ulPid    = USB_PID_DATA0;
+    }
 
-#if (USB_OTG_DMA_SUPPORT != 0)
-        if (USB_DMA_CONFIG(pxUSB) != 0)
+    /* Periodic pipes get a single packet per interval,
+     * the others as many as the transfer size register fits */
+    if (USB_PIPE_PERIODIC(pxPipe))
+    {
+        ulMaxLength = pxPipe->MaxPacketSize;
+    }
+    else
+    {
+        ulPktCnt = USB_EP_MAX_XFRSIZ / pxPipe->MaxPacketSize;
+        if (ulPktCnt > USB_EP_MAX_PKTCNT)
         {
-            /*Set threshold parameters */
-            pxUSB->Inst->DTHRCTL.w = (
-                    USB_OTG_DTHRCTL_TXTHRLEN_6  |
-                    USB_OTG_DTHRCTL_RXTHRLEN_6  |
-                    USB_OTG_DTHRCTL_RXTHREN     |
-                    USB_OTG_DTHRCTL_ISOTHREN    |
-                    USB_OTG_DTHRCTL_NONISOTHREN  );
+            ulPktCnt = USB_EP_MAX_PKTCNT;
         }
-#endif
+        ulMaxLength = ulPktCnt * pxPipe->MaxPacketSize;
+    }
+    if (ulLength > ulMaxLength)
+    {
+        ulLength = ulMaxLength;
+    }
 
-#ifdef USB_OTG_GLPMCFG_LPMEN
-        /* Set Link Power Management feature (L1 sleep mode support) */
-        if (pxConfig->LPM != DISABLE)
-        {
-            SET_BIT(pxUSB->Inst->GLPMCFG.w,
-                USB_OTG_GLPMCFG_LPMEN | USB_OTG_GLPMCFG_LPMACK | USB_OTG_GLPMCFG_ENBESL);
-        }
-#endif
+    ulPktCnt = USB_prvPacketCount(pxPipe, ulLength);
+    pxPipe->Transfer.Request = ulLength;
+    pxPipe->Transfer.Written = 0;
+    pxPipe->Halt = USB_HALT_NONE;
+
+    /* IN requests are made of complete packets */
+    if (ucIn != 0)
+    {
+        ulLength = ulPktCnt * pxPipe->MaxPacketSize;
     }
-}
 
-/**
+    pxHC->HCINT.w  = USB_HCINT_ALL;
+    pxHC->HCTSIZ.w = (ulLength << USB_OTG_HCTSIZ_XFRSIZ_Pos)
+                   | (ulPktCnt << USB_OTG_HCTSIZ_PKTCNT_Pos)
+                   | (ulPid    << USB_OTG_HCTSIZ_DPID_Pos);
+
+#if (USB_OTG_DMA_SUPPORT != 0)
+    if (USB_DMA_CONFIG(pxHost) != 0)
+    {
+        /* The core transfers all packets of the request and retries NAKed
+         * non-periodic transactions, the outcome is reported with the halt */
+        pxHC->HCDMA    = (uint32_t)USB_prvPipeData(pxPipe);
+        pxHC->HCINTMSK.w = USB_OTG_HCINTMSK_CHHM | USB_OTG_HCINTMSK_AHBERR;
+    }
+    else
+#endif
+    {
+        pxHC->HCINTMSK.w = USB_OTG_HCINTMSK_XFRCM  | USB_OTG_HCINTMSK_CHHM   |
+                           USB_OTG_HCINTMSK_STALLM | USB_OTG_HCINTMSK_NAKM   |
+                           USB_OTG_HCINTMSK_TXERRM | USB_OTG_HCINTMSK_BBERRM |
+                           USB_OTG_HCINTMSK_FRMORM | USB_OTG_HCINTMSK_DTERRM;
+    }
+    SET_BIT(pxHost->Inst->HAINTMSK, 1 << ucCh);
+
+    ulHCCHAR = ((uint32_t)pxPipe->MaxPacketSize     << USB_OTG_HCCHAR_MPSIZ_Pos)
+             | ((uint32_t)(pxPipe->EpAddress & 0xF) << USB_OTG_HCCHAR_EPNUM_Pos)
+             | ((uint32_t)ucIn                      << USB_OTG_HCCHAR_EPDIR_Pos)
+             | ((uint32_t)pxPipe->Type              << USB_OTG_HCCHAR_EPTYP_Pos)
+             | ((uint32_t)1                         << USB_OTG_HCCHAR_MC_Pos)
+             | ((uint32_t)pxPipe->DevAddress        << USB_OTG_HCCHAR_DAD_Pos)
+             | USB_OTG_HCCHAR_CHENA;
+
+    if (pxHost->Speed == USB_HOST_SPEED_LOW)
+    {
+        ulHCCHAR |= USB_OTG_HCCHAR_LSDEV;
+    }
+
+    /* Periodic transactions are scheduled to the next (micro)frame */
+    if (USB_PIPE_PERIODIC(pxPipe) && ((pxHost->Inst->HFNUM.b.FRNUM & 1) == 0))
+    {
+        ulHCCHAR |= USB_OTG_HCCHAR_ODDFRM;
+    }
+
+    pxHC->HCCHAR.w = ulHCCHAR;
+
+    /* Without DMA the OUT data is pushed through the Tx FIFOs
+     * by the Tx FIFO empty interrupt. The scheduler runs either in the interrupt handler
+     * or in the critical section of the pipe APIs, so GINTMSK is modified atomically */
+    if ((USB_DMA_CONFIG(pxHost) == 0) && (ucIn == 0) &&
+        (pxPipe->Transfer.Request > 0))
+    {
+        if (USB_PIPE_PERIODIC(pxPipe))
+        {
+            USB_IT_ENABLE(pxHost, PTXFE);
+        }
+        else
+        {
+            USB_IT_ENABLE(pxHost, NPTXFE);
+        }
+    }
+}
+
+/* Assigns the free channels to the pipes waiting for service */
+static void USB_prvHostSchedule(USB_HostHandleType * pxHost, uint8_t ucFrameStart)
+{
+    uint8_t ucCh, ucChCount = USB_CHANNEL_COUNT(pxHost);
+    uint8_t ucSlot = 0, ucScanned = 0;
+    uint16_t usFrame = (pxHost->Inst->HFNUM.b.FRNUM + 1) & USB_FRNUM_MASK;
+    bool bWaiting = true;
+
+    for (ucCh = 0; (ucCh < ucChCount) && bWaiting; ucCh++)
+    {
+        USB_PipeType * pxPipe = NULL;
+
+        if ((pxHost->Channels[ucCh] != NULL) || ((pxHost->Halting & (1 << ucCh)) != 0))
+        {
+            /* Channel is busy */
+        }
+        else
+        {
+            /* Periodic pipes are served at the frame start when their interval elapsed */
+            for (; (ucFrameStart != 0) && (pxPipe == NULL) && (ucSlot < USBH_MAX_PIPE_COUNT); ucSlot++)
+            {
+                USB_PipeType * pxCand = pxHost->Pipes[ucSlot];
+
+                if ((pxCand != NULL) && USB_PIPE_PERIODIC(pxCand) &&
+                    (pxCand->Status == USB_PIPE_BUSY) && (pxCand->Channel == USB_NO_CHANNEL) &&
+                    (((usFrame - pxCand->NextFrame) & USB_FRNUM_MASK) < ((USB_FRNUM_MASK + 1) / 2)))
+                {
+                    pxPipe = pxCand;
+                    pxPipe->NextFrame = (usFrame + pxPipe->Interval) & USB_FRNUM_MASK;
+                }
+            }
+
+            /* Non-periodic pipes share the remaining channels in round-robin order */
+            for (; (pxPipe == NULL) && (ucScanned < USBH_MAX_PIPE_COUNT); ucScanned++)
+            {
+                USB_PipeType * pxCand = pxHost->Pipes[pxHost->NextPipe];
+
+                pxHost->NextPipe = (pxHost->NextPipe + 1) % USBH_MAX_PIPE_COUNT;
+
+                if ((pxCand != NULL) && !USB_PIPE_PERIODIC(pxCand) &&
+                    (pxCand->Status == USB_PIPE_BUSY) && (pxCand->Channel == USB_NO_CHANNEL) &&
+                    (pxCand->Deferred == 0))
+                {
+                    pxPipe = pxCand;
+                }
+            }
+
+            if (pxPipe == NULL)
+            {
+                bWaiting = false;
+            }
+            else
+            {
+                pxHost->Channels[ucCh] = pxPipe;
+                pxPipe->Channel = ucCh;
+                USB_prvChannelStart(pxHost, ucCh);
+            }
+        }
+    }
+}
+
+/* Evaluates the request of the halted channel, then releases it,
+ * and completes the pipe transfer or leaves it for rescheduling */
+static void USB_prvChannelHalted(USB_HostHandleType * pxHost, uint8_t ucCh)
+{
+    USB_PipeType * pxPipe = pxHost->Channels[ucCh];
+    USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+    USB_PipeStatusType eStatus = USB_PIPE_BUSY;
+    uint32_t ulPktCnt = USB_prvPacketCount(pxPipe, pxPipe->Transfer.Request);
+    uint32_t ulDone;
+
+    /* Release the channel */
+    pxHost->Channels[ucCh] = NULL;
+    pxPipe->Channel = USB_NO_CHANNEL;
+    CLEAR_BIT(pxHost->Inst->HAINTMSK, 1 << ucCh);
+    pxHC->HCINTMSK.w = 0;
+    pxHC->HCINT.w = USB_HCINT_ALL;
+
+    /* Determine the transferred data amount */
+    if (USB_prvPipeIsIn(pxPipe) != 0)
+    {
+#if (USB_OTG_DMA_SUPPORT != 0)
+        if (USB_DMA_CONFIG(pxHost) != 0)
+        {
+            pxPipe->Transfer.Written = ulPktCnt * pxPipe->MaxPacketSize
+                    - pxHC->HCTSIZ.b.XFRSIZ;
+        }
+#endif
+        ulDone = pxPipe->Transfer.Written;
+    }
+    else if (pxPipe->Halt == USB_HALT_XFRC)
+    {
+        ulDone = pxPipe->Transfer.Request;
+    }
+    else
+    {
+        /* Only the acknowledged packets are complete */
+        ulDone = (ulPktCnt - pxHC->HCTSIZ.b.PKTCNT) * pxPipe->MaxPacketSize;
+        if (ulDone > pxPipe->Transfer.Request)
+        {
+            ulDone = pxPipe->Transfer.Request;
+        }
+    }
+
+    if (pxPipe->Status != USB_PIPE_BUSY)
+    {
+        /* Cancelled transfer */
+    }
+    else
+    {
+        /* The core maintains the data toggling within the request */
+        pxPipe->Toggle = pxHC->HCTSIZ.b.DPID;
+
+        if (pxPipe->Stage != USB_STAGE_SETUP)
+        {
+            pxPipe->Transfer.Progress += ulDone;
+        }
+
+        switch (pxPipe->Halt)
+        {
+            case USB_HALT_XFRC:
+                pxPipe->Errors = 0;
+
+                if (pxPipe->Stage == USB_STAGE_SETUP)
+                {
+                    pxPipe->Stage = (pxPipe->Transfer.Length > 0) ?
+                            USB_STAGE_DATA : USB_STAGE_STATUS;
+                    pxPipe->Toggle = USB_PID_DATA1;
+                }
+                else if (pxPipe->Stage == USB_STAGE_STATUS)
+                {
+                    eStatus = USB_PIPE_DONE;
+                }
+                /* Short packet or all data transferred */
+                else if ((pxPipe->Transfer.Progress >= pxPipe->Transfer.Length) ||
+                         (ulDone < pxPipe->Transfer.Request) ||
+                         (pxPipe->Type == USB_EP_TYPE_ISOCHRONOUS))
+                {
+                    if (pxPipe->Type == USB_EP_TYPE_CONTROL)
+                    {
+                        pxPipe->Stage = USB_STAGE_STATUS;
+                    }
+                    else
+                    {
+                        eStatus = USB_PIPE_DONE;
+                    }
+                }
+                break;
+
+            case USB_HALT_NAK:
+                /* Retried when the pipe is scheduled again. A non-periodic pipe
+                 * waits for the next frame, otherwise a NAKing device would keep
+                 * the handler busy with back to back NAK and halt interrupts */
+                pxPipe->Errors = 0;
+
+                if (!USB_PIPE_PERIODIC(pxPipe))
+                {
+                    pxPipe->Deferred = 1;
+                    USB_IT_ENABLE(pxHost, SOF);
+                }
+                break;
+
+            case USB_HALT_STALL:
+                eStatus = USB_PIPE_STALL;
+                break;
+
+            case USB_HALT_FRMOR:
+                /* Periodic transaction missed its frame, retry in the next one */
+                if (pxPipe->Type == USB_EP_TYPE_ISOCHRONOUS)
+                {
+                    eStatus = USB_PIPE_ERROR;
+                }
+                break;
+
+            case USB_HALT_XACTERR:
+                if ((pxPipe->Type == USB_EP_TYPE_ISOCHRONOUS) ||
+                    (++pxPipe->Errors >= USB_HOST_MAX_ERRORS))
+                {
+                    eStatus = USB_PIPE_ERROR;
+                }
+                break;
+
+            default:
+                eStatus = USB_PIPE_ERROR;
+                break;
+        }
+
+        if (eStatus != USB_PIPE_BUSY)
+        {
+            pxPipe->Transfer.Length = pxPipe->Transfer.Progress;
+            pxPipe->Status = eStatus;
+
+            XPD_SAFE_CALLBACK(pxPipe->Complete, pxPipe);
+        }
+    }
+}
+
+/* Disables the channel, its request is evaluated once it's halted */
+static void USB_prvChannelHalt(USB_HostHandleType * pxHost, uint8_t ucCh, uint8_t ucReason)
+{
+    USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+
+    if (pxHost->Channels[ucCh]->Halt == USB_HALT_NONE)
+    {
+        pxHost->Channels[ucCh]->Halt = ucReason;
+    }
+
+    if (pxHC->HCCHAR.b.CHENA != 0)
+    {
+        pxHC->HCINTMSK.w = USB_OTG_HCINTMSK_CHHM;
+        SET_BIT(pxHC->HCCHAR.w, USB_OTG_HCCHAR_CHDIS | USB_OTG_HCCHAR_CHENA);
+    }
+    else
+    {
+        USB_prvChannelHalted(pxHost, ucCh);
+    }
+}
+
+/* Releases the channel from its pipe, an enabled channel
+ * is only reassigned when its halt is reported */
+static void USB_prvChannelCancel(USB_HostHandleType * pxHost, uint8_t ucCh)
+{
+    USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+
+    pxHost->Channels[ucCh]->Channel = USB_NO_CHANNEL;
+    pxHost->Channels[ucCh] = NULL;
+
+    if (pxHC->HCCHAR.b.CHENA != 0)
+    {
+        SET_BIT(pxHost->Halting, 1 << ucCh);
+        pxHC->HCINTMSK.w = USB_OTG_HCINTMSK_CHHM;
+        SET_BIT(pxHC->HCCHAR.w, USB_OTG_HCCHAR_CHDIS | USB_OTG_HCCHAR_CHENA);
+    }
+    else
+    {
+        CLEAR_BIT(pxHost->Inst->HAINTMSK, 1 << ucCh);
+        pxHC->HCINTMSK.w = 0;
+        pxHC->HCINT.w = USB_HCINT_ALL;
+    }
+}
+
+/* Determine the halt reason from the channel interrupt flags */
+static uint8_t USB_prvHaltReason(uint32_t ulHCINT)
+{
+    uint8_t ucReason = USB_HALT_NONE;
+
+    if ((ulHCINT & USB_OTG_HCINT_XFRC) != 0)
+    {
+        ucReason = USB_HALT_XFRC;
+    }
+    else if ((ulHCINT & USB_OTG_HCINT_STALL) != 0)
+    {
+        ucReason = USB_HALT_STALL;
+    }
+    else if ((ulHCINT & (USB_OTG_HCINT_BBERR | USB_OTG_HCINT_AHBERR)) != 0)
+    {
+        ucReason = USB_HALT_FATAL;
+    }
+    else if ((ulHCINT & (USB_OTG_HCINT_TXERR | USB_OTG_HCINT_DTERR)) != 0)
+    {
+        ucReason = USB_HALT_XACTERR;
+    }
+    else if ((ulHCINT & USB_OTG_HCINT_FRMOR) != 0)
+    {
+        ucReason = USB_HALT_FRMOR;
+    }
+    else if ((ulHCINT & USB_OTG_HCINT_NAK) != 0)
+    {
+        ucReason = USB_HALT_NAK;
+    }
+    return ucReason;
+}
+
+/* Handle host channel events */
+static void USB_prvChannelEventHandler(USB_HostHandleType * pxHost, uint8_t ucCh)
+{
+    USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+    USB_PipeType * pxPipe = pxHost->Channels[ucCh];
+    uint32_t ulHCINT = pxHC->HCINT.w;
+
+    if (pxPipe == NULL)
+    {
+        /* Late events of a released channel, it's reusable once halted */
+        if ((ulHCINT & USB_OTG_HCINT_CHH) != 0)
+        {
+            CLEAR_BIT(pxHost->Halting, 1 << ucCh);
+        }
+        pxHC->HCINT.w = ulHCINT;
+        pxHC->HCINTMSK.w = 0;
+        CLEAR_BIT(pxHost->Inst->HAINTMSK, 1 << ucCh);
+    }
+    else if ((ulHCINT & USB_OTG_HCINT_CHH) != 0)
+    {
+        /* With DMA the transaction outcome is only reported with the halt */
+        if (pxPipe->Halt == USB_HALT_NONE)
+        {
+            pxPipe->Halt = USB_prvHaltReason(ulHCINT);
+        }
+        USB_prvChannelHalted(pxHost, ucCh);
+    }
+    else
+    {
+        /* Without DMA the channel is halted on transaction events */
+        ulHCINT &= pxHC->HCINTMSK.w;
+        pxHC->HCINT.w = ulHCINT;
+
+        if (ulHCINT != 0)
+        {
+            USB_prvChannelHalt(pxHost, ucCh, USB_prvHaltReason(ulHCINT));
+        }
+    }
+}
+
+/* Continues pushing the pending OUT packets when the Tx FIFO has emptied */
+static void USB_prvHostTxFifoEmpty(USB_HostHandleType * pxHost, uint8_t ucPeriodic)
+{
+    uint8_t ucCh, ucChCount = USB_CHANNEL_COUNT(pxHost);
+    uint32_t ulLeft = 0;
+
+    for (ucCh = 0; ucCh < ucChCount; ucCh++)
+    {
+        USB_PipeType * pxPipe = pxHost->Channels[ucCh];
+
+        if ((pxPipe != NULL) && (pxPipe->Halt == USB_HALT_NONE) &&
+            (USB_PIPE_PERIODIC(pxPipe) == (ucPeriodic != 0)) &&
+            (USB_prvPipeIsIn(pxPipe) == 0))
+        {
+            ulLeft += USB_prvChannelWrite(pxHost, ucCh);
+        }
+    }
+
+    if (ulLeft > 0)
+    {
+    }
+    else if (ucPeriodic != 0)
+    {
+        USB_IT_DISABLE(pxHost, PTXFE);
+    }
+    else
+    {
+        USB_IT_DISABLE(pxHost, NPTXFE);
+    }
+}
+
+/* Terminates all pipe transfers */
+static void USB_prvHostAbort(USB_HostHandleType * pxHost)
+{
+    uint8_t ucCh, ucSlot, ucChCount = USB_CHANNEL_COUNT(pxHost);
+
+    /* Disable all channels */
+    pxHost->Inst->HAINTMSK = 0;
+    for (ucCh = 0; ucCh < ucChCount; ucCh++)
+    {
+        USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
+
+        pxHC->HCINTMSK.w = 0;
+        if (pxHC->HCCHAR.b.CHENA != 0)
+        {
+            SET_BIT(pxHC->HCCHAR.w, USB_OTG_HCCHAR_CHDIS | USB_OTG_HCCHAR_CHENA);
+        }
+        pxHC->HCINT.w = USB_HCINT_ALL;
+        pxHost->Channels[ucCh] = NULL;
+    }
+    pxHost->Halting = 0;
+    USB_IT_DISABLE(pxHost, NPTXFE);
+    USB_IT_DISABLE(pxHost, PTXFE);
+
+    /* Fail the ongoing transfers */
+    for (ucSlot = 0; ucSlot < USBH_MAX_PIPE_COUNT; ucSlot++)
+    {
+        USB_PipeType * pxPipe = pxHost->Pipes[ucSlot];
+
+        if (pxPipe != NULL)
+        {
+            pxPipe->Channel = USB_NO_CHANNEL;
+
+            if (pxPipe->Status == USB_PIPE_BUSY)
+            {
+                pxPipe->Transfer.Length = pxPipe->Transfer.Progress;
+                pxPipe->Status = USB_PIPE_ERROR;
+
+                XPD_SAFE_CALLBACK(pxPipe->Complete, pxPipe);
+            }
+        }
+    }
+}
+
+/** @defgroup USB_Exported_Functions USB Exported Functions
+ * @{ */
+
+/**
+ * @brief Initializes the USB OTG peripheral using the setup configuration
+ * @param pxUSB: pointer to the USB handle structure
+ * @param pxConfig: USB setup configuration
+ */
+void USB_vDevInit(USB_HandleType * pxUSB, const USB_InitType * pxConfig)
+{
+    /* Enable peripheral clock */
+#ifdef USB_OTG_HS
+    if (IS_USB_OTG_HS(pxUSB->Inst))
+    {
+        RCC_vClockEnable(RCC_POS_OTG_HS);
+    }
+    else
+#endif
+    {
+        RCC_vClockEnable(RCC_POS_OTG_FS);
+    }
+
+    /* Initialize handle variables */
+    pxUSB->EP.OUT[0].MaxPacketSize =
+    pxUSB->EP.IN [0].MaxPacketSize = USBD_EP0_MAX_PACKET_SIZE;
+    pxUSB->EP.OUT[0].Type =
+    pxUSB->EP.IN [0].Type = USB_EP_TYPE_CONTROL;
+    pxUSB->LinkState = USB_LINK_STATE_OFF;
+
+    /* Disable interrupts */
+    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
+
+    /* Initialize dependencies (pins, IRQ lines) */
+    XPD_SAFE_CALLBACK(pxUSB->Callbacks.DepInit, pxUSB);
+
+    /* Initialize selected PHY */
+    USB_prvPhyInit(pxUSB->Inst, pxConfig->PHY);
+
+#if (USB_OTG_DMA_SUPPORT != 0)
+    /* Set dedicated DMA */
+    if (pxConfig->DMA != DISABLE)
+    {
+        SET_BIT(pxUSB->Inst->GAHBCFG.w,
+                USB_OTG_GAHBCFG_HBSTLEN_2 | USB_OTG_GAHBCFG_DMAEN);
+    }
+#endif
+
+    {
+        uint8_t ucEpNum;
+        uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
+
+        /* Set Device Mode */
+        MODIFY_REG(pxUSB->Inst->GUSBCFG.w,
+                USB_OTG_GUSBCFG_FHMOD | USB_OTG_GUSBCFG_FDMOD,
+                USB_OTG_GUSBCFG_FDMOD);
+
+        /* Immediate soft disconnect */
+        USB_REG_BIT(pxUSB,DCTL,SDIS) = 1;
+
+        /* VBUS sensing unused */
+#ifdef USB_OTG_GCCFG_VBDEN
+        {
+            USB_REG_BIT(pxUSB,GCCFG,VBDEN) = 0;
+
+            SET_BIT(pxUSB->Inst->GOTGCTL.w,
+                    USB_OTG_GOTGCTL_BVALOEN | USB_OTG_GOTGCTL_BVALOVAL);
+        }
+#else
+        {
+            USB_REG_BIT(pxUSB,GCCFG,NOVBUSSENS) = 1;
+        }
+#endif
+
+        /* Restart the Phy Clock */
+        pxUSB->Inst->PCGCCTL.w = 0;
+
+#ifdef USB_OTG_HS
+        /* HS PHY interfaces */
+        if (pxConfig->PHY != USB_PHY_EMBEDDED_FS)
+        {
+            pxUSB->Inst->DCFG.b.DSPD = 0;
+        }
+        else
+#endif
+        {
+            /* Internal FS Phy */
+            pxUSB->Inst->DCFG.b.DSPD = 3;
+        }
+
+        /* Init endpoints */
+        for (ucEpNum = 0; ucEpNum < ucEpCount; ucEpNum++)
+        {
+            USB_vEpClose(pxUSB, ucEpNum);
+            USB_vEpClose(pxUSB, 0x80 | ucEpNum);
+        }
+        USB_REG_BIT(pxUSB,DIEPMSK,TXFURM) = 0;
+
+#if (USB_OTG_DMA_SUPPORT != 0)
+        if (USB_DMA_CONFIG(pxUSB) != 0)
+        {
+            /*Set threshold parameters */
+            pxUSB->Inst->DTHRCTL.w = (
+                    USB_OTG_DTHRCTL_TXTHRLEN_6  |
+                    USB_OTG_DTHRCTL_RXTHRLEN_6  |
+                    USB_OTG_DTHRCTL_RXTHREN     |
+                    USB_OTG_DTHRCTL_ISOTHREN    |
+                    USB_OTG_DTHRCTL_NONISOTHREN  );
+        }
+#endif
+
+#ifdef USB_OTG_GLPMCFG_LPMEN
+        /* Set Link Power Management feature (L1 sleep mode support) */
+        if (pxConfig->LPM != DISABLE)
+        {
+            SET_BIT(pxUSB->Inst->GLPMCFG.w,
+                USB_OTG_GLPMCFG_LPMEN | USB_OTG_GLPMCFG_LPMACK | USB_OTG_GLPMCFG_ENBESL);
+        }
+#endif
+    }
+}
+
+/**
  * @brief Restores the USB peripheral to its default inactive state
  * @param pxUSB: pointer to the USB handle structure
- * @return ERROR if input is incorrect, OK if success
+ * @return ERROR if input is incorrect, OK if success
+ */
+void USB_vDevDeinit(USB_HandleType * pxUSB)
+{
+    USB_vDevStop_IT(pxUSB);
+
+    /* Deinitialize dependencies */
+    XPD_SAFE_CALLBACK(pxUSB->Callbacks.DepDeinit, pxUSB);
+
+    /* Disable peripheral clock */
+#ifdef USB_OTG_HS
+    if (IS_USB_OTG_HS(pxUSB->Inst))
+    {
+        /* Disable any PHY clocking as well */
+        USB_prvHsPhyDeinit(pxUSB->Inst);
+
+        RCC_vClockDisable(RCC_POS_OTG_HS);
+    }
+    else
+#endif
+    {
+        RCC_vClockDisable(RCC_POS_OTG_FS);
+    }
+}
+
+/**
+ * @brief Starts the USB device operation
+ * @param pxUSB: pointer to the USB handle structure
+ */
+void USB_vDevStart_IT(USB_HandleType * pxUSB)
+{
+    uint32_t ulGINTMSK;
+
+    /* Clear any pending interrupts except SRQ */
+    pxUSB->Inst->GINTSTS.w  = ~USB_OTG_GINTSTS_SRQINT;
+    USB_prvClearEpInts(pxUSB);
+
+    /* Enable interrupts matching to the Device mode ONLY */
+    ulGINTMSK = USB_OTG_GINTMSK_USBSUSPM | USB_OTG_GINTMSK_USBRST |
+                USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_IEPINT |
+                USB_OTG_GINTMSK_OEPINT   | USB_OTG_GINTMSK_WUIM   |
+                USB_OTG_GINTMSK_RXFLVLM;
+
+    /* When DMA is used, Rx data isn't read by IRQHandler */
+    if (USB_DMA_CONFIG(pxUSB) != 0)
+    {
+        CLEAR_BIT(ulGINTMSK, USB_OTG_GINTMSK_RXFLVLM);
+    }
+#ifdef USB_OTG_GLPMCFG_LPMEN
+    /* Set Link Power Management feature (L1 sleep mode support) */
+    if (USB_REG_BIT(pxUSB,GLPMCFG,LPMEN) != DISABLE)
+    {
+        SET_BIT(ulGINTMSK, USB_OTG_GINTMSK_LPMINTM);
+    }
+#endif
+
+    /* Apply interrupts selection */
+    pxUSB->Inst->GINTMSK.w = ulGINTMSK;
+
+    /* Also configure device endpoint interrupts */
+    pxUSB->Inst->DIEPMSK.w = USB_OTG_DIEPMSK_XFRCM
+            | USB_OTG_DIEPMSK_TOM | USB_OTG_DIEPMSK_EPDM;
+    pxUSB->Inst->DOEPMSK.w = USB_OTG_DOEPMSK_XFRCM | USB_OTG_DOEPMSK_STUPM
+#ifdef USB_OTG_DOEPMSK_OTEPSPRM
+            | USB_OTG_DOEPMSK_OTEPSPRM
+#endif
+            | USB_OTG_DOEPMSK_EPDM;
+    pxUSB->Inst->DAINTMSK.w = 0;
+
+    USB_prvConnectCtrl(pxUSB, ENABLE);
+
+    /* Enable global interrupts */
+    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 1;
+}
+
+/**
+ * @brief Disconnects the device from the USB host
+ * @param pxUSB: pointer to the USB handle structure
+ */
+void USB_vDevStop_IT(USB_HandleType * pxUSB)
+{
+    /* Disable global interrupts */
+    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
+
+    /* Clear any pending interrupts except SRQ */
+    pxUSB->Inst->GINTSTS.w  = ~USB_OTG_GINTSTS_SRQINT;
+    USB_prvClearEpInts(pxUSB);
+
+    /* Clear interrupt masks */
+    CLEAR_BIT(pxUSB->Inst->GINTMSK.w,
+            USB_OTG_GINTMSK_USBSUSPM | USB_OTG_GINTMSK_USBRST |
+            USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_IEPINT |
+            USB_OTG_GINTMSK_OEPINT   | USB_OTG_GINTMSK_WUIM   |
+#ifdef USB_OTG_GLPMCFG_LPMEN
+            USB_OTG_GINTMSK_LPMINTM |
+#endif
+            USB_OTG_GINTMSK_RXFLVLM);
+    pxUSB->Inst->DIEPMSK.w  = 0;
+    pxUSB->Inst->DOEPMSK.w  = 0;
+    pxUSB->Inst->DAINTMSK.w = 0;
+
+    /* Flush the FIFOs */
+    USB_prvFlushRxFifo(pxUSB->Inst);
+    USB_prvFlushTxFifo(pxUSB->Inst, USB_ALL_TX_FIFOS);
+
+    /* Virtual disconnect */
+    USB_prvConnectCtrl(pxUSB, DISABLE);
+
+    /* Set Link State to disconnected */
+    pxUSB->LinkState = USB_LINK_STATE_OFF;
+}
+
+/**
+ * @brief Sets the USB device address
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucAddress: new device address
+ */
+void USB_vSetAddress(USB_HandleType * pxUSB, uint8_t ucAddress)
+{
+    pxUSB->Inst->DCFG.b.DAD = ucAddress;
+}
+
+/**
+ * @brief Sets endpoint buffers and opens the default control endpoint.
+ * @param pxUSB: pointer to the USB handle structure
+ */
+void USB_vCtrlEpOpen(USB_HandleType * pxUSB)
+{
+    /* Allocate FIFO space for all used endpoints based on MPS */
+    USB_vAllocateEPs(pxUSB);
+
+    /* Open EP0 */
+    USB_prvCtrlEpOpen(pxUSB);
+}
+
+/**
+ * @brief Opens an endpoint.
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint address
+ * @param eType: endpoint type
+ * @param usMaxPacketSize: endpoint maximum data packet size
+ */
+void USB_vEpOpen(
+        USB_HandleType *    pxUSB,
+        uint8_t             ucEpAddress,
+        USB_EndPointType    eType,
+        uint16_t            usMaxPacketSize)
+{
+    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+    USB_EndPointHandleType * pxEP = USB_GET_EP_AT(pxUSB, ucEpAddress);
+    uint8_t ucEpNum = ucEpAddress & 0xF;
+
+    pxEP->MaxPacketSize = usMaxPacketSize;
+    pxEP->Type = eType;
+
+    /* Activate Endpoint interrupts */
+    if (ucEpAddress > 0x7F)
+    {
+        SET_BIT(pxUSB->Inst->DAINTMSK.w,
+                1 << (ucEpNum + USB_OTG_DAINTMSK_IEPM_Pos));
+    }
+    else
+    {
+        SET_BIT(pxUSB->Inst->DAINTMSK.w,
+                1 << (ucEpNum + USB_OTG_DAINTMSK_OEPM_Pos));
+    }
+
+    /* Check if currently inactive */
+    if (pxDEP->DxEPCTL.b.USBAEP == 0)
+    {
+        pxDEP->DxEPCTL.b.MPSIZ  = pxEP->MaxPacketSize;
+        pxDEP->DxEPCTL.b.EPTYP  = pxEP->Type;
+
+        /* Only valid for IN EP, the field is reserved for OUT EPs */
+        pxDEP->DxEPCTL.b.TXFNUM = ucEpNum;
+
+        pxDEP->DxEPCTL.b.SD0PID_SEVNFRM = 1;
+        pxDEP->DxEPCTL.b.USBAEP = 1;
+    }
+}
+
+/**
+ * @brief Closes an active endpoint (EP0 shall not be closed).
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint address
+ */
+void USB_vEpClose(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+{
+    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+    uint8_t ucEpNum = ucEpAddress & 0xF;
+
+    /* Deactivate Endpoint */
+    if (ucEpAddress > 0x7F)
+    {
+        /* Disable endpoint interrupts */
+        CLEAR_BIT(pxUSB->Inst->DEACHMSK,
+                1 << (ucEpNum + USB_OTG_DEACHINTMSK_IEP1INTM_Pos - 1));
+        CLEAR_BIT(pxUSB->Inst->DAINTMSK.w,
+                1 << (ucEpNum + USB_OTG_DAINTMSK_IEPM_Pos));
+
+        /* Flush dedicated FIFO */
+        USB_prvFlushTxFifo(pxUSB->Inst, ucEpNum);
+    }
+    else
+    {
+        /* Disable endpoint interrupts */
+        CLEAR_BIT(pxUSB->Inst->DEACHMSK,
+                1 << (ucEpNum + USB_OTG_DEACHINTMSK_OEP1INTM_Pos - 1));
+        CLEAR_BIT(pxUSB->Inst->DAINTMSK.w,
+                1 << (ucEpNum + USB_OTG_DAINTMSK_OEPM_Pos));
+    }
+
+    /* If a transfer is ongoing, interrupt with NACK */
+    if (pxDEP->DxEPCTL.b.EPENA != 0)
+    {
+        pxDEP->DxEPCTL.w = USB_OTG_DOEPCTL_EPDIS | USB_OTG_DOEPCTL_SNAK;
+    }
+    else
+    {
+        pxDEP->DxEPCTL.w = 0;
+    }
+
+    pxDEP->DxEPTSIZ.w = 0;
+    pxDEP->DxEPINT.w  = 0xFF;
+}
+
+/**
+ * @brief Set a STALL condition on an endpoint
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint number
+ */
+void USB_vEpSetStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+{
+    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+
+    if (pxDEP->DxEPCTL.b.EPENA == 0)
+    {
+        pxDEP->DxEPCTL.b.EPDIS = 0;
+    }
+    pxDEP->DxEPCTL.b.STALL = 1;
+
+    /* STALL-ed EP must still be able to receive SETUP */
+    if (ucEpAddress == 0)
+    {
+        USB_prvPrepareSetup(pxUSB);
+    }
+}
+
+/**
+ * @brief Clear a STALL condition on an endpoint
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint number
+ */
+void USB_vEpClearStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+{
+    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+
+    pxDEP->DxEPCTL.b.STALL = 0;
+
+    /* INTERRUPT || BULK -> set DATA0 PID */
+    if (pxDEP->DxEPCTL.b.EPTYP >= USB_EP_TYPE_BULK)
+    {
+        pxDEP->DxEPCTL.b.SD0PID_SEVNFRM = 1;
+    }
+}
+
+/**
+ * @brief Clears the current data content of an active endpoint.
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint number
+ */
+void USB_vEpFlush(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+{
+    if (ucEpAddress > 0x7F)
+    {
+        USB_prvFlushTxFifo(pxUSB->Inst, ucEpAddress & 0xF);
+    }
+    else
+    {
+        USB_prvFlushRxFifo(pxUSB->Inst);
+    }
+}
+
+/**
+ * @brief Initiates data reception on the OUT endpoint.
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint address
+ * @param pucData: pointer to the data buffer
+ * @param ulLength: amount of data bytes to transfer
+ * @note  When DMA is used, the data buffer shall be word aligned and sized to complete
+ *        packets, unless the endpoint's BounceBuffer is set.
+ * @note  Transfers exceeding the transfer size register limits are received
+ *        in consecutive requests until a short packet or the requested length.
+ */
+void USB_vEpReceive(
+        USB_HandleType *    pxUSB,
+        uint8_t             ucEpAddress,
+        uint8_t *           pucData,
+        uint32_t            ulLength)
+{
+    USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpAddress];
+
+    /* setup transfer */
+    pxEP->Transfer.Data       = pucData;
+    pxEP->Transfer.Progress   = ulLength;
+    pxEP->Transfer.Length     = 0;
+
+    USB_prvEpReceive(pxUSB, ucEpAddress);
+}
+
+/**
+ * @brief Initiates data transmission on the IN endpoint.
+ * @param pxUSB: pointer to the USB handle structure
+ * @param ucEpAddress: endpoint address
+ * @param pucData: pointer to the data buffer
+ * @param ulLength: amount of data bytes to transfer
+ * @note  When DMA is used, word aligned data is transferred in a single multi-packet
+ *        request, otherwise packet by packet through the endpoint's BounceBuffer.
+ * @note  Transfers exceeding the transfer size register limits are sent
+ *        in consecutive requests of complete packets.
+ * @note  A transfer of complete packets is not terminated by a zero length packet,
+ *        the class driver has to send an empty transfer after it when its protocol
+ *        requires a short packet.
+ * @note  When called outside of the USB interrupt handler,
+ *        XPD_ENTER_CRITICAL has to mask the USB interrupt.
+ */
+void USB_vEpSend(
+        USB_HandleType *    pxUSB,
+        uint8_t             ucEpAddress,
+        const uint8_t *     pucData,
+        uint32_t            ulLength)
+{
+    uint8_t ucEpNum = ucEpAddress & 0xF;
+    USB_EndPointHandleType * pxEP = &pxUSB->EP.IN[ucEpNum];
+
+    /* setup and start the transfer */
+    pxEP->Transfer.Data       = (uint8_t*)pucData;
+    pxEP->Transfer.Progress   = ulLength;
+    pxEP->Transfer.Length     = ulLength;
+
+    USB_prvEpSend(pxUSB, ucEpNum);
+}
+
+/**
+ * @brief USB interrupt handler that provides event-driven peripheral management
+ *        and handle callbacks.
+ * @param pxUSB: pointer to the USB handle structure
+ */
+void USB_vDevIRQHandler(USB_HandleType * pxUSB)
+{
+    uint32_t ulGINT = pxUSB->Inst->GINTSTS.w & pxUSB->Inst->GINTMSK.w;
+
+    if (ulGINT != 0)
+    {
+        union {
+            struct {
+                uint16_t IEPINT;
+                uint16_t OEPINT;
+            }b;
+            uint32_t w;
+        }xDAINT = { .w = pxUSB->Inst->DAINT.w & pxUSB->Inst->DAINTMSK.w };
+
+        /* Rx FIFO level reached */
+        if ((ulGINT & USB_OTG_GINTSTS_RXFLVL) != 0)
+        {
+            uint32_t ulGRXSTSP  = pxUSB->Inst->GRXSTSP.w;
+            uint16_t usDataCount= (ulGRXSTSP & USB_OTG_GRXSTSP_BCNT_Msk)
+                                            >> USB_OTG_GRXSTSP_BCNT_Pos;
+            uint8_t  ucEpNum    = (ulGRXSTSP & USB_OTG_GRXSTSP_EPNUM_Msk)
+                                            >> USB_OTG_GRXSTSP_EPNUM_Pos;
+            USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpNum];
+
+            switch (ulGRXSTSP & USB_OTG_GRXSTSP_PKTSTS_Msk)
+            {
+                case STS_DATA_UPDT:
+                    /* Data packet received */
+                    USB_prvReadFifo(pxUSB->Inst, pxEP->Transfer.Data, usDataCount);
+                    pxEP->Transfer.Length += usDataCount;
+                    pxEP->Transfer.Data += usDataCount;
+                    break;
+
+                case STS_SETUP_UPDT:
+                    /* Setup packet received */
+                    USB_prvReadFifo(pxUSB->Inst, (uint8_t *)&pxUSB->Setup,
+                            sizeof(pxUSB->Setup));
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        /* OUT endpoint interrupts */
+        if ((ulGINT & USB_OTG_GINTSTS_OEPINT) != 0)
+        {
+            uint8_t ucEpNum;
+
+            /* Handle individual endpoint interrupts */
+            for (ucEpNum = 0; xDAINT.b.OEPINT != 0; ucEpNum++, xDAINT.b.OEPINT >>= 1)
+            {
+                if ((xDAINT.b.OEPINT & 1) != 0)
+                {
+                    USB_prvOutEpEventHandler(pxUSB, ucEpNum);
+                }
+            }
+        }
+
+        /* IN endpoint interrupts */
+        if ((ulGINT & USB_OTG_GINTSTS_IEPINT) != 0)
+        {
+            uint8_t ucEpNum;
+
+            /* Handle individual endpoint interrupts */
+            for (ucEpNum = 0; xDAINT.b.IEPINT != 0; ucEpNum++, xDAINT.b.IEPINT >>= 1)
+            {
+                if ((xDAINT.b.IEPINT & 1) != 0)
+                {
+                    USB_prvInEpEventHandler(pxUSB, ucEpNum);
+                }
+            }
+        }
+
+        /* Handle Reset Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_USBRST) != 0)
+        {
+            /* Clear IT flag */
+            USB_FLAG_CLEAR(pxUSB, USBRST);
+
+            pxUSB->LinkState = USB_LINK_STATE_ACTIVE;
+
+            /* Stop any ongoing Remote Wakeup signaling and EP0 transfers */
+            USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
+            USB_prvFlushRxFifo(pxUSB->Inst);
+            USB_prvFlushTxFifo(pxUSB->Inst, 0);
+
+            /* Clear EP interrupt flags */
+            USB_prvClearEpInts(pxUSB);
+
+            /* Set default address (0) */
+            USB_vSetAddress(pxUSB, 0);
+        }
+
+        /* Handle Enumeration done Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_ENUMDNE) != 0)
+        {
+            USB_SpeedType eSpeed = USB_SPEED_FULL;
+
+            /* Clear IT flag */
+            USB_FLAG_CLEAR(pxUSB, ENUMDNE);
+
+            /* Clear global IN NAK */
+            USB_REG_BIT(pxUSB,DCTL,CGINAK) = 1;
+
+#ifdef USB_OTG_HS
+            /* High speed enumerated */
+            if (pxUSB->Inst->DSTS.b.ENUMSPD == 0)
+            {
+                eSpeed = USB_SPEED_HIGH;
+                pxUSB->Inst->GUSBCFG.b.TRDT = 9;
+            }
+            else
+#endif
+            {
+                /* Full speed enumeration */
+                uint32_t ulTRDT;
+
+                /* Get most suitable value depending on AHB frequency */
+                ulTRDT = 224000000 / RCC_ulClockFreq_Hz(HCLK);
+                if (ulTRDT < 6)
+                {
+                    ulTRDT = 6;
+                }
+                pxUSB->Inst->GUSBCFG.b.TRDT = ulTRDT;
+            }
+
+            /* Notify device handler */
+            USB_vResetCallback(pxUSB, eSpeed);
+        }
+
+        /* Handle Resume Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_WKUINT) != 0)
+        {
+            /* Stop any ongoing Remote Wakeup signaling */
+            USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
+
+            USB_FLAG_CLEAR(pxUSB, WKUINT);
+
+            XPD_SAFE_CALLBACK(pxUSB->Callbacks.Resume, pxUSB);
+
+            /* LPM state is changed after Resume callback
+             * -> possible to determine exited suspend level */
+            pxUSB->LinkState = USB_LINK_STATE_ACTIVE;
+        }
+
+#ifdef USB_OTG_GLPMCFG_LPMEN
+        /* Handle L1 suspend request */
+        if ((ulGINT & USB_OTG_GINTSTS_LPMINT) != 0)
+        {
+            USB_FLAG_CLEAR(pxUSB, LPMINT);
+
+            /* Set the target Link State */
+            pxUSB->LinkState = USB_LINK_STATE_SLEEP;
+            XPD_SAFE_CALLBACK(pxUSB->Callbacks.Suspend, pxUSB);
+        }
+#endif
+
+        /* Handle Suspend Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_USBSUSP) != 0)
+        {
+            USB_FLAG_CLEAR(pxUSB, USBSUSP);
+
+            if (USB_REG_BIT(pxUSB,DSTS,SUSPSTS) != 0)
+            {
+                /* Set the target Link State */
+                pxUSB->LinkState = USB_LINK_STATE_SUSPEND;
+                XPD_SAFE_CALLBACK(pxUSB->Callbacks.Suspend, pxUSB);
+            }
+        }
+
+        /* Handle SOF Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_SOF) != 0)
+        {
+            USB_FLAG_CLEAR(pxUSB, SOF);
+
+            XPD_SAFE_CALLBACK(pxUSB->Callbacks.SOF, pxUSB);
+        }
+    }
+}
+
+/**
+ * @brief Activates remote wake-up signaling.
+ * @param pxUSB: pointer to the USB handle structure
+ * @return
+ */
+void USB_vSetRemoteWakeup(USB_HandleType * pxUSB)
+{
+    if (USB_REG_BIT(pxUSB,DSTS,SUSPSTS) != 0)
+    {
+        /* Activate Remote wakeup signaling
+         * If LPM is supported and in L1 Sleep state,
+         * this bit is cleared automatically */
+        USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 1;
+    }
+}
+
+/**
+ * @brief Deactivates remote wake-up signaling.
+ * @param pxUSB: pointer to the USB handle structure
+ */
+void USB_vClearRemoteWakeup(USB_HandleType * pxUSB)
+{
+    /* Deactivate Resume signal after 1 - 15 ms */
+    USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
+}
+
+/**
+ * @brief Executes Battery Charger Detection algorithm.
+ * @note  This function shall be executed before the USB peripheral is connected
+ *        (started) with DP pull-up.
+ * @param pxUSB: pointer to the USB handle structure
+ * @return The determined upstream port type
  */
-void USB_vDevDeinit(USB_HandleType * pxUSB)
+USB_ChargerType USB_eChargerDetect(USB_HandleType * pxUSB)
 {
-    USB_vDevStop_IT(pxUSB);
+#ifndef USB_OTG_GCCFG_BCDEN
+    USB_ChargerType eDetection = USB_BCD_NOT_SUPPORTED;
+#else
+    /* USB power is always available before the data lines are contacted */
+    USB_ChargerType eDetection = USB_BCD_NO_DATA_CONTACT;
 
-    /* Deinitialize dependencies */
-    XPD_SAFE_CALLBACK(pxUSB->Callbacks.DepDeinit, pxUSB);
+    /* Enable Battery Charger Detection */
+    USB_REG_BIT(pxUSB,GCCFG,BCDEN) = 1;
 
-    /* Disable peripheral clock */
-#ifdef USB_OTG_HS
-    if (IS_USB_OTG_HS(pxUSB->Inst))
+    /* Check if device is connected */
+    if (USB_REG_BIT(pxUSB,DCTL,SDIS) != 0)
     {
-        /* Disable any PHY clocking as well */
-        USB_prvHsPhyDeinit(pxUSB);
+        /* Adjust depending on the speed of plugging in the device */
+        uint32_t ulTimeout = 1000;
 
-        RCC_vClockDisable(RCC_POS_OTG_HS);
+        USB_REG_BIT(pxUSB,GCCFG,DCDEN) = 1;
+
+        /* Data Contact Detect: determines contact of data lines
+         * to the bus powering entity */
+        if (XPD_OK == XPD_eWaitForDiff((void*)&pxUSB->Inst->GCCFG.w,
+                USB_OTG_GCCFG_DCDET, 0, &ulTimeout))
+        {
+            /* Bus electric stabilization */
+            XPD_vDelay_ms(100);
+
+            /* Primary Detection:
+             * distinguishes between a Standard Downstream Port
+             * and Charging Ports */
+            pxUSB->Inst->GCCFG.w = (pxUSB->Inst->GCCFG.w &
+                    ~USB_OTG_GCCFG_DCDEN) | USB_OTG_GCCFG_PDEN;
+
+            /* Bus electric stabilization */
+            XPD_vDelay_ms(100);
+
+            /* Check the results of PD */
+            switch (pxUSB->Inst->GCCFG.w & (USB_OTG_GCCFG_PS2DET | USB_OTG_GCCFG_PDET))
+            {
+                case USB_OTG_GCCFG_PS2DET:
+                    /* D- is externally pulled high during Primary Detection
+                     * PS2 port or proprietary charger */
+                    eDetection = USB_BCD_PS2_PROPRIETARY_PORT;
+                    break;
+
+                case USB_OTG_GCCFG_PDET:
+                {
+                    /* Secondary Detection:
+                     * distinguishes between Charging Downstream Port
+                     * and Dedicated Charging Port */
+                    pxUSB->Inst->GCCFG.w = (pxUSB->Inst->GCCFG.w &
+                            ~USB_OTG_GCCFG_PDEN) | USB_OTG_GCCFG_SDEN;
+
+                    /* Bus electric stabilization */
+                    XPD_vDelay_ms(100);
+
+                    if (USB_REG_BIT(pxUSB,GCCFG,SDET) != 0)
+                    {
+                        /* Dedicated Downstream Port DCP */
+                        eDetection = USB_BCD_DEDICATED_CHARGING_PORT;
+                    }
+                    else
+                    {
+                        /* Charging Downstream Port CDP */
+                        eDetection = USB_BCD_CHARGING_DOWNSTREAM_PORT;
+                    }
+                    break;
+                }
+
+                default:
+                    /* No downstream side support for PD
+                     * Standard Downstream Port SDP */
+                    eDetection = USB_BCD_STANDARD_DOWNSTREAM_PORT;
+                    break;
+            }
+        }
+    }
+    /* Disable Battery Charger Detection */
+    CLEAR_BIT(pxUSB->Inst->GCCFG.w,
+            USB_OTG_GCCFG_BCDEN | USB_OTG_GCCFG_DCDEN |
+            USB_OTG_GCCFG_PDEN | USB_OTG_GCCFG_SDEN);
+#endif
+    return eDetection;
+}
+
+/**
+ * @brief Determines the USB peripheral's current bus speed.
+ * @param pxUSB: pointer to the USB handle structure
+ * @return The current USB device speed
+ */
+USB_SpeedType USB_eDevSpeed(USB_HandleType * pxUSB)
+{
+    USB_SpeedType eSpeed;
+#ifdef USB_OTG_HS
+    /* High speed enumerated */
+    if (pxUSB->Inst->DSTS.b.ENUMSPD == 0)
+    {
+        eSpeed = USB_SPEED_HIGH;
     }
     else
 #endif
     {
-        RCC_vClockDisable(RCC_POS_OTG_FS);
+        eSpeed = USB_SPEED_FULL;
     }
+    return eSpeed;
 }
 
 /**
- * @brief Starts the USB device operation
+ * @brief Plans the FIFO RAM allocation of the endpoints: each endpoint gets
+ *        a single packet buffer at first, then the remaining RAM is distributed
+ *        in rounds of one additional packet up to the requested depths,
+ *        with isochronous IN, bulk IN, OUT, and other IN endpoints served in this order.
  * @param pxUSB: pointer to the USB handle structure
+ * @param axRequests: array of endpoint allocation requests
+ * @param ucCount: number of requests
+ * @param pxLayout: the resulting FIFO layout
+ * @return ERROR if the minimal allocation doesn't fit in the FIFO RAM
+ *         or an endpoint address is invalid, OK otherwise
  */
-void USB_vDevStart_IT(USB_HandleType * pxUSB)
+XPD_ReturnType USB_eFifoPlan(
+        USB_HandleType *            pxUSB,
+        const USB_FifoRequestType   axRequests[],
+        uint8_t                     ucCount,
+        USB_FifoLayoutType *        pxLayout)
 {
-    uint32_t ulGINTMSK;
+    XPD_ReturnType eResult = XPD_OK;
+    uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
+    uint8_t ucIndex, ucRank, ucLevel, ucMaxDepth = 1;
+    uint8_t ucOutCount = 0, ucCtrlCount = 0;
+    uint16_t usRxPacket = USBD_EP0_MAX_PACKET_SIZE / sizeof(uint32_t);
 
-    /* Clear any pending interrupts except SRQ */
-    pxUSB->Inst->GINTSTS.w  = ~USB_OTG_GINTSTS_SRQINT;
-    USB_prvClearEpInts(pxUSB);
+#ifndef USB_OTG_HS
+    (void) pxUSB;
+#endif
 
-    /* Enable interrupts matching to the Device mode ONLY */
-    ulGINTMSK = USB_OTG_GINTMSK_USBSUSPM | USB_OTG_GINTMSK_USBRST |
-                USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_IEPINT |
-                USB_OTG_GINTMSK_OEPINT   | USB_OTG_GINTMSK_WUIM   |
-                USB_OTG_GINTMSK_RXFLVLM;
+    for (ucIndex = 0; ucIndex < USBD_MAX_EP_COUNT; ucIndex++)
+    {
+        pxLayout->TxSize[ucIndex]  = 0;
+        pxLayout->TxDepth[ucIndex] = 0;
+    }
+    pxLayout->Total = USB_TOTAL_FIFO_SIZE(pxUSB) / sizeof(uint32_t);
 
-    /* When DMA is used, Rx data isn't read by IRQHandler */
-    if (USB_DMA_CONFIG(pxUSB) != 0)
+    /* Minimal allocation: a single packet buffer for each endpoint */
+    for (ucIndex = 0; ucIndex < ucCount; ucIndex++)
     {
-        CLEAR_BIT(ulGINTMSK, USB_OTG_GINTMSK_RXFLVLM);
+        const USB_FifoRequestType * pxReq = &axRequests[ucIndex];
+        uint16_t usPacket = (pxReq->MaxPacketSize + 3) / sizeof(uint32_t);
+        uint8_t ucEpNum = pxReq->Address & 0xF;
+
+        if (ucEpNum >= ucEpCount)
+        {
+            eResult = XPD_ERROR;
+        }
+        else if (pxReq->Address > 0x7F)
+        {
+            /* TX FIFOs have a minimal size of 16 words */
+            pxLayout->TxSize[ucEpNum]  = (usPacket < 16) ? 16 : usPacket;
+            pxLayout->TxDepth[ucEpNum] = 1;
+        }
+        else
+        {
+            ucOutCount++;
+            if (pxReq->Type == USB_EP_TYPE_CONTROL)
+            {
+                ucCtrlCount++;
+            }
+            if (usPacket > usRxPacket)
+            {
+                usRxPacket = usPacket;
+            }
+        }
+
+        if (pxReq->Depth > ucMaxDepth)
+        {
+            ucMaxDepth = pxReq->Depth;
+        }
     }
-#ifdef USB_OTG_GLPMCFG_LPMEN
-    /* Set Link Power Management feature (L1 sleep mode support) */
-    if (USB_REG_BIT(pxUSB,GLPMCFG,LPMEN) != DISABLE)
+    if (ucCtrlCount == 0)
     {
-        SET_BIT(ulGINTMSK, USB_OTG_GINTMSK_LPMINTM);
+        ucCtrlCount = 1;
     }
-#endif
 
-    /* Apply interrupts selection */
-    pxUSB->Inst->GINTMSK.w = ulGINTMSK;
+    /* Each received packet is stored with a status word */
+    usRxPacket++;
 
-    /* Also configure device endpoint interrupts */
-    pxUSB->Inst->DIEPMSK.w = USB_OTG_DIEPMSK_XFRCM
-            | USB_OTG_DIEPMSK_TOM | USB_OTG_DIEPMSK_EPDM;
-    pxUSB->Inst->DOEPMSK.w = USB_OTG_DOEPMSK_XFRCM | USB_OTG_DOEPMSK_STUPM
-#ifdef USB_OTG_DOEPMSK_OTEPSPRM
-            | USB_OTG_DOEPMSK_OTEPSPRM
-#endif
-            | USB_OTG_DOEPMSK_EPDM;
-    pxUSB->Inst->DAINTMSK.w = 0;
+    /* RX FIFO: SETUP packets of the control endpoints, the data packets,
+     * the transfer complete status of each OUT endpoint, and Global OUT NAK */
+    pxLayout->RxDepth = 1;
+    pxLayout->RxSize  = (5 * ucCtrlCount + 8) + usRxPacket + (2 * ucOutCount) + 1;
 
-    USB_prvConnectCtrl(pxUSB, ENABLE);
+    pxLayout->Used = pxLayout->RxSize;
+    for (ucIndex = 0; ucIndex < ucEpCount; ucIndex++)
+    {
+        pxLayout->Used += pxLayout->TxSize[ucIndex];
+    }
 
-    /* Enable global interrupts */
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 1;
-}
+    if (pxLayout->Used > pxLayout->Total)
+    {
+        eResult = XPD_ERROR;
+    }
 
-/**
- * @brief Disconnects the device from the USB host
- * @param pxUSB: pointer to the USB handle structure
- */
-void USB_vDevStop_IT(USB_HandleType * pxUSB)
-{
-    /* Disable global interrupts */
-    USB_REG_BIT(pxUSB, GAHBCFG, GINT) = 0;
+    /* Deeper buffering is distributed evenly, one packet per round */
+    for (ucLevel = 2; (eResult == XPD_OK) && (ucLevel <= ucMaxDepth); ucLevel++)
+    {
+        for (ucRank = 0; ucRank < 4; ucRank++)
+        {
+            for (ucIndex = 0; ucIndex < ucCount; ucIndex++)
+            {
+                const USB_FifoRequestType * pxReq = &axRequests[ucIndex];
+                uint8_t ucEpNum = pxReq->Address & 0xF;
+                uint8_t ucReqRank;
+                uint16_t usSize, usCost;
 
-    /* Clear any pending interrupts except SRQ */
-    pxUSB->Inst->GINTSTS.w  = ~USB_OTG_GINTSTS_SRQINT;
-    USB_prvClearEpInts(pxUSB);
+                if (pxReq->Address <= 0x7F)
+                {
+                    ucReqRank = 2;
+                }
+                else if (pxReq->Type == USB_EP_TYPE_ISOCHRONOUS)
+                {
+                    ucReqRank = 0;
+                }
+                else if (pxReq->Type == USB_EP_TYPE_BULK)
+                {
+                    ucReqRank = 1;
+                }
+                else
+                {
+                    ucReqRank = 3;
+                }
 
-    /* Clear interrupt masks */
-    CLEAR_BIT(pxUSB->Inst->GINTMSK.w,
-            USB_OTG_GINTMSK_USBSUSPM | USB_OTG_GINTMSK_USBRST |
-            USB_OTG_GINTMSK_ENUMDNEM | USB_OTG_GINTMSK_IEPINT |
-            USB_OTG_GINTMSK_OEPINT   | USB_OTG_GINTMSK_WUIM   |
-#ifdef USB_OTG_GLPMCFG_LPMEN
-            USB_OTG_GINTMSK_LPMINTM |
-#endif
-            USB_OTG_GINTMSK_RXFLVLM);
-    pxUSB->Inst->DIEPMSK.w  = 0;
-    pxUSB->Inst->DOEPMSK.w  = 0;
-    pxUSB->Inst->DAINTMSK.w = 0;
+                if ((ucReqRank != ucRank) || (pxReq->Depth < ucLevel))
+                {
+                    continue;
+                }
 
-    /* Flush the FIFOs */
-    USB_prvFlushRxFifo(pxUSB);
-    USB_prvFlushTxFifo(pxUSB, USB_ALL_TX_FIFOS);
+                if (ucReqRank == 2)
+                {
+                    /* The shared RX FIFO grows once per round */
+                    if ((pxLayout->RxDepth < ucLevel) &&
+                        ((pxLayout->Used + usRxPacket) <= pxLayout->Total))
+                    {
+                        pxLayout->RxDepth = ucLevel;
+                        pxLayout->RxSize += usRxPacket;
+                        pxLayout->Used   += usRxPacket;
+                    }
+                }
+                else if (pxLayout->TxDepth[ucEpNum] < ucLevel)
+                {
+                    usSize = ucLevel * ((pxReq->MaxPacketSize + 3) / sizeof(uint32_t));
+                    if (usSize < 16)
+                    {
+                        usSize = 16;
+                    }
+                    usCost = usSize - pxLayout->TxSize[ucEpNum];
 
-    /* Virtual disconnect */
-    USB_prvConnectCtrl(pxUSB, DISABLE);
+                    if ((pxLayout->Used + usCost) <= pxLayout->Total)
+                    {
+                        pxLayout->TxDepth[ucEpNum] = ucLevel;
+                        pxLayout->TxSize[ucEpNum]  = usSize;
+                        pxLayout->Used += usCost;
+                    }
+                }
+                else {}
+            }
+        }
+    }
 
-    /* Set Link State to disconnected */
-    pxUSB->LinkState = USB_LINK_STATE_OFF;
+    return eResult;
 }
 
 /**
- * @brief Sets the USB device address
+ * @brief Applies a FIFO layout on the USB peripheral.
  * @param pxUSB: pointer to the USB handle structure
- * @param ucAddress: new device address
+ * @param pxLayout: the FIFO layout to apply
  */
-void USB_vSetAddress(USB_HandleType * pxUSB, uint8_t ucAddress)
+void USB_vFifoConfig(USB_HandleType * pxUSB, const USB_FifoLayoutType * pxLayout)
 {
-    pxUSB->Inst->DCFG.b.DAD = ucAddress;
+    uint8_t ucEpNum;
+    uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
+    uint32_t ulFifoOffset = pxLayout->RxSize;
+
+    pxUSB->Inst->GRXFSIZ = pxLayout->RxSize;
+
+    /* EP0 TX FIFO */
+    pxUSB->Inst->DIEPTXF0_HNPTXFSIZ.w =
+            ((uint32_t)pxLayout->TxSize[0] << USB_OTG_DIEPTXF_INEPTXFD_Pos) |
+            (ulFifoOffset << USB_OTG_DIEPTXF_INEPTXSA_Pos);
+    ulFifoOffset += pxLayout->TxSize[0];
+
+    /* EPx TX FIFOs, the unused endpoints get an empty FIFO */
+    for (ucEpNum = 1; ucEpNum < ucEpCount; ucEpNum++)
+    {
+        pxUSB->Inst->DIEPTXF[ucEpNum - 1].w =
+                ((uint32_t)pxLayout->TxSize[ucEpNum] << USB_OTG_DIEPTXF_INEPTXFD_Pos) |
+                (ulFifoOffset << USB_OTG_DIEPTXF_INEPTXSA_Pos);
+        ulFifoOffset += pxLayout->TxSize[ucEpNum];
+    }
 }
 
 /**
- * @brief Sets endpoint buffers and opens the default control endpoint.
+ * @brief Configure peripheral FIFO allocation for endpoints
+ *        after device initialization and before starting the USB operation.
+ *        Bulk and isochronous endpoints request USB_FIFO_STREAM_DEPTH packets,
+ *        the rest single packet buffering.
  * @param pxUSB: pointer to the USB handle structure
  */
-void USB_vCtrlEpOpen(USB_HandleType * pxUSB)
+__weak void USB_vAllocateEPs(USB_HandleType * pxUSB)
 {
-    /* Allocate FIFO space for all used endpoints based on MPS */
-    USB_vAllocateEPs(pxUSB);
+    USB_FifoRequestType axRequests[2 * USBD_MAX_EP_COUNT];
+    USB_FifoLayoutType xLayout;
+    uint8_t ucEpNum, ucCount = 0;
+    uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
+
+    /* Collect the used endpoints */
+    for (ucEpNum = 0; ucEpNum < ucEpCount; ucEpNum++)
+    {
+        USB_EndPointHandleType * pxEP = &pxUSB->EP.IN[ucEpNum];
+        uint8_t ucDir;
+
+        for (ucDir = 0; ucDir < 2; ucDir++, pxEP = &pxUSB->EP.OUT[ucEpNum])
+        {
+            if ((ucEpNum == 0) || (pxEP->MaxPacketSize != 0))
+            {
+                axRequests[ucCount].Address       = (ucDir == 0) ? (0x80 | ucEpNum) : ucEpNum;
+                axRequests[ucCount].Type          = pxEP->Type;
+                axRequests[ucCount].MaxPacketSize = pxEP->MaxPacketSize;
+                axRequests[ucCount].Depth         =
+                        ((pxEP->Type == USB_EP_TYPE_BULK) ||
+                         (pxEP->Type == USB_EP_TYPE_ISOCHRONOUS)) ? USB_FIFO_STREAM_DEPTH : 1;
+                ucCount++;
+            }
+        }
+    }
 
-    /* Open EP0 */
-    USB_prvCtrlEpOpen(pxUSB);
+    /* If even the single packet buffers exceed the FIFO RAM,
+     * the RX FIFO is reduced so that the TX FIFOs remain within it */
+    if (USB_eFifoPlan(pxUSB, axRequests, ucCount, &xLayout) != XPD_OK)
+    {
+        uint16_t usTxUsed = xLayout.Used - xLayout.RxSize;
+
+        if (usTxUsed < xLayout.Total)
+        {
+            xLayout.RxSize = xLayout.Total - usTxUsed;
+            xLayout.Used   = xLayout.Total;
+        }
+    }
+
+    USB_vFifoConfig(pxUSB, &xLayout);
 }
 
 /**
- * @brief Opens an endpoint.
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint address
- * @param eType: endpoint type
- * @param usMaxPacketSize: endpoint maximum data packet size
+ * @brief Initializes the USB OTG peripheral in host mode using the setup configuration
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxConfig: USB setup configuration
  */
-void USB_vEpOpen(
-        USB_HandleType *    pxUSB,
-        uint8_t             ucEpAddress,
-        USB_EndPointType    eType,
-        uint16_t            usMaxPacketSize)
+void USB_vHostInit(USB_HostHandleType * pxHost, const USB_InitType * pxConfig)
 {
-    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
-    USB_EndPointHandleType * pxEP = USB_GET_EP_AT(pxUSB, ucEpAddress);
-    uint8_t ucEpNum = ucEpAddress & 0xF;
+    USB_PHYType ePHY = USB_PHY_EMBEDDED_FS;
+    uint8_t ucCh, ucSlot, ucChCount = USB_CHANNEL_COUNT(pxHost);
 
-    pxEP->MaxPacketSize = usMaxPacketSize;
-    pxEP->Type = eType;
+#ifdef USB_OTG_HS
+    ePHY = pxConfig->PHY;
+#else
+    (void) pxConfig;
+#endif
 
-    /* Activate Endpoint interrupts */
-    if (ucEpAddress > 0x7F)
+#ifdef USB_OTG_HS
+    /* Enable peripheral clock */
+    if (IS_USB_OTG_HS(pxHost->Inst))
     {
-        SET_BIT(pxUSB->Inst->DAINTMSK.w,
-                1 << (ucEpNum + USB_OTG_DAINTMSK_IEPM_Pos));
+        RCC_vClockEnable(RCC_POS_OTG_HS);
     }
     else
+#endif
     {
-        SET_BIT(pxUSB->Inst->DAINTMSK.w,
-                1 << (ucEpNum + USB_OTG_DAINTMSK_OEPM_Pos));
+        RCC_vClockEnable(RCC_POS_OTG_FS);
     }
 
-    /* Check if currently inactive */
-    if (pxDEP->DxEPCTL.b.USBAEP == 0)
+    /* Initialize handle variables */
+    for (ucSlot = 0; ucSlot < USBH_MAX_PIPE_COUNT; ucSlot++)
     {
-        pxDEP->DxEPCTL.b.MPSIZ  = pxEP->MaxPacketSize;
-        pxDEP->DxEPCTL.b.EPTYP  = pxEP->Type;
+        pxHost->Pipes[ucSlot] = NULL;
+    }
+    for (ucCh = 0; ucCh < USBH_MAX_CHANNEL_COUNT; ucCh++)
+    {
+        pxHost->Channels[ucCh] = NULL;
+    }
+    pxHost->Halting = 0;
+    pxHost->Speed = USB_HOST_SPEED_FULL;
+    pxHost->PeriodicCount = 0;
+    pxHost->NextPipe = 0;
 
-        /* Only valid for IN EP, the field is reserved for OUT EPs */
-        pxDEP->DxEPCTL.b.TXFNUM = ucEpNum;
+    /* Disable interrupts */
+    pxHost->Inst->GAHBCFG.b.GINT = 0;
 
-        pxDEP->DxEPCTL.b.SD0PID_SEVNFRM = 1;
-        pxDEP->DxEPCTL.b.USBAEP = 1;
-    }
-}
+    /* Initialize dependencies (pins, IRQ lines) */
+    XPD_SAFE_CALLBACK(pxHost->Callbacks.DepInit, pxHost);
 
-/**
- * @brief Closes an active endpoint (EP0 shall not be closed).
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint address
- */
-void USB_vEpClose(USB_HandleType * pxUSB, uint8_t ucEpAddress)
-{
-    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
-    uint8_t ucEpNum = ucEpAddress & 0xF;
+    /* Initialize selected PHY */
+    USB_prvPhyInit(pxHost->Inst, ePHY);
 
-    /* Deactivate Endpoint */
-    if (ucEpAddress > 0x7F)
+#if (USB_OTG_DMA_SUPPORT != 0)
+    /* Set dedicated DMA */
+    if (pxConfig->DMA != DISABLE)
     {
-        /* Disable endpoint interrupts */
-        CLEAR_BIT(pxUSB->Inst->DEACHMSK,
-                1 << (ucEpNum + USB_OTG_DEACHINTMSK_IEP1INTM_Pos - 1));
-        CLEAR_BIT(pxUSB->Inst->DAINTMSK.w,
-                1 << (ucEpNum + USB_OTG_DAINTMSK_IEPM_Pos));
+        SET_BIT(pxHost->Inst->GAHBCFG.w,
+                USB_OTG_GAHBCFG_HBSTLEN_2 | USB_OTG_GAHBCFG_DMAEN);
+    }
+#endif
 
-        /* Flush dedicated FIFO */
-        USB_prvFlushTxFifo(pxUSB, ucEpNum);
+    /* Set Host Mode, it takes effect after 25 ms */
+    MODIFY_REG(pxHost->Inst->GUSBCFG.w,
+            USB_OTG_GUSBCFG_FHMOD | USB_OTG_GUSBCFG_FDMOD,
+            USB_OTG_GUSBCFG_FHMOD);
+    XPD_vDelay_ms(25);
+
+    /* VBUS sensing unused */
+#ifdef USB_OTG_GCCFG_VBDEN
+    pxHost->Inst->GCCFG.b.VBDEN = 0;
+#else
+    pxHost->Inst->GCCFG.b.NOVBUSSENS = 1;
+#endif
+
+    /* Restart the Phy Clock */
+    pxHost->Inst->PCGCCTL.w = 0;
+
+    if (ePHY == USB_PHY_EMBEDDED_FS)
+    {
+        /* FS/LS only with 48 MHz PHY clock */
+        pxHost->Inst->HCFG.w = USB_OTG_HCFG_FSLSS | (1 << USB_OTG_HCFG_FSLSPCS_Pos);
     }
     else
     {
-        /* Disable endpoint interrupts */
-        CLEAR_BIT(pxUSB->Inst->DEACHMSK,
-                1 << (ucEpNum + USB_OTG_DEACHINTMSK_OEP1INTM_Pos - 1));
-        CLEAR_BIT(pxUSB->Inst->DAINTMSK.w,
-                1 << (ucEpNum + USB_OTG_DAINTMSK_OEPM_Pos));
+        pxHost->Inst->HCFG.w = 0;
     }
 
-    /* If a transfer is ongoing, interrupt with NACK */
-    if (pxDEP->DxEPCTL.b.EPENA != 0)
+    /* Split the FIFO RAM between reception, non-periodic and periodic transmission */
     {
-        pxDEP->DxEPCTL.w = USB_OTG_DOEPCTL_EPDIS | USB_OTG_DOEPCTL_SNAK;
+        uint32_t ulTotal = USB_TOTAL_FIFO_SIZE(pxHost) / sizeof(uint32_t);
+        uint32_t ulRxSize = ulTotal / 2;
+        uint32_t ulNPTxSize = ulTotal / 4;
+
+        pxHost->Inst->GRXFSIZ = ulRxSize;
+        pxHost->Inst->DIEPTXF0_HNPTXFSIZ.w =
+                (ulNPTxSize << USB_OTG_DIEPTXF_INEPTXFD_Pos) |
+                (ulRxSize   << USB_OTG_DIEPTXF_INEPTXSA_Pos);
+        pxHost->Inst->HPTXFSIZ.w =
+                ((ulTotal - ulRxSize - ulNPTxSize) << USB_OTG_HPTXFSIZ_PTXFD_Pos) |
+                ((ulRxSize + ulNPTxSize)           << USB_OTG_HPTXFSIZ_PTXSA_Pos);
     }
-    else
+
+    USB_prvFlushTxFifo(pxHost->Inst, USB_ALL_TX_FIFOS);
+    USB_prvFlushRxFifo(pxHost->Inst);
+
+    /* Reset the channels */
+    pxHost->Inst->HAINTMSK = 0;
+    for (ucCh = 0; ucCh < ucChCount; ucCh++)
     {
-        pxDEP->DxEPCTL.w = 0;
+        pxHost->Inst->HC[ucCh].HCINTMSK.w = 0;
+        pxHost->Inst->HC[ucCh].HCINT.w = USB_HCINT_ALL;
     }
-
-    pxDEP->DxEPTSIZ.w = 0;
-    pxDEP->DxEPINT.w  = 0xFF;
 }
 
 /**
- * @brief Set a STALL condition on an endpoint
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint number
+ * @brief Restores the USB peripheral to its default inactive state
+ * @param pxHost: pointer to the USB host handle structure
  */
-void USB_vEpSetStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+void USB_vHostDeinit(USB_HostHandleType * pxHost)
 {
-    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+    USB_vHostStop_IT(pxHost);
 
-    if (pxDEP->DxEPCTL.b.EPENA == 0)
+    /* Deinitialize dependencies */
+    XPD_SAFE_CALLBACK(pxHost->Callbacks.DepDeinit, pxHost);
+
+    /* Disable peripheral clock */
+#ifdef USB_OTG_HS
+    if (IS_USB_OTG_HS(pxHost->Inst))
     {
-        pxDEP->DxEPCTL.b.EPDIS = 0;
-    }
-    pxDEP->DxEPCTL.b.STALL = 1;
+        /* Disable any PHY clocking as well */
+        USB_prvHsPhyDeinit(pxHost->Inst);
 
-    /* STALL-ed EP must still be able to receive SETUP */
-    if (ucEpAddress == 0)
+        RCC_vClockDisable(RCC_POS_OTG_HS);
+    }
+    else
+#endif
     {
-        USB_prvPrepareSetup(pxUSB);
+        RCC_vClockDisable(RCC_POS_OTG_FS);
     }
 }
 
 /**
- * @brief Clear a STALL condition on an endpoint
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint number
+ * @brief Powers the root port and starts the USB host operation
+ * @param pxHost: pointer to the USB host handle structure
  */
-void USB_vEpClearStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
+void USB_vHostStart_IT(USB_HostHandleType * pxHost)
 {
-    USB_OTG_GenEndpointType * pxDEP = USB_EPR(pxUSB, ucEpAddress);
+    uint32_t ulGINTMSK;
 
-    pxDEP->DxEPCTL.b.STALL = 0;
+    /* Clear any pending interrupts except SRQ */
+    pxHost->Inst->GINTSTS.w = ~USB_OTG_GINTSTS_SRQINT;
 
-    /* INTERRUPT || BULK -> set DATA0 PID */
-    if (pxDEP->DxEPCTL.b.EPTYP >= USB_EP_TYPE_BULK)
-    {
-        pxDEP->DxEPCTL.b.SD0PID_SEVNFRM = 1;
-    }
-}
+    /* Enable interrupts matching to the Host mode ONLY */
+    ulGINTMSK = USB_OTG_GINTMSK_PRTIM | USB_OTG_GINTMSK_HCIM |
+                USB_OTG_GINTMSK_DISCINT | USB_OTG_GINTMSK_RXFLVLM;
 
-/**
- * @brief Clears the current data content of an active endpoint.
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint number
- */
-void USB_vEpFlush(USB_HandleType * pxUSB, uint8_t ucEpAddress)
-{
-    if (ucEpAddress > 0x7F)
+    /* When DMA is used, Rx data isn't read by IRQHandler */
+    if (USB_DMA_CONFIG(pxHost) != 0)
     {
-        USB_prvFlushTxFifo(pxUSB, ucEpAddress & 0xF);
+        CLEAR_BIT(ulGINTMSK, USB_OTG_GINTMSK_RXFLVLM);
     }
-    else
+
+    /* SOF drives the periodic scheduling */
+    if ((pxHost->PeriodicCount != 0) || (pxHost->Callbacks.SOF != NULL))
     {
-        USB_prvFlushRxFifo(pxUSB);
+        SET_BIT(ulGINTMSK, USB_OTG_GINTMSK_SOFM);
     }
+
+    /* Apply interrupts selection */
+    pxHost->Inst->GINTMSK.w = ulGINTMSK;
+
+    /* Drive VBUS */
+    USB_prvPortModify(pxHost->Inst, 0, USB_OTG_HPRT_PPWR);
+
+    /* Enable global interrupts */
+    pxHost->Inst->GAHBCFG.b.GINT = 1;
 }
 
 /**
- * @brief Initiates data reception on the OUT endpoint.
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint address
- * @param pucData: pointer to the data buffer
- * @param usLength: amount of data bytes to transfer
+ * @brief Stops the USB host operation and powers down the root port
+ * @param pxHost: pointer to the USB host handle structure
  */
-void USB_vEpReceive(
-        USB_HandleType *    pxUSB,
-        uint8_t             ucEpAddress,
-        uint8_t *           pucData,
-        uint16_t            usLength)
+void USB_vHostStop_IT(USB_HostHandleType * pxHost)
 {
-    USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpAddress];
+    /* Disable global interrupts */
+    pxHost->Inst->GAHBCFG.b.GINT = 0;
 
-    /* setup transfer */
-    pxEP->Transfer.Data       = pucData;
-    pxEP->Transfer.Progress   = usLength;
-    pxEP->Transfer.Length     = 0;
+    /* Clear interrupt masks and pending interrupts except SRQ */
+    pxHost->Inst->GINTMSK.w = 0;
+    pxHost->Inst->GINTSTS.w = ~USB_OTG_GINTSTS_SRQINT;
 
-    USB_prvEpReceive(pxUSB, ucEpAddress);
+    /* Terminate the ongoing transfers */
+    USB_prvHostAbort(pxHost);
+
+    /* Flush the FIFOs */
+    USB_prvFlushRxFifo(pxHost->Inst);
+    USB_prvFlushTxFifo(pxHost->Inst, USB_ALL_TX_FIFOS);
+
+    /* Stop driving VBUS */
+    USB_prvPortModify(pxHost->Inst, USB_OTG_HPRT_PPWR, 0);
 }
 
 /**
- * @brief Initiates data transmission on the IN endpoint.
- * @param pxUSB: pointer to the USB handle structure
- * @param ucEpAddress: endpoint address
- * @param pucData: pointer to the data buffer
- * @param usLength: amount of data bytes to transfer
+ * @brief Starts the reset signaling on the root port.
+ * @note  The reset signaling shall be stopped by @ref USB_vHostClearPortReset
+ *        after 10 - 20 ms, then the port enabling is signaled through the
+ *        PortEnable callback.
+ * @param pxHost: pointer to the USB host handle structure
  */
-void USB_vEpSend(
-        USB_HandleType *    pxUSB,
-        uint8_t             ucEpAddress,
-        const uint8_t *     pucData,
-        uint16_t            usLength)
+void USB_vHostSetPortReset(USB_HostHandleType * pxHost)
 {
-    uint8_t ucEpNum = ucEpAddress & 0xF;
-    USB_EndPointHandleType * pxEP = &pxUSB->EP.IN[ucEpNum];
-
-    /* setup and start the transfer */
-    pxEP->Transfer.Data       = (uint8_t*)pucData;
-    pxEP->Transfer.Progress   = usLength;
-    pxEP->Transfer.Length     = usLength;
+    USB_prvPortModify(pxHost->Inst, 0, USB_OTG_HPRT_PRST);
+}
 
-    USB_prvEpSend(pxUSB, ucEpNum);
+/**
+ * @brief Stops the reset signaling on the root port.
+ * @param pxHost: pointer to the USB host handle structure
+ */
+void USB_vHostClearPortReset(USB_HostHandleType * pxHost)
+{
+    USB_prvPortModify(pxHost->Inst, USB_OTG_HPRT_PRST, 0);
 }
 
 /**
- * @brief USB interrupt handler that provides event-driven peripheral management
- *        and handle callbacks.
- * @param pxUSB: pointer to the USB handle structure
+ * @brief USB host interrupt handler that provides event-driven peripheral management,
+ *        pipe transfer scheduling and handle callbacks.
+ * @param pxHost: pointer to the USB host handle structure
  */
-void USB_vDevIRQHandler(USB_HandleType * pxUSB)
+void USB_vHostIRQHandler(USB_HostHandleType * pxHost)
 {
-    uint32_t ulGINT = pxUSB->Inst->GINTSTS.w & pxUSB->Inst->GINTMSK.w;
+    uint32_t ulGINT = pxHost->Inst->GINTSTS.w & pxHost->Inst->GINTMSK.w;
 
     if (ulGINT != 0)
     {
-        union {
-            struct {
-                uint16_t IEPINT;
-                uint16_t OEPINT;
-            }b;
-            uint32_t w;
-        }xDAINT = { .w = pxUSB->Inst->DAINT.w & pxUSB->Inst->DAINTMSK.w };
-
         /* Rx FIFO level reached */
         if ((ulGINT & USB_OTG_GINTSTS_RXFLVL) != 0)
         {
-            uint32_t ulGRXSTSP  = pxUSB->Inst->GRXSTSP.w;
+            uint32_t ulGRXSTSP  = pxHost->Inst->GRXSTSP.w;
             uint16_t usDataCount= (ulGRXSTSP & USB_OTG_GRXSTSP_BCNT_Msk)
                                             >> USB_OTG_GRXSTSP_BCNT_Pos;
-            uint8_t  ucEpNum    = (ulGRXSTSP & USB_OTG_GRXSTSP_EPNUM_Msk)
+            uint8_t  ucCh       = (ulGRXSTSP & USB_OTG_GRXSTSP_EPNUM_Msk)
                                             >> USB_OTG_GRXSTSP_EPNUM_Pos;
-            USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpNum];
+            USB_PipeType * pxPipe = pxHost->Channels[ucCh];
 
-            switch (ulGRXSTSP & USB_OTG_GRXSTSP_PKTSTS_Msk)
+            if (((ulGRXSTSP & USB_OTG_GRXSTSP_PKTSTS_Msk) != STS_IN_DATA) || (usDataCount == 0))
             {
-                case STS_DATA_UPDT:
-                    /* Data packet received */
-                    USB_prvReadFifo(pxUSB, pxEP->Transfer.Data, usDataCount);
-                    pxEP->Transfer.Length += usDataCount;
-                    pxEP->Transfer.Data += usDataCount;
-                    break;
-
-                case STS_SETUP_UPDT:
-                    /* Setup packet received */
-                    USB_prvReadFifo(pxUSB, (uint8_t *)&pxUSB->Setup,
-                            sizeof(pxUSB->Setup));
-                    break;
-
-                default:
-                    break;
+                /* No data to read */
             }
-        }
-
-        /* OUT endpoint interrupts */
-        if ((ulGINT & USB_OTG_GINTSTS_OEPINT) != 0)
-        {
-            uint8_t ucEpNum;
-
-            /* Handle individual endpoint interrupts */
-            for (ucEpNum = 0; xDAINT.b.OEPINT != 0; ucEpNum++, xDAINT.b.OEPINT >>= 1)
+            else if (pxPipe == NULL)
             {
-                if ((xDAINT.b.OEPINT & 1) != 0)
+                /* Discard the data of a released channel */
+                for (usDataCount = (usDataCount + 3) / 4; usDataCount > 0; usDataCount--)
                 {
-                    USB_prvOutEpEventHandler(pxUSB, ucEpNum);
+                    (void) pxHost->Inst->DFIFO[0].DR;
                 }
             }
-        }
+            else
+            {
+                USB_OTG_HostChannelTypeDef * pxHC = &pxHost->Inst->HC[ucCh];
 
-        /* IN endpoint interrupts */
-        if ((ulGINT & USB_OTG_GINTSTS_IEPINT) != 0)
-        {
-            uint8_t ucEpNum;
+                USB_prvReadFifo(pxHost->Inst,
+                        USB_prvPipeData(pxPipe) + pxPipe->Transfer.Written, usDataCount);
+                pxPipe->Transfer.Written += usDataCount;
 
-            /* Handle individual endpoint interrupts */
-            for (ucEpNum = 0; xDAINT.b.IEPINT != 0; ucEpNum++, xDAINT.b.IEPINT >>= 1)
-            {
-                if ((xDAINT.b.IEPINT & 1) != 0)
+                /* Re-activate the channel when more packets are expected */
+                if (pxHC->HCTSIZ.b.PKTCNT > 0)
                 {
-                    USB_prvInEpEventHandler(pxUSB, ucEpNum);
+                    MODIFY_REG(pxHC->HCCHAR.w, USB_OTG_HCCHAR_CHDIS, USB_OTG_HCCHAR_CHENA);
                 }
             }
         }
 
-        /* Handle Reset Interrupt */
-        if ((ulGINT & USB_OTG_GINTSTS_USBRST) != 0)
-        {
-            /* Clear IT flag */
-            USB_FLAG_CLEAR(pxUSB, USBRST);
-
-            pxUSB->LinkState = USB_LINK_STATE_ACTIVE;
-
-            /* Stop any ongoing Remote Wakeup signaling and EP0 transfers */
-            USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
-            USB_prvFlushRxFifo(pxUSB);
-            USB_prvFlushTxFifo(pxUSB, 0);
-
-            /* Clear EP interrupt flags */
-            USB_prvClearEpInts(pxUSB);
+        /* Channel interrupts */
+        if ((ulGINT & USB_OTG_GINTSTS_HCINT) != 0)
+        {
+            uint32_t ulHAINT = pxHost->Inst->HAINT & pxHost->Inst->HAINTMSK;
+            uint8_t ucCh;
 
-            /* Set default address (0) */
-            USB_vSetAddress(pxUSB, 0);
+            /* Handle individual channel interrupts */
+            for (ucCh = 0; ulHAINT != 0; ucCh++, ulHAINT >>= 1)
+            {
+                if ((ulHAINT & 1) != 0)
+                {
+                    USB_prvChannelEventHandler(pxHost, ucCh);
+                }
+            }
+
+            /* Serve the waiting pipes with the released channels */
+            USB_prvHostSchedule(pxHost, 0);
         }
 
-        /* Handle Enumeration done Interrupt */
-        if ((ulGINT & USB_OTG_GINTSTS_ENUMDNE) != 0)
+        /* Tx FIFOs have space for the pending OUT packets */
+        if ((ulGINT & USB_OTG_GINTSTS_NPTXFE) != 0)
         {
-            USB_SpeedType eSpeed = USB_SPEED_FULL;
+            USB_prvHostTxFifoEmpty(pxHost, 0);
+        }
+        if ((ulGINT & USB_OTG_GINTSTS_PTXFE) != 0)
+        {
+            USB_prvHostTxFifoEmpty(pxHost, 1);
+        }
 
-            /* Clear IT flag */
-            USB_FLAG_CLEAR(pxUSB, ENUMDNE);
+        /* Root port status changes */
+        if ((ulGINT & USB_OTG_GINTSTS_HPRTINT) != 0)
+        {
+            uint32_t ulHPRT = pxHost->Inst->HPRT.w;
+            uint32_t ulAck  = ulHPRT & (USB_OTG_HPRT_PCDET |
+                    USB_OTG_HPRT_PENCHNG | USB_OTG_HPRT_POCCHNG);
 
-            /* Clear global IN NAK */
-            USB_REG_BIT(pxUSB,DCTL,CGINAK) = 1;
+            /* Acknowledge the changes, leave the port enabled */
+            pxHost->Inst->HPRT.w = (ulHPRT & ~(USB_OTG_HPRT_PENA | USB_OTG_HPRT_PCDET |
+                    USB_OTG_HPRT_PENCHNG | USB_OTG_HPRT_POCCHNG)) | ulAck;
 
-#ifdef USB_OTG_HS
-            /* High speed enumerated */
-            if (pxUSB->Inst->DSTS.b.ENUMSPD == 0)
+            if ((ulAck & USB_OTG_HPRT_PCDET) != 0)
             {
-                eSpeed = USB_SPEED_HIGH;
-                pxUSB->Inst->GUSBCFG.b.TRDT = 9;
+                XPD_SAFE_CALLBACK(pxHost->Callbacks.Connect, pxHost);
             }
-            else
-#endif
+
+            if (((ulAck & USB_OTG_HPRT_PENCHNG) != 0) && ((ulHPRT & USB_OTG_HPRT_PENA) != 0))
             {
-                /* Full speed enumeration */
-                uint32_t ulTRDT;
+                bool bReset = false;
 
-                /* Get most suitable value depending on AHB frequency */
-                ulTRDT = 224000000 / RCC_ulClockFreq_Hz(HCLK);
-                if (ulTRDT < 6)
+                pxHost->Speed = (ulHPRT & USB_OTG_HPRT_PSPD_Msk) >> USB_OTG_HPRT_PSPD_Pos;
+
+                /* FS PHY clock has to match the device speed */
+                if (pxHost->Inst->HCFG.b.FSLSS != 0)
                 {
-                    ulTRDT = 6;
+                    uint32_t ulFSLSPCS = 1;
+
+                    if (pxHost->Speed == USB_HOST_SPEED_LOW)
+                    {
+                        ulFSLSPCS = 2;
+                        pxHost->Inst->HFIR = 6000;
+                    }
+                    else
+                    {
+                        pxHost->Inst->HFIR = 48000;
+                    }
+
+                    if (pxHost->Inst->HCFG.b.FSLSPCS != ulFSLSPCS)
+                    {
+                        pxHost->Inst->HCFG.b.FSLSPCS = ulFSLSPCS;
+                        bReset = true;
+                    }
+                }
+
+                if (bReset)
+                {
+                    /* PHY clock change takes effect with another port reset */
+                    XPD_SAFE_CALLBACK(pxHost->Callbacks.Connect, pxHost);
+                }
+                else
+                {
+                    XPD_SAFE_CALLBACK(pxHost->Callbacks.PortEnable, pxHost);
                 }
-                pxUSB->Inst->GUSBCFG.b.TRDT = ulTRDT;
             }
 
-            /* Notify device handler */
-            USB_vResetCallback(pxUSB, eSpeed);
+            if (((ulAck & USB_OTG_HPRT_POCCHNG) != 0) && ((ulHPRT & USB_OTG_HPRT_POCA) != 0))
+            {
+                /* Overcurrent, stop driving VBUS */
+                USB_prvPortModify(pxHost->Inst, USB_OTG_HPRT_PPWR, 0);
+            }
         }
 
-        /* Handle Resume Interrupt */
-        if ((ulGINT & USB_OTG_GINTSTS_WKUINT) != 0)
+        /* Device detached */
+        if ((ulGINT & USB_OTG_GINTSTS_DISCINT) != 0)
         {
-            /* Stop any ongoing Remote Wakeup signaling */
-            USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
-
-            USB_FLAG_CLEAR(pxUSB, WKUINT);
+            USB_FLAG_CLEAR(pxHost, DISCINT);
 
-            XPD_SAFE_CALLBACK(pxUSB->Callbacks.Resume, pxUSB);
+            USB_prvHostAbort(pxHost);
+            USB_prvFlushRxFifo(pxHost->Inst);
+            USB_prvFlushTxFifo(pxHost->Inst, USB_ALL_TX_FIFOS);
 
-            /* LPM state is changed after Resume callback
-             * -> possible to determine exited suspend level */
-            pxUSB->LinkState = USB_LINK_STATE_ACTIVE;
+            XPD_SAFE_CALLBACK(pxHost->Callbacks.Disconnect, pxHost);
         }
 
-#ifdef USB_OTG_GLPMCFG_LPMEN
-        /* Handle L1 suspend request */
-        if ((ulGINT & USB_OTG_GINTSTS_LPMINT) != 0)
+        /* Handle SOF Interrupt */
+        if ((ulGINT & USB_OTG_GINTSTS_SOF) != 0)
         {
-            USB_FLAG_CLEAR(pxUSB, LPMINT);
-
-            /* Set the target Link State */
-            pxUSB->LinkState = USB_LINK_STATE_SLEEP;
-            XPD_SAFE_CALLBACK(pxUSB->Callbacks.Suspend, pxUSB);
-        }
-#endif
+            uint8_t ucSlot;
 
-        /* Handle Suspend Interrupt */
-        if ((ulGINT & USB_OTG_GINTSTS_USBSUSP) != 0)
-        {
-            USB_FLAG_CLEAR(pxUSB, USBSUSP);
+            USB_FLAG_CLEAR(pxHost, SOF);
 
-            if (USB_REG_BIT(pxUSB,DSTS,SUSPSTS) != 0)
+            /* The NAKed non-periodic pipes are retried in the new frame */
+            for (ucSlot = 0; ucSlot < USBH_MAX_PIPE_COUNT; ucSlot++)
             {
-                /* Set the target Link State */
-                pxUSB->LinkState = USB_LINK_STATE_SUSPEND;
-                XPD_SAFE_CALLBACK(pxUSB->Callbacks.Suspend, pxUSB);
+                if (pxHost->Pipes[ucSlot] != NULL)
+                {
+                    pxHost->Pipes[ucSlot]->Deferred = 0;
+                }
             }
-        }
 
-        /* Handle SOF Interrupt */
-        if ((ulGINT & USB_OTG_GINTSTS_SOF) != 0)
-        {
-            USB_FLAG_CLEAR(pxUSB, SOF);
+            /* Start the due periodic transactions */
+            USB_prvHostSchedule(pxHost, 1);
 
-            XPD_SAFE_CALLBACK(pxUSB->Callbacks.SOF, pxUSB);
-        }
-    }
-}
+            /* Without periodic pipes SOF is only needed until the deferred pipes are retried */
+            if ((pxHost->PeriodicCount == 0) && (pxHost->Callbacks.SOF == NULL))
+            {
+                USB_IT_DISABLE(pxHost, SOF);
+            }
 
-/**
- * @brief Activates remote wake-up signaling.
- * @param pxUSB: pointer to the USB handle structure
- * @return
- */
-void USB_vSetRemoteWakeup(USB_HandleType * pxUSB)
-{
-    if (USB_REG_BIT(pxUSB,DSTS,SUSPSTS) != 0)
-    {
-        /* Activate Remote wakeup signaling
-         * If LPM is supported and in L1 Sleep state,
-         * this bit is cleared automatically */
-        USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 1;
+            XPD_SAFE_CALLBACK(pxHost->Callbacks.SOF, pxHost);
+        }
     }
 }
 
 /**
- * @brief Deactivates remote wake-up signaling.
- * @param pxUSB: pointer to the USB handle structure
- */
-void USB_vClearRemoteWakeup(USB_HandleType * pxUSB)
-{
-    /* Deactivate Resume signal after 1 - 15 ms */
-    USB_REG_BIT(pxUSB,DCTL,RWUSIG) = 0;
-}
-
-/**
- * @brief Executes Battery Charger Detection algorithm.
- * @note  This function shall be executed before the USB peripheral is connected
- *        (started) with DP pull-up.
- * @param pxUSB: pointer to the USB handle structure
- * @return The determined upstream port type
+ * @brief Adds a pipe to the host's scheduling.
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxPipe: pointer to the pipe structure with configured
+ *        DevAddress, EpAddress, Type, MaxPacketSize and Interval (for periodic pipes)
+ * @return ERROR if the MaxPacketSize is zero or all USBH_MAX_PIPE_COUNT pipes are already open,
+ *         OK if success
  */
-USB_ChargerType USB_eChargerDetect(USB_HandleType * pxUSB)
+XPD_ReturnType USB_ePipeOpen(USB_HostHandleType * pxHost, USB_PipeType * pxPipe)
 {
-#ifndef USB_OTG_GCCFG_BCDEN
-    USB_ChargerType eDetection = USB_BCD_NOT_SUPPORTED;
-#else
-    /* USB power is always available before the data lines are contacted */
-    USB_ChargerType eDetection = USB_BCD_NO_DATA_CONTACT;
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint8_t ucSlot;
 
-    /* Enable Battery Charger Detection */
-    USB_REG_BIT(pxUSB,GCCFG,BCDEN) = 1;
+    XPD_ENTER_CRITICAL(pxHost);
 
-    /* Check if device is connected */
-    if (USB_REG_BIT(pxUSB,DCTL,SDIS) != 0)
+    for (ucSlot = 0; (ucSlot < USBH_MAX_PIPE_COUNT) && (pxHost->Pipes[ucSlot] != NULL); ucSlot++)
     {
-        /* Adjust depending on the speed of plugging in the device */
-        uint32_t ulTimeout = 1000;
+    }
 
-        USB_REG_BIT(pxUSB,GCCFG,DCDEN) = 1;
+    if ((ucSlot < USBH_MAX_PIPE_COUNT) && (pxPipe->MaxPacketSize > 0))
+    {
+        pxPipe->Status    = USB_PIPE_IDLE;
+        pxPipe->Channel   = USB_NO_CHANNEL;
+        pxPipe->Toggle    = USB_PID_DATA0;
+        pxPipe->Slot      = ucSlot;
+        pxPipe->Deferred  = 0;
+        pxPipe->NextFrame = pxHost->Inst->HFNUM.b.FRNUM;
+
+        if (pxPipe->Interval == 0)
+        {
+            pxPipe->Interval = 1;
+        }
 
-        /* Data Contact Detect: determines contact of data lines
-         * to the bus powering entity */
-        if (XPD_OK == XPD_eWaitForDiff((void*)&pxUSB->Inst->GCCFG.w,
-                USB_OTG_GCCFG_DCDET, 0, &ulTimeout))
+        if (USB_PIPE_PERIODIC(pxPipe))
         {
-            /* Bus electric stabilization */
-            XPD_vDelay_ms(100);
+            /* SOF drives the periodic scheduling */
+            pxHost->PeriodicCount++;
+            USB_IT_ENABLE(pxHost, SOF);
+        }
 
-            /* Primary Detection:
-             * distinguishes between a Standard Downstream Port
-             * and Charging Ports */
-            pxUSB->Inst->GCCFG.w = (pxUSB->Inst->GCCFG.w &
-                    ~USB_OTG_GCCFG_DCDEN) | USB_OTG_GCCFG_PDEN;
+        pxHost->Pipes[ucSlot] = pxPipe;
+        eResult = XPD_OK;
+    }
 
-            /* Bus electric stabilization */
-            XPD_vDelay_ms(100);
+    XPD_EXIT_CRITICAL(pxHost);
 
-            /* Check the results of PD */
-            switch (pxUSB->Inst->GCCFG.w & (USB_OTG_GCCFG_PS2DET | USB_OTG_GCCFG_PDET))
-            {
-                case USB_OTG_GCCFG_PS2DET:
-                    /* D- is externally pulled high during Primary Detection
-                     * PS2 port or proprietary charger */
-                    eDetection = USB_BCD_PS2_PROPRIETARY_PORT;
-                    break;
+    return eResult;
+}
 
-                case USB_OTG_GCCFG_PDET:
-                {
-                    /* Secondary Detection:
-                     * distinguishes between Charging Downstream Port
-                     * and Dedicated Charging Port */
-                    pxUSB->Inst->GCCFG.w = (pxUSB->Inst->GCCFG.w &
-                            ~USB_OTG_GCCFG_PDEN) | USB_OTG_GCCFG_SDEN;
+/**
+ * @brief Cancels the pipe's transfer and removes it from the host's scheduling.
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxPipe: pointer to the pipe structure
+ */
+void USB_vPipeClose(USB_HostHandleType * pxHost, USB_PipeType * pxPipe)
+{
+    USB_vPipeCancel(pxHost, pxPipe);
 
-                    /* Bus electric stabilization */
-                    XPD_vDelay_ms(100);
+    XPD_ENTER_CRITICAL(pxHost);
 
-                    if (USB_REG_BIT(pxUSB,GCCFG,SDET) != 0)
-                    {
-                        /* Dedicated Downstream Port DCP */
-                        eDetection = USB_BCD_DEDICATED_CHARGING_PORT;
-                    }
-                    else
-                    {
-                        /* Charging Downstream Port CDP */
-                        eDetection = USB_BCD_CHARGING_DOWNSTREAM_PORT;
-                    }
-                    break;
-                }
+    pxHost->Pipes[pxPipe->Slot] = NULL;
 
-                default:
-                    /* No downstream side support for PD
-                     * Standard Downstream Port SDP */
-                    eDetection = USB_BCD_STANDARD_DOWNSTREAM_PORT;
-                    break;
-            }
-        }
+    /* SOF is disabled by the interrupt handler once it isn't needed */
+    if (USB_PIPE_PERIODIC(pxPipe))
+    {
+        pxHost->PeriodicCount--;
     }
-    /* Disable Battery Charger Detection */
-    CLEAR_BIT(pxUSB->Inst->GCCFG.w,
-            USB_OTG_GCCFG_BCDEN | USB_OTG_GCCFG_DCDEN |
-            USB_OTG_GCCFG_PDEN | USB_OTG_GCCFG_SDEN);
-#endif
-    return eDetection;
+
+    XPD_EXIT_CRITICAL(pxHost);
 }
 
 /**
- * @brief Determines the USB peripheral's current bus speed.
- * @param pxUSB: pointer to the USB handle structure
- * @return The current USB device speed
+ * @brief Submits a data transfer on a non-control pipe.
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxPipe: pointer to the pipe structure
+ * @param pucData: pointer to the data buffer
+ * @param ulLength: amount of data bytes to transfer
+ * @return BUSY if the pipe has an ongoing transfer, OK if the transfer is scheduled
+ * @note  Non-periodic transfers are split to channel requests of up to
+ *        1023 packets, periodic pipes transfer a single packet each interval.
+ *        The transfer completes with a short packet or the requested length,
+ *        and is signaled through the pipe's Complete callback.
+ * @note  Without DMA a NAKed non-periodic transaction is retried in the next frame.
+ * @note  IN data buffers shall be sized to complete packets, and when DMA is used,
+ *        shall be word aligned.
  */
-USB_SpeedType USB_eDevSpeed(USB_HandleType * pxUSB)
+XPD_ReturnType USB_ePipeTransfer(USB_HostHandleType * pxHost, USB_PipeType * pxPipe,
+        uint8_t * pucData, uint32_t ulLength)
 {
-    USB_SpeedType eSpeed;
-#ifdef USB_OTG_HS
-    /* High speed enumerated */
-    if (pxUSB->Inst->DSTS.b.ENUMSPD == 0)
-    {
-        eSpeed = USB_SPEED_HIGH;
-    }
-    else
-#endif
+    XPD_ReturnType eResult = XPD_BUSY;
+
+    XPD_ENTER_CRITICAL(pxHost);
+
+    if (pxPipe->Status != USB_PIPE_BUSY)
     {
-        eSpeed = USB_SPEED_FULL;
+        pxPipe->Transfer.Data     = pucData;
+        pxPipe->Transfer.Length   = ulLength;
+        pxPipe->Transfer.Progress = 0;
+        pxPipe->Stage    = USB_STAGE_DATA;
+        pxPipe->Errors   = 0;
+        pxPipe->Deferred = 0;
+        pxPipe->Status   = USB_PIPE_BUSY;
+
+        /* Periodic pipes are started at the next frame */
+        USB_prvHostSchedule(pxHost, 0);
+        eResult = XPD_OK;
     }
-    return eSpeed;
+
+    XPD_EXIT_CRITICAL(pxHost);
+
+    return eResult;
 }
 
 /**
- * @brief Configure peripheral FIFO allocation for endpoints
- *        after device initialization and before starting the USB operation.
- * @param pxUSB: pointer to the USB handle structure
+ * @brief Submits a control transfer on a control pipe.
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxPipe: pointer to the pipe structure
+ * @param pucSetup: pointer to the 8 byte setup packet, has to remain valid until completion
+ * @param pucData: pointer to the data stage buffer of the setup's wLength size
+ * @return BUSY if the pipe has an ongoing transfer, OK if the transfer is scheduled
  */
-__weak void USB_vAllocateEPs(USB_HandleType * pxUSB)
+XPD_ReturnType USB_ePipeControl(USB_HostHandleType * pxHost, USB_PipeType * pxPipe,
+        const uint8_t * pucSetup, uint8_t * pucData)
 {
-    XPD_ReturnType eResult = XPD_OK;
-    uint8_t ucEpNum;
-    uint8_t ucEpCount = USB_ENDPOINT_COUNT(pxUSB);
-    uint32_t ulMinFifoSizeVal = 16;
-    uint32_t ulFifoSize = ulMinFifoSizeVal * sizeof(uint32_t);
-    uint32_t ulFifoOffset;
-    uint32_t ulFifoLimit = USB_TOTAL_FIFO_SIZE(pxUSB);
+    XPD_ReturnType eResult = XPD_BUSY;
 
-    /* Configure the global Receive FIFO based on the largest requested OUT EP size */
-    for (ucEpNum = 0; ucEpNum < ucEpCount; ucEpNum++)
+    XPD_ENTER_CRITICAL(pxHost);
+
+    if (pxPipe->Status != USB_PIPE_BUSY)
     {
-        if (pxUSB->EP.OUT[ucEpNum].MaxPacketSize > ulFifoSize)
-        {
-            ulFifoSize = pxUSB->EP.OUT[ucEpNum].MaxPacketSize;
-        }
+        pxPipe->Setup = pucSetup;
+        pxPipe->Transfer.Data     = pucData;
+        pxPipe->Transfer.Length   = USB_SETUP_LENGTH(pucSetup);
+        pxPipe->Transfer.Progress = 0;
+        pxPipe->Stage    = USB_STAGE_SETUP;
+        pxPipe->Errors   = 0;
+        pxPipe->Deferred = 0;
+        pxPipe->Status   = USB_PIPE_BUSY;
+
+        USB_prvHostSchedule(pxHost, 0);
+        eResult = XPD_OK;
     }
 
-    /* FIFO sizes are in words */
-    ulFifoSize = (ulFifoSize + 3) >> 2;
+    XPD_EXIT_CRITICAL(pxHost);
 
-    /* Global RX FIFO according to trial and error, thanks to defective documentation */
-    ulFifoOffset = 11           /* to receive SETUP packets on the control endpoint */
-            + (ulFifoSize + 1)  /* each packet gets status info as well */
-            + (ucEpCount * 2)   /* transfer complete status is also stored with the last packet */
-            + 1;                /* for Global OUT NAK */
-    pxUSB->Inst->GRXFSIZ = ulFifoOffset;
-
-    /* EP0 TX FIFO */
-    ulFifoSize = (pxUSB->EP.IN[0].MaxPacketSize + 3) >> 2;
-    if (ulFifoSize < ulMinFifoSizeVal)
-    {   ulFifoSize = ulMinFifoSizeVal; }
+    return eResult;
+}
 
-    pxUSB->Inst->DIEPTXF0_HNPTXFSIZ.w =
-            (ulFifoSize   << USB_OTG_DIEPTXF_INEPTXFD_Pos) |
-            (ulFifoOffset << USB_OTG_DIEPTXF_INEPTXSA_Pos);
+/**
+ * @brief Cancels the ongoing transfer of the pipe without completion callback.
+ * @param pxHost: pointer to the USB host handle structure
+ * @param pxPipe: pointer to the pipe structure
+ */
+void USB_vPipeCancel(USB_HostHandleType * pxHost, USB_PipeType * pxPipe)
+{
+    XPD_ENTER_CRITICAL(pxHost);
 
-    for (ucEpNum = 1; ucEpNum < ucEpCount; ucEpNum++)
+    if (pxPipe->Status == USB_PIPE_BUSY)
     {
-        /* Increase offset with the FIFO size */
-        ulFifoOffset += ulFifoSize;
-
-        /* FIFO sizes are in words */
-        ulFifoSize = (pxUSB->EP.IN[ucEpNum].MaxPacketSize + 3) >> 2;
-        if (ulFifoSize < ulMinFifoSizeVal)
-        {   ulFifoSize = ulMinFifoSizeVal; }
+        pxPipe->Status = USB_PIPE_IDLE;
 
-        /* EPx TX FIFOs */
-        pxUSB->Inst->DIEPTXF[ucEpNum - 1].w =
-                (ulFifoSize   << USB_OTG_DIEPTXF_INEPTXFD_Pos) |
-                (ulFifoOffset << USB_OTG_DIEPTXF_INEPTXSA_Pos);
-    }
-
-    /* Total FIFO use shouldn't exceed available size */
-    if (ulFifoLimit < (ulFifoOffset + ulFifoSize))
-    {
-        eResult = XPD_ERROR;
+        /* The pipe is detached from its channel right away,
+         * so it can be resubmitted or closed before the channel halts */
+        if (pxPipe->Channel != USB_NO_CHANNEL)
+        {
+            USB_prvChannelCancel(pxHost, pxPipe->Channel);
+        }
     }
 
-    (void) eResult;
+    XPD_EXIT_CRITICAL(pxHost);
 }
 
 /** @} */
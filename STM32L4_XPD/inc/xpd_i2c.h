@@ -31,6 +31,7 @@ extern "C"
 #include <xpd_common.h>
 #include <xpd_dma.h>
 #include <xpd_rcc.h>
+#include <xpd_tim.h>
 
 /** @defgroup I2C
  * @{ */
@@ -103,14 +104,36 @@ typedef struct
     uint16_t Length;    /*!< The desired length of the data transfer */
 }I2C_TransferType;
 
+/** @brief I2C slave register region access types */
+typedef enum
+{
+    I2C_REGION_READ_ONLY  = 0, /*!< The master can only read the region */
+    I2C_REGION_READ_WRITE = 1, /*!< The master can read and write the region */
+}I2C_RegionAccessType;
+
+/** @brief I2C slave register map region */
+typedef struct
+{
+    uint8_t * Bank[2];                  /*!< Memory of the region. When the second bank is set,
+                                             the region is double buffered: the master always reads
+                                             a complete published bank, while the application
+                                             updates the other one. Double buffered regions are read-only. */
+    uint16_t Address;                   /*!< The first register address of the region */
+    uint16_t Size;                      /*!< The size of the region in bytes */
+    I2C_RegionAccessType Access;        /*!< Access rights of the master */
+    volatile uint8_t Front;             /*!< [Internal] Index of the bank served to the master */
+    volatile uint8_t Pending;           /*!< [Internal] Bank swap deferred until the ongoing read ends */
+}I2C_RegionType;
+
 /** @brief I2C setup structure */
 typedef struct
 {
-    uint32_t BusFreq_Hz;                    /*!< Desired I2C bus frequency [Hz] */
+    uint32_t BusFreq_Hz;                    /*!< Desired I2C bus frequency [Hz], up to 1 MHz (Fast-mode Plus
+                                                 also requires the Fm+ drive of the pins to be enabled) */
     union {
     struct {
-    uint16_t : 4;
-    uint16_t : 1;
+    uint16_t DigitalFilter : 4;             /*!< Digital noise filter length in kernel clock periods (0 to disable) */
+    FunctionalState NoAnalogFilter : 1;     /*!< Disable the analog noise filter */
     I2C_AddressModeType AddressingMode : 1; /*!< Global addressing mode */
     uint16_t : 3;
     FunctionalState NoStretch : 1;          /*!< [Slave] Do not stretch SCL low when waiting for software
@@ -143,6 +166,8 @@ typedef struct
         };
         uint16_t wValue;
     }OwnAddress2;                   /*!< [Slave] The module's secondary address, only used with 7 bit addressing */
+    uint16_t RiseTime_ns;           /*!< SDA and SCL rise time of the bus [ns] */
+    uint16_t FallTime_ns;           /*!< SDA and SCL fall time of the bus [ns] */
 }I2C_InitType;
 
 /** @brief I2C Handle structure */
@@ -169,8 +194,30 @@ typedef struct
         const I2C_TransferType * pMaster;       /*!< Current master mode transfer */
         I2C_TransferType Slave;                 /*!< Slave mode transfer */
     }Transfers;                                 /*   Current transfer references */
+    struct {
+        I2C_ErrorType * pStatus;                /*!< Status of the remaining transfers of the batch */
+        uint16_t Count;                         /*!< Number of remaining transfers of the batch */
+    }Batch;                                     /*   Master transfer batch context */
+    struct {
+        I2C_RegionType * Regions;               /*!< Regions of the slave register map */
+        I2C_RegionType * pActive;               /*!< The region at the register pointer (NULL if unmapped) */
+        I2C_RegionType * pReading;              /*!< The region whose front bank is being read */
+        I2C_RegionType * pArmed;                /*!< [Internal] Region of the preloaded read */
+        uint16_t Address;                       /*!< Register pointer */
+        uint16_t ArmedAddress;                  /*!< [Internal] Register pointer of the preloaded read */
+        uint8_t Count;                          /*!< Number of regions */
+        uint8_t AddressSize;                    /*!< Size of the register address in bytes */
+        uint8_t Armed;                          /*!< [Internal] The read is preloaded */
+    }RegMap;                                    /*   Slave register map context */
+    struct {
+        TIM_HandleType * pTIM;                  /*!< Timer pacing the polling */
+        uint32_t Start;                         /*!< [Internal] CR2 value starting the polling sequence */
+        volatile uint32_t Sequence;             /*!< Number of published samples */
+        volatile uint8_t Front;                 /*!< Index of the published sample buffer */
+    }Poll;                                      /*   Timed polling context */
     DataStreamType Stream;                      /*!< Data transfer management */
     uint16_t DataCtrlBits;                      /*!< Data stage control bits to use */
+    uint32_t BusFreq_Hz;                        /*!< The bus frequency achieved by the configured timing [Hz] */
     RCC_PositionType CtrlPos;                   /*!< Relative position for reset and clock control */
     volatile I2C_ErrorType Errors;              /*!< Transfer errors */
 }I2C_HandleType;
@@ -344,6 +391,14 @@ XPD_ReturnType  I2C_eMasterTransfer         (I2C_HandleType * pxI2C, const I2C_T
                                              uint32_t ulTimeout);
 void            I2C_vMasterTransfer_IT      (I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer);
 XPD_ReturnType  I2C_eMasterTransfer_DMA     (I2C_HandleType * pxI2C, const I2C_TransferType * pxTransfer);
+
+XPD_ReturnType  I2C_eMasterBatch_DMA        (I2C_HandleType * pxI2C, const I2C_TransferType * paxTransfers,
+                                             uint16_t usCount, I2C_ErrorType * paeStatus);
+
+XPD_ReturnType  I2C_ePollStart_DMA          (I2C_HandleType * pxI2C, TIM_HandleType * pxTIM,
+                                             const I2C_TransferType * pxTransfer);
+void            I2C_vPollStop_DMA           (I2C_HandleType * pxI2C);
+uint32_t        I2C_ulPollSnapshot          (I2C_HandleType * pxI2C, uint8_t * pucData);
 /** @} */
 
 /** @addtogroup I2C_Slave_Exported_Functions
@@ -370,6 +425,37 @@ __STATIC_INLINE I2C_TransferType * I2C_pxSlaveTransferInfo(I2C_HandleType * pxI2
 
 /** @} */
 
+/** @addtogroup I2C_RegMap_Exported_Functions
+ * @{ */
+XPD_ReturnType  I2C_eSlaveRegMap_IT         (I2C_HandleType * pxI2C, I2C_RegionType * paxRegions,
+                                             uint8_t ucCount, uint8_t ucAddressSize);
+
+void            I2C_vRegionPublish          (I2C_HandleType * pxI2C, I2C_RegionType * pxRegion);
+
+/**
+ * @brief Returns the region memory which the application can update without disturbing the master.
+ * @param pxRegion: pointer to the register region
+ * @return The back bank of a double buffered region, the memory of a single buffered region,
+ *         or NULL if the back bank is still waiting to be published
+ */
+__STATIC_INLINE uint8_t * I2C_pucRegionBackBank(I2C_RegionType * pxRegion)
+{
+    if (pxRegion->Bank[1] == NULL)
+    {
+        return pxRegion->Bank[0];
+    }
+    else if (pxRegion->Pending != 0)
+    {
+        return NULL;
+    }
+    else
+    {
+        return pxRegion->Bank[pxRegion->Front ^ 1];
+    }
+}
+
+/** @} */
+
 /** @} */
 
 #define XPD_I2C_API
@@ -30,7 +30,9 @@ extern "C"
 
 #include <xpd_common.h>
 #include <xpd_dma.h>
+#include <xpd_gpio.h>
 #include <xpd_rcc.h>
+#include <xpd_tim.h>
 
 /** @defgroup SPI
  * @{ */
@@ -133,6 +135,9 @@ typedef struct
     }DMA;                                    /*   DMA handle references */
     DataStreamType RxStream;                 /*!< Data reception stream */
     DataStreamType TxStream;                 /*!< Data transmission stream */
+    DataStreamType FrameStream;              /*!< Last received frame in the circular buffer (slave streaming) */
+    DataStreamType ReplyStream;              /*!< Reply data armed for the next frame (slave streaming) */
+    uint32_t CSControl[2];                   /*!< [Internal] Chip select assert and release values (timed sampling) */
     RCC_PositionType CtrlPos;                /*!< Relative position for reset and clock control */
 #if defined(__XPD_SPI_ERROR_DETECT) || defined(__XPD_DMA_ERROR_DETECT)
     volatile SPI_ErrorType Errors;           /*!< Transfer errors */
@@ -322,6 +327,30 @@ XPD_ReturnType  SPI_eSendReceive_DMA    (SPI_HandleType * pxSPI,
                                          uint16_t usLength);
 
 void            SPI_vStop_DMA           (SPI_HandleType * pxSPI);
+
+
+XPD_ReturnType  SPI_eSlaveStreamStart_DMA(SPI_HandleType * pxSPI,
+                                         void * pvRxRing,
+                                         uint16_t usRingLength,
+                                         void * pvTxData,
+                                         uint16_t usTxLength);
+
+void            SPI_vSlaveStreamReply   (SPI_HandleType * pxSPI,
+                                         void * pvTxData,
+                                         uint16_t usTxLength);
+
+void            SPI_vSlaveStreamIRQHandler(SPI_HandleType * pxSPI);
+
+
+XPD_ReturnType  SPI_eTimedReceive_DMA   (SPI_HandleType * pxSPI,
+                                         TIM_HandleType * pxTIM,
+                                         GPIO_PinType eChipSelect,
+                                         void * pvRxData,
+                                         uint16_t usLength,
+                                         uint8_t ucFrames);
+
+void            SPI_vTimedStop_DMA      (SPI_HandleType * pxSPI,
+                                         TIM_HandleType * pxTIM);
 /** @} */
 
 /** @} */
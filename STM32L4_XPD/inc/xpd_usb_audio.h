@@ -0,0 +1,133 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_audio.h
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-08-04
+  * @brief   STM32 eXtensible Peripheral Drivers USB Audio Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#ifndef __XPD_USB_AUDIO_H_
+#define __XPD_USB_AUDIO_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <xpd_common.h>
+#include <xpd_usb.h>
+#include <xpd_dma.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/** @ingroup USB
+ * @defgroup USB_Audio USB Audio
+ * @brief    Asynchronous Audio Class 1.0 / 2.0 speaker stream with explicit feedback
+ * @{ */
+
+/** @defgroup USB_Audio_Exported_Types USB Audio Exported Types
+ * @{ */
+
+#ifndef USB_AUDIO_MAX_PACKET_SIZE
+#if defined(USB_OTG_HS)
+#define USB_AUDIO_MAX_PACKET_SIZE   1024 /*!< Largest supported isochronous packet size */
+#else
+#define USB_AUDIO_MAX_PACKET_SIZE   1023 /*!< Largest supported isochronous packet size */
+#endif
+#endif
+#ifndef USB_AUDIO_MAX_SAMPLE_RATES
+#define USB_AUDIO_MAX_SAMPLE_RATES  4    /*!< Largest number of selectable sample rates */
+#endif
+#ifndef USB_AUDIO_FEEDBACK_FRAMES
+#define USB_AUDIO_FEEDBACK_FRAMES   16   /*!< Number of (micro)frames of a clock measurement */
+#endif
+
+/** @brief Audio function structure */
+typedef struct
+{
+    USB_HandleType *      pUSB;             /*!< USB handle of the device */
+    DMA_HandleType *      pDMA;             /*!< Circular mode memory to peripheral DMA stream
+                                                 of the codec interface */
+    void *                PeriphAddress;    /*!< Data register address of the codec interface */
+    uint8_t               OutEpAddress;     /*!< Isochronous OUT (host to device) data endpoint address */
+    uint8_t               FeedbackEpAddress;/*!< Isochronous IN feedback endpoint address */
+    uint16_t              MaxPacketSize;    /*!< Data endpoint packet size [.. USB_AUDIO_MAX_PACKET_SIZE] */
+    uint8_t               Version;          /*!< Audio Device Class version: 1 or 2 */
+    uint8_t               ClockSourceId;    /*!< Entity ID of the clock source for version 2 */
+    uint8_t               FrameSize;        /*!< Size of a sample of all channels [bytes] */
+    uint8_t               DmaWidth;         /*!< Size of a DMA data item [bytes] */
+    uint16_t              MclkRatio;        /*!< Codec master clock to sample rate ratio */
+    const uint32_t *      SampleRates;      /*!< Selectable sample rates [Hz] */
+    uint8_t               SampleRateCount;  /*!< Number of selectable sample rates
+                                                 [1 .. USB_AUDIO_MAX_SAMPLE_RATES] */
+    uint8_t *             Buffer;           /*!< Audio ring storage */
+    uint32_t              Size;             /*!< Size of the ring, has to be a multiple of
+                                                 FrameSize and DmaWidth, and larger than
+                                                 4 times the MaxPacketSize */
+    struct {
+        XPD_HandleCallbackType SampleRate;  /*!< The host has changed the SampleRate */
+    } Callbacks;                            /*   Function Callbacks */
+    uint32_t              SampleRate;       /*!< Current sample rate [Hz] */
+    uint16_t              Underruns;        /*!< Number of times the codec has consumed the whole ring */
+    uint16_t              Overruns;         /*!< Number of packets dropped due to a full ring */
+    uint32_t              Head;             /*!< [Internal] Write index of the ring */
+    uint32_t              Feedback;         /*!< [Internal] Current rate feedback value */
+    uint32_t              CaptureSum;       /*!< [Internal] Master clock cycles of the measurement */
+    uint16_t              LastCapture;      /*!< [Internal] Timer capture at the previous SOF */
+    uint8_t               Frames;           /*!< [Internal] Number of (micro)frames of the measurement */
+    uint8_t               FracBits;         /*!< [Internal] Fraction bits of the feedback format */
+    volatile uint8_t      Streaming;        /*!< [Internal] Set while the data endpoint is open */
+    uint8_t               Running;          /*!< [Internal] Codec DMA state: 0 - prefilling the ring,
+                                                 1 - running, 2 - stopped by an underrun */
+    uint8_t               Captured;         /*!< [Internal] Set when LastCapture is valid */
+    uint8_t               Staged;           /*!< [Internal] OUT packet destination:
+                                                 0 - ring, 1 - Packet buffer, 2 - dropped */
+    volatile uint8_t      FeedbackBusy;     /*!< [Internal] Set while the feedback is being sent */
+    uint32_t              FeedbackData;     /*!< [Internal] Feedback endpoint packet buffer */
+    uint32_t              Control[(2 + 12 * USB_AUDIO_MAX_SAMPLE_RATES + 3) / sizeof(uint32_t)];
+                                            /*!< [Internal] Control request data buffer */
+    uint32_t              Packet[(USB_AUDIO_MAX_PACKET_SIZE + 3) / sizeof(uint32_t)];
+                                            /*!< [Internal] Buffer of OUT packets crossing the ring end */
+}USB_AudioType;
+
+/** @} */
+
+/** @addtogroup USB_Audio_Exported_Functions
+ * @{ */
+XPD_ReturnType  USB_eAudioInit          (USB_AudioType * pxAudio);
+void            USB_vAudioStart         (USB_AudioType * pxAudio);
+void            USB_vAudioStop          (USB_AudioType * pxAudio);
+
+XPD_ReturnType  USB_eAudioSetupRequest  (USB_AudioType * pxAudio, const uint8_t * pucSetup,
+                                         uint8_t ** ppucData, uint16_t * pusLength);
+void            USB_vAudioSetupData     (USB_AudioType * pxAudio, const uint8_t * pucSetup);
+
+void            USB_vAudioSofCapture    (USB_AudioType * pxAudio, uint16_t usCapture);
+
+void            USB_vAudioDataIn        (USB_AudioType * pxAudio);
+void            USB_vAudioDataOut       (USB_AudioType * pxAudio, USB_EndPointHandleType * pxEP);
+/** @} */
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XPD_USB_AUDIO_H_ */
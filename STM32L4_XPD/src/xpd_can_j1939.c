@@ -0,0 +1,967 @@
+/**
+  ******************************************************************************
+  * @file    xpd_can_j1939.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-02
+  * @brief   STM32 eXtensible Peripheral Drivers CAN J1939 Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_can_j1939.h>
+#include <xpd_utils.h>
+
+#if defined(CAN) || defined(CAN1)
+
+/* Network management and transport protocol PGNs */
+#define J1939_PGN_REQUEST       0x0EA00
+#define J1939_PGN_TP_DT         0x0EB00
+#define J1939_PGN_TP_CM         0x0EC00
+#define J1939_PGN_ADDRESS_CLAIM 0x0EE00
+
+/* Connection management control bytes */
+#define J1939_CM_RTS            16
+#define J1939_CM_CTS            17
+#define J1939_CM_EOMA           19
+#define J1939_CM_BAM            32
+#define J1939_CM_ABORT          255
+
+/* Connection abort reasons */
+#define J1939_ABORT_NONE        0
+#define J1939_ABORT_RESOURCES   2
+#define J1939_ABORT_TIMEOUT     3
+#define J1939_ABORT_CTS_IN_DATA 4
+#define J1939_ABORT_BAD_SEQ     7
+
+/* Session states */
+#define J1939_IDLE              0
+#define J1939_TX_BAM            1
+#define J1939_TX_WAIT_CTS       2
+#define J1939_TX_SEND           3
+#define J1939_RX_BAM            4
+#define J1939_RX_RTS            5
+
+/* Priorities of the protocol messages */
+#define J1939_PRIORITY_CLAIM    6
+#define J1939_PRIORITY_TP       7
+
+/* Self-configurable address range */
+#define J1939_ADDRESS_DYNAMIC_FIRST 128
+#define J1939_ADDRESS_DYNAMIC_LAST  247
+
+/* the first tick period is partial */
+#define J1939_TICKS(MS)         ((((MS) + CAN_J1939_TICK_ms - 1) / CAN_J1939_TICK_ms) + 1)
+
+#define J1939_BAM_TICKS         J1939_TICKS(50)
+#define J1939_CLAIM_TICKS       J1939_TICKS(250)
+#define J1939_T1_TICKS          J1939_TICKS(750)
+#define J1939_T2_TICKS          J1939_TICKS(1250)
+#define J1939_T3_TICKS          J1939_TICKS(1250)
+#define J1939_T4_TICKS          J1939_TICKS(1050)
+
+#define J1939_PACKET_COUNT(LEN) (((LEN) + 6) / 7)
+
+/** @defgroup CAN_J1939_Private_Functions CAN J1939 Private Functions
+ * @{ */
+
+/**
+ * @brief Queues a frame of the layer for transmission.
+ * @param pxJ: pointer to the J1939 layer
+ * @param ucPriority: the frame priority
+ * @param ulPGN: the Parameter Group Number of the frame
+ * @param ucDestination: the destination address (only used by PDU1 format PGNs)
+ * @param pucData: pointer to the frame data
+ * @param ucLength: the frame data length
+ * @return BUSY if the transmit queue is full, OK if the frame is queued
+ */
+static XPD_ReturnType CAN_prvJ1939Post(CAN_J1939Type * pxJ, uint8_t ucPriority, uint32_t ulPGN,
+        uint8_t ucDestination, const uint8_t * pucData, uint8_t ucLength)
+{
+    CAN_FrameType xFrame;
+    uint8_t i;
+
+    /* the PDU specific field of PDU1 format PGNs is the destination address */
+    if (((ulPGN >> 8) & 0xFF) < 240)
+    {
+        ulPGN = (ulPGN & 0x3FF00) | ucDestination;
+    }
+    xFrame.Id.Value = ((uint32_t)ucPriority << 26) | (ulPGN << 8) | pxJ->Address;
+    xFrame.Id.Type  = CAN_IDTYPE_EXT_DATA;
+    xFrame.DLC      = ucLength;
+
+    for (i = 0; i < ucLength; i++)
+    {
+        xFrame.Data.Byte[i] = pucData[i];
+    }
+
+    return CAN_eEnqueue_IT(pxJ->pCAN, &xFrame);
+}
+
+/**
+ * @brief Sends a connection management frame.
+ * @param pxJ: pointer to the J1939 layer
+ * @param ucDestination: the destination address
+ * @param aucData: the frame data with the first 5 bytes set
+ * @param ulPGN: the PGN of the transported message
+ * @return BUSY if the transmit queue is full, OK if the frame is queued
+ */
+static XPD_ReturnType CAN_prvJ1939Control(CAN_J1939Type * pxJ, uint8_t ucDestination,
+        uint8_t aucData[8], uint32_t ulPGN)
+{
+    aucData[5] = ulPGN;
+    aucData[6] = ulPGN >> 8;
+    aucData[7] = ulPGN >> 16;
+
+    return CAN_prvJ1939Post(pxJ, J1939_PRIORITY_TP, J1939_PGN_TP_CM, ucDestination, aucData, 8);
+}
+
+/**
+ * @brief Sends a connection abort frame.
+ * @param pxJ: pointer to the J1939 layer
+ * @param ucDestination: the destination address
+ * @param ucReason: the abort reason
+ * @param ulPGN: the PGN of the transported message
+ */
+static void CAN_prvJ1939Abort(CAN_J1939Type * pxJ, uint8_t ucDestination, uint8_t ucReason,
+        uint32_t ulPGN)
+{
+    uint8_t aucData[8] = { J1939_CM_ABORT, ucReason, 0xFF, 0xFF, 0xFF };
+
+    (void) CAN_prvJ1939Control(pxJ, ucDestination, aucData, ulPGN);
+}
+
+/**
+ * @brief Sends the address claim of the layer.
+ * @param pxJ: pointer to the J1939 layer
+ */
+static void CAN_prvJ1939SendClaim(CAN_J1939Type * pxJ)
+{
+    (void) CAN_prvJ1939Post(pxJ, J1939_PRIORITY_CLAIM, J1939_PGN_ADDRESS_CLAIM,
+            CAN_J1939_ADDRESS_GLOBAL, pxJ->Name, 8);
+}
+
+/**
+ * @brief Passes a received message to the callback of its PGN dispatch table entry.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxMessage: pointer to the received message
+ * @param ucEntry: the dispatch table entry selected by the acceptance filter
+ */
+static void CAN_prvJ1939Dispatch(CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage,
+        uint8_t ucEntry)
+{
+    /* search the table when the filter didn't select the entry */
+    if ((ucEntry >= pxJ->PgnCount) || (pxJ->Pgns[ucEntry].PGN != pxMessage->PGN))
+    {
+        for (ucEntry = 0; ucEntry < pxJ->PgnCount; ucEntry++)
+        {
+            if (pxJ->Pgns[ucEntry].PGN == pxMessage->PGN)
+            {
+                break;
+            }
+        }
+    }
+
+    if (ucEntry < pxJ->PgnCount)
+    {
+        XPD_SAFE_CALLBACK(pxJ->Pgns[ucEntry].Callback, (void*)pxMessage);
+    }
+}
+
+/**
+ * @brief Finds the ongoing session of a connection.
+ * @param pxJ: pointer to the J1939 layer
+ * @param ucRx: set for reception, 0 for transmission sessions
+ * @param ucPeer: the address of the remote node
+ * @param ucBroadcast: set for broadcast, 0 for destination specific sessions
+ * @return Pointer to the session, or NULL if the connection isn't open
+ */
+static CAN_J1939SessionType * CAN_prvJ1939Find(CAN_J1939Type * pxJ, uint8_t ucRx,
+        uint8_t ucPeer, uint8_t ucBroadcast)
+{
+    CAN_J1939SessionType * pxSession = NULL;
+    uint8_t ucIndex;
+
+    for (ucIndex = 0; ucIndex < pxJ->SessionCount; ucIndex++)
+    {
+        CAN_J1939SessionType * pxCurrent = &pxJ->Sessions[ucIndex];
+        uint8_t ucState = pxCurrent->State;
+        uint8_t ucSessionPeer = (ucRx != 0) ?
+                pxCurrent->Message.Source : pxCurrent->Message.Destination;
+
+        if ((ucState != J1939_IDLE)
+         && ((ucState >= J1939_RX_BAM) == (ucRx != 0))
+         && (ucSessionPeer == ucPeer)
+         && ((pxCurrent->Message.Destination == CAN_J1939_ADDRESS_GLOBAL) == (ucBroadcast != 0)))
+        {
+            pxSession = pxCurrent;
+            break;
+        }
+    }
+    return pxSession;
+}
+
+/**
+ * @brief Selects an idle session for a new connection.
+ * @param pxJ: pointer to the J1939 layer
+ * @param ucRx: set for reception, 0 for transmission sessions
+ * @param usLength: the length of the transported message
+ * @return Pointer to the session, or NULL if no suitable session is available
+ */
+static CAN_J1939SessionType * CAN_prvJ1939Allocate(CAN_J1939Type * pxJ, uint8_t ucRx,
+        uint16_t usLength)
+{
+    CAN_J1939SessionType * pxSession = NULL;
+    uint8_t ucIndex;
+
+    for (ucIndex = 0; ucIndex < pxJ->SessionCount; ucIndex++)
+    {
+        CAN_J1939SessionType * pxCurrent = &pxJ->Sessions[ucIndex];
+
+        if (pxCurrent->State != J1939_IDLE)
+        {
+        }
+        else if (ucRx != 0)
+        {
+            if ((pxCurrent->Buffer != NULL) && (pxCurrent->Size >= usLength))
+            {
+                pxSession = pxCurrent;
+                break;
+            }
+        }
+        else if (pxCurrent->Buffer == NULL)
+        {
+            /* transmit only sessions are preferred for transmission */
+            pxSession = pxCurrent;
+            break;
+        }
+        else if (pxSession == NULL)
+        {
+            pxSession = pxCurrent;
+        }
+        else {}
+    }
+    return pxSession;
+}
+
+/**
+ * @brief Terminates the session with an error.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxSession: pointer to the session
+ * @param ucReason: the abort reason to send to the peer, J1939_ABORT_NONE for silent termination
+ */
+static void CAN_prvJ1939Fail(CAN_J1939Type * pxJ, CAN_J1939SessionType * pxSession,
+        uint8_t ucReason)
+{
+    uint8_t ucPeer = (pxSession->State >= J1939_RX_BAM) ?
+            pxSession->Message.Source : pxSession->Message.Destination;
+
+    /* broadcasts are never aborted on the bus */
+    if ((ucReason != J1939_ABORT_NONE) && (pxSession->Message.Destination != CAN_J1939_ADDRESS_GLOBAL))
+    {
+        CAN_prvJ1939Abort(pxJ, ucPeer, ucReason, pxSession->Message.PGN);
+    }
+
+    pxSession->State = J1939_IDLE;
+    pxSession->Timer = 0;
+
+    XPD_SAFE_CALLBACK(pxJ->Callbacks.Error, &pxSession->Message);
+}
+
+/**
+ * @brief Requests the next packet window of the received message.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxSession: pointer to the session
+ */
+static void CAN_prvJ1939ClearToSend(CAN_J1939Type * pxJ, CAN_J1939SessionType * pxSession)
+{
+    uint8_t aucData[8];
+    uint8_t ucCount = pxSession->Packets - pxSession->Next + 1;
+
+    if (ucCount > CAN_J1939_CTS_PACKETS)
+    {
+        ucCount = CAN_J1939_CTS_PACKETS;
+    }
+    if (ucCount > pxSession->MaxWindow)
+    {
+        ucCount = pxSession->MaxWindow;
+    }
+    pxSession->WindowEnd = pxSession->Next + ucCount - 1;
+    pxSession->Timer     = J1939_T2_TICKS;
+
+    aucData[0] = J1939_CM_CTS;
+    aucData[1] = ucCount;
+    aucData[2] = pxSession->Next;
+    aucData[3] = 0xFF;
+    aucData[4] = 0xFF;
+
+    (void) CAN_prvJ1939Control(pxJ, pxSession->Message.Source, aucData, pxSession->Message.PGN);
+}
+
+/**
+ * @brief Sends the data packets of the session which are due.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxSession: pointer to the session
+ */
+static void CAN_prvJ1939TxData(CAN_J1939Type * pxJ, CAN_J1939SessionType * pxSession)
+{
+    uint8_t aucData[8], ucSent, i;
+
+    do
+    {
+        uint16_t usOffset = (uint16_t)(pxSession->Next - 1) * 7;
+
+        aucData[0] = pxSession->Next;
+        for (i = 0; i < 7; i++, usOffset++)
+        {
+            aucData[1 + i] = (usOffset < pxSession->Message.Length) ?
+                    pxSession->Message.Data[usOffset] : 0xFF;
+        }
+
+        if (CAN_prvJ1939Post(pxJ, J1939_PRIORITY_TP, J1939_PGN_TP_DT,
+                pxSession->Message.Destination, aucData, 8) != XPD_OK)
+        {
+            /* transmit queue is full, retry on the next tick */
+            pxSession->Timer = 1;
+            return;
+        }
+        ucSent = pxSession->Next++;
+    }
+    /* the packets of a CTS window are sent back-to-back */
+    while ((pxSession->State == J1939_TX_SEND) && (ucSent < pxSession->WindowEnd));
+
+    if (pxSession->State == J1939_TX_SEND)
+    {
+        /* wait for the next CTS or the end of message acknowledgement */
+        pxSession->State = J1939_TX_WAIT_CTS;
+        pxSession->Timer = J1939_T3_TICKS;
+    }
+    else if (ucSent < pxSession->Packets)
+    {
+        pxSession->Timer = J1939_BAM_TICKS;
+    }
+    else
+    {
+        /* broadcast is complete */
+        pxSession->State = J1939_IDLE;
+        pxSession->Timer = 0;
+
+        XPD_SAFE_CALLBACK(pxJ->Callbacks.Transmit, &pxSession->Message);
+    }
+}
+
+/**
+ * @brief Processes a received data transfer packet.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxMessage: pointer to the received frame's message
+ */
+static void CAN_prvJ1939RxData(CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage)
+{
+    CAN_J1939SessionType * pxSession = CAN_prvJ1939Find(pxJ, 1, pxMessage->Source,
+            pxMessage->Destination == CAN_J1939_ADDRESS_GLOBAL);
+    uint8_t ucSeq = pxMessage->Data[0], i;
+
+    if ((pxSession == NULL) || (pxMessage->Length < 8) || (ucSeq < pxSession->Next))
+    {
+        /* unexpected or duplicate packets are ignored */
+    }
+    else if ((ucSeq != pxSession->Next) || ((pxSession->State == J1939_RX_RTS)
+          && (ucSeq > pxSession->WindowEnd)))
+    {
+        CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_BAD_SEQ);
+    }
+    else
+    {
+        uint8_t * pucBuffer = pxSession->Buffer;
+
+        for (i = 1; (i < 8) && (pxSession->Offset < pxSession->Message.Length); i++)
+        {
+            pucBuffer[pxSession->Offset++] = pxMessage->Data[i];
+        }
+        pxSession->Next++;
+
+        if (pxSession->Offset == pxSession->Message.Length)
+        {
+            if (pxSession->State == J1939_RX_RTS)
+            {
+                uint8_t aucData[8];
+
+                aucData[0] = J1939_CM_EOMA;
+                aucData[1] = pxSession->Message.Length;
+                aucData[2] = pxSession->Message.Length >> 8;
+                aucData[3] = pxSession->Packets;
+                aucData[4] = 0xFF;
+
+                (void) CAN_prvJ1939Control(pxJ, pxSession->Message.Source, aucData,
+                        pxSession->Message.PGN);
+            }
+            pxSession->State = J1939_IDLE;
+            pxSession->Timer = 0;
+
+            CAN_prvJ1939Dispatch(pxJ, &pxSession->Message, CAN_FILTER_TAG_NONE);
+        }
+        else if ((pxSession->State == J1939_RX_RTS) && (pxSession->Next > pxSession->WindowEnd))
+        {
+            CAN_prvJ1939ClearToSend(pxJ, pxSession);
+        }
+        else
+        {
+            pxSession->Timer = J1939_T1_TICKS;
+        }
+    }
+}
+
+/**
+ * @brief Opens a reception session for an announced message.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxMessage: pointer to the received frame's message
+ * @param ulPGN: the PGN of the announced message
+ */
+static void CAN_prvJ1939RxOpen(CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage,
+        uint32_t ulPGN)
+{
+    const uint8_t * pucData = pxMessage->Data;
+    uint8_t ucBroadcast = pucData[0] == J1939_CM_BAM;
+    uint16_t usLength = pucData[1] | ((uint16_t)pucData[2] << 8);
+    CAN_J1939SessionType * pxSession;
+
+    /* BAM is only valid as broadcast, RTS only as destination specific */
+    if (ucBroadcast != (pxMessage->Destination == CAN_J1939_ADDRESS_GLOBAL))
+    {
+        return;
+    }
+
+    /* a new announcement replaces the ongoing transfer of the connection */
+    pxSession = CAN_prvJ1939Find(pxJ, 1, pxMessage->Source, ucBroadcast);
+    if (pxSession != NULL)
+    {
+        CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_NONE);
+    }
+
+    if ((usLength <= 8) || (usLength > CAN_J1939_MAX_LENGTH)
+     || (pucData[3] != J1939_PACKET_COUNT(usLength)))
+    {
+        /* invalid announcement */
+    }
+    else if ((pxSession = CAN_prvJ1939Allocate(pxJ, 1, usLength)) == NULL)
+    {
+        if (ucBroadcast == 0)
+        {
+            CAN_prvJ1939Abort(pxJ, pxMessage->Source, J1939_ABORT_RESOURCES, ulPGN);
+        }
+    }
+    else
+    {
+        pxSession->Message.Data        = pxSession->Buffer;
+        pxSession->Message.PGN         = ulPGN;
+        pxSession->Message.Length      = usLength;
+        pxSession->Message.Priority    = pxMessage->Priority;
+        pxSession->Message.Source      = pxMessage->Source;
+        pxSession->Message.Destination = pxMessage->Destination;
+        pxSession->Offset              = 0;
+        pxSession->Packets             = pucData[3];
+        pxSession->Next                = 1;
+
+        if (ucBroadcast != 0)
+        {
+            pxSession->State = J1939_RX_BAM;
+            pxSession->Timer = J1939_T1_TICKS;
+        }
+        else
+        {
+            /* 0 and 0xFF both mean no limit */
+            pxSession->MaxWindow = (pucData[4] != 0) ? pucData[4] : 0xFF;
+            pxSession->State     = J1939_RX_RTS;
+
+            CAN_prvJ1939ClearToSend(pxJ, pxSession);
+        }
+    }
+}
+
+/**
+ * @brief Processes a received connection management frame.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxMessage: pointer to the received frame's message
+ */
+static void CAN_prvJ1939Connection(CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage)
+{
+    const uint8_t * pucData = pxMessage->Data;
+    uint32_t ulPGN = pucData[5] | ((uint32_t)pucData[6] << 8) | ((uint32_t)pucData[7] << 16);
+    CAN_J1939SessionType * pxSession = NULL;
+
+    if (pxMessage->Length < 8)
+    {
+        return;
+    }
+
+    switch (pucData[0])
+    {
+        case J1939_CM_BAM:
+        case J1939_CM_RTS:
+            CAN_prvJ1939RxOpen(pxJ, pxMessage, ulPGN);
+            return;
+
+        case J1939_CM_ABORT:
+            /* the abort can target either direction of the connection */
+            pxSession = CAN_prvJ1939Find(pxJ, 1, pxMessage->Source, 0);
+            if ((pxSession == NULL) || (pxSession->Message.PGN != ulPGN))
+            {
+                pxSession = CAN_prvJ1939Find(pxJ, 0, pxMessage->Source, 0);
+            }
+            if ((pxSession != NULL) && (pxSession->Message.PGN == ulPGN))
+            {
+                CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_NONE);
+            }
+            return;
+
+        default:
+            break;
+    }
+
+    /* the rest are responses to a destination specific transmission */
+    pxSession = CAN_prvJ1939Find(pxJ, 0, pxMessage->Source, 0);
+    if ((pxSession == NULL) || (pxSession->Message.PGN != ulPGN))
+    {
+    }
+    else if (pucData[0] == J1939_CM_EOMA)
+    {
+        if (pxSession->State == J1939_TX_WAIT_CTS)
+        {
+            pxSession->State = J1939_IDLE;
+            pxSession->Timer = 0;
+
+            XPD_SAFE_CALLBACK(pxJ->Callbacks.Transmit, &pxSession->Message);
+        }
+    }
+    else if (pucData[0] == J1939_CM_CTS)
+    {
+        uint8_t ucCount = pucData[1], ucNext = pucData[2];
+
+        if (pxSession->State == J1939_TX_SEND)
+        {
+            CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_CTS_IN_DATA);
+        }
+        else if (ucCount == 0)
+        {
+            /* the receiver holds the connection open */
+            pxSession->Timer = J1939_T4_TICKS;
+        }
+        else if ((ucNext == 0) || (ucNext > pxSession->Packets)
+              || (ucCount > (pxSession->Packets - ucNext + 1)))
+        {
+            CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_BAD_SEQ);
+        }
+        else
+        {
+            pxSession->Next      = ucNext;
+            pxSession->WindowEnd = ucNext + ucCount - 1;
+            pxSession->State     = J1939_TX_SEND;
+
+            CAN_prvJ1939TxData(pxJ, pxSession);
+        }
+    }
+    else {}
+}
+
+/**
+ * @brief Resolves an address claim contention with another node.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pucName: the NAME of the contending node
+ */
+static void CAN_prvJ1939Contend(CAN_J1939Type * pxJ, const uint8_t * pucName)
+{
+    uint8_t i = 7;
+
+    /* NAMEs are compared from the most significant byte, lower value wins */
+    while ((i > 0) && (pucName[i] == pxJ->Name[i]))
+    {
+        i--;
+    }
+
+    if (pxJ->Name[i] < pucName[i])
+    {
+        /* defend the address */
+        CAN_prvJ1939SendClaim(pxJ);
+    }
+    else if (pxJ->Name[i] > pucName[i])
+    {
+        uint8_t ucNext = ((pxJ->Address < J1939_ADDRESS_DYNAMIC_FIRST)
+                       || (pxJ->Address > J1939_ADDRESS_DYNAMIC_LAST)) ?
+                J1939_ADDRESS_DYNAMIC_FIRST : pxJ->Address + 1;
+
+        /* arbitrary address capable nodes try the self-configurable range once */
+        if (((pxJ->Name[7] & 0x80) != 0) && (ucNext <= J1939_ADDRESS_DYNAMIC_LAST))
+        {
+            pxJ->Address    = ucNext;
+            pxJ->ClaimState = CAN_J1939_CLAIM_PENDING;
+            pxJ->ClaimTimer = J1939_CLAIM_TICKS;
+
+            CAN_prvJ1939SendClaim(pxJ);
+        }
+        else
+        {
+            /* send cannot claim address */
+            pxJ->Address    = CAN_J1939_ADDRESS_NULL;
+            pxJ->ClaimState = CAN_J1939_CLAIM_FAILED;
+            pxJ->ClaimTimer = 0;
+
+            CAN_prvJ1939SendClaim(pxJ);
+
+            XPD_SAFE_CALLBACK(pxJ->Callbacks.Claimed, pxJ);
+        }
+    }
+    else {}
+}
+
+/**
+ * @brief Runs the timer only while any of the sessions or the address claim needs timing.
+ * @param pxJ: pointer to the J1939 layer
+ */
+static void CAN_prvJ1939TimerUpdate(CAN_J1939Type * pxJ)
+{
+    uint8_t ucIndex, ucTicking = (pxJ->ClaimTimer != 0) ? 1 : 0;
+
+    for (ucIndex = 0; (ucIndex < pxJ->SessionCount) && (ucTicking == 0); ucIndex++)
+    {
+        if (pxJ->Sessions[ucIndex].Timer != 0)
+        {
+            ucTicking = 1;
+        }
+    }
+
+    if (ucTicking != pxJ->Ticking)
+    {
+        pxJ->Ticking = ucTicking;
+
+        if (ucTicking != 0)
+        {
+            TIM_vCounterStart_IT(pxJ->pTIM);
+        }
+        else
+        {
+            TIM_vCounterStop_IT(pxJ->pTIM);
+        }
+    }
+}
+
+/** @} */
+
+/** @defgroup CAN_J1939_Exported_Functions CAN J1939 Exported Functions
+ *  @brief    J1939 network management and message transfer functions
+ *  @details  The layer claims a source address on the network, receives the PGNs
+ *            of its dispatch table through dedicated acceptance filters, and transfers
+ *            the messages longer than 8 bytes with the transport protocol: broadcast
+ *            (BAM) and destination specific (RTS/CTS) connections are carried out
+ *            concurrently in the available sessions. BAM packet spacing, the address
+ *            claim delay and the connection timeouts are measured by a timer,
+ *            which is only running while needed.
+ * @{
+ */
+
+/**
+ * @brief Resets the J1939 layer and configures the acceptance filters
+ *        of its CAN peripheral for the layer's PGNs.
+ * @param pxJ: pointer to the J1939 layer
+ * @return ERROR if the filters cannot fit in the filter banks, OK otherwise
+ * @note  The previous filter configuration of the CAN peripheral is replaced.
+ *        The timer's update callback has to call @ref CAN_vJ1939Tick,
+ *        and the received frames have to be passed to @ref CAN_eJ1939Process.
+ */
+XPD_ReturnType CAN_eJ1939Init(CAN_J1939Type * pxJ)
+{
+    static const uint32_t aulProtocolPGNs[] = {
+        J1939_PGN_ADDRESS_CLAIM, J1939_PGN_REQUEST, J1939_PGN_TP_CM, J1939_PGN_TP_DT };
+    CAN_FilterType axFilters[CAN_FILTER_FMI_COUNT / 4];
+    uint8_t aucMatchIndexes[CAN_FILTER_FMI_COUNT / 4];
+    uint8_t ucProtocolCount = sizeof(aulProtocolPGNs) / sizeof(aulProtocolPGNs[0]);
+    uint8_t ucCount = ucProtocolCount + pxJ->PgnCount;
+    uint8_t ucIndex;
+    XPD_ReturnType eResult = XPD_ERROR;
+
+    for (ucIndex = 0; ucIndex < pxJ->SessionCount; ucIndex++)
+    {
+        pxJ->Sessions[ucIndex].State = J1939_IDLE;
+        pxJ->Sessions[ucIndex].Timer = 0;
+    }
+    for (ucIndex = 0; ucIndex < CAN_FILTER_FMI_COUNT; ucIndex++)
+    {
+        pxJ->Dispatch[ucIndex] = CAN_FILTER_TAG_NONE;
+    }
+    pxJ->Address    = CAN_J1939_ADDRESS_NULL;
+    pxJ->ClaimState = CAN_J1939_CLAIM_NONE;
+    pxJ->ClaimTimer = 0;
+    pxJ->Ticking    = 0;
+    TIM_vCounterStop_IT(pxJ->pTIM);
+
+    /* each extended mask filter occupies a complete filter bank */
+    if (ucCount <= (CAN_FILTER_FMI_COUNT / 4))
+    {
+        for (ucIndex = 0; ucIndex < ucCount; ucIndex++)
+        {
+            uint32_t ulPGN = (ucIndex < ucProtocolCount) ?
+                    aulProtocolPGNs[ucIndex] : pxJ->Pgns[ucIndex - ucProtocolCount].PGN;
+
+            /* the destination address of PDU1 format PGNs is checked by software,
+             * so the filters remain valid when the claimed address changes */
+            axFilters[ucIndex].Mask = (((ulPGN >> 8) & 0xFF) < 240) ? 0x03FF0000 : 0x03FFFF00;
+            axFilters[ucIndex].Pattern.Value = (ulPGN << 8) & axFilters[ucIndex].Mask;
+            axFilters[ucIndex].Pattern.Type  = CAN_IDTYPE_EXT_DATA;
+            axFilters[ucIndex].Mode = CAN_FILTER_MASK;
+            axFilters[ucIndex].FIFO = pxJ->FIFO;
+        }
+
+        eResult = CAN_eFilterConfig(pxJ->pCAN, axFilters, aucMatchIndexes, ucCount);
+
+        if (eResult == XPD_OK)
+        {
+            for (ucIndex = ucProtocolCount; ucIndex < ucCount; ucIndex++)
+            {
+                pxJ->Dispatch[aucMatchIndexes[ucIndex]] = ucIndex - ucProtocolCount;
+            }
+        }
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Starts claiming the preferred address of the layer.
+ * @param pxJ: pointer to the J1939 layer
+ * @note  The claimed callback is called when the address is claimed
+ *        after the contention period, or when no address could be claimed.
+ */
+void CAN_vJ1939Claim(CAN_J1939Type * pxJ)
+{
+    XPD_ENTER_CRITICAL(pxJ);
+
+    pxJ->Address    = pxJ->PreferredAddress;
+    pxJ->ClaimState = CAN_J1939_CLAIM_PENDING;
+    pxJ->ClaimTimer = J1939_CLAIM_TICKS;
+
+    CAN_prvJ1939SendClaim(pxJ);
+
+    CAN_prvJ1939TimerUpdate(pxJ);
+
+    XPD_EXIT_CRITICAL(pxJ);
+}
+
+/**
+ * @brief Starts the transmission of a message from the claimed address of the layer.
+ *        Messages up to 8 bytes are sent in a single frame, longer ones
+ *        are transported by BAM when sent to the global address, otherwise by RTS/CTS.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxMessage: pointer to the message, its data has to remain valid until the transfer completes
+ * @return ERROR if the length is invalid or no address is claimed,
+ *         BUSY if no session is available for the connection or the transmit queue is full,
+ *         OK if the transmission is started
+ */
+XPD_ReturnType CAN_eJ1939Send(CAN_J1939Type * pxJ, const CAN_J1939MessageType * pxMessage)
+{
+    XPD_ReturnType eResult = XPD_BUSY;
+
+    if ((pxMessage->Length > CAN_J1939_MAX_LENGTH) || (pxJ->ClaimState != CAN_J1939_CLAIM_DONE))
+    {
+        eResult = XPD_ERROR;
+    }
+    else if (pxMessage->Length <= 8)
+    {
+        eResult = CAN_prvJ1939Post(pxJ, pxMessage->Priority, pxMessage->PGN,
+                pxMessage->Destination, pxMessage->Data, pxMessage->Length);
+
+        if (eResult == XPD_OK)
+        {
+            XPD_SAFE_CALLBACK(pxJ->Callbacks.Transmit, (void*)pxMessage);
+        }
+    }
+    else
+    {
+        CAN_J1939SessionType * pxSession = NULL;
+        uint8_t ucBroadcast = pxMessage->Destination == CAN_J1939_ADDRESS_GLOBAL;
+
+        XPD_ENTER_CRITICAL(pxJ);
+
+        /* only one connection is allowed to each destination */
+        if (CAN_prvJ1939Find(pxJ, 0, pxMessage->Destination, ucBroadcast) == NULL)
+        {
+            pxSession = CAN_prvJ1939Allocate(pxJ, 0, pxMessage->Length);
+        }
+
+        if (pxSession != NULL)
+        {
+            uint8_t aucData[8];
+
+            aucData[0] = (ucBroadcast != 0) ? J1939_CM_BAM : J1939_CM_RTS;
+            aucData[1] = pxMessage->Length;
+            aucData[2] = pxMessage->Length >> 8;
+            aucData[3] = J1939_PACKET_COUNT(pxMessage->Length);
+            aucData[4] = 0xFF;
+
+            eResult = CAN_prvJ1939Control(pxJ, pxMessage->Destination, aucData, pxMessage->PGN);
+
+            if (eResult == XPD_OK)
+            {
+                pxSession->Message        = *pxMessage;
+                pxSession->Message.Source = pxJ->Address;
+                pxSession->Packets        = aucData[3];
+                pxSession->Next           = 1;
+
+                if (ucBroadcast != 0)
+                {
+                    pxSession->State = J1939_TX_BAM;
+                    pxSession->Timer = J1939_BAM_TICKS;
+                }
+                else
+                {
+                    pxSession->State = J1939_TX_WAIT_CTS;
+                    pxSession->Timer = J1939_T3_TICKS;
+                }
+
+                CAN_prvJ1939TimerUpdate(pxJ);
+            }
+        }
+
+        XPD_EXIT_CRITICAL(pxJ);
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Processes a received CAN frame: handles the address claims and the transport
+ *        protocol connections, and dispatches the received messages by their PGN.
+ *        Shall be called from the context where the frames are received.
+ * @param pxJ: pointer to the J1939 layer
+ * @param pxFrame: pointer to the received frame
+ * @return ERROR if the frame isn't addressed to the layer, OK if it was processed
+ */
+XPD_ReturnType CAN_eJ1939Process(CAN_J1939Type * pxJ, const CAN_FrameType * pxFrame)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint32_t ulId = pxFrame->Id.Value;
+    uint8_t ucPF = ulId >> 16, ucPS = ulId >> 8;
+    CAN_J1939MessageType xMessage;
+
+    xMessage.PGN = (ulId >> 8) & 0x3FF00;
+    if (ucPF < 240)
+    {
+        xMessage.Destination = ucPS;
+    }
+    else
+    {
+        xMessage.PGN |= ucPS;
+        xMessage.Destination = CAN_J1939_ADDRESS_GLOBAL;
+    }
+
+    if ((pxFrame->Id.Type == CAN_IDTYPE_EXT_DATA)
+     && ((xMessage.Destination == CAN_J1939_ADDRESS_GLOBAL) || (xMessage.Destination == pxJ->Address)))
+    {
+        xMessage.Data     = pxFrame->Data.Byte;
+        xMessage.Length   = pxFrame->DLC;
+        xMessage.Priority = (ulId >> 26) & 7;
+        xMessage.Source   = ulId;
+
+        XPD_ENTER_CRITICAL(pxJ);
+
+        switch (xMessage.PGN)
+        {
+            case J1939_PGN_ADDRESS_CLAIM:
+                if ((xMessage.Length == 8) && (xMessage.Source == pxJ->Address)
+                 && ((pxJ->ClaimState == CAN_J1939_CLAIM_PENDING) || (pxJ->ClaimState == CAN_J1939_CLAIM_DONE)))
+                {
+                    CAN_prvJ1939Contend(pxJ, xMessage.Data);
+                }
+                break;
+
+            case J1939_PGN_TP_CM:
+                CAN_prvJ1939Connection(pxJ, &xMessage);
+                break;
+
+            case J1939_PGN_TP_DT:
+                CAN_prvJ1939RxData(pxJ, &xMessage);
+                break;
+
+            case J1939_PGN_REQUEST:
+                if ((xMessage.Length >= 3) && (xMessage.Data[0] == (J1939_PGN_ADDRESS_CLAIM & 0xFF))
+                 && (xMessage.Data[1] == ((J1939_PGN_ADDRESS_CLAIM >> 8) & 0xFF))
+                 && (xMessage.Data[2] == (J1939_PGN_ADDRESS_CLAIM >> 16)))
+                {
+                    /* report the claimed address, or the failure to claim one */
+                    if (pxJ->ClaimState != CAN_J1939_CLAIM_NONE)
+                    {
+                        CAN_prvJ1939SendClaim(pxJ);
+                    }
+                    break;
+                }
+                /* other requests are handled by the application */
+
+            default:
+                CAN_prvJ1939Dispatch(pxJ, &xMessage, (pxFrame->Index < CAN_FILTER_FMI_COUNT) ?
+                        pxJ->Dispatch[pxFrame->Index] : CAN_FILTER_TAG_NONE);
+                break;
+        }
+
+        CAN_prvJ1939TimerUpdate(pxJ);
+
+        XPD_EXIT_CRITICAL(pxJ);
+
+        eResult = XPD_OK;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Advances the timing of the layer: completes the address claim,
+ *        sends the paced broadcast packets, and detects the connection timeouts.
+ *        Shall be called from the update callback of the layer's timer.
+ * @param pxJ: pointer to the J1939 layer
+ */
+void CAN_vJ1939Tick(CAN_J1939Type * pxJ)
+{
+    uint8_t ucIndex;
+
+    XPD_ENTER_CRITICAL(pxJ);
+
+    if ((pxJ->ClaimTimer != 0) && (--pxJ->ClaimTimer == 0))
+    {
+        pxJ->ClaimState = CAN_J1939_CLAIM_DONE;
+
+        XPD_SAFE_CALLBACK(pxJ->Callbacks.Claimed, pxJ);
+    }
+
+    for (ucIndex = 0; ucIndex < pxJ->SessionCount; ucIndex++)
+    {
+        CAN_J1939SessionType * pxSession = &pxJ->Sessions[ucIndex];
+
+        if ((pxSession->Timer != 0) && (--pxSession->Timer == 0))
+        {
+            if ((pxSession->State == J1939_TX_BAM) || (pxSession->State == J1939_TX_SEND))
+            {
+                CAN_prvJ1939TxData(pxJ, pxSession);
+            }
+            else
+            {
+                CAN_prvJ1939Fail(pxJ, pxSession, J1939_ABORT_TIMEOUT);
+            }
+        }
+    }
+
+    CAN_prvJ1939TimerUpdate(pxJ);
+
+    XPD_EXIT_CRITICAL(pxJ);
+}
+
+/** @} */
+
+#endif /* defined(CAN) || defined(CAN1) */
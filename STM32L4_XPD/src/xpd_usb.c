@@ -87,7 +87,11 @@ do { if (USB_REG_BIT(pxUSB,EPR[EP_ID],BIT_NAME) != 0) USB_TOGGLE(EP_ID, BIT_NAME
         (&(HANDLE)->EP.IN[(NUMBER) & 0xF]) :                            \
         (&(HANDLE)->EP.OUT[NUMBER]))
 
-#define USB_EP_DOUBLE_BUFFERED(ENDPOINT)  ((ENDPOINT)->Type == USB_EP_TYPE_ISOCHRONOUS)
+#define USB_EP_DOUBLE_BUFFERED_BULK(ENDPOINT)  \
+        (((ENDPOINT)->Type == USB_EP_TYPE_BULK) && ((ENDPOINT)->DoubleBuffer != 0))
+
+#define USB_EP_DOUBLE_BUFFERED(ENDPOINT)  \
+        (((ENDPOINT)->Type == USB_EP_TYPE_ISOCHRONOUS) || USB_EP_DOUBLE_BUFFERED_BULK(ENDPOINT))
 
 static const uint16_t usb_ausEpTypeRemap[4] = {
     USB_EP_CONTROL,
@@ -99,39 +103,140 @@ static const uint16_t usb_ausEpTypeRemap[4] = {
 /* Writes user data to USB endpoint packet memory */
 static void USB_prvWritePMA(uint8_t * pucSrcBuf, uint16_t usPmaAddress, uint16_t usDataCount)
 {
-    USB_PacketAddressType * pxDst = (USB_PacketAddressType *)USB_PMAADDR + (usPmaAddress / 2);
-    uint16_t usWCount;
+    __IO USB_PacketAddressType * pxDst = (USB_PacketAddressType *)USB_PMAADDR + (usPmaAddress / 2);
+    const uint8_t * pucSrc = pucSrcBuf;
+    uint16_t usWCount = usDataCount / 2;
 
-    /* Assemble halfwords and copy them to packet memory */
-    for (usWCount = (usDataCount + 1) / 2; usWCount > 0; usWCount--)
+    if (((uint32_t)pucSrc & 1) != 0)
     {
-        *pxDst = ((uint16_t)(pucSrcBuf[1]) << 8) | (uint16_t)(pucSrcBuf[0]);
-        pxDst++;
-        pucSrcBuf += 2;
+        /* Unaligned source: assemble halfwords from aligned reads shifted by one byte */
+        if (usDataCount > 0)
+        {
+            uint16_t usCarry = *pucSrc++;
+
+            /* Only the halfwords within the buffer are read */
+            for (usWCount = (usDataCount - 1) / 2; usWCount > 0; usWCount--, pucSrc += 2)
+            {
+                uint16_t usData = __UNALIGNED_UINT16_READ(pucSrc);
+                *pxDst++ = usCarry | (uint16_t)(usData << 8);
+                usCarry = usData >> 8;
+            }
+
+            /* The last halfword is completed with the last byte if exists */
+            if ((usDataCount & 1) == 0)
+            {
+                usCarry |= (uint16_t)(*pucSrc << 8);
+            }
+            *pxDst = usCarry;
+        }
+    }
+    else
+    {
+        /* Halfword aligned head */
+        if ((((uint32_t)pucSrc & 2) != 0) && (usWCount > 0))
+        {
+            *pxDst++ = __UNALIGNED_UINT16_READ(pucSrc);
+            pucSrc += 2;
+            usWCount--;
+        }
+
+        /* Word aligned bulk, split each word to halfwords */
+        for (; usWCount >= 4; usWCount -= 4)
+        {
+            uint32_t ulData0 = __UNALIGNED_UINT32_READ(pucSrc);
+            uint32_t ulData1 = __UNALIGNED_UINT32_READ(pucSrc + 4);
+
+            pxDst[0] = (uint16_t)ulData0;
+            pxDst[1] = (uint16_t)(ulData0 >> 16);
+            pxDst[2] = (uint16_t)ulData1;
+            pxDst[3] = (uint16_t)(ulData1 >> 16);
+            pxDst  += 4;
+            pucSrc += 8;
+        }
+
+        /* Halfword tail */
+        for (; usWCount > 0; usWCount--)
+        {
+            *pxDst++ = __UNALIGNED_UINT16_READ(pucSrc);
+            pucSrc += 2;
+        }
+
+        /* The last, unaligned byte is written if exists */
+        if ((usDataCount & 1) != 0)
+        {
+            *pxDst = *pucSrc;
+        }
     }
 }
 
 /* Reads USB endpoint data from packet memory */
 static void USB_prvReadPMA(uint8_t * pucDstBuf, uint16_t usPmaAddress, uint16_t usDataCount)
 {
-    USB_PacketAddressType * pxSrc = (USB_PacketAddressType *)USB_PMAADDR + (usPmaAddress / 2);
-    uint16_t usWCount;
+    __IO USB_PacketAddressType * pxSrc = (USB_PacketAddressType *)USB_PMAADDR + (usPmaAddress / 2);
+    uint8_t * pucDst = pucDstBuf;
+    uint16_t usWCount = usDataCount / 2;
 
-    /* Copy each halfword into the byte buffer */
-    for (usWCount = usDataCount / 2; usWCount > 0; usWCount--)
+    if (((uint32_t)pucDst & 1) != 0)
     {
-        uint16_t usData = *pxSrc;
-        *pucDstBuf = usData;
-        pucDstBuf++;
-        *pucDstBuf = usData >> 8;
-        pucDstBuf++;
-        pxSrc++;
-    }
+        /* Unaligned destination: the first byte is stored alone,
+         * the rest with aligned writes of halfwords shifted by one byte */
+        if (usDataCount > 0)
+        {
+            uint16_t usCarry = *pxSrc++;
 
-    /* The last, unaligned byte is filled if exists */
-    if ((usDataCount & 1) != 0)
+            *pucDst++ = (uint8_t)usCarry;
+            usCarry >>= 8;
+
+            for (usWCount = (usDataCount - 1) / 2; usWCount > 0; usWCount--, pucDst += 2)
+            {
+                uint16_t usData = *pxSrc++;
+                __UNALIGNED_UINT16_WRITE(pucDst, usCarry | (uint16_t)(usData << 8));
+                usCarry = usData >> 8;
+            }
+
+            /* The last, unaligned byte is filled if exists */
+            if ((usDataCount & 1) == 0)
+            {
+                *pucDst = (uint8_t)usCarry;
+            }
+        }
+    }
+    else
     {
-        *pucDstBuf = (uint8_t)*pxSrc;
+        /* Halfword aligned head */
+        if ((((uint32_t)pucDst & 2) != 0) && (usWCount > 0))
+        {
+            __UNALIGNED_UINT16_WRITE(pucDst, *pxSrc++);
+            pucDst += 2;
+            usWCount--;
+        }
+
+        /* Word aligned bulk, assemble words from halfwords */
+        for (; usWCount >= 4; usWCount -= 4)
+        {
+            uint32_t ulData0 = (uint16_t)pxSrc[0];
+            uint32_t ulData1 = (uint16_t)pxSrc[2];
+
+            ulData0 |= (uint32_t)((uint16_t)pxSrc[1]) << 16;
+            ulData1 |= (uint32_t)((uint16_t)pxSrc[3]) << 16;
+            __UNALIGNED_UINT32_WRITE(pucDst, ulData0);
+            __UNALIGNED_UINT32_WRITE(pucDst + 4, ulData1);
+            pucDst += 8;
+            pxSrc  += 4;
+        }
+
+        /* Halfword tail */
+        for (; usWCount > 0; usWCount--)
+        {
+            __UNALIGNED_UINT16_WRITE(pucDst, *pxSrc++);
+            pucDst += 2;
+        }
+
+        /* The last, unaligned byte is filled if exists */
+        if ((usDataCount & 1) != 0)
+        {
+            *pucDst = (uint8_t)*pxSrc;
+        }
     }
 }
 
@@ -191,40 +296,61 @@ static void USB_prvReceivePacket(USB_HandleType * pxUSB, USB_EndPointHandleType
         USB_EP_BDT[pxEP->RegId].RX_COUNT = usPacketLength;
     }
 
-    USB_EP_SET_STATUS(pxEP->RegId, RX, VALID);
+    if (USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
+    {
+        /* Release the buffer to the USB by toggling SW_BUF flag (DTOG != SW_BUF) */
+        USB_TOGGLE(pxEP->RegId, DTOG_TX);
+    }
+    else
+    {
+        USB_EP_SET_STATUS(pxEP->RegId, RX, VALID);
+    }
 }
 
-/* Handle IN EP transfer */
-static void USB_prvTransmitPacket(USB_HandleType * pxUSB, USB_EndPointHandleType * pxEP)
+/* Writes the next IN packet to buffer 0 or 1 of a double buffered endpoint */
+static void USB_prvWriteBuffer(USB_EndPointHandleType * pxEP, uint16_t usBuffer1)
 {
-    uint16_t usPmaAddress = USB_EP_BDT[pxEP->RegId].TX_ADDR;
+    uint16_t usPmaAddress;
     uint16_t usPacketLength = USB_prvNextPacketSize(pxEP);
 
+    if (usBuffer1 != 0)
+    {
+        USB_EP_BDT[pxEP->RegId].RX_COUNT = usPacketLength;
+        usPmaAddress = USB_EP_BDT[pxEP->RegId].RX_ADDR;
+    }
+    else
+    {
+        USB_EP_BDT[pxEP->RegId].TX_COUNT = usPacketLength;
+        usPmaAddress = USB_EP_BDT[pxEP->RegId].TX_ADDR;
+    }
+
+    /* Write the data to the packet memory */
+    USB_prvWritePMA(pxEP->Transfer.Data, usPmaAddress, usPacketLength);
+
+    pxEP->Transfer.Data += usPacketLength;
+}
+
+/* Handle IN EP transfer */
+static void USB_prvTransmitPacket(USB_HandleType * pxUSB, USB_EndPointHandleType * pxEP)
+{
     if (!USB_EP_DOUBLE_BUFFERED(pxEP))
     {
+        uint16_t usPacketLength = USB_prvNextPacketSize(pxEP);
+
         USB_EP_BDT[pxEP->RegId].TX_COUNT = usPacketLength;
 
         /* Write the data to the packet memory */
-        USB_prvWritePMA(pxEP->Transfer.Data, usPmaAddress, usPacketLength);
+        USB_prvWritePMA(pxEP->Transfer.Data, USB_EP_BDT[pxEP->RegId].TX_ADDR, usPacketLength);
 
         /* Validate Tx endpoint */
         USB_EP_SET_STATUS(pxEP->RegId, TX, VALID);
+
+        pxEP->Transfer.Data += usPacketLength;
     }
-    else /* Double buffered endpoint */
+    else /* Double buffered isochronous endpoint */
     {
         /* Use buffer 1 when DTOG == 1 */
-        if ((USB->EPR[pxEP->RegId].w & USB_EP_DTOG_TX) != 0)
-        {
-            USB_EP_BDT[pxEP->RegId].RX_COUNT = usPacketLength;
-            usPmaAddress = USB_EP_BDT[pxEP->RegId].RX_ADDR;
-        }
-        else
-        {
-            USB_EP_BDT[pxEP->RegId].TX_COUNT = usPacketLength;
-        }
-
-        /* Write the data to the packet memory */
-        USB_prvWritePMA(pxEP->Transfer.Data, usPmaAddress, usPacketLength);
+        USB_prvWriteBuffer(pxEP, USB->EPR[pxEP->RegId].w & USB_EP_DTOG_TX);
 
         /* Toggle SW_BUF flag to clear NAK status (DTOG == SW_BUF) */
         if (USB->EPR[pxEP->RegId].b.DTOG_TX == USB->EPR[pxEP->RegId].b.DTOG_RX)
@@ -234,6 +360,33 @@ static void USB_prvTransmitPacket(USB_HandleType * pxUSB, USB_EndPointHandleType
     }
 }
 
+/* Handle double buffered bulk IN EP transfer */
+static void USB_prvTransmitBulk(USB_EndPointHandleType * pxEP)
+{
+    /* The application's buffer is selected by SW_BUF */
+    uint16_t usSwBuf = USB->EPR[pxEP->RegId].w & USB_EP_DTOG_RX;
+
+    /* Idle endpoint, write the first packet */
+    if (pxEP->Pending == 0)
+    {
+        USB_prvWriteBuffer(pxEP, usSwBuf);
+    }
+    pxEP->Pending = 0;
+
+    /* Write the next packet to the other buffer, which is free as its previous
+     * packet has been sent. Both the packet memory and Pending are complete
+     * before the release, so the CTR_TX of the released buffer finds them consistent
+     * even when the transfer is started outside of the interrupt handler */
+    if (pxEP->Transfer.Progress > 0)
+    {
+        USB_prvWriteBuffer(pxEP, usSwBuf ^ USB_EP_DTOG_RX);
+        pxEP->Pending = 1;
+    }
+
+    /* Release the written buffer to the USB by toggling SW_BUF flag (DTOG != SW_BUF) */
+    USB_TOGGLE(pxEP->RegId, DTOG_RX);
+}
+
 /* Opens EP0 bidirectional dedicated control endpoint */
 static void USB_prvCtrlEpOpen(USB_HandleType * pxUSB)
 {
@@ -445,6 +598,7 @@ void USB_vEpOpen(
         /* Initially no data */
         USB_EP_BDT[pxEP->RegId].TX_COUNT =
         USB_EP_BDT[pxEP->RegId].RX_COUNT = 0;
+        pxEP->Pending = 0;
 
         if (ucEpAddress > 0x7F)
         {
@@ -455,8 +609,12 @@ void USB_vEpOpen(
         }
         else
         {
-            /* Set SW_BUF flag */
-            USB_TOGGLE(pxEP->RegId, DTOG_TX);
+            /* Set SW_BUF flag, bulk endpoints NAK (DTOG == SW_BUF)
+             * until a reception is started */
+            if (!USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
+            {
+                USB_TOGGLE(pxEP->RegId, DTOG_TX);
+            }
 
             /* Configure VALID status for the Endpoint */
             USB_EP_SET_STATUS(pxEP->RegId, RX, VALID);
@@ -544,7 +702,24 @@ void USB_vEpClearStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
 {
     USB_EndPointHandleType * pxEP = USB_GET_EP_AT(pxUSB, ucEpAddress);
 
-    if (ucEpAddress > 0x7F)
+    if (USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
+    {
+        /* Reset both buffers to application ownership (DTOG == SW_BUF == 0 result in NAK),
+         * the next transfer releases them again */
+        USB_TOGGLE_CLEAR(pxEP->RegId, DTOG_TX);
+        USB_TOGGLE_CLEAR(pxEP->RegId, DTOG_RX);
+        pxEP->Pending = 0;
+
+        if (ucEpAddress > 0x7F)
+        {
+            USB_EP_SET_STATUS(pxEP->RegId, TX, VALID);
+        }
+        else
+        {
+            USB_EP_SET_STATUS(pxEP->RegId, RX, VALID);
+        }
+    }
+    else if (ucEpAddress > 0x7F)
     {
         USB_TOGGLE_CLEAR(pxEP->RegId, DTOG_TX);
         USB_EP_SET_STATUS(pxEP->RegId, TX, NAK);
@@ -561,22 +736,35 @@ void USB_vEpClearStall(USB_HandleType * pxUSB, uint8_t ucEpAddress)
  * @param pxUSB: pointer to the USB handle structure
  * @param ucEpAddress: endpoint address
  * @param pucData: pointer to the data buffer
- * @param usLength: amount of data bytes to transfer
+ * @param ulLength: amount of data bytes to transfer
+ * @note  Double buffered bulk endpoints write the following packet to packet memory
+ *        while the previous one is being transmitted.
+ * @note  A transfer of complete packets is not terminated by a zero length packet,
+ *        the class driver has to send an empty transfer after it when its protocol
+ *        requires a short packet.
  */
 void USB_vEpSend(
         USB_HandleType *    pxUSB,
         uint8_t             ucEpAddress,
         const uint8_t *     pucData,
-        uint16_t            usLength)
+        uint32_t            ulLength)
 {
     USB_EndPointHandleType * pxEP = &pxUSB->EP.IN[ucEpAddress & 0xF];
 
     /* setup the transfer */
     pxEP->Transfer.Data       = (uint8_t*)pucData;
-    pxEP->Transfer.Progress   = usLength;
-    pxEP->Transfer.Length     = usLength;
+    pxEP->Transfer.Progress   = ulLength;
+    pxEP->Transfer.Length     = ulLength;
 
-    USB_prvTransmitPacket(pxUSB, pxEP);
+    if (USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
+    {
+        pxEP->Pending = 0;
+        USB_prvTransmitBulk(pxEP);
+    }
+    else
+    {
+        USB_prvTransmitPacket(pxUSB, pxEP);
+    }
 }
 
 /**
@@ -584,19 +772,21 @@ void USB_vEpSend(
  * @param pxUSB: pointer to the USB handle structure
  * @param ucEpAddress: endpoint address
  * @param pucData: pointer to the data buffer
- * @param usLength: amount of data bytes to transfer
+ * @param ulLength: amount of data bytes to transfer
+ * @note  Double buffered bulk endpoints receive the following packet to packet memory
+ *        while the previous one is being read.
  */
 void USB_vEpReceive(
         USB_HandleType *    pxUSB,
         uint8_t             ucEpAddress,
         uint8_t *           pucData,
-        uint16_t            usLength)
+        uint32_t            ulLength)
 {
     USB_EndPointHandleType * pxEP = &pxUSB->EP.OUT[ucEpAddress];
 
     /* setup transfer */
     pxEP->Transfer.Data       = pucData;
-    pxEP->Transfer.Progress   = usLength;
+    pxEP->Transfer.Progress   = ulLength;
     pxEP->Transfer.Length     = 0;
 
     USB_prvReceivePacket(pxUSB, pxEP);
@@ -675,6 +865,7 @@ void USB_vIRQHandler(USB_HandleType * pxUSB)
             {
                 /* Get Data packet */
                 uint16_t usPmaAddress = USB_EP_BDT[usEpId].RX_ADDR;
+                uint8_t  ucLast;
                 usDataCount = USB_EP_BDT[usEpId].RX_COUNT & 0x3FF;
 
                 /* Clear RX complete flag */
@@ -689,7 +880,24 @@ void USB_vIRQHandler(USB_HandleType * pxUSB)
                         usPmaAddress = USB_EP_BDT[usEpId].TX_ADDR;
                         usDataCount  = USB_EP_BDT[usEpId].TX_COUNT & 0x3FF;
                     }
+                }
+
+                /* If the last packet of the data, transfer is complete
+                 * TODO if Length % MaxPacketSize == 0 the transfer will hang without ZLP */
+                ucLast = (pxEP->Transfer.Progress == 0) ||
+                         (usDataCount < pxEP->MaxPacketSize);
 
+                if (USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
+                {
+                    /* Release the other buffer for the next packet
+                     * before reading out the current one */
+                    if (!ucLast)
+                    {
+                        USB_prvReceivePacket(pxUSB, pxEP);
+                    }
+                }
+                else if (USB_EP_DOUBLE_BUFFERED(pxEP))
+                {
                     /* Switch the reception buffer by toggling SW_BUF flag */
                     USB_TOGGLE(usEpId, DTOG_TX);
                 }
@@ -699,10 +907,7 @@ void USB_vIRQHandler(USB_HandleType * pxUSB)
                 pxEP->Transfer.Length += usDataCount;
                 pxEP->Transfer.Data += usDataCount;
 
-                /* If the last packet of the data, transfer is complete
-                 * TODO if Length % MaxPacketSize == 0 the transfer will hang without ZLP */
-                if ((pxEP->Transfer.Progress == 0) ||
-                    (usDataCount < pxEP->MaxPacketSize))
+                if (ucLast)
                 {
                     /* Reception finished */
                     USB_vDataOutCallback(pxUSB, pxEP);
@@ -715,7 +920,7 @@ void USB_vIRQHandler(USB_HandleType * pxUSB)
                         USB_EP_SET_STATUS(0, RX, VALID);
                     }
                 }
-                else
+                else if (!USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
                 {
                     /* Continue data reception */
                     USB_prvReceivePacket(pxUSB, pxEP);
@@ -731,21 +936,21 @@ void USB_vIRQHandler(USB_HandleType * pxUSB)
             /* Clear TX complete flag */
             USB_EP_FLAG_CLEAR(usEpId, CTR_TX);
 
-            /* Double buffering */
-            if ((USB_EP_DOUBLE_BUFFERED(pxEP)) && ((usEpReg & USB_EP_DTOG_TX) == 0))
-            {
-                /* written from endpoint 1 buffer */
-                usDataCount = USB_EP_BDT[usEpId].RX_COUNT & 0x3FF;
-            }
-            else
+            if (USB_EP_DOUBLE_BUFFERED_BULK(pxEP))
             {
-                /* written from endpoint 0 (Tx) buffer */
-                usDataCount = USB_EP_BDT[usEpId].TX_COUNT & 0x3FF;
+                if (pxEP->Pending != 0)
+                {
+                    /* Release the packet written in advance, write the next one */
+                    USB_prvTransmitBulk(pxEP);
+                }
+                else
+                {
+                    /* Transmission complete */
+                    USB_vDataInCallback(pxUSB, pxEP);
+                }
             }
-            pxEP->Transfer.Data += usDataCount;
-
             /* If the last packet of the data */
-            if (pxEP->Transfer.Progress == 0)
+            else if (pxEP->Transfer.Progress == 0)
             {
                 /* Transmission complete */
                 USB_vDataInCallback(pxUSB, pxEP);
@@ -907,6 +1112,8 @@ USB_ChargerType USB_eChargerDetect(USB_HandleType * pxUSB)
 /**
  * @brief Configure EPnR assignment and packet memory allocation for all endpoints
  *        based on the handle's Endpoint setup.
+ * @note  Double buffered endpoints (isochronous, or bulk with DoubleBuffer set)
+ *        use a separate EPnR and two packet buffers of MaxPacketSize.
  * @param pxUSB: pointer to the USB handle structure
  */
 __weak void USB_vAllocateEPs(USB_HandleType * pxUSB)
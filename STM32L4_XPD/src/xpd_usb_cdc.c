@@ -0,0 +1,451 @@
+/**
+  ******************************************************************************
+  * @file    xpd_usb_cdc.c
+  * @author  Benedek Kupper
+  * @version 0.1
+  * @date    2018-07-20
+  * @brief   STM32 eXtensible Peripheral Drivers USB CDC-ACM Module
+  *
+  * Copyright (c) 2018 Benedek Kupper
+  *
+  * Licensed under the Apache License, Version 2.0 (the "License");
+  * you may not use this file except in compliance with the License.
+  * You may obtain a copy of the License at
+  *
+  *     http://www.apache.org/licenses/LICENSE-2.0
+  *
+  * Unless required by applicable law or agreed to in writing, software
+  * distributed under the License is distributed on an "AS IS" BASIS,
+  * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  * See the License for the specific language governing permissions and
+  * limitations under the License.
+  */
+#include <xpd_usb_cdc.h>
+#include <xpd_utils.h>
+
+#if defined(USB) || defined(USB_OTG_FS)
+
+/* Setup packet fields */
+#define CDC_SETUP_REQUEST_TYPE(SETUP)   ((SETUP)[0])
+#define CDC_SETUP_REQUEST(SETUP)        ((SETUP)[1])
+#define CDC_SETUP_VALUE(SETUP)          ((uint16_t)(SETUP)[2] | ((uint16_t)(SETUP)[3] << 8))
+#define CDC_SETUP_LENGTH(SETUP)         ((uint16_t)(SETUP)[6] | ((uint16_t)(SETUP)[7] << 8))
+
+#define CDC_REQUEST_TYPE_MASK           0x60
+#define CDC_REQUEST_TYPE_CLASS          0x20
+
+/* Transferred size of the line coding */
+#define CDC_LINE_CODING_SIZE            7
+
+/** @defgroup USB_CDC_Private_Functions USB CDC Private Functions
+ * @{ */
+
+/**
+ * @brief Starts an IN transfer of the contiguous data of the TxRing.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param ucZLP: set if an empty transfer shall be sent when no data is available
+ */
+static void USB_prvCdcTransmit(USB_CdcType * pxCdc, uint8_t ucZLP)
+{
+    USB_CdcRingType * pxRing = &pxCdc->TxRing;
+    uint16_t usTail  = pxRing->Tail & (pxRing->Size - 1);
+    uint16_t usCount = pxRing->Head - pxRing->Tail;
+
+    /* The transfer reaches until the end of the storage at most */
+    if (usCount > (pxRing->Size - usTail))
+    {
+        usCount = pxRing->Size - usTail;
+    }
+
+    if ((usCount > 0) || (ucZLP != 0))
+    {
+        pxCdc->TxLength = usCount;
+        pxCdc->TxBusy = 1;
+
+        USB_vEpSend(pxCdc->pUSB, pxCdc->InEpAddress, &pxRing->Buffer[usTail], usCount);
+    }
+    else
+    {
+        pxCdc->TxBusy = 0;
+    }
+}
+
+/**
+ * @brief Starts an OUT transfer to the free space of the RxRing.
+ * @param pxCdc: pointer to the CDC function structure
+ */
+static void USB_prvCdcReceive(USB_CdcType * pxCdc)
+{
+    USB_CdcRingType * pxRing = &pxCdc->RxRing;
+    uint16_t usHead  = pxRing->Head & (pxRing->Size - 1);
+    uint16_t usFree  = pxRing->Size - (uint16_t)(pxRing->Head - pxRing->Tail);
+    uint16_t usSpace = pxRing->Size - usHead;
+
+    if (usSpace > usFree)
+    {
+        usSpace = usFree;
+    }
+
+    /* Only complete packets can be received directly to the ring */
+    usSpace -= usSpace % pxCdc->MaxPacketSize;
+
+    if (usSpace > 0)
+    {
+        pxCdc->RxStaged = 0;
+        pxCdc->RxBusy = 1;
+
+        USB_vEpReceive(pxCdc->pUSB, pxCdc->OutEpAddress, &pxRing->Buffer[usHead], usSpace);
+    }
+    else if (usFree >= pxCdc->MaxPacketSize)
+    {
+        /* The packet would cross the end of the storage */
+        pxCdc->RxStaged = 1;
+        pxCdc->RxBusy = 1;
+
+        USB_vEpReceive(pxCdc->pUSB, pxCdc->OutEpAddress,
+                (uint8_t*)pxCdc->Packet, pxCdc->MaxPacketSize);
+    }
+    else
+    {
+        /* The host is NAKed until the ring is read */
+        pxCdc->RxBusy = 0;
+    }
+}
+
+/** @} */
+
+/** @defgroup USB_CDC_Exported_Functions USB CDC Exported Functions
+ * @{ */
+
+/**
+ * @brief Initializes the CDC function and sets up its endpoints in the USB handle,
+ *        so that they are considered by the endpoint resource allocation.
+ * @param pxCdc: pointer to the CDC function structure
+ * @return ERROR if the ring or packet sizes are invalid, OK otherwise
+ * @note  This function shall be called before the USB device is started.
+ *        The bulk endpoints of the packet memory core are set up with double buffering.
+ */
+XPD_ReturnType USB_eCdcInit(USB_CdcType * pxCdc)
+{
+    XPD_ReturnType eResult = XPD_ERROR;
+    uint16_t usTxSize = pxCdc->TxRing.Size;
+    uint16_t usRxSize = pxCdc->RxRing.Size;
+
+    if ((pxCdc->MaxPacketSize == 0) || (pxCdc->MaxPacketSize > USB_CDC_MAX_PACKET_SIZE))
+    {
+    }
+    /* Ring sizes have to be powers of 2, with room for two packets */
+    else if (((usTxSize & (usTxSize - 1)) != 0) || (usTxSize < (2 * pxCdc->MaxPacketSize)) ||
+             ((usRxSize & (usRxSize - 1)) != 0) || (usRxSize < (2 * pxCdc->MaxPacketSize)))
+    {
+    }
+    else
+    {
+        USB_EndPointHandleType * pxIn  = &pxCdc->pUSB->EP.IN[pxCdc->InEpAddress & 0xF];
+        USB_EndPointHandleType * pxOut = &pxCdc->pUSB->EP.OUT[pxCdc->OutEpAddress & 0xF];
+
+        pxCdc->TxRing.Head = pxCdc->TxRing.Tail = 0;
+        pxCdc->RxRing.Head = pxCdc->RxRing.Tail = 0;
+
+        /* Default serial port parameters: 115200 baud 8N1 */
+        pxCdc->LineCoding.DTERate    = 115200;
+        pxCdc->LineCoding.CharFormat = 0;
+        pxCdc->LineCoding.ParityType = 0;
+        pxCdc->LineCoding.DataBits   = 8;
+        pxCdc->ControlLineState      = 0;
+        pxCdc->Configured = 0;
+        pxCdc->TxBusy = 0;
+        pxCdc->RxBusy = 0;
+
+        /* Endpoint properties for the resource allocation */
+        pxIn->MaxPacketSize = pxOut->MaxPacketSize = pxCdc->MaxPacketSize;
+        pxIn->Type          = pxOut->Type          = USB_EP_TYPE_BULK;
+#ifdef USB
+        /* Packet copy overlaps with the transfer of the other buffer */
+        pxIn->DoubleBuffer  = pxOut->DoubleBuffer  = 1;
+#endif
+        if (pxCdc->NotifyEpAddress != 0)
+        {
+            USB_EndPointHandleType * pxNotify = &pxCdc->pUSB->EP.IN[pxCdc->NotifyEpAddress & 0xF];
+
+            pxNotify->MaxPacketSize = USB_CDC_NOTIFY_PACKET_SIZE;
+            pxNotify->Type          = USB_EP_TYPE_INTERRUPT;
+        }
+
+        eResult = XPD_OK;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Opens the endpoints of the CDC function and starts the data transfers.
+ * @param pxCdc: pointer to the CDC function structure
+ * @note  This function shall be called when the device configuration is set.
+ */
+void USB_vCdcOpen(USB_CdcType * pxCdc)
+{
+    if (pxCdc->NotifyEpAddress != 0)
+    {
+        USB_vEpOpen(pxCdc->pUSB, pxCdc->NotifyEpAddress, USB_EP_TYPE_INTERRUPT,
+                USB_CDC_NOTIFY_PACKET_SIZE);
+    }
+    USB_vEpOpen(pxCdc->pUSB, pxCdc->InEpAddress, USB_EP_TYPE_BULK,
+            pxCdc->MaxPacketSize);
+    USB_vEpOpen(pxCdc->pUSB, pxCdc->OutEpAddress, USB_EP_TYPE_BULK,
+            pxCdc->MaxPacketSize);
+
+    XPD_ENTER_CRITICAL(pxCdc);
+
+    pxCdc->Configured = 1;
+
+    /* Receive to the free ring space, send the data written while disconnected */
+    USB_prvCdcReceive(pxCdc);
+    USB_prvCdcTransmit(pxCdc, 0);
+
+    XPD_EXIT_CRITICAL(pxCdc);
+}
+
+/**
+ * @brief Closes the endpoints of the CDC function.
+ * @param pxCdc: pointer to the CDC function structure
+ * @note  Data of an interrupted IN transfer stays in the TxRing, and is sent again
+ *        after the next @ref USB_vCdcOpen.
+ */
+void USB_vCdcClose(USB_CdcType * pxCdc)
+{
+    XPD_ENTER_CRITICAL(pxCdc);
+
+    pxCdc->Configured = 0;
+    pxCdc->TxBusy = 0;
+    pxCdc->RxBusy = 0;
+
+    XPD_EXIT_CRITICAL(pxCdc);
+
+    if (pxCdc->NotifyEpAddress != 0)
+    {
+        USB_vEpClose(pxCdc->pUSB, pxCdc->NotifyEpAddress);
+    }
+    USB_vEpClose(pxCdc->pUSB, pxCdc->InEpAddress);
+    USB_vEpClose(pxCdc->pUSB, pxCdc->OutEpAddress);
+}
+
+/**
+ * @brief Writes data to the TxRing, and starts its transmission when the IN endpoint is idle.
+ *        Data written during an ongoing transfer is coalesced into the next transfer.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param pucData: pointer to the data to send
+ * @param ulLength: amount of data bytes to send
+ * @return The number of bytes written to the TxRing
+ * @note  The TxRing is lock-free for a single writer context.
+ *        When the OTG core uses DMA, the IN endpoint's BounceBuffer has to be set.
+ */
+uint32_t USB_ulCdcWrite(USB_CdcType * pxCdc, const uint8_t * pucData, uint32_t ulLength)
+{
+    USB_CdcRingType * pxRing = &pxCdc->TxRing;
+    uint16_t usHead = pxRing->Head;
+    uint16_t usFree = pxRing->Size - (uint16_t)(usHead - pxRing->Tail);
+    uint32_t ulCount;
+
+    if (ulLength > usFree)
+    {
+        ulLength = usFree;
+    }
+
+    for (ulCount = 0; ulCount < ulLength; ulCount++)
+    {
+        pxRing->Buffer[(usHead + ulCount) & (pxRing->Size - 1)] = pucData[ulCount];
+    }
+
+    /* release the data only after it has been copied */
+    pxRing->Head = usHead + ulLength;
+
+    /* The ongoing transfer's completion sends the new data otherwise */
+    if ((pxCdc->TxBusy == 0) && (ulLength > 0))
+    {
+        XPD_ENTER_CRITICAL(pxCdc);
+
+        if ((pxCdc->TxBusy == 0) && (pxCdc->Configured != 0))
+        {
+            USB_prvCdcTransmit(pxCdc, 0);
+        }
+
+        XPD_EXIT_CRITICAL(pxCdc);
+    }
+
+    return ulLength;
+}
+
+/**
+ * @brief Reads received data from the RxRing, and restarts the reception
+ *        if it was stopped due to the lack of space.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param pucData: pointer to the destination buffer
+ * @param ulLength: size of the destination buffer
+ * @return The number of bytes read from the RxRing
+ * @note  The RxRing is lock-free for a single reader context.
+ *        When the OTG core uses DMA, the OUT endpoint's BounceBuffer has to be set.
+ */
+uint32_t USB_ulCdcRead(USB_CdcType * pxCdc, uint8_t * pucData, uint32_t ulLength)
+{
+    USB_CdcRingType * pxRing = &pxCdc->RxRing;
+    uint16_t usTail  = pxRing->Tail;
+    uint16_t usCount = pxRing->Head - usTail;
+    uint32_t ulCount;
+
+    if (ulLength > usCount)
+    {
+        ulLength = usCount;
+    }
+
+    for (ulCount = 0; ulCount < ulLength; ulCount++)
+    {
+        pucData[ulCount] = pxRing->Buffer[(usTail + ulCount) & (pxRing->Size - 1)];
+    }
+
+    /* release the space only after it has been copied */
+    pxRing->Tail = usTail + ulLength;
+
+    if ((pxCdc->RxBusy == 0) && (ulLength > 0))
+    {
+        XPD_ENTER_CRITICAL(pxCdc);
+
+        if ((pxCdc->RxBusy == 0) && (pxCdc->Configured != 0))
+        {
+            USB_prvCdcReceive(pxCdc);
+        }
+
+        XPD_EXIT_CRITICAL(pxCdc);
+    }
+
+    return ulLength;
+}
+
+/**
+ * @brief Processes the CDC class-specific control requests.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param pucSetup: pointer to the setup packet
+ * @param ppucData: set to the data stage buffer (data to send, or to receive)
+ * @param pusLength: set to the data stage length
+ * @return OK if the request is supported, ERROR if it shall be stalled
+ * @note  After the OUT data stage of a request is complete,
+ *        @ref USB_vCdcSetupData has to be called.
+ */
+XPD_ReturnType USB_eCdcSetupRequest(
+        USB_CdcType *       pxCdc,
+        const uint8_t *     pucSetup,
+        uint8_t **          ppucData,
+        uint16_t *          pusLength)
+{
+    XPD_ReturnType eResult = XPD_OK;
+    uint16_t usLength = CDC_SETUP_LENGTH(pucSetup);
+
+    *ppucData  = NULL;
+    *pusLength = 0;
+
+    if ((CDC_SETUP_REQUEST_TYPE(pucSetup) & CDC_REQUEST_TYPE_MASK) != CDC_REQUEST_TYPE_CLASS)
+    {
+        eResult = XPD_ERROR;
+    }
+    else switch (CDC_SETUP_REQUEST(pucSetup))
+    {
+        case USB_CDC_SET_LINE_CODING:
+        case USB_CDC_GET_LINE_CODING:
+            *ppucData  = (uint8_t*)&pxCdc->LineCoding;
+            *pusLength = (usLength < CDC_LINE_CODING_SIZE) ? usLength : CDC_LINE_CODING_SIZE;
+            break;
+
+        case USB_CDC_SET_CONTROL_LINE_STATE:
+            pxCdc->ControlLineState = CDC_SETUP_VALUE(pucSetup);
+            XPD_SAFE_CALLBACK(pxCdc->Callbacks.ControlLineState, pxCdc);
+            break;
+
+        case USB_CDC_SEND_BREAK:
+            break;
+
+        default:
+            eResult = XPD_ERROR;
+            break;
+    }
+
+    return eResult;
+}
+
+/**
+ * @brief Completes the CDC class-specific control requests with OUT data stage.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param pucSetup: pointer to the setup packet
+ */
+void USB_vCdcSetupData(USB_CdcType * pxCdc, const uint8_t * pucSetup)
+{
+    if (CDC_SETUP_REQUEST(pucSetup) == USB_CDC_SET_LINE_CODING)
+    {
+        XPD_SAFE_CALLBACK(pxCdc->Callbacks.LineCoding, pxCdc);
+    }
+}
+
+/**
+ * @brief Handles the completion of the IN transfer:
+ *        the TxRing space is released, and its remaining data is sent immediately.
+ * @param pxCdc: pointer to the CDC function structure
+ * @note  This function shall be called from @ref USB_vDataInCallback
+ *        for the CDC function's bulk IN endpoint.
+ */
+void USB_vCdcDataIn(USB_CdcType * pxCdc)
+{
+    uint16_t usSent = pxCdc->TxLength;
+
+    pxCdc->TxRing.Tail += usSent;
+    pxCdc->TxLength = 0;
+
+    if (pxCdc->Configured != 0)
+    {
+        /* A transfer of complete packets is terminated by a ZLP
+         * if no more data follows it */
+        USB_prvCdcTransmit(pxCdc,
+                (usSent > 0) && ((usSent % pxCdc->MaxPacketSize) == 0));
+    }
+}
+
+/**
+ * @brief Handles the completion of the OUT transfer:
+ *        the received data is released to the RxRing, and the reception is restarted immediately.
+ * @param pxCdc: pointer to the CDC function structure
+ * @param pxEP: pointer to the bulk OUT endpoint handle
+ * @note  This function shall be called from @ref USB_vDataOutCallback
+ *        for the CDC function's bulk OUT endpoint.
+ */
+void USB_vCdcDataOut(USB_CdcType * pxCdc, USB_EndPointHandleType * pxEP)
+{
+    USB_CdcRingType * pxRing = &pxCdc->RxRing;
+    uint16_t usHead = pxRing->Head;
+    uint16_t usLength = pxEP->Transfer.Length;
+
+    if (pxCdc->RxStaged != 0)
+    {
+        const uint8_t * pucPacket = (const uint8_t*)pxCdc->Packet;
+        uint16_t usCount;
+
+        for (usCount = 0; usCount < usLength; usCount++)
+        {
+            pxRing->Buffer[(usHead + usCount) & (pxRing->Size - 1)] = pucPacket[usCount];
+        }
+    }
+
+    /* release the data only after it has been copied */
+    pxRing->Head = usHead + usLength;
+
+    if (pxCdc->Configured != 0)
+    {
+        USB_prvCdcReceive(pxCdc);
+    }
+
+    if (usLength > 0)
+    {
+        XPD_SAFE_CALLBACK(pxCdc->Callbacks.Receive, pxCdc);
+    }
+}
+
+/** @} */
+
+#endif /* defined(USB) || defined(USB_OTG_FS) */
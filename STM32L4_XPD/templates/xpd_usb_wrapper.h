@@ -98,13 +98,23 @@ typedef struct
 {
     struct {
         uint8_t *Data;                  /*!< Current data element of transfer */
-        uint16_t Length;                /*!< Represents the actual transferred length */
-        uint16_t Progress;              /*!< Progress of the transfer */
+        uint32_t Length;                /*!< Represents the actual transferred length */
+        uint32_t Progress;              /*!< Progress of the transfer */
+#ifdef USB_OTG_FS
+        uint32_t Request;               /*!< [Internal] Data left to write in the current hardware request */
+#endif
     }Transfer;                          /*!< Endpoint data transfer context */
     uint16_t            MaxPacketSize;  /*!< Endpoint Max packet size */
     USB_EndPointType    Type;           /*!< Endpoint type */
 #ifdef USB
     uint8_t             RegId;          /*!< Endpoint register ID */
+    uint8_t             DoubleBuffer;   /*!< Set before packet memory allocation to double buffer
+                                             a bulk endpoint (isochronous ones always are) */
+    volatile uint8_t    Pending;        /*!< [Internal] Double buffered IN packet written in advance */
+#endif
+#if defined(USB_OTG_GAHBCFG_DMAEN)
+    uint32_t *          BounceBuffer;   /*!< Optional MaxPacketSize buffer for DMA transfers
+                                             of unaligned data and partial OUT packets */
 #endif
 }USB_EndPointHandleType;
 